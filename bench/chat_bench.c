@@ -0,0 +1,653 @@
+// Bộ sinh tải nhiều kết nối: đăng ký + login N user giả, tạo group, rồi gửi hỗn hợp lệnh theo
+// tốc độ mục tiêu (open loop, không chờ trả lời) và đo độ trễ giao tin end-to-end nhờ timestamp
+// nhúng trong nội dung tin nhắn (cùng máy nên dùng chung CLOCK_MONOTONIC với người nhận).
+//
+//   make chat_bench
+//   ./chat_bench [-H host] [-p port] [-c conns] [-r ops/s] [-d seconds] [-m mix]
+//                [-g groups] [-G group_size] [-s msg_bytes] [-u user_prefix] [-S seed]
+//                [-l logins/s] [-L login_conns]
+//
+//   mix: trọng số các lệnh, mặc định msgto=60,groupmsg=20,friends=10,addfriend=5,churn=5
+//   (churn = LOGOUT rồi LOGIN lại). -l chạy thêm luồng LOGIN riêng trên -L kết nối (mặc định 200)
+//   không gửi / nhận tin, để đo độ trễ các lệnh khác khi server đang hash mật khẩu.
+//   Server nhận tối đa MAX_CLIENTS kết nối.
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define IN_BUF 16384
+#define OUT_BUF 16384
+#define NAME_LEN 48
+#define GROUP_ID_LEN 32
+#define PASSWORD "benchpass"
+#define DRAIN_SEC 2 // hết thời gian gửi thì chờ thêm để nhận nốt tin đang trên đường
+
+enum
+{
+    OP_MSGTO,
+    OP_GROUPMSG,
+    OP_FRIENDS,
+    OP_ADDFRIEND,
+    OP_CHURN,
+    OP_COUNT
+};
+static const char *const op_names[OP_COUNT] = {"msgto", "groupmsg", "friends", "addfriend", "churn"};
+
+typedef struct
+{
+    int fd;
+    int logged_in;
+    int login_failed;
+    uint64_t login_sent; // kết nối luồng LOGIN: lúc gửi LOGIN đang chờ trả lời, 0 = rảnh
+    long replies; // dòng trả lời lệnh (không tính tin nhắn / thông báo bắt đầu bằng '[')
+    char name[NAME_LEN];
+    char group_id[GROUP_ID_LEN]; // group vừa tạo (kết nối làm owner)
+    char in[IN_BUF];
+    int inlen;
+    char out[OUT_BUF];
+    int outlen;
+} Conn;
+
+typedef struct
+{
+    int owner;
+    int *members; // index kết nối, gồm cả owner
+    int n;
+    char id[GROUP_ID_LEN];
+} Group;
+
+typedef struct
+{
+    uint64_t *v; // nano giây
+    size_t n, cap;
+} Lat;
+
+static Conn *conns;
+static int nconns;
+static int nusers; // kết nối [0, nusers) gửi / nhận tin, phần sau chỉ chạy luồng LOGIN
+static Group *groups;
+static int ngroups;
+static struct pollfd *pfds;
+
+static int measuring = 0;
+static uint64_t run_start_ns;
+static Lat lat_pm, lat_group, lat_offline, lat_login;
+static long closed_conns = 0, dropped = 0, logins_ok = 0, logins_failed = 0;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void lat_push(Lat *l, uint64_t v)
+{
+    if (l->n == l->cap)
+    {
+        size_t cap = l->cap ? l->cap * 2 : 4096;
+        uint64_t *nv = realloc(l->v, cap * sizeof(uint64_t));
+        if (!nv)
+            return;
+        l->v = nv;
+        l->cap = cap;
+    }
+    l->v[l->n++] = v;
+}
+
+// ---------- kết nối ----------
+
+static void conn_close(Conn *c)
+{
+    if (c->fd < 0)
+        return;
+    close(c->fd);
+    c->fd = -1;
+    c->logged_in = 0;
+    closed_conns++;
+}
+
+static void conn_flush(Conn *c)
+{
+    while (c->fd >= 0 && c->outlen > 0)
+    {
+        ssize_t n = send(c->fd, c->out, c->outlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0)
+        {
+            conn_close(c);
+            return;
+        }
+        memmove(c->out, c->out + n, c->outlen - n);
+        c->outlen -= (int)n;
+    }
+}
+
+// Xếp 1 dòng lệnh vào buffer gửi. Server đọc không kịp (buffer đầy) thì bỏ lệnh, -1
+static int conn_send(Conn *c, const char *fmt, ...)
+{
+    char line[OUT_BUF];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (c->fd < 0 || n < 0 || c->outlen + n > OUT_BUF)
+    {
+        dropped++;
+        return -1;
+    }
+    memcpy(c->out + c->outlen, line, n);
+    c->outlen += n;
+    conn_flush(c);
+    return 0;
+}
+
+// Tin nhắn do bench gửi có dạng "... ] ts=<ns> xxx": ghi độ trễ từ lúc gửi tới lúc nhận
+static void record_delivery(Lat *l, const char *line, uint64_t now)
+{
+    const char *p = strstr(line, "] ts=");
+    if (!p || !measuring)
+        return;
+    uint64_t ts = strtoull(p + 5, NULL, 10);
+    if (ts >= run_start_ns && ts <= now)
+        lat_push(l, now - ts);
+}
+
+static void handle_line(Conn *c, char *line, uint64_t now)
+{
+    // Tin nhắn có seq của session: "#<seq> <text>"
+    if (line[0] == '#')
+    {
+        char *sp = strchr(line, ' ');
+        if (!sp)
+            return;
+        line = sp + 1;
+    }
+
+    if (!strncmp(line, "[PM from ", 9))
+        record_delivery(&lat_pm, line, now);
+    else if (!strncmp(line, "[Group ", 7))
+        record_delivery(&lat_group, line, now);
+    else if (!strncmp(line, "[Offline ", 9))
+        record_delivery(&lat_offline, line, now);
+    else if (line[0] == '[')
+        return; // presence, thông báo server, xác nhận gửi
+    else
+    {
+        c->replies++;
+        int login_reply = 1;
+        if (!strncmp(line, "Login OK", 8))
+            c->logged_in = 1;
+        else if (!strncmp(line, "Login FAIL", 10))
+            c->login_failed = 1;
+        else
+            login_reply = 0;
+        if (login_reply && c->login_sent)
+        {
+            if (measuring)
+            {
+                lat_push(&lat_login, now - c->login_sent);
+                if (c->logged_in)
+                    logins_ok++;
+                else
+                    logins_failed++;
+            }
+            c->login_sent = 0;
+        }
+        else if (!strncmp(line, "Group created! ID: ", 19))
+            snprintf(c->group_id, sizeof(c->group_id), "%s", line + 19);
+    }
+}
+
+static void conn_read(Conn *c)
+{
+    if (c->inlen >= IN_BUF - 1)
+        c->inlen = 0; // dòng dài bất thường, bỏ
+    ssize_t n = recv(c->fd, c->in + c->inlen, IN_BUF - 1 - c->inlen, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    if (n <= 0)
+    {
+        conn_close(c);
+        return;
+    }
+    c->inlen += (int)n;
+
+    uint64_t now = now_ns();
+    int start = 0;
+    for (int i = 0; i < c->inlen; i++)
+    {
+        if (c->in[i] != '\n')
+            continue;
+        c->in[i] = '\0';
+        if (i > start && c->in[i - 1] == '\r')
+            c->in[i - 1] = '\0';
+        handle_line(c, c->in + start, now);
+        start = i + 1;
+    }
+    memmove(c->in, c->in + start, c->inlen - start);
+    c->inlen -= start;
+}
+
+// 1 vòng poll trên mọi kết nối
+static void pump(int timeout_ms)
+{
+    for (int i = 0; i < nconns; i++)
+    {
+        pfds[i].fd = conns[i].fd;
+        pfds[i].events = POLLIN | (conns[i].outlen > 0 ? POLLOUT : 0);
+        pfds[i].revents = 0;
+    }
+    if (poll(pfds, nconns, timeout_ms) <= 0)
+        return;
+    for (int i = 0; i < nconns; i++)
+    {
+        if (pfds[i].revents & POLLOUT)
+            conn_flush(&conns[i]);
+        if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            conn_read(&conns[i]);
+    }
+}
+
+static int connect_to(const char *host, const char *port)
+{
+    struct addrinfo hints = {0}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0)
+        return -1;
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// ---------- setup ----------
+
+static int count_logged_in()
+{
+    int n = 0;
+    for (int i = 0; i < nconns; i++)
+        n += conns[i].logged_in;
+    return n;
+}
+
+static void login_all()
+{
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < nconns; i++)
+        conn_send(&conns[i], "REGISTER %s %s\nLOGIN %s %s\n", conns[i].name, PASSWORD, conns[i].name, PASSWORD);
+
+    // Hash mật khẩu chạy trên worker của server nên bước này chậm hơn hẳn các lệnh khác
+    for (;;)
+    {
+        int done = 0;
+        for (int i = 0; i < nconns; i++)
+            done += conns[i].fd < 0 || conns[i].logged_in || conns[i].login_failed;
+        if (done == nconns || now_ns() - t0 > 300 * 1000000000ull)
+            break;
+        pump(100);
+    }
+    double dt = (now_ns() - t0) / 1e9;
+    int ok = count_logged_in();
+    printf("login: %d/%d user(s) in %.2fs (%.0f/s), %ld connection(s) closed by server\n", ok, nconns, dt,
+           ok / dt, closed_conns);
+}
+
+// Chờ tới khi mọi kết nối đã nhận đủ want[i] dòng trả lời
+static void wait_replies(const long *want, double timeout_sec)
+{
+    uint64_t t0 = now_ns();
+    for (;;)
+    {
+        int done = 1;
+        for (int i = 0; i < nconns && done; i++)
+            done = conns[i].fd < 0 || conns[i].replies >= want[i];
+        if (done || now_ns() - t0 > (uint64_t)(timeout_sec * 1e9))
+            return;
+        pump(50);
+    }
+}
+
+static void create_groups(int group_size)
+{
+    if (ngroups == 0)
+        return;
+    long *want = malloc(sizeof(long) * nconns);
+    groups = calloc(ngroups, sizeof(Group));
+    if (!want || !groups)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    // Mỗi owner tạo tuần tự từng group (ID trả về lưu vào conn->group_id)
+    for (int g = 0; g < ngroups; g++)
+    {
+        Conn *owner = &conns[g % nusers];
+        groups[g].owner = g % nusers;
+        owner->group_id[0] = '\0';
+        for (int i = 0; i < nconns; i++)
+            want[i] = conns[i].replies;
+        want[groups[g].owner]++;
+        conn_send(owner, "CREATEGROUP bench-group-%d\n", g);
+        wait_replies(want, 10);
+        snprintf(groups[g].id, sizeof(groups[g].id), "%s", owner->group_id);
+    }
+
+    // Member chọn ngẫu nhiên (không trùng), owner là member đầu tiên
+    int *pick = malloc(sizeof(int) * nconns);
+    for (int i = 0; i < nconns; i++)
+        want[i] = conns[i].replies;
+    for (int g = 0; g < ngroups; g++)
+    {
+        Group *gr = &groups[g];
+        int n = group_size < nusers ? group_size : nusers;
+        gr->members = malloc(sizeof(int) * n);
+        if (!gr->members || !pick || !gr->id[0])
+            continue;
+        for (int i = 0; i < nusers; i++)
+            pick[i] = i;
+        pick[gr->owner] = 0;
+        pick[0] = gr->owner;
+        gr->members[gr->n++] = gr->owner;
+        for (int k = 1; k < n; k++)
+        {
+            int j = k + rand() % (nusers - k);
+            int t = pick[k];
+            pick[k] = pick[j];
+            pick[j] = t;
+            if (conn_send(&conns[gr->owner], "ADDMEMBER %s %s\n", gr->id, conns[pick[k]].name) == 0)
+            {
+                gr->members[gr->n++] = pick[k];
+                want[gr->owner]++;
+            }
+            // Không để buffer gửi của owner đầy khi group lớn
+            if (conns[gr->owner].outlen > OUT_BUF / 2)
+                pump(10);
+        }
+    }
+    wait_replies(want, 60);
+
+    long members = 0;
+    int created = 0;
+    for (int g = 0; g < ngroups; g++)
+    {
+        members += groups[g].n;
+        created += groups[g].id[0] != '\0';
+    }
+    printf("groups: %d/%d created, %ld membership(s)\n", created, ngroups, members);
+    free(pick);
+    free(want);
+}
+
+// ---------- chạy tải ----------
+
+static int random_logged_in()
+{
+    for (int tries = 0; tries < 16; tries++)
+    {
+        int i = rand() % nusers;
+        if (conns[i].logged_in)
+            return i;
+    }
+    return -1;
+}
+
+static int do_op(int op, int msg_bytes)
+{
+    char pad[OUT_BUF / 2];
+    int padlen = msg_bytes < (int)sizeof(pad) ? msg_bytes : (int)sizeof(pad) - 1;
+    memset(pad, 'x', padlen);
+    pad[padlen] = '\0';
+
+    if (op == OP_GROUPMSG)
+    {
+        if (ngroups == 0)
+            return -1;
+        Group *g = &groups[rand() % ngroups];
+        if (g->n == 0)
+            return -1;
+        Conn *c = &conns[g->members[rand() % g->n]];
+        if (!c->logged_in)
+            return -1;
+        return conn_send(c, "GROUPMSG %s ts=%llu %s\n", g->id, (unsigned long long)now_ns(), pad);
+    }
+
+    int i = random_logged_in();
+    if (i < 0)
+        return -1;
+    Conn *c = &conns[i];
+    int j = rand() % nusers;
+    if (j == i)
+        j = (j + 1) % nusers;
+
+    if (op == OP_MSGTO)
+        return conn_send(c, "MSGTO %s ts=%llu %s\n", conns[j].name, (unsigned long long)now_ns(), pad);
+    if (op == OP_FRIENDS)
+        return conn_send(c, "FRIENDS\n");
+    if (op == OP_ADDFRIEND)
+        return conn_send(c, "ADDFRIEND %s\n", conns[j].name);
+    if (op == OP_CHURN)
+    {
+        c->logged_in = 0; // "Login OK" sẽ bật lại
+        return conn_send(c, "LOGOUT\nLOGIN %s %s\n", c->name, PASSWORD);
+    }
+    return -1;
+}
+
+// Luồng LOGIN: chọn 1 kết nối đang rảnh, đã login thì LOGOUT trước
+static int do_login()
+{
+    for (int tries = 0; tries < 16; tries++)
+    {
+        Conn *c = &conns[nusers + rand() % (nconns - nusers)];
+        if (c->fd < 0 || c->login_sent)
+            continue;
+        int rc = c->logged_in ? conn_send(c, "LOGOUT\nLOGIN %s %s\n", c->name, PASSWORD)
+                              : conn_send(c, "LOGIN %s %s\n", c->name, PASSWORD);
+        if (rc == 0)
+        {
+            c->logged_in = 0;
+            c->login_sent = now_ns();
+        }
+        return rc;
+    }
+    return -1;
+}
+
+static int parse_mix(const char *s, int *weights)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", s);
+    memset(weights, 0, sizeof(int) * OP_COUNT);
+    for (char *tok = strtok(buf, ","); tok; tok = strtok(NULL, ","))
+    {
+        char *eq = strchr(tok, '=');
+        if (!eq)
+            return -1;
+        *eq = '\0';
+        int k = 0;
+        while (k < OP_COUNT && strcmp(op_names[k], tok) != 0)
+            k++;
+        if (k == OP_COUNT || atoi(eq + 1) < 0)
+            return -1;
+        weights[k] = atoi(eq + 1);
+    }
+    return 0;
+}
+
+static void print_latency(const char *label, const char *what, Lat *l, double secs)
+{
+    if (l->n == 0)
+    {
+        printf("%-9s %s: 0\n", label, what);
+        return;
+    }
+    qsort(l->v, l->n, sizeof(uint64_t), cmp_u64);
+    printf("%-9s %s: %zu (%.0f/s)  p50 %.0fus  p99 %.0fus  p999 %.0fus  max %.0fus\n", label, what, l->n,
+           l->n / secs, l->v[l->n / 2] / 1e3, l->v[l->n * 99 / 100] / 1e3, l->v[l->n * 999 / 1000] / 1e3,
+           l->v[l->n - 1] / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    const char *host = "127.0.0.1", *port = "8080", *prefix = "bench";
+    const char *mix = "msgto=60,groupmsg=20,friends=10,addfriend=5,churn=5";
+    int rate = 1000, duration = 10, group_size = 50, msg_bytes = 64, login_rate = 0, login_conns = 200;
+    unsigned seed = 1;
+    nconns = 1000;
+    ngroups = 20;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "H:p:c:r:d:m:g:G:s:u:S:l:L:")) != -1)
+    {
+        if (opt == 'H')
+            host = optarg;
+        else if (opt == 'p')
+            port = optarg;
+        else if (opt == 'c')
+            nconns = atoi(optarg);
+        else if (opt == 'r')
+            rate = atoi(optarg);
+        else if (opt == 'd')
+            duration = atoi(optarg);
+        else if (opt == 'm')
+            mix = optarg;
+        else if (opt == 'g')
+            ngroups = atoi(optarg);
+        else if (opt == 'G')
+            group_size = atoi(optarg);
+        else if (opt == 's')
+            msg_bytes = atoi(optarg);
+        else if (opt == 'u')
+            prefix = optarg;
+        else if (opt == 'S')
+            seed = (unsigned)strtoul(optarg, NULL, 10);
+        else if (opt == 'l')
+            login_rate = atoi(optarg);
+        else if (opt == 'L')
+            login_conns = atoi(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-H host] [-p port] [-c conns] [-r ops/s] [-d seconds] [-m mix]\n"
+                            "       [-g groups] [-G group_size] [-s msg_bytes] [-u user_prefix] [-S seed]\n"
+                            "       [-l logins/s] [-L login_conns]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    int weights[OP_COUNT], total_weight = 0;
+    if (parse_mix(mix, weights) != 0)
+    {
+        fprintf(stderr, "bad mix '%s' (ops: msgto, groupmsg, friends, addfriend, churn)\n", mix);
+        return 1;
+    }
+    for (int k = 0; k < OP_COUNT; k++)
+        total_weight += weights[k];
+    if (nconns < 2 || rate <= 0 || duration <= 0 || total_weight == 0 || ngroups < 0 || msg_bytes < 0 ||
+        login_rate < 0 || (login_rate > 0 && login_conns <= 0))
+    {
+        fprintf(stderr, "need conns >= 2, rate > 0, duration > 0, a non-empty mix and login_conns > 0 with -l\n");
+        return 1;
+    }
+    nusers = nconns;
+    if (login_rate > 0)
+        nconns += login_conns;
+    srand(seed);
+
+    conns = calloc(nconns, sizeof(Conn));
+    pfds = calloc(nconns, sizeof(struct pollfd));
+    if (!conns || !pfds)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < nconns; i++)
+    {
+        if (i < nusers)
+            snprintf(conns[i].name, NAME_LEN, "%s%d", prefix, i);
+        else
+            snprintf(conns[i].name, NAME_LEN, "%sl%d", prefix, i - nusers);
+        conns[i].fd = connect_to(host, port);
+        if (conns[i].fd < 0)
+        {
+            fprintf(stderr, "connect %d failed: %s\n", i, strerror(errno));
+            closed_conns++;
+        }
+    }
+    printf("connect: %d connection(s) to %s:%s\n", nconns - (int)closed_conns, host, port);
+
+    login_all();
+    create_groups(group_size);
+
+    // Open loop: mỗi vòng gửi bù đủ số lệnh đến hạn theo tốc độ mục tiêu, không đợi trả lời
+    long sent[OP_COUNT] = {0}, skipped = 0, issued = 0, logins_issued = 0, logins_sent = 0;
+    measuring = 1;
+    run_start_ns = now_ns();
+    uint64_t end_ns = run_start_ns + (uint64_t)duration * 1000000000ull;
+    for (uint64_t now = run_start_ns; now < end_ns; now = now_ns())
+    {
+        long due = (long)((now - run_start_ns) / 1e9 * rate);
+        for (; issued < due; issued++)
+        {
+            int r = rand() % total_weight, op = 0;
+            while (r >= weights[op])
+                r -= weights[op++];
+            if (do_op(op, msg_bytes) == 0)
+                sent[op]++;
+            else
+                skipped++;
+        }
+        long logins_due = (long)((now - run_start_ns) / 1e9 * login_rate);
+        for (; logins_issued < logins_due; logins_issued++)
+            logins_sent += do_login() == 0;
+        pump(1);
+    }
+    double secs = (now_ns() - run_start_ns) / 1e9;
+    uint64_t drain_end = now_ns() + DRAIN_SEC * 1000000000ull;
+    while (now_ns() < drain_end)
+        pump(10);
+
+    long total = 0;
+    printf("run: %.2fs at target %d op/s\n", secs, rate);
+    for (int k = 0; k < OP_COUNT; k++)
+    {
+        printf("  %-10s %ld\n", op_names[k], sent[k]);
+        total += sent[k];
+    }
+    printf("sent: %ld op(s) (%.0f/s), skipped %ld (%ld send buffer full, rest no logged-in sender)\n", total,
+           total / secs, skipped, dropped);
+    print_latency("pm", "deliveries", &lat_pm, secs);
+    print_latency("group", "deliveries", &lat_group, secs);
+    print_latency("offline", "deliveries", &lat_offline, secs);
+    if (login_rate > 0)
+    {
+        printf("logins: target %d/s, sent %ld (rest no idle login connection), ok %ld (%.0f/s), fail %ld\n",
+               login_rate, logins_sent, logins_ok, logins_ok / secs, logins_failed);
+        print_latency("login", "replies", &lat_login, secs);
+    }
+    printf("connections closed by server: %ld, still logged in: %d\n", closed_conns, count_logged_in());
+    return 0;
+}
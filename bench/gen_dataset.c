@@ -0,0 +1,238 @@
+// Sinh dataset tổng hợp cho benchmark lưu trữ: accounts.txt, friends.txt, groups.txt,
+// group_members.txt, offline_messages.txt đúng định dạng file cũ. Server chạy lần đầu trong thư
+// mục đó (WAL rỗng) sẽ import các file này vào WAL (rồi snapshot), tức là ra luôn định dạng mới.
+//
+//   make gen_dataset
+//   ./gen_dataset [-u users] [-f avg_friends] [-a accepted_ratio] [-g groups] [-m groups_per_user]
+//                 [-z zipf_s] [-M offline_per_user] [-p password] [-S seed] [-o dir]
+//
+// - bậc bạn bè theo luật lũy thừa (Pareto, alpha 2.5), user có index nhỏ là "hub" được kết bạn
+//   nhiều hơn; a phần là FRIEND, còn lại PENDING
+// - kích thước group theo Zipf (group thứ r có ~1/r^s member), tổng số membership = users * m
+// - tin offline: 80% PM, 20% tin group, thời điểm rải trong 30 ngày gần nhất
+// Cùng seed + tham số thì ra cùng dữ liệu, trừ timestamp tin offline (tính từ lúc chạy). RNG riêng,
+// không phụ thuộc rand() của libc.
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_DEGREE 5000
+#define PARETO_ALPHA 2.5
+#define OFFLINE_WINDOW_SEC (30L * 24 * 3600)
+
+static uint64_t rng_state;
+
+// xorshift64*
+static uint64_t rng()
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+static double rng_unit() // [0, 1)
+{
+    return (rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static long rng_below(long n)
+{
+    return (long)(rng() % (uint64_t)n);
+}
+
+static long gcd(long a, long b)
+{
+    while (b)
+    {
+        long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static FILE *open_out(const char *dir, const char *name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    return f;
+}
+
+// Member k của group g: dãy start + k * stride (mod users), stride nguyên tố cùng nhau với users
+// nên không trùng, không cần giữ danh sách member trong RAM
+typedef struct
+{
+    long size, start, stride;
+} GroupShape;
+
+static long member_of(const GroupShape *g, long k, long users)
+{
+    return (long)(((unsigned long long)g->start + (unsigned long long)k * g->stride) % users);
+}
+
+int main(int argc, char **argv)
+{
+    long users = 10000, groups = -1;
+    double avg_friends = 10, accepted = 0.8, groups_per_user = 3, zipf_s = 1.1, offline_per_user = 0.5;
+    const char *password = "1234", *dir = ".";
+    uint64_t seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "u:f:a:g:m:z:M:p:S:o:")) != -1)
+    {
+        if (opt == 'u')
+            users = atol(optarg);
+        else if (opt == 'f')
+            avg_friends = atof(optarg);
+        else if (opt == 'a')
+            accepted = atof(optarg);
+        else if (opt == 'g')
+            groups = atol(optarg);
+        else if (opt == 'm')
+            groups_per_user = atof(optarg);
+        else if (opt == 'z')
+            zipf_s = atof(optarg);
+        else if (opt == 'M')
+            offline_per_user = atof(optarg);
+        else if (opt == 'p')
+            password = optarg;
+        else if (opt == 'S')
+            seed = strtoull(optarg, NULL, 10);
+        else if (opt == 'o')
+            dir = optarg;
+        else
+        {
+            fprintf(stderr, "usage: %s [-u users] [-f avg_friends] [-a accepted_ratio] [-g groups]\n"
+                            "       [-m groups_per_user] [-z zipf_s] [-M offline_per_user] [-p password]\n"
+                            "       [-S seed] [-o dir]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (groups < 0)
+        groups = users / 20 > 0 ? users / 20 : 1;
+    if (users < 2 || avg_friends < 0 || accepted < 0 || accepted > 1 || groups_per_user < 0 || zipf_s <= 0 ||
+        offline_per_user < 0 || strchr(password, ' '))
+    {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+    rng_state = seed * 0x9E3779B97F4A7C15ull + 1;
+    mkdir(dir, 0755);
+    time_t t0 = time(NULL);
+
+    // accounts.txt: "username password" (mật khẩu thô kiểu cũ, server tự hash lại khi login)
+    FILE *f = open_out(dir, "accounts.txt");
+    for (long i = 0; i < users; i++)
+        fprintf(f, "user%ld %s\n", i, password);
+    fclose(f);
+
+    // friends.txt: "A|B|FRIEND" hoặc "A|B|PENDING" (A gửi cho B). Mỗi user tự khởi tạo bậc/2
+    // quan hệ, phía nhận lệch về index nhỏ (u^3) nên in-degree cũng có đuôi dài. Chỉ bỏ trùng trong
+    // cùng 1 người gửi, cặp trùng ngược chiều (hiếm) thì importer tự bỏ qua
+    f = open_out(dir, "friends.txt");
+    static long targets[MAX_DEGREE];
+    double xmin = avg_friends * (PARETO_ALPHA - 2) / (PARETO_ALPHA - 1); // Pareto có mean = avg_friends
+    long edges = 0, pending = 0;
+    for (long i = 0; i < users && avg_friends > 0; i++)
+    {
+        double d = xmin / pow(1.0 - rng_unit(), 1.0 / (PARETO_ALPHA - 1));
+        long out = (long)(d / 2 + rng_unit()); // làm tròn ngẫu nhiên, giữ đúng kỳ vọng
+        if (out > MAX_DEGREE)
+            out = MAX_DEGREE;
+        for (long k = 0; k < out; k++)
+        {
+            double u = rng_unit();
+            long j = (long)(users * u * u * u), t = 0;
+            while (t < k && targets[t] != j)
+                t++;
+            targets[k] = j;
+            if (j == i || t < k)
+                continue;
+            int friend = rng_unit() < accepted;
+            fprintf(f, "user%ld|user%ld|%s\n", i, j, friend ? "FRIEND" : "PENDING");
+            edges++;
+            pending += !friend;
+        }
+    }
+    fclose(f);
+
+    // groups.txt: "G<n>|name|creator", group_members.txt: "G<n>|username|OWNER/MEMBER".
+    // Kích thước group thứ r tỉ lệ 1/r^s, tối thiểu 2, tối đa = users
+    GroupShape *shape = calloc(groups, sizeof(GroupShape));
+    if (!shape)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    double harmonic = 0;
+    for (long r = 1; r <= groups; r++)
+        harmonic += 1.0 / pow((double)r, zipf_s);
+    double total_members = users * groups_per_user;
+
+    FILE *fg = open_out(dir, "groups.txt");
+    FILE *fm = open_out(dir, "group_members.txt");
+    long memberships = 0, largest = 0;
+    for (long g = 0; g < groups; g++)
+    {
+        GroupShape *s = &shape[g];
+        s->size = (long)(total_members / pow((double)(g + 1), zipf_s) / harmonic + 0.5);
+        if (s->size < 2)
+            s->size = 2;
+        if (s->size > users)
+            s->size = users;
+        s->start = rng_below(users);
+        s->stride = 1 + rng_below(users - 1);
+        while (gcd(s->stride, users) != 1)
+            s->stride = s->stride % (users - 1) + 1;
+
+        fprintf(fg, "G%ld|group %ld|user%ld\n", g + 1, g + 1, member_of(s, 0, users));
+        for (long k = 0; k < s->size; k++)
+            fprintf(fm, "G%ld|user%ld|%s\n", g + 1, member_of(s, k, users), k == 0 ? "OWNER" : "MEMBER");
+        memberships += s->size;
+        if (s->size > largest)
+            largest = s->size;
+    }
+    fclose(fg);
+    fclose(fm);
+
+    // offline_messages.txt: "to|from|timestamp|message", tin group có from = "GROUP:<gid>:<sender>"
+    f = open_out(dir, "offline_messages.txt");
+    long messages = (long)(users * offline_per_user);
+    time_t now = time(NULL);
+    for (long n = 0; n < messages; n++)
+    {
+        long ts = (long)now - rng_below(OFFLINE_WINDOW_SEC);
+        if (rng_unit() < 0.8)
+        {
+            long to = rng_below(users), from = rng_below(users);
+            fprintf(f, "user%ld|user%ld|%ld|hello user%ld, message %ld\n", to, from, ts, to, n);
+        }
+        else
+        {
+            long g = rng_below(groups);
+            const GroupShape *s = &shape[g];
+            long to = member_of(s, rng_below(s->size), users), from = member_of(s, rng_below(s->size), users);
+            fprintf(f, "user%ld|GROUP:G%ld:user%ld|%ld|group message %ld\n", to, g + 1, from, ts, n);
+        }
+    }
+    fclose(f);
+    free(shape);
+
+    printf("%s: %ld users, %ld friend edges (%ld pending), %ld groups / %ld memberships (largest %ld), "
+           "%ld offline messages in %lds\n",
+           dir, users, edges, pending, groups, memberships, largest, messages, (long)(time(NULL) - t0));
+    return 0;
+}
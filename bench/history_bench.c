@@ -0,0 +1,141 @@
+// Benchmark lịch sử hội thoại: ghi N tin nhắn vào 1 hội thoại rồi đo thời gian đọc 1 trang
+// ở đầu / giữa / cuối lịch sử. Thời gian đọc phải gần như không đổi theo độ sâu.
+//
+//   make history_bench
+//   ./history_bench [messages=10000000] [page=50] [pages=1000] [dir]
+#include "server/history/history.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_KEY "P alice bob"
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void count_cb(uint64_t seq, uint64_t msg_id, const char *from, const char *text, void *userdata)
+{
+    (void)seq;
+    (void)msg_id;
+    (void)from;
+    (void)text;
+    (*(int *)userdata)++;
+}
+
+// Ghi trong process con để process cha mở lại hội thoại từ đầu (nạp index từ đĩa)
+static int write_phase(long messages)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid > 0)
+    {
+        int status;
+        waitpid(pid, &status, 0);
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+    }
+
+    char text[128];
+    double t0 = now_sec();
+    for (long i = 1; i <= messages; i++)
+    {
+        snprintf(text, sizeof(text), "message number %ld with some typical chat payload text", i);
+        if (history_append(BENCH_KEY, (uint64_t)i << 22, (i & 1) ? "alice" : "bob", text) != (uint64_t)i)
+        {
+            fprintf(stderr, "append %ld failed\n", i);
+            _exit(1);
+        }
+    }
+    history_sync();
+    double dt = now_sec() - t0;
+    printf("append: %ld messages in %.2fs (%.0f msg/s)\n", messages, dt, messages / dt);
+    fflush(stdout);
+    _exit(0);
+}
+
+// Đọc `pages` trang ở quanh vị trí before_seq (0 = mới nhất, -1 = ngẫu nhiên), in p50 / p99
+static void read_phase(const char *label, long messages, long before, int page, int pages)
+{
+    double *lat = malloc(sizeof(double) * pages);
+    if (!lat)
+        return;
+
+    for (int i = 0; i < pages; i++)
+    {
+        uint64_t b = before >= 0 ? (uint64_t)before : (uint64_t)(rand() % messages) + 1;
+        uint64_t total;
+        int got = 0;
+        double t0 = now_sec();
+        int r = history_page(BENCH_KEY, b, page, &total, count_cb, &got);
+        lat[i] = (now_sec() - t0) * 1e6;
+        if (r < 0 || total != (uint64_t)messages)
+        {
+            fprintf(stderr, "page before %llu failed\n", (unsigned long long)b);
+            break;
+        }
+    }
+    qsort(lat, pages, sizeof(double), cmp_double);
+    printf("%-8s page=%d: p50 %.1fus  p99 %.1fus  max %.1fus\n", label, page,
+           lat[pages / 2], lat[pages * 99 / 100], lat[pages - 1]);
+    free(lat);
+}
+
+int main(int argc, char **argv)
+{
+    long messages = argc > 1 ? atol(argv[1]) : 10000000;
+    int page = argc > 2 ? atoi(argv[2]) : 50;
+    int pages = argc > 3 ? atoi(argv[3]) : 1000;
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s", argc > 4 ? argv[4] : "/tmp/history_bench.XXXXXX");
+    if (messages <= page || page <= 0 || page > HISTORY_MAX_PAGE || pages <= 0)
+    {
+        fprintf(stderr, "usage: %s [messages>page] [page<=%d] [pages] [dir]\n", argv[0], HISTORY_MAX_PAGE);
+        return 1;
+    }
+    if (argc <= 4 && !mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    if (history_init(dir) != 0)
+    {
+        perror("history_init");
+        return 1;
+    }
+    printf("dir: %s\n", dir);
+
+    if (write_phase(messages) != 0)
+        return 1;
+
+    // Lần đọc đầu tiên: mở file + nạp index thưa + quét phần đuôi sau entry cuối
+    uint64_t total;
+    int got = 0;
+    double t0 = now_sec();
+    history_page(BENCH_KEY, 0, page, &total, count_cb, &got);
+    printf("reopen: %llu messages indexed in %.2fms\n", (unsigned long long)total, (now_sec() - t0) * 1e3);
+
+    srand(1);
+    read_phase("newest", messages, 0, page, pages);
+    read_phase("middle", messages, messages / 2, page, pages);
+    read_phase("oldest", messages, page + 1, page, pages);
+    read_phase("random", messages, -1, page, pages);
+
+    if (argc <= 4)
+        printf("(data left in %s, remove it when done)\n", dir);
+    return 0;
+}
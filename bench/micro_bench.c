@@ -0,0 +1,394 @@
+// Microbenchmark các đường nóng của server: tách dòng, dispatch từng lệnh qua protocol_handle,
+// auth / friend / group / offline trên dataset tổng hợp N user. Dataset dựng bằng chính API của
+// các store (ghi WAL + history vào thư mục tạm, xóa khi xong) nên đo đúng đường chạy của server.
+//
+//   make bench                      (chạy lần lượt với BENCH_USERS="1000 100000 1000000")
+//   make micro_bench && ./micro_bench [users=100000] [iterations=20000] [friends_per_user=8] [dir]
+//
+// Mỗi dòng in p50 / p99 / mean của 1 lần gọi, đã gồm chi phí đọc đồng hồ (in ở dòng đầu).
+#include "server/auth/auth.h"
+#include "server/client/client_mgr.h"
+#include "server/friend/friend.h"
+#include "server/group/group.h"
+#include "server/history/history.h"
+#include "server/idgen/idgen.h"
+#include "server/intern/intern.h"
+#include "server/offline/offline.h"
+#include "server/protocol/protocol.h"
+#include "server/session/session.h"
+#include "server/wal/wal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GROUP_SIZE 50
+#define OFFLINE_PER_USER 10 // số tin chờ mỗi user trong bench offline_deliver_messages
+#define CHECK_LOGIN_MAX 200 // PBKDF2 chậm, không cần nhiều lần đo
+#define PIPELINE_LINES 32
+
+static long nusers, iterations;
+static char (*names)[USERNAME_LEN];
+static char (*group_ids)[GROUP_ID_LEN];
+static long ngroups;
+
+// Kết nối giả qua socketpair: me = u0, peer = u1 (cùng group "bench")
+static Client *me, *peer;
+static int me_sock, peer_sock;
+static char my_group[GROUP_ID_LEN];
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static const char *user(long i)
+{
+    return names[i % nusers];
+}
+
+static long rnd(long n)
+{
+    return (((long)rand() << 16) ^ rand()) % n;
+}
+
+// Đọc bỏ mọi thứ server đã gửi cho 2 kết nối giả (ngoài phần đo)
+static void drain()
+{
+    char buf[65536];
+    while (recv(me_sock, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        ;
+    while (recv(peer_sock, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        ;
+}
+
+// ---------- đo ----------
+
+typedef void (*bench_fn)(long i);
+
+static void run(const char *label, long n, bench_fn fn)
+{
+    double *lat = malloc(sizeof(double) * n);
+    if (!lat || n <= 0)
+    {
+        free(lat);
+        return;
+    }
+
+    double total = 0;
+    for (long i = 0; i < n; i++)
+    {
+        double t0 = now_ns();
+        fn(i);
+        lat[i] = now_ns() - t0;
+        total += lat[i];
+        drain();
+    }
+    qsort(lat, n, sizeof(double), cmp_double);
+    printf("  %-38s p50 %9.2fus  p99 %9.2fus  mean %9.2fus  (%ld ops)\n", label, lat[n / 2] / 1e3,
+           lat[n * 99 / 100] / 1e3, total / n / 1e3, n);
+    free(lat);
+}
+
+// ---------- dataset ----------
+
+static void build_dataset(int degree)
+{
+    double t0 = now_ns();
+    char hash[PASSWORD_FIELD_LEN];
+    auth_hash_password("pass", hash, sizeof(hash));
+
+    names = malloc(sizeof(*names) * nusers);
+    if (!names)
+        exit(1);
+    for (long i = 0; i < nusers; i++)
+    {
+        snprintf(names[i], USERNAME_LEN, "u%ld", i);
+        auth_add_account(names[i], hash);
+    }
+
+    // Mỗi user gửi degree/2 lời mời, 3/4 được chấp nhận -> trung bình ~degree quan hệ
+    long edges = 0;
+    for (long i = 0; i < nusers; i++)
+    {
+        for (int k = 0; k < degree / 2; k++)
+        {
+            long j = rnd(nusers);
+            if (j == i || friend_add_request(user(i), user(j)) != FR_OK)
+                continue;
+            if (k % 4 != 3)
+                friend_accept_request(user(j), user(i));
+            edges++;
+        }
+    }
+
+    ngroups = nusers / GROUP_SIZE > 0 ? nusers / GROUP_SIZE : 1;
+    group_ids = malloc(sizeof(*group_ids) * ngroups);
+    if (!group_ids)
+        exit(1);
+    for (long g = 0; g < ngroups; g++)
+    {
+        const char *owner = user(rnd(nusers));
+        char gname[32];
+        snprintf(gname, sizeof(gname), "group%ld", g);
+        group_create(owner, gname, group_ids[g], GROUP_ID_LEN);
+        for (int k = 1; k < GROUP_SIZE; k++)
+            group_add_member(group_ids[g], user(rnd(nusers)), owner);
+    }
+
+    // Group của 2 kết nối giả: u0 owner, u1 + member ngẫu nhiên (phần lớn offline)
+    group_create(user(0), "bench", my_group, sizeof(my_group));
+    group_add_member(my_group, user(1), user(0));
+    for (int k = 2; k < GROUP_SIZE; k++)
+        group_add_member(my_group, user(rnd(nusers)), user(0));
+    wal_sync();
+
+    printf("dataset: %ld users, %ld friend edges, %ld groups x %d members in %.2fs\n", nusers, edges, ngroups,
+           GROUP_SIZE, (now_ns() - t0) / 1e9);
+}
+
+static int open_conn(const char *username, int *peer_end)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+        return -1;
+    int idx = client_add(sv[0]);
+    if (idx < 0)
+        return -1;
+    client_login(client_at(idx), username);
+    char token[SESSION_TOKEN_MAX];
+    session_open(username, token, sizeof(token)); // tin nhắn giao qua session như sau LOGIN thật
+    *peer_end = sv[1];
+    return idx;
+}
+
+// ---------- benchmark: framing ----------
+
+static void b_frame_one(long i)
+{
+    (void)i;
+    static const char line[] = "MSGTO u1 hello there, this is a typical chat line\n";
+    client_append_data(me, line, sizeof(line) - 1);
+    client_pop_line(me);
+}
+
+static void b_frame_pipelined(long i)
+{
+    (void)i;
+    static char chunk[PIPELINE_LINES * 64];
+    static int len = 0;
+    if (len == 0)
+    {
+        for (int k = 0; k < PIPELINE_LINES; k++)
+            len += snprintf(chunk + len, sizeof(chunk) - len, "MSGTO u1 pipelined message number %02d\n", k);
+    }
+    client_append_data(me, chunk, len);
+    while (client_pop_line(me))
+        ;
+}
+
+// ---------- benchmark: store ----------
+
+static void b_account_hit(long i)
+{
+    (void)i;
+    account_exists(user(rnd(nusers)));
+}
+
+static void b_account_miss(long i)
+{
+    char name[USERNAME_LEN];
+    snprintf(name, sizeof(name), "nobody%ld", i);
+    account_exists(name);
+}
+
+static void b_check_login(long i)
+{
+    check_login(user(i), "pass");
+}
+
+static void b_friend_add(long i)
+{
+    (void)i;
+    friend_add_request(user(rnd(nusers)), user(rnd(nusers)));
+}
+
+static void b_group_member_hit(long i)
+{
+    (void)i;
+    group_check_member(my_group, user(1));
+}
+
+static void b_group_member_random(long i)
+{
+    (void)i;
+    group_check_member(group_ids[rnd(ngroups)], user(rnd(nusers)));
+}
+
+static void b_offline_save(long i)
+{
+    (void)i;
+    offline_save_message(user(2 + rnd(nusers - 2)), user(0), idgen_next(), "offline message body for the benchmark");
+}
+
+static void ignore_text(const char *text, void *userdata)
+{
+    (void)text;
+    (void)userdata;
+}
+
+static void b_offline_deliver(long i)
+{
+    offline_deliver_messages(user(2 + i), ignore_text, NULL);
+}
+
+// ---------- benchmark: dispatch ----------
+
+static const char *command_line;
+
+static void b_command(long i)
+{
+    (void)i;
+    protocol_handle(me, command_line);
+}
+
+static char rotating[INBUF_SIZE];
+static const char *rotating_fmt;
+
+// Lệnh có tham số là user ngẫu nhiên (ADDFRIEND, MSGTO tới user offline)
+static void b_command_random_user(long i)
+{
+    (void)i;
+    snprintf(rotating, sizeof(rotating), rotating_fmt, user(2 + rnd(nusers - 2)));
+    protocol_handle(me, rotating);
+}
+
+static void bench_commands()
+{
+    static const struct
+    {
+        const char *label, *line;
+    } simple[] = {
+        {"protocol_handle ONLINECOUNT", "ONLINECOUNT"},
+        {"protocol_handle LIST", "LIST"},
+        {"protocol_handle FRIENDS", "FRIENDS"},
+        {"protocol_handle REQUESTS", "REQUESTS"},
+        {"protocol_handle LISTGROUPS", "LISTGROUPS"},
+        {"protocol_handle MSGTO (online)", "MSGTO u1 hello from the benchmark"},
+        {"protocol_handle HISTORY", "HISTORY u1"},
+        {"protocol_handle unknown command", "NOSUCHCOMMAND"},
+    };
+    for (size_t k = 0; k < sizeof(simple) / sizeof(simple[0]); k++)
+    {
+        command_line = simple[k].line;
+        run(simple[k].label, iterations, b_command);
+    }
+
+    char line[128];
+    command_line = line;
+    snprintf(line, sizeof(line), "GROUPINFO %s", my_group);
+    run("protocol_handle GROUPINFO", iterations, b_command);
+    snprintf(line, sizeof(line), "RECENT %s", my_group);
+    run("protocol_handle RECENT", iterations, b_command);
+    snprintf(line, sizeof(line), "GROUPMSG %s hello group", my_group);
+    run("protocol_handle GROUPMSG (50 members)", iterations, b_command);
+
+    rotating_fmt = "MSGTO %s hello offline user";
+    run("protocol_handle MSGTO (offline)", iterations, b_command_random_user);
+    rotating_fmt = "ADDFRIEND %s";
+    run("protocol_handle ADDFRIEND", iterations, b_command_random_user);
+}
+
+int main(int argc, char **argv)
+{
+    nusers = argc > 1 ? atol(argv[1]) : 100000;
+    iterations = argc > 2 ? atol(argv[2]) : 20000;
+    int degree = argc > 3 ? atoi(argv[3]) : 8;
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s", argc > 4 ? argv[4] : "/tmp/micro_bench.XXXXXX");
+    if (nusers < 3 || iterations <= 0 || degree < 0)
+    {
+        fprintf(stderr, "usage: %s [users>=3] [iterations] [friends_per_user] [dir]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 4 ? mkdir(dir, 0755) != 0 : !mkdtemp(dir))
+    {
+        perror(dir);
+        return 1;
+    }
+    // WAL, history, server.log của các store đều nằm trong thư mục hiện tại
+    if (chdir(dir) != 0)
+    {
+        perror("chdir");
+        return 1;
+    }
+    srand(1);
+
+    intern_init();
+    auth_init();
+    friend_init();
+    group_init();
+    offline_init();
+    clients_init();
+    session_init();
+    protocol_init();
+    if (history_init(HISTORY_DIR) != 0 || wal_open(WAL_FILE, WAL_SYNC_WINDOW_MS) < 0)
+    {
+        perror("open stores");
+        return 1;
+    }
+
+    double t0 = now_ns();
+    for (int i = 0; i < 1000; i++)
+        now_ns();
+    printf("=== micro_bench: %ld users, dir %s ===\ntimer overhead: %.0fns per op\n", nusers, dir,
+           (now_ns() - t0) / 1000);
+
+    build_dataset(degree);
+    me = client_at(open_conn(user(0), &me_sock));
+    peer = client_at(open_conn(user(1), &peer_sock));
+
+    printf("framing:\n");
+    run("client_append_data + pop_line", iterations, b_frame_one);
+    run("pipelined, 32 lines per call", iterations / PIPELINE_LINES + 1, b_frame_pipelined);
+
+    printf("storage:\n");
+    run("account_exists (hit)", iterations, b_account_hit);
+    run("account_exists (miss)", iterations, b_account_miss);
+    run("check_login", iterations < CHECK_LOGIN_MAX ? iterations : CHECK_LOGIN_MAX, b_check_login);
+    run("friend_add_request", iterations, b_friend_add);
+    run("group_check_member (member)", iterations, b_group_member_hit);
+    run("group_check_member (random)", iterations, b_group_member_random);
+    run("offline_save_message", iterations, b_offline_save);
+
+    long receivers = iterations < nusers - 2 ? iterations : nusers - 2;
+    for (long i = 0; i < receivers; i++)
+        for (int k = 0; k < OFFLINE_PER_USER; k++)
+            offline_save_message(user(2 + i), user(0), idgen_next(), "queued offline message");
+    run("offline_deliver_messages (10 msgs)", receivers, b_offline_deliver);
+
+    printf("dispatch:\n");
+    bench_commands();
+
+    wal_sync();
+    history_sync();
+    if (argc <= 4)
+    {
+        char cmd[300];
+        snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+        if (system(cmd) != 0)
+            printf("(could not remove %s)\n", dir);
+    }
+    return 0;
+}
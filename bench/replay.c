@@ -0,0 +1,663 @@
+// Phát lại file trace do server ghi (MINACHAT_CAPTURE=<file>) vào 1 server khác: mỗi kết nối
+// trong trace là 1 kết nối TCP, các dòng gửi đúng thứ tự của kết nối đó, theo nhịp gốc nhân tốc độ.
+//
+//   make replay
+//   ./replay [-H host] [-p port] [-x speed] [-P server_pid] [-w password] [-r] trace_file
+//
+//   -x: 1 = đúng nhịp gốc (mặc định), 10 = nhanh gấp 10, 0 = nhanh nhất có thể
+//   -P: pid của server đích, in thêm CPU (user + sys) server đã dùng trong lúc replay
+//   -w: mật khẩu thay cho mật khẩu đã bị che trong trace (mặc định REPLAY_PASSWORD)
+//   -r: REGISTER mỗi user với mật khẩu đó trước lần LOGIN đầu tiên của user
+//
+// Kết quả: thời gian chạy, độ trễ so với lịch trong trace (tool / server không theo kịp) và
+// p50 / p99 / p999 thời gian từ lúc gửi 1 dòng tới byte trả lời đầu tiên trên kết nối đó (mỗi kết
+// nối đo 1 dòng một lúc, tin nhắn đẩy tới giữa chừng cũng tính là trả lời nên chỉ dùng để so sánh
+// 2 bản build trên cùng trace). Server đích nên chạy trên bản sao dữ liệu của server đã capture
+// (bạn bè, group), với account có mật khẩu -w hoặc tạo bằng -r. Trace không có mật khẩu / chữ ký
+// token thật (xem capture.h): LOGIN / REGISTER gửi mật khẩu -w, RESUME đổi thành LOGIN user đó.
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "server/capture/capture.h"
+
+#define MAX_CONNS 4096
+#define TABLE_SIZE 8192 // bảng băm conn -> Conn*, lũy thừa 2 và > MAX_CONNS
+#define IN_BUF 8192
+#define OUT_BUF 16384
+#define MAX_LINE 65536
+#define DRAIN_SEC 2        // hết trace thì nhận tiếp tới khi server im lặng chừng này giây
+#define STALL_SEC 30       // ... hoặc chừng này giây nếu còn dòng chưa gửi được (chờ kết quả LOGIN)
+#define MAX_SPEED_BATCH 64 // chế độ nhanh nhất: poll 1 lần sau mỗi chừng này record
+#define SEND_WAIT_SEC 5    // buffer gửi của 1 kết nối đầy quá lâu thì bỏ dòng
+#define HEAD_LEN 24
+#define REPLAY_PASSWORD "replaypw"
+#define USER_TABLE 16384 // bảng user đã REGISTER (-r), lũy thừa 2
+#define NAME_LEN 64
+#define MAX_PASSWORD 127 // server nhận mật khẩu tối đa 127 byte
+
+typedef struct
+{
+    uint64_t key;        // (segment << 40) | conn_id
+    int fd;              // -1 nếu connect thất bại (các dòng sau của kết nối bị bỏ)
+    int closing;         // trace đã đóng, chờ gửi hết buffer rồi close
+    uint64_t probe_ns;   // thời điểm gửi dòng đang đo, 0 = không đo
+    int held;            // sau LOGIN / REGISTER: từ byte này chờ có kết quả mới gửi, -1 = không
+    char head[HEAD_LEN]; // đầu dòng đang nhận, đủ để nhận ra kết quả LOGIN / REGISTER
+    int headlen;
+    char out[OUT_BUF];
+    int outlen;
+} Conn;
+
+typedef struct
+{
+    uint64_t *v; // nano giây
+    size_t n, cap;
+} Lat;
+
+static const char *host = "127.0.0.1", *port = "8080";
+static const char *password = REPLAY_PASSWORD;
+static int register_users = 0;
+static char *registered[USER_TABLE];
+static Conn *table[TABLE_SIZE];
+static Conn *active[MAX_CONNS];
+static int nactive = 0;
+static struct pollfd pfds[MAX_CONNS];
+
+static Lat lat;
+static long lines = 0, opened = 0, connect_failed = 0, dropped = 0, broken = 0;
+static uint64_t bytes_in = 0, last_rx_ns = 0;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void lat_push(Lat *l, uint64_t v)
+{
+    if (l->n == l->cap)
+    {
+        size_t cap = l->cap ? l->cap * 2 : 4096;
+        uint64_t *nv = realloc(l->v, cap * sizeof(uint64_t));
+        if (!nv)
+            return;
+        l->v = nv;
+        l->cap = cap;
+    }
+    l->v[l->n++] = v;
+}
+
+// ---------- bảng kết nối (open addressing, xóa bằng dịch lùi) ----------
+
+static unsigned slot_of(uint64_t key)
+{
+    return (unsigned)((key * 0x9E3779B97F4A7C15ull) >> 40) & (TABLE_SIZE - 1);
+}
+
+static Conn *table_get(uint64_t key)
+{
+    for (unsigned i = slot_of(key); table[i]; i = (i + 1) & (TABLE_SIZE - 1))
+    {
+        if (table[i]->key == key)
+            return table[i];
+    }
+    return NULL;
+}
+
+static void table_put(Conn *c)
+{
+    unsigned i = slot_of(c->key);
+    while (table[i])
+        i = (i + 1) & (TABLE_SIZE - 1);
+    table[i] = c;
+}
+
+static void table_del(uint64_t key)
+{
+    unsigned i = slot_of(key);
+    while (table[i] && table[i]->key != key)
+        i = (i + 1) & (TABLE_SIZE - 1);
+    if (!table[i])
+        return;
+    table[i] = NULL;
+
+    // Dời các phần tử phía sau về chỗ trống nếu slot gốc của chúng không nằm giữa 2 vị trí
+    for (unsigned j = (i + 1) & (TABLE_SIZE - 1); table[j]; j = (j + 1) & (TABLE_SIZE - 1))
+    {
+        unsigned home = slot_of(table[j]->key);
+        if (((j - home) & (TABLE_SIZE - 1)) >= ((j - i) & (TABLE_SIZE - 1)))
+        {
+            table[i] = table[j];
+            table[j] = NULL;
+            i = j;
+        }
+    }
+}
+
+// ---------- kết nối ----------
+
+static int connect_to()
+{
+    struct addrinfo hints = {0}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0)
+        return -1;
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static Conn *conn_open(uint64_t key)
+{
+    if (nactive >= MAX_CONNS)
+        return NULL;
+    Conn *c = calloc(1, sizeof(Conn));
+    if (!c)
+        return NULL;
+    c->key = key;
+    c->held = -1;
+    c->fd = connect_to();
+    if (c->fd < 0)
+        connect_failed++;
+    else
+        opened++;
+    table_put(c);
+    active[nactive++] = c;
+    return c;
+}
+
+static void conn_drop(int i)
+{
+    Conn *c = active[i];
+    if (c->fd >= 0)
+        close(c->fd);
+    if (!c->closing)
+        table_del(c->key);
+    free(c);
+    active[i] = active[--nactive];
+}
+
+static void conn_broken(Conn *c)
+{
+    close(c->fd);
+    c->fd = -1;
+    c->outlen = 0;
+    broken++;
+}
+
+static int is_auth(const char *line)
+{
+    return !strncmp(line, "LOGIN ", 6) || !strncmp(line, "REGISTER ", 9);
+}
+
+// Vị trí ngay sau dòng LOGIN / REGISTER đầu tiên trong buffer gửi (bắt đầu ở đầu dòng), -1 nếu không có
+static int next_hold(const char *out, int len)
+{
+    for (int start = 0; start < len;)
+    {
+        const char *nl = memchr(out + start, '\n', len - start);
+        int end = nl ? (int)(nl - out) + 1 : len;
+        if (is_auth(out + start))
+            return end;
+        start = end;
+    }
+    return -1;
+}
+
+static void conn_flush(Conn *c)
+{
+    while (c->fd >= 0 && c->outlen > 0 && c->held != 0)
+    {
+        int len = c->held > 0 ? c->held : c->outlen;
+        ssize_t n = send(c->fd, c->out, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0)
+        {
+            conn_broken(c);
+            return;
+        }
+        memmove(c->out, c->out + n, c->outlen - n);
+        c->outlen -= (int)n;
+        if (c->held > 0)
+            c->held -= (int)n;
+        if (!c->probe_ns)
+            c->probe_ns = now_ns();
+    }
+}
+
+static void conn_read(Conn *c)
+{
+    char buf[IN_BUF];
+    ssize_t n = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    if (n <= 0)
+    {
+        conn_broken(c);
+        return;
+    }
+    bytes_in += (uint64_t)n;
+    last_rx_ns = now_ns();
+    if (c->probe_ns)
+    {
+        lat_push(&lat, now_ns() - c->probe_ns);
+        c->probe_ns = 0;
+    }
+
+    // Các dòng khác (trả lời lệnh trước, tin nhắn đẩy) có thể tới trước kết quả xác thực
+    for (ssize_t i = 0; i < n; i++)
+    {
+        if (buf[i] != '\n')
+        {
+            if (c->headlen < HEAD_LEN - 1)
+                c->head[c->headlen++] = buf[i];
+            continue;
+        }
+        c->head[c->headlen] = '\0';
+        c->headlen = 0;
+        if (c->held == 0 && (!strncmp(c->head, "Login ", 6) || !strncmp(c->head, "Register ", 9) ||
+                             !strncmp(c->head, "Already logged in", 17)))
+        {
+            c->held = next_hold(c->out, c->outlen);
+            conn_flush(c);
+        }
+    }
+}
+
+// 1 vòng poll trên mọi kết nối, đóng các kết nối trace đã đóng khi gửi xong
+static void pump(int timeout_ms)
+{
+    for (int i = 0; i < nactive; i++)
+    {
+        pfds[i].fd = active[i]->fd;
+        pfds[i].events = POLLIN | (active[i]->outlen > 0 && active[i]->held != 0 ? POLLOUT : 0);
+        pfds[i].revents = 0;
+    }
+    int ready = poll(pfds, nactive, timeout_ms);
+    for (int i = 0; ready > 0 && i < nactive; i++)
+    {
+        if (pfds[i].revents & POLLOUT)
+            conn_flush(active[i]);
+        if (active[i]->fd >= 0 && (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+            conn_read(active[i]);
+    }
+    for (int i = nactive - 1; i >= 0; i--)
+    {
+        if (active[i]->closing && (active[i]->outlen == 0 || active[i]->fd < 0))
+            conn_drop(i);
+    }
+}
+
+static long unsent_bytes()
+{
+    long n = 0;
+    for (int i = 0; i < nactive; i++)
+    {
+        if (active[i]->fd >= 0)
+            n += active[i]->outlen;
+    }
+    return n;
+}
+
+static void conn_send_line(Conn *c, const char *line, size_t len)
+{
+    if (c->fd < 0 || len + 1 > OUT_BUF)
+    {
+        dropped++;
+        return;
+    }
+    // Giữ thứ tự trong kết nối: buffer đầy thì chờ server đọc chứ không bỏ dòng
+    uint64_t give_up = now_ns() + SEND_WAIT_SEC * 1000000000ull;
+    while (c->fd >= 0 && c->outlen + (int)len + 1 > OUT_BUF && now_ns() < give_up)
+        pump(10);
+    if (c->fd < 0 || c->outlen + (int)len + 1 > OUT_BUF)
+    {
+        dropped++;
+        return;
+    }
+
+    memcpy(c->out + c->outlen, line, len);
+    c->out[c->outlen + len] = '\n';
+    c->outlen += (int)len + 1;
+    // Client thật chờ kết quả xác thực rồi mới gửi tiếp, server cũng giữ các dòng sau trong
+    // buffer vào (INBUF_SIZE) lúc worker hash mật khẩu nên replay nhanh phải chờ theo
+    if (c->held < 0 && is_auth(line))
+        c->held = c->outlen;
+    lines++;
+    conn_flush(c);
+}
+
+// ---------- thông tin đăng nhập bị che ----------
+
+// 1 nếu user chưa có trong bảng (và thêm vào). Bảng đầy thì coi như chưa có: REGISTER lại chỉ bị từ chối
+static int first_seen(const char *user)
+{
+    uint32_t h = 2166136261u;
+    for (const char *p = user; *p; p++)
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    for (unsigned i = 0; i < USER_TABLE; i++)
+    {
+        unsigned slot = (h + i) & (USER_TABLE - 1);
+        if (!registered[slot])
+        {
+            registered[slot] = strdup(user);
+            return 1;
+        }
+        if (!strcmp(registered[slot], user))
+            return 0;
+    }
+    return 1;
+}
+
+static int hex_digit(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+// Username trong payload hex của token RESUME (trước dấu ':' đầu tiên). 0 nếu OK
+static int token_user(const char *token, char *user, size_t size)
+{
+    for (size_t n = 0; n + 1 < size; n++, token += 2)
+    {
+        int hi = hex_digit(token[0]), lo = hi < 0 ? -1 : hex_digit(token[1]);
+        if (lo < 0)
+            return -1;
+        user[n] = (char)(hi << 4 | lo);
+        if (user[n] == ':')
+        {
+            user[n] = '\0';
+            return n > 0 ? 0 : -1;
+        }
+    }
+    return -1;
+}
+
+// verb = "LOGIN" / "REGISTER", mật khẩu -w
+static void send_auth(Conn *c, const char *verb, const char *user)
+{
+    char buf[NAME_LEN + MAX_PASSWORD + 16];
+    conn_send_line(c, buf, (size_t)snprintf(buf, sizeof(buf), "%s %s %s", verb, user, password));
+}
+
+static void send_login(Conn *c, const char *user)
+{
+    if (register_users && first_seen(user))
+        send_auth(c, "REGISTER", user);
+    send_auth(c, "LOGIN", user);
+}
+
+// Dòng có mật khẩu / chữ ký đã che thì gửi lại bằng mật khẩu -w, còn lại gửi nguyên văn
+static void replay_line(Conn *c, const char *line, size_t len)
+{
+    char cmd[16], arg[256], secret[256]; // arg: username, hoặc token của RESUME
+    int n = sscanf(line, "%15s %255s %255s", cmd, arg, secret);
+    size_t alen = n >= 2 ? strlen(arg) : 0;
+    if (n == 3 && alen < NAME_LEN && !strcmp(secret, CAPTURE_REDACTED) && !strcmp(cmd, "LOGIN"))
+    {
+        send_login(c, arg);
+        return;
+    }
+    if (n == 3 && alen < NAME_LEN && !strcmp(secret, CAPTURE_REDACTED) && !strcmp(cmd, "REGISTER"))
+    {
+        if (register_users)
+            first_seen(arg);
+        send_auth(c, "REGISTER", arg);
+        return;
+    }
+
+    // RESUME <payload>.* <seq>: không có chữ ký thì không resume được, đăng nhập lại bằng mật khẩu
+    char name[NAME_LEN];
+    if (alen > 2 && !strcmp(cmd, "RESUME") && !strcmp(arg + alen - 2, "." CAPTURE_REDACTED) &&
+        token_user(arg, name, sizeof(name)) == 0)
+    {
+        send_login(c, name);
+        return;
+    }
+    conn_send_line(c, line, len);
+}
+
+// ---------- đọc trace ----------
+
+static int get_varint(FILE *f, uint64_t *v)
+{
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int b = getc(f);
+        if (b == EOF)
+            return -1;
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+static uint64_t cpu_ticks(int pid)
+{
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    // Sau "(comm)" là state rồi các trường số, utime / stime là trường thứ 14 / 15
+    char *p = strrchr(buf, ')');
+    unsigned long long utime = 0, stime = 0;
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+        return 0;
+    return utime + stime;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-H host] [-p port] [-x speed (0 = max)] [-P server_pid] [-w password] [-r] trace_file\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    double speed = 1;
+    int server_pid = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "H:p:x:P:w:r")) != -1)
+    {
+        if (opt == 'H')
+            host = optarg;
+        else if (opt == 'p')
+            port = optarg;
+        else if (opt == 'x')
+            speed = atof(optarg);
+        else if (opt == 'P')
+            server_pid = atoi(optarg);
+        else if (opt == 'w')
+            password = optarg;
+        else if (opt == 'r')
+            register_users = 1;
+        else
+            usage(argv[0]);
+    }
+    if (optind != argc - 1 || speed < 0 || strlen(password) > MAX_PASSWORD)
+        usage(argv[0]);
+
+    FILE *f = fopen(argv[optind], "rb");
+    if (!f)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (getc(f) != CAPTURE_MAGIC[0])
+    {
+        fprintf(stderr, "%s: not a capture trace\n", argv[optind]);
+        return 1;
+    }
+    ungetc(CAPTURE_MAGIC[0], f);
+
+    static char line[MAX_LINE];
+    uint64_t segment = 0, first_wall_us = 0, t_us = 0; // t_us: thời điểm record tính từ đầu trace
+    uint64_t max_lag_ns = 0, records = 0, ticks0 = server_pid ? cpu_ticks(server_pid) : 0;
+    uint64_t start = now_ns();
+    int truncated = 0;
+
+    for (int type; (type = getc(f)) != EOF; records++)
+    {
+        uint64_t dt, conn, len;
+        if (type == CAPTURE_MAGIC[0])
+        {
+            char magic[CAPTURE_MAGIC_LEN];
+            uint64_t wall;
+            if (fread(magic + 1, 1, CAPTURE_MAGIC_LEN - 1, f) != CAPTURE_MAGIC_LEN - 1 ||
+                memcmp(magic + 1, CAPTURE_MAGIC + 1, CAPTURE_MAGIC_LEN - 1) || get_varint(f, &wall) != 0)
+            {
+                fprintf(stderr, "bad segment header, stopping\n");
+                truncated = 1;
+                break;
+            }
+            if (segment++ == 0)
+                first_wall_us = wall;
+            // Segment sau (process mới sau hot upgrade) nối tiếp theo đồng hồ thật, không lùi
+            if (wall - first_wall_us > t_us)
+                t_us = wall - first_wall_us;
+            continue;
+        }
+        if (get_varint(f, &dt) != 0 || get_varint(f, &conn) != 0)
+        {
+            truncated = 1;
+            break;
+        }
+        t_us += dt;
+
+        if (type == CAPTURE_LINE)
+        {
+            if (get_varint(f, &len) != 0 || len >= MAX_LINE || fread(line, 1, len, f) != len)
+            {
+                truncated = 1;
+                break;
+            }
+            line[len] = '\0';
+        }
+        else if (type != CAPTURE_OPEN && type != CAPTURE_CLOSE)
+        {
+            fprintf(stderr, "unknown record type 0x%02x, stopping\n", type);
+            truncated = 1;
+            break;
+        }
+
+        // Chờ tới lịch của record, trong lúc chờ vẫn nhận trả lời
+        if (speed > 0)
+        {
+            uint64_t due = start + (uint64_t)(t_us * 1000.0 / speed);
+            for (uint64_t now = now_ns(); now + 1000000 <= due; now = now_ns())
+                pump((int)((due - now) / 1000000));
+            uint64_t now = now_ns();
+            if (now > due && now - due > max_lag_ns)
+                max_lag_ns = now - due;
+        }
+        else if (records % MAX_SPEED_BATCH == 0)
+        {
+            pump(0);
+        }
+
+        uint64_t key = (segment << 40) | conn;
+        Conn *c = table_get(key);
+        if (type == CAPTURE_OPEN)
+        {
+            if (!c)
+                conn_open(key);
+        }
+        else if (type == CAPTURE_CLOSE)
+        {
+            if (c)
+            {
+                table_del(key);
+                c->closing = 1;
+            }
+        }
+        else
+        {
+            // Kết nối mở trước khi bắt đầu capture: mở khi gặp dòng đầu tiên
+            if (!c)
+                c = conn_open(key);
+            if (c)
+                replay_line(c, line, len);
+            else
+                dropped++;
+        }
+    }
+    fclose(f);
+
+    double trace_sec = t_us / 1e6;
+    double send_sec = (now_ns() - start) / 1e9;
+    last_rx_ns = now_ns();
+    while (nactive > 0)
+    {
+        uint64_t silent = now_ns() - last_rx_ns;
+        if (silent > STALL_SEC * 1000000000ull || (silent > DRAIN_SEC * 1000000000ull && !unsent_bytes()))
+            break;
+        pump(50);
+    }
+    long unsent = unsent_bytes();
+    uint64_t ticks1 = server_pid ? cpu_ticks(server_pid) : 0;
+    double wall_sec = (now_ns() - start) / 1e9;
+    while (nactive > 0)
+        conn_drop(nactive - 1);
+
+    printf("%s%llu record(s), %ld line(s) on %ld connection(s) (%ld connect failed, %ld line(s) dropped, "
+           "%ld closed by server)\n",
+           truncated ? "trace truncated after " : "", (unsigned long long)records, lines, opened, connect_failed,
+           dropped, broken);
+    if (unsent > 0)
+        printf("%ld byte(s) still unsent when the server went quiet\n", unsent);
+    printf("trace span %.2fs, replayed in %.2fs (%.1fx), %.0f lines/s, %.2f MB received\n", trace_sec, send_sec,
+           send_sec > 0 ? trace_sec / send_sec : 0, send_sec > 0 ? lines / send_sec : 0, bytes_in / 1e6);
+    if (speed > 0)
+        printf("max lag behind schedule %.2f ms\n", max_lag_ns / 1e6);
+
+    if (lat.n > 0)
+    {
+        qsort(lat.v, lat.n, sizeof(uint64_t), cmp_u64);
+        printf("first-reply latency (%zu samples): p50 %.1f us  p99 %.1f us  p999 %.1f us  max %.1f us\n", lat.n,
+               lat.v[lat.n / 2] / 1e3, lat.v[(size_t)(lat.n * 0.99)] / 1e3, lat.v[(size_t)(lat.n * 0.999)] / 1e3,
+               lat.v[lat.n - 1] / 1e3);
+    }
+    if (server_pid)
+    {
+        double cpu = (double)(ticks1 - ticks0) / sysconf(_SC_CLK_TCK);
+        printf("server cpu %.2fs (%.1f%% of %.2fs wall)\n", cpu, wall_sec > 0 ? cpu * 100 / wall_sec : 0, wall_sec);
+    }
+    free(lat.v);
+    return 0;
+}
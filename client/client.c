@@ -59,7 +59,9 @@ int main()
     printf("Commands:\n");
     printf("  REGISTER <username> <password> - Register new account\n");
     printf("  LOGIN <username> <password>    - Login to chat\n");
-    printf("  LIST                           - List online users\n");
+    printf("  RESUME <token> <last_seq>      - Resume session after reconnect\n");
+    printf("  LIST [cursor] [limit]          - List online users (paged)\n");
+    printf("  ONLINECOUNT                    - Number of online users\n");
     printf("\n");
     printf("Friend Management:\n");
     printf("  ADDFRIEND <user>               - Send friend request\n");
@@ -72,6 +74,8 @@ int main()
     printf("Messaging:\n");
     printf("  MSGTO <user> <message>         - Send private message\n");
     printf("                                   (saved if offline)\n");
+    printf("  HISTORY <user|group_id> [before_seq] [n]\n");
+    printf("                                 - View message history (paged)\n");
     printf("\n");
     printf("Group Chat:\n");
     printf("  CREATEGROUP <group_name>       - Create new group\n");
@@ -81,7 +85,16 @@ int main()
     printf("  GROUPMSG <group_id> <message>  - Send message to group\n");
     printf("  LISTGROUPS                     - View your groups\n");
     printf("  GROUPINFO <group_id>           - View group members\n");
+    printf("  RECENT <group_id>              - View latest group messages\n");
     printf("\n");
+    printf("Topics:\n");
+    printf("  SUBSCRIBE <topic>              - Receive messages published to topic\n");
+    printf("  UNSUBSCRIBE <topic>            - Stop receiving topic\n");
+    printf("  PUBLISH <topic> <message>      - Publish to topic subscribers\n");
+    printf("\n");
+    printf("  STATS                          - Server metrics (admin only)\n");
+    printf("  TRACE [N|DUMP]                 - Sample 1/N commands, dump spans (admin only)\n");
+    printf("  SLOWLOG [GET [n]|LEN|RESET]    - Commands over the slow threshold (admin only)\n");
     printf("  LOGOUT                         - Logout (stay connected)\n");
     printf("  exit                           - Disconnect and quit\n");
     printf("==================\n\n");
@@ -106,12 +119,13 @@ int main()
         if (strcmp(message, "help") == 0)
         {
             printf("\n=== Available Commands ===\n");
-            printf("Account: REGISTER, LOGIN, LOGOUT\n");
+            printf("Account: REGISTER, LOGIN, RESUME, LOGOUT\n");
             printf("Friends: ADDFRIEND, ACCEPT, REJECT, UNFRIEND, REQUESTS, FRIENDS\n");
-            printf("Message: MSGTO <user> <message>\n");
+            printf("Message: MSGTO <user> <message>, HISTORY <user|group_id> [before_seq] [n]\n");
             printf("Group: CREATEGROUP, ADDMEMBER, REMOVEMEMBER, LEAVEGROUP\n");
-            printf("       GROUPMSG, LISTGROUPS, GROUPINFO\n");
-            printf("Other: LIST (online users), exit\n");
+            printf("       GROUPMSG, LISTGROUPS, GROUPINFO, RECENT\n");
+            printf("Topic: SUBSCRIBE, UNSUBSCRIBE, PUBLISH\n");
+            printf("Other: LIST [cursor] [limit], ONLINECOUNT, STATS, TRACE, SLOWLOG, exit\n");
             printf("==========================\n\n");
             continue;
         }
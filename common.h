@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <stdint.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -16,14 +17,21 @@
 #define MAX_CLIENTS 1024
 #define INBUF_SIZE 4096
 #define USERNAME_LEN 50
+#define ADMIN_USERNAME "admin" // tài khoản quản trị: PUBLISH *, STATS
 
-typedef struct
+typedef struct Client
 {
     int fd;
+    uint64_t conn_id; // tăng dần, phân biệt các kết nối dùng lại cùng slot / fd
+    int auth_pending; // đang chờ worker xác thực LOGIN/REGISTER
     int logged_in;
+    uint32_t uid; // user ID đã intern, 0 khi chưa login
     char username[USERNAME_LEN];
     char inbuf[INBUF_SIZE];
     int inlen;
+    uint64_t online_seq; // thứ tự login, 0 khi không nằm trong danh sách online
+    struct Client *online_prev, *online_next;
+    struct Subscription *subs; // các topic đang SUBSCRIBE (pubsub)
 } Client;
 
 #endif
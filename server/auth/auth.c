@@ -1,20 +1,55 @@
 #include "../../common.h"
 #include "auth.h"
-
-#include <sys/file.h> // flock
-#include <fcntl.h>    // open flags
-#include <unistd.h>   // close
-#include <errno.h>
+#include "../crypto/sha256.h"
+#include "../intern/intern.h"
+#include "../trace/trace.h"
+#include "../util/idmap.h"
+#include "../wal/wal.h"
 
 #define ACCOUNTS_FILE "accounts.txt"
 #define MIN_USERNAME_LEN 3
 #define MIN_PASSWORD_LEN 4
+#define HASH_PREFIX "$pbkdf2-sha256$"
+#define SALT_LEN 16
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+// Hash cố định cho user không tồn tại: cùng số vòng lặp với hash thật nên LOGIN sai user và sai
+// mật khẩu tốn thời gian như nhau (không dò được username qua thời gian trả lời)
+#define DUMMY_HASH HASH_PREFIX STR(AUTH_HASH_ITERATIONS) "$" \
+    "00000000000000000000000000000000$" \
+    "0000000000000000000000000000000000000000000000000000000000000000"
 
 /*
-    mỗi dòng:  <username><space><password>\n
-  => username/password KHÔNG được chứa whitespace (space/tab/newline)
+    State: bảng user ID -> password hash trong bộ nhớ, mọi thay đổi ghi vào WAL.
+    Account có trong snapshot được tra thẳng trên mapping; bảng in-memory chỉ giữ các account
+    thêm/đổi mật khẩu sau snapshot và che bản trong snapshot.
+    accounts.txt kiểu cũ (<username><space><password>\n) chỉ được đọc 1 lần khi WAL còn trống.
+    Dòng cũ lưu mật khẩu plaintext vẫn login được, và được hash lại ngay lần login đầu tiên
 */
 
+static IdMap accounts; // user ID -> char* hash
+
+// Hash đang có hiệu lực của user, NULL nếu không tồn tại
+static const char *lookup_id(uint32_t uid)
+{
+    const char *h = idmap_get(&accounts, uid);
+    if (h)
+        return h;
+
+    SnapTable base;
+    if (snap_table(SNAP_ACCOUNTS, &base) != 0)
+        return NULL;
+    const SnapEntry *e = snap_at(&base, uid);
+    return e && e->aux ? snap_str(&base, e->aux) : NULL;
+}
+
+static const char *lookup(const char *username)
+{
+    uint32_t uid = intern_find(INTERN_USERS, username);
+    return uid != INTERN_NONE ? lookup_id(uid) : NULL;
+}
+
 static int has_whitespace(const char *s)
 {
     if (s == NULL || s[0] == '\0')
@@ -28,7 +63,7 @@ static int has_whitespace(const char *s)
     return 0;
 }
 
-static int is_valid_credential(const char *username, const char *password)
+int auth_valid_credential(const char *username, const char *password)
 {
     if (has_whitespace(username) || has_whitespace(password))
         return 0;
@@ -45,123 +80,224 @@ static int is_valid_credential(const char *username, const char *password)
     return 1;
 }
 
-static int user_exists_in_stream(FILE *file, const char *username)
+// ---------- hash ----------
+
+int auth_hash_password(const char *password, char *out, size_t outsz)
 {
-    char u[USERNAME_LEN], p[100];
+    TRACE_SCOPE("auth", "auth_hash_password");
+    uint8_t salt[SALT_LEN];
+    if (crypto_random(salt, sizeof(salt)) != 0)
+        return 0;
+
+    uint8_t dk[SHA256_DIGEST_LEN];
+    pbkdf2_hmac_sha256(password, strlen(password), salt, sizeof(salt), AUTH_HASH_ITERATIONS, dk);
+
+    char salt_hex[SALT_LEN * 2 + 1], dk_hex[SHA256_DIGEST_LEN * 2 + 1];
+    crypto_hex_encode(salt, sizeof(salt), salt_hex);
+    crypto_hex_encode(dk, sizeof(dk), dk_hex);
 
-    // Đọc đúng format: cần đủ 2 token
-    while (fscanf(file, "%49s %99s", u, p) == 2)
+    int n = snprintf(out, outsz, HASH_PREFIX "%d$%s$%s", AUTH_HASH_ITERATIONS, salt_hex, dk_hex);
+    return n > 0 && (size_t)n < outsz;
+}
+
+// *legacy = 1 nếu stored là mật khẩu plaintext kiểu cũ
+int auth_verify_password(const char *password, const char *stored, int *legacy)
+{
+    TRACE_SCOPE("auth", "auth_verify_password");
+    *legacy = 0;
+    if (strncmp(stored, HASH_PREFIX, strlen(HASH_PREFIX)) != 0)
     {
-        if (strcmp(username, u) == 0)
-            return 1;
+        *legacy = 1;
+        // Chạy PBKDF2 bỏ kết quả để account cũ tốn thời gian như account đã hash, và so digest
+        // thay vì strcmp: thời gian không phụ thuộc vị trí ký tự sai đầu tiên
+        uint8_t a[SHA256_DIGEST_LEN], b[SHA256_DIGEST_LEN];
+        static const uint8_t salt[SALT_LEN] = {0};
+        pbkdf2_hmac_sha256(password, strlen(password), salt, sizeof(salt), AUTH_HASH_ITERATIONS, a);
+        Sha256Ctx ctx;
+        sha256_init(&ctx);
+        sha256_update(&ctx, stored, strlen(stored));
+        sha256_final(&ctx, a);
+        sha256_init(&ctx);
+        sha256_update(&ctx, password, strlen(password));
+        sha256_final(&ctx, b);
+        return crypto_equal(a, b, sizeof(a));
     }
-    return 0;
+
+    // <iter>$<salt>$<hash>
+    const char *p = stored + strlen(HASH_PREFIX);
+    char *end = NULL;
+    long iter = strtol(p, &end, 10);
+    if (iter <= 0 || *end != '$')
+        return 0;
+
+    const char *salt_hex = end + 1;
+    const char *dk_hex = strchr(salt_hex, '$');
+    if (!dk_hex)
+        return 0;
+
+    uint8_t salt[64], expect[SHA256_DIGEST_LEN];
+    int saltlen = crypto_hex_decode(salt_hex, (size_t)(dk_hex - salt_hex), salt, sizeof(salt));
+    dk_hex++;
+    if (saltlen <= 0 || strlen(dk_hex) != SHA256_DIGEST_LEN * 2 ||
+        crypto_hex_decode(dk_hex, SHA256_DIGEST_LEN * 2, expect, sizeof(expect)) != SHA256_DIGEST_LEN)
+        return 0;
+
+    uint8_t dk[SHA256_DIGEST_LEN];
+    pbkdf2_hmac_sha256(password, strlen(password), salt, (size_t)saltlen, (uint32_t)iter, dk);
+    return crypto_equal(dk, expect, sizeof(dk));
 }
 
-int check_login(const char *username, const char *password)
+const char *auth_dummy_hash()
 {
-    if (!is_valid_credential(username, password))
-        return 0;
+    return DUMMY_HASH;
+}
+
+// ---------- state ----------
 
-    int fd = open(ACCOUNTS_FILE, O_RDONLY);
-    if (fd < 0)
+static int apply_set(const char *username, const char *hash)
+{
+    uint32_t uid = intern_id(INTERN_USERS, username);
+    char *copy = uid != INTERN_NONE ? strdup(hash) : NULL;
+    if (!copy)
+        return -1;
+
+    char *old = idmap_get(&accounts, uid);
+    if (idmap_put(&accounts, uid, copy) != 0)
     {
-        // Chưa có file => chưa có account
-        return 0;
+        free(copy);
+        return -1;
     }
+    free(old);
+    return 0;
+}
+
+static int log_account(int type, const char *username, const char *hash)
+{
+    WalRecord rec;
+    wal_record_begin(&rec, type);
+    wal_record_str(&rec, username);
+    wal_record_str(&rec, hash);
+    return wal_append(&rec);
+}
 
-    // Shared lock: nhiều người có thể đọc đồng thời
-    if (flock(fd, LOCK_SH) != 0)
+static int replay_account(WalReader *r)
+{
+    char u[USERNAME_LEN], h[PASSWORD_FIELD_LEN];
+    if (wal_read_str(r, u, sizeof(u)) != 0 || wal_read_str(r, h, sizeof(h)) != 0)
+        return -1;
+    return apply_set(u, h);
+}
+
+static void snapshot_accounts(SnapWriter *w)
+{
+    uint32_t count = intern_count(INTERN_USERS);
+    snap_table_begin(w, SNAP_ACCOUNTS, 0);
+    for (uint32_t uid = 1; uid <= count; uid++)
     {
-        close(fd);
-        return 0;
+        const char *h = lookup_id(uid);
+        snap_table_entry(w, NULL, h ? snap_string(w, h) : 0);
     }
+    snap_table_end(w);
+}
+
+void auth_init()
+{
+    wal_register_handler(WAL_ACCOUNT_ADD, replay_account);
+    wal_register_handler(WAL_ACCOUNT_PASSWORD, replay_account);
+    wal_register_snapshot(snapshot_accounts);
+}
 
-    FILE *file = fdopen(fd, "r");
+int auth_import_legacy()
+{
+    FILE *file = fopen(ACCOUNTS_FILE, "r");
     if (!file)
-    {
-        // fdopen fail -> nhớ unlock/close fd
-        flock(fd, LOCK_UN);
-        close(fd);
         return 0;
-    }
-
-    char u[USERNAME_LEN], p[100];
-    int ok = 0;
 
-    while (fscanf(file, "%49s %99s", u, p) == 2)
+    char u[USERNAME_LEN], p[PASSWORD_FIELD_LEN];
+    int count = 0;
+    while (fscanf(file, "%49s %191s", u, p) == 2)
     {
-        if (strcmp(username, u) == 0 && strcmp(password, p) == 0)
-        {
-            ok = 1;
-            break;
-        }
+        if (lookup(u))
+            continue;
+        if (apply_set(u, p) == 0 && log_account(WAL_ACCOUNT_ADD, u, p) == 0)
+            count++;
     }
-
-    // fclose(file) sẽ close(fd) luôn
-    flock(fd, LOCK_UN);
     fclose(file);
-    return ok;
+
+    // Đổi tên để lần sau không import lại và không ai nhầm là dữ liệu còn được cập nhật
+    rename(ACCOUNTS_FILE, ACCOUNTS_FILE ".migrated");
+    return count;
 }
 
-int register_user(const char *username, const char *password)
+int account_exists(const char *username)
 {
-    if (!is_valid_credential(username, password))
+    if (has_whitespace(username) || strlen(username) >= USERNAME_LEN)
         return 0;
+    return lookup(username) != NULL;
+}
 
-    // O_RDWR để vừa đọc vừa ghi trong cùng 1 file descriptor
-    // O_CREAT để đảm bảo file tồn tại
-    int fd = open(ACCOUNTS_FILE, O_RDWR | O_CREAT, 0644);
-    if (fd < 0)
-    {
-        perror("Could not open accounts file");
+int auth_get_hash(const char *username, char *out, size_t outsz)
+{
+    TRACE_SCOPE("auth", "auth_get_hash");
+    const char *h = lookup(username);
+    if (!h || strlen(h) >= outsz)
         return 0;
-    }
+    strcpy(out, h);
+    return 1;
+}
 
-    // Exclusive lock: đảm bảo check + append là atomic theo nghĩa logic
-    if (flock(fd, LOCK_EX) != 0)
-    {
-        perror("Could not lock accounts file");
-        close(fd);
+int auth_add_account(const char *username, const char *hash)
+{
+    TRACE_SCOPE("auth", "auth_add_account");
+    if (has_whitespace(username) || strlen(username) >= USERNAME_LEN)
         return 0;
-    }
+    if (lookup(username))
+        return 0; // Username already exists
 
-    FILE *file = fdopen(fd, "r+");
-    if (!file)
-    {
-        flock(fd, LOCK_UN);
-        close(fd);
+    if (log_account(WAL_ACCOUNT_ADD, username, hash) != 0)
         return 0;
-    }
+    return apply_set(username, hash) == 0;
+}
 
-    // 1) Check tồn tại username (đang giữ LOCK_EX nên không ai chen vào)
-    rewind(file);
-    if (user_exists_in_stream(file, username))
-    {
-        flock(fd, LOCK_UN);
-        fclose(file); // đóng luôn fd
-        return 0;     // Username already exists
-    }
+void auth_set_password(const char *username, const char *hash)
+{
+    TRACE_SCOPE("auth", "auth_set_password");
+    if (!lookup(username))
+        return;
+    if (log_account(WAL_ACCOUNT_PASSWORD, username, hash) == 0)
+        apply_set(username, hash);
+}
 
-    // 2) Append cuối file
-    fseek(file, 0, SEEK_END);
-    if (fprintf(file, "%s %s\n", username, password) < 0)
-    {
-        // fprintf thất bại
-        flock(fd, LOCK_UN);
-        fclose(file);
+int check_login(const char *username, const char *password)
+{
+    if (!auth_valid_credential(username, password))
         return 0;
-    }
 
-    if (fflush(file) != 0)
+    char stored[PASSWORD_FIELD_LEN];
+    int exists = auth_get_hash(username, stored, sizeof(stored));
+    if (!exists)
+        snprintf(stored, sizeof(stored), "%s", DUMMY_HASH);
+
+    int legacy = 0;
+    int ok = auth_verify_password(password, stored, &legacy) && exists;
+    if (ok && legacy)
     {
-        // fflush thất bại
-        flock(fd, LOCK_UN);
-        fclose(file);
-        return 0;
+        char hashed[PASSWORD_FIELD_LEN];
+        if (auth_hash_password(password, hashed, sizeof(hashed)))
+            auth_set_password(username, hashed);
     }
+    return ok;
+}
+
+int register_user(const char *username, const char *password)
+{
+    if (!auth_valid_credential(username, password))
+        return 0;
+    if (account_exists(username))
+        return 0;
 
-    flock(fd, LOCK_UN);
-    fclose(file); // đóng luôn fd
-    return 1;     // Registration successful
+    char hashed[PASSWORD_FIELD_LEN];
+    if (!auth_hash_password(password, hashed, sizeof(hashed)))
+        return 0;
+    return auth_add_account(username, hashed);
 }
@@ -1,6 +1,33 @@
 #ifndef AUTH_H
 #define AUTH_H
+
+#include <stddef.h>
+
 // khai bao các hàm liên quan đến xác thực người dùng de server sử dụng
+// Mật khẩu lưu dạng $pbkdf2-sha256$<iter>$<salt hex>$<hash hex>
+#define AUTH_HASH_ITERATIONS 10000
+#define PASSWORD_FIELD_LEN 192 // đủ chứa chuỗi hash
+
+// Tạo bảng account in-memory và đăng ký handler replay WAL
+void auth_init();
+// Lần đầu chạy với WAL: nạp accounts.txt kiểu cũ vào WAL. Trả về số account
+int auth_import_legacy();
+
+int account_exists(const char *username);
+int auth_valid_credential(const char *username, const char *password);
+
+// Các hàm đọc/ghi bảng account chỉ gọi trên reactor thread
+int auth_get_hash(const char *username, char *out, size_t outsz); // 1 nếu user tồn tại
+int auth_add_account(const char *username, const char *hash);     // 1 OK, 0 nếu đã tồn tại / lỗi
+void auth_set_password(const char *username, const char *hash);
+
+// Thuần CPU, không đụng state nên gọi được từ worker thread
+int auth_hash_password(const char *password, char *out, size_t outsz);
+int auth_verify_password(const char *password, const char *stored, int *legacy);
+// Hash thay thế khi user không tồn tại: verify tốn như user thật, caller luôn trả FAIL
+const char *auth_dummy_hash();
+
+// Bản đồng bộ (hash ngay trên thread gọi)
 int check_login(const char *username, const char *password);
 int register_user(const char *username, const char *password);
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,153 @@
+#include "capture.h"
+#include "../metrics/metrics.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define CAPTURE_BUFFER (1 << 20) // stdio buffer, chỉ ghi đĩa khi đầy nên gần như không tốn syscall
+
+static FILE *out = NULL;
+static uint64_t last_ns; // thời điểm record trước, để ghi delta
+
+static void stop(const char *why)
+{
+    perror(why);
+    fclose(out);
+    out = NULL;
+    fprintf(stderr, "Traffic capture disabled\n");
+}
+
+static void put_varint(uint64_t v)
+{
+    unsigned char b[10];
+    int n = 0;
+    do
+    {
+        b[n] = v & 0x7f;
+        v >>= 7;
+        if (v)
+            b[n] |= 0x80;
+        n++;
+    } while (v);
+    fwrite(b, 1, n, out);
+}
+
+static void put_head(int type, uint64_t conn)
+{
+    uint64_t now = metrics_now_ns();
+    fputc(type, out);
+    put_varint((now - last_ns) / 1000);
+    put_varint(conn);
+    // Làm tròn xuống µs: cộng đúng phần đã ghi để sai số không dồn lại theo số record
+    last_ns += (now - last_ns) / 1000 * 1000;
+}
+
+int capture_start(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (fd < 0)
+        return -1;
+    out = fdopen(fd, "a");
+    if (!out)
+    {
+        close(fd);
+        return -1;
+    }
+    setvbuf(out, NULL, _IOFBF, CAPTURE_BUFFER);
+
+    // Process cũ (hot upgrade) có thể chưa flush xong phần của nó nên không dựa vào độ dài file:
+    // segment nào cũng mở đầu bằng magic, chỉ cần không ghi xen giữa 2 process
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_LEN, out);
+    put_varint((uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec);
+    last_ns = metrics_now_ns();
+
+    if (ferror(out))
+    {
+        fclose(out);
+        out = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void capture_conn(int type, uint64_t conn)
+{
+    if (!out)
+        return;
+    put_head(type, conn);
+    if (ferror(out))
+        stop("capture write failed");
+}
+
+// Token thứ n (0 = tên lệnh) tách bằng dấu cách như strtok của protocol: [*start, *end). 0 nếu không có
+static int find_token(const char *line, size_t len, int n, size_t *start, size_t *end)
+{
+    size_t i = 0;
+    for (int k = 0;; k++)
+    {
+        while (i < len && line[i] == ' ')
+            i++;
+        if (i == len)
+            return 0;
+        *start = i;
+        while (i < len && line[i] != ' ')
+            i++;
+        *end = i;
+        if (k == n)
+            return 1;
+    }
+}
+
+static int is_command(const char *line, size_t start, size_t end, const char *cmd)
+{
+    return end - start == strlen(cmd) && !memcmp(line + start, cmd, end - start);
+}
+
+// Đoạn [*start, *end) của dòng phải che: mật khẩu LOGIN / REGISTER, chữ ký token RESUME. 0 nếu không có
+static int secret_span(const char *line, size_t len, size_t *start, size_t *end)
+{
+    size_t s, e;
+    if (!find_token(line, len, 0, &s, &e))
+        return 0;
+    if (is_command(line, s, e, "LOGIN") || is_command(line, s, e, "REGISTER"))
+        return find_token(line, len, 2, start, end);
+    if (!is_command(line, s, e, "RESUME") || !find_token(line, len, 1, start, end))
+        return 0;
+    const char *dot = memchr(line + *start, '.', *end - *start);
+    if (dot)
+        *start = (size_t)(dot - line) + 1;
+    return *start < *end;
+}
+
+void capture_line(uint64_t conn, const char *line, size_t len)
+{
+    if (!out)
+        return;
+    put_head(CAPTURE_LINE, conn);
+    size_t s, e;
+    if (secret_span(line, len, &s, &e))
+    {
+        put_varint(len - (e - s) + strlen(CAPTURE_REDACTED));
+        fwrite(line, 1, s, out);
+        fputs(CAPTURE_REDACTED, out);
+        fwrite(line + e, 1, len - e, out);
+    }
+    else
+    {
+        put_varint(len);
+        fwrite(line, 1, len, out);
+    }
+    if (ferror(out))
+        stop("capture write failed");
+}
+
+void capture_flush()
+{
+    if (out && fflush(out) != 0)
+        stop("capture flush failed");
+}
@@ -0,0 +1,42 @@
+// Ghi lại lưu lượng vào (mỗi dòng lệnh của từng kết nối + thời điểm) thành file trace nhị phân
+// để bench/replay phát lại vào 1 server khác. Bật bằng MINACHAT_CAPTURE=<file>
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAPTURE_MAGIC "MCTRACE1"
+#define CAPTURE_MAGIC_LEN 8
+
+/*
+    File gồm các segment, mỗi process ghi 1 segment nối vào cuối file (hot upgrade không ghi đè).
+    Segment = CAPTURE_MAGIC, wall_us (giờ thật lúc bắt đầu), rồi các record. Số nguyên ghi dạng
+    varint (LEB128 không dấu):
+      'O' dt_us conn                 kết nối mới
+      'L' dt_us conn len <len byte>  1 dòng lệnh, không có '\n'
+      'C' dt_us conn                 kết nối đóng
+    dt_us = số micro giây kể từ record trước trong cùng segment (CLOCK_MONOTONIC), conn = conn_id.
+    conn_id chỉ duy nhất trong 1 segment: client nhận lại khi hot upgrade mở kết nối mới ở segment sau
+
+    Trace không chứa thông tin đăng nhập dùng lại được: mật khẩu của LOGIN / REGISTER ghi thành
+    CAPTURE_REDACTED, token của RESUME chỉ giữ phần payload (hex của username:sid:expiry), chữ ký sau
+    dấu '.' ghi thành CAPTURE_REDACTED. bench/replay thay lại bằng mật khẩu cho trước (-w)
+*/
+#define CAPTURE_OPEN 'O'
+#define CAPTURE_LINE 'L'
+#define CAPTURE_CLOSE 'C'
+
+#define CAPTURE_REDACTED "*"
+
+// Mở file trace (tạo mới quyền 0600 vì trace chứa username và nội dung tin nhắn). 0 nếu OK, -1 nếu lỗi
+int capture_start(const char *path);
+
+// Các hàm ghi không làm gì khi capture tắt. Lỗi ghi đĩa thì tự tắt capture
+void capture_conn(int type, uint64_t conn); // CAPTURE_OPEN / CAPTURE_CLOSE
+void capture_line(uint64_t conn, const char *line, size_t len); // tự che thông tin đăng nhập
+
+// Đẩy buffer xuống file (trước khi thoát / chuyển giao cho process mới)
+void capture_flush();
+
+#endif
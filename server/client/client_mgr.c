@@ -1,6 +1,22 @@
 #include "client_mgr.h"
+#include "../capture/capture.h"
+#include "../durable/durable.h"
+#include "../group/group.h"
+#include "../intern/intern.h"
+#include "../metrics/metrics.h"
+#include "../probe/probe.h"
+#include "../slowlog/slowlog.h"
+#include "../util/idmap.h"
 
 static Client clients[MAX_CLIENTS];
+static int connected_count = 0;
+static uint64_t next_conn_id = 1;
+static IdMap online; // user ID -> Client* đang login
+
+// Danh sách client đang login theo thứ tự login (nối vào cuối), dùng cho LIST / ONLINECOUNT
+static Client *online_head = NULL, *online_tail = NULL;
+static int online_count = 0;
+static uint64_t next_online_seq = 1;
 
 void clients_init()
 {
@@ -19,9 +35,16 @@ int client_add(int fd)
         if (clients[i].fd == -1)
         {
             clients[i].fd = fd;
+            clients[i].conn_id = next_conn_id++;
+            clients[i].auth_pending = 0;
             clients[i].inlen = 0;
             clients[i].logged_in = 0;
+            clients[i].uid = INTERN_NONE;
             clients[i].username[0] = '\0';
+            clients[i].subs = NULL;
+            connected_count++;
+            capture_conn(CAPTURE_OPEN, clients[i].conn_id);
+            PROBE2(conn__accept, clients[i].conn_id, fd);
 
             return i;
         }
@@ -29,18 +52,115 @@ int client_add(int fd)
     return -1;
 }
 
+int client_restore(int fd, int logged_in, const char *username, const char *inbuf, int inlen)
+{
+    if (inlen < 0 || inlen >= INBUF_SIZE)
+        return -1;
+
+    int idx = client_add(fd);
+    if (idx < 0)
+        return -1;
+
+    Client *c = &clients[idx];
+    c->logged_in = logged_in;
+    strncpy(c->username, username, USERNAME_LEN - 1);
+    c->username[USERNAME_LEN - 1] = '\0';
+    memcpy(c->inbuf, inbuf, inlen);
+    c->inlen = inlen;
+    c->inbuf[inlen] = '\0';
+    return idx;
+}
+
+void clients_index_restored()
+{
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (clients[i].fd != -1 && clients[i].logged_in && clients[i].uid == INTERN_NONE)
+            client_login(&clients[i], clients[i].username);
+    }
+}
+
+// ---------- danh sách online ----------
+
+static void online_link(Client *c)
+{
+    if (c->online_seq != 0)
+        return;
+    c->online_seq = next_online_seq++;
+    c->online_prev = online_tail;
+    c->online_next = NULL;
+    if (online_tail)
+        online_tail->online_next = c;
+    else
+        online_head = c;
+    online_tail = c;
+    online_count++;
+}
+
+static void online_unlink(Client *c)
+{
+    if (c->online_seq == 0)
+        return;
+    if (c->online_prev)
+        c->online_prev->online_next = c->online_next;
+    else
+        online_head = c->online_next;
+    if (c->online_next)
+        c->online_next->online_prev = c->online_prev;
+    else
+        online_tail = c->online_prev;
+    c->online_prev = c->online_next = NULL;
+    c->online_seq = 0;
+    online_count--;
+}
+
+void client_login(Client *c, const char *username)
+{
+    if (c->username != username)
+    {
+        strncpy(c->username, username, USERNAME_LEN - 1);
+        c->username[USERNAME_LEN - 1] = '\0';
+    }
+    c->logged_in = 1;
+    c->uid = intern_id(INTERN_USERS, c->username);
+    idmap_put(&online, c->uid, c);
+    online_link(c);
+    group_user_online(c->uid);
+    PROBE2(user__login, c->conn_id, c->uid);
+}
+
+void client_logout(Client *c)
+{
+    if (c->logged_in)
+        PROBE2(user__logout, c->conn_id, c->uid);
+    // Kết nối cũ bị RESUME thay thế thì index đã trỏ sang kết nối mới
+    if (c->uid != INTERN_NONE && idmap_get(&online, c->uid) == c)
+    {
+        idmap_put(&online, c->uid, NULL);
+        group_user_offline(c->uid);
+    }
+    online_unlink(c);
+    c->logged_in = 0;
+    c->uid = INTERN_NONE;
+    c->username[0] = '\0';
+}
+
 void client_remove(Client *c)
 {
     if (c->fd != -1)
+    {
         close(c->fd); // Đóng socket tại đây
+        connected_count--;
+        capture_conn(CAPTURE_CLOSE, c->conn_id);
+    }
 
     // Reset thông tin
+    client_logout(c);
     c->fd = -1;
-    c->logged_in = 0;
+    c->conn_id = 0;
+    c->auth_pending = 0;
     c->inlen = 0;
     c->inbuf[0] = '\0';
-
-    c->username[0] = '\0';
 }
 
 int client_append_data(Client *c, const char *data, int len)
@@ -94,97 +214,105 @@ Client *client_by_fd(int fd)
     return NULL;
 }
 
+Client *client_at(int idx)
+{
+    if (idx < 0 || idx >= MAX_CLIENTS || clients[idx].fd == -1)
+        return NULL;
+    return &clients[idx];
+}
+
 Client *client_by_username(const char *username)
 {
-    for (int i = 0; i < MAX_CLIENTS; i++)
-    {
-        if (clients[i].fd != -1 && clients[i].logged_in &&
-            strcmp(clients[i].username, username) == 0)
-            return &clients[i];
-    }
-    return NULL;
+    return client_by_uid(intern_find(INTERN_USERS, username));
 }
 
-void clients_broadcast(const char *msg, Client *exclude)
+Client *client_by_uid(uint32_t uid)
 {
-    int len = strlen(msg);
-    for (int i = 0; i < MAX_CLIENTS; i++)
-    {
-        if (clients[i].fd != -1 && clients[i].logged_in && &clients[i] != exclude)
-        {
-            send(clients[i].fd, msg, len, 0);
-        }
-    }
+    return idmap_get(&online, uid);
 }
 
-int clients_broadcast_to_group(const char *msg, Client *sender, client_filter_cb filter, void *userdata)
+// Chỉ duyệt danh sách online, không quét mọi slot
+int clients_broadcast(const char *msg, Client *exclude)
 {
     int len = strlen(msg);
     int count = 0;
-    for (int i = 0; i < MAX_CLIENTS; i++)
+    for (Client *c = online_head; c; c = c->online_next)
     {
-        if (clients[i].fd != -1 && clients[i].logged_in && &clients[i] != sender)
+        if (c != exclude)
         {
-            // Kiểm tra xem client này có được nhận message không
-            if (filter && filter(clients[i].username, userdata))
-            {
-                send(clients[i].fd, msg, len, 0);
-                count++;
-            }
+            count++;
+            if (durable_hold(c->fd, msg, (size_t)len))
+                continue;
+            ssize_t n = send(c->fd, msg, len, 0);
+            if (n > 0)
+                metrics_add(METRIC_BYTES_OUT, (uint64_t)n);
+            slowlog_count_send();
         }
     }
     return count;
 }
 
-int clients_format_online(char *out, size_t outsz, Client *exclude)
+int clients_online_count()
 {
+    return online_count;
+}
+
+int clients_connected_count()
+{
+    return connected_count;
+}
+
+/*
+    Cursor = online_seq * MAX_CLIENTS + slot của user cuối trang trước. User đó còn online
+    thì đi tiếp từ nó (O(limit)); đã logout thì danh sách vẫn xếp theo online_seq nên
+    chỉ cần bỏ qua các user login trước nó: đi từ đầu danh sách, tối đa số user đang online
+    (<= MAX_CLIENTS bước), chỉ xảy ra khi user cuối trang logout giữa 2 lần gọi.
+    online_seq bắt đầu từ 1 nên cursor có seq 0 (< MAX_CLIENTS) là không hợp lệ: slot offline
+    cũng có online_seq 0, coi như khớp thì trả về trang rỗng. Trả lại từ trang đầu
+*/
+int clients_format_online(uint64_t cursor, int limit, char *out, size_t outsz, Client *exclude, uint64_t *next)
+{
+    *next = 0;
     if (!out || outsz == 0)
         return 0;
+    out[0] = '\0';
 
-    size_t used = 0;
-    int count = 0;
-
-    int n = snprintf(out + used, outsz - used, "=== Online users ===\n");
-    if (n < 0 || (size_t)n >= outsz - used)
+    Client *c = online_head;
+    uint64_t seq = cursor / MAX_CLIENTS;
+    if (seq != 0)
     {
-        out[0] = '\0';
-        return 0;
+        Client *last = &clients[cursor % MAX_CLIENTS];
+        if (last->online_seq == seq)
+            c = last->online_next;
+        else
+        {
+            while (c && c->online_seq <= seq)
+                c = c->online_next;
+        }
     }
-    used += (size_t)n;
 
-    for (int i = 0; i < MAX_CLIENTS; i++)
+    size_t used = 0;
+    int count = 0;
+    Client *last = NULL;
+    for (; c && count < limit; c = c->online_next)
     {
-        if (clients[i].fd != -1 &&
-            clients[i].logged_in &&
-            &clients[i] != exclude)
+        if (c == exclude)
+            continue;
+        int n = snprintf(out + used, outsz - used, "- %s\n", c->username);
+        if (n < 0 || (size_t)n >= outsz - used)
         {
-            count++;
-            n = snprintf(out + used, outsz - used, "- %s\n", clients[i].username);
-            if (n < 0)
-                break;
-
-            if ((size_t)n >= outsz - used)
-            {
-                const char *truncated = "...\n";
-                size_t tlen = strlen(truncated);
-                if (outsz - used > tlen)
-                {
-                    memcpy(out + used, truncated, tlen);
-                    out[used + tlen] = '\0';
-                }
-                else
-                {
-                    out[used] = '\0';
-                }
-                break;
-            }
-            used += (size_t)n;
+            out[used] = '\0';
+            break; // hết chỗ: dừng trang ở đây, trang sau đi tiếp từ user này
         }
+        used += (size_t)n;
+        count++;
+        last = c;
     }
 
-    n = snprintf(out + used, outsz - used, "Total: %d\n", count);
-    if (n < 0 || (size_t)n >= outsz - used)
-        out[used] = '\0';
-
+    // Còn user phía sau (không tính chính mình) thì trả cursor cho trang sau
+    while (c && c == exclude)
+        c = c->online_next;
+    if (c && last)
+        *next = last->online_seq * MAX_CLIENTS + (uint64_t)(last - clients);
     return count;
 }
@@ -8,17 +8,31 @@ void clients_init();
 int client_add(int fd);
 void client_remove(Client *c);
 Client *client_by_fd(int fd);
+Client *client_at(int idx); // NULL nếu slot trống
+
+// Khôi phục client nhận từ process cũ khi hot upgrade. Trả về index hoặc -1
+int client_restore(int fd, int logged_in, const char *username, const char *inbuf, int inlen);
+// Client khôi phục trước khi nạp store chưa có user ID, gọi sau khi WAL đã replay xong
+void clients_index_restored();
+
+// Gắn / gỡ user cho kết nối, giữ index user ID -> client
+void client_login(Client *c, const char *username);
+void client_logout(Client *c);
 
 int client_append_data(Client *c, const char *data, int len); // Trả về 0 nếu OK, -1 nếu buffer đầy
 int client_has_line(Client *c);
 char *client_pop_line(Client *c); // Trả về static buffer, phải dùng ngay
 
 Client *client_by_username(const char *username);
-void clients_broadcast(const char *msg, Client *exclude);
+Client *client_by_uid(uint32_t uid);
+int clients_broadcast(const char *msg, Client *exclude); // Gửi cho mọi client đang login, trả về số người nhận
 
-// Callback để kiểm tra xem username có được nhận message không
-typedef int (*client_filter_cb)(const char *username, void *userdata);
-int clients_broadcast_to_group(const char *msg, Client *sender, client_filter_cb filter, void *userdata);
+#define LIST_DEFAULT_PAGE 50
+#define LIST_MAX_PAGE 100
 
-int clients_format_online(char *out, size_t outsz, Client *exclude); // Trả về số user đang online
+int clients_online_count();
+int clients_connected_count(); // mọi kết nối, kể cả chưa login
+// 1 trang LIST: tối đa limit user login sau cursor (0 = từ đầu), chi phí O(limit).
+// Trả về số user trong trang, *next = cursor cho trang sau hoặc 0 nếu đã hết
+int clients_format_online(uint64_t cursor, int limit, char *out, size_t outsz, Client *exclude, uint64_t *next);
 #endif
@@ -0,0 +1,281 @@
+#include "sha256.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void transform(Sha256Ctx *ctx, const uint8_t *block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+    uint32_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t S1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + S1 + ch + K[i] + w[i];
+        uint32_t S0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = S0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+void sha256_init(Sha256Ctx *ctx)
+{
+    static const uint32_t H0[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(ctx->state, H0, sizeof(H0));
+    ctx->bitlen = 0;
+    ctx->buflen = 0;
+}
+
+void sha256_update(Sha256Ctx *ctx, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    ctx->bitlen += (uint64_t)len * 8;
+
+    if (ctx->buflen > 0)
+    {
+        size_t take = SHA256_BLOCK_LEN - ctx->buflen;
+        if (take > len)
+            take = len;
+        memcpy(ctx->buf + ctx->buflen, p, take);
+        ctx->buflen += take;
+        p += take;
+        len -= take;
+        if (ctx->buflen < SHA256_BLOCK_LEN)
+            return;
+        transform(ctx, ctx->buf);
+        ctx->buflen = 0;
+    }
+
+    while (len >= SHA256_BLOCK_LEN)
+    {
+        transform(ctx, p);
+        p += SHA256_BLOCK_LEN;
+        len -= SHA256_BLOCK_LEN;
+    }
+
+    memcpy(ctx->buf, p, len);
+    ctx->buflen = len;
+}
+
+void sha256_final(Sha256Ctx *ctx, uint8_t out[SHA256_DIGEST_LEN])
+{
+    uint64_t bitlen = ctx->bitlen;
+    uint8_t pad = 0x80;
+    sha256_update(ctx, &pad, 1);
+
+    uint8_t zero = 0;
+    while (ctx->buflen != 56)
+        sha256_update(ctx, &zero, 1);
+
+    uint8_t lenbuf[8];
+    for (int i = 0; i < 8; i++)
+        lenbuf[i] = (uint8_t)(bitlen >> (56 - i * 8));
+    sha256_update(ctx, lenbuf, 8);
+
+    for (int i = 0; i < 8; i++)
+    {
+        out[i * 4] = (uint8_t)(ctx->state[i] >> 24);
+        out[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+        out[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+        out[i * 4 + 3] = (uint8_t)ctx->state[i];
+    }
+}
+
+void hmac_sha256(const void *key, size_t keylen, const void *msg, size_t msglen,
+                 uint8_t out[SHA256_DIGEST_LEN])
+{
+    uint8_t k[SHA256_BLOCK_LEN] = {0};
+    if (keylen > SHA256_BLOCK_LEN)
+    {
+        Sha256Ctx kc;
+        sha256_init(&kc);
+        sha256_update(&kc, key, keylen);
+        sha256_final(&kc, k);
+    }
+    else
+    {
+        memcpy(k, key, keylen);
+    }
+
+    uint8_t ipad[SHA256_BLOCK_LEN], opad[SHA256_BLOCK_LEN];
+    for (int i = 0; i < SHA256_BLOCK_LEN; i++)
+    {
+        ipad[i] = k[i] ^ 0x36;
+        opad[i] = k[i] ^ 0x5c;
+    }
+
+    uint8_t inner[SHA256_DIGEST_LEN];
+    Sha256Ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, ipad, sizeof(ipad));
+    sha256_update(&ctx, msg, msglen);
+    sha256_final(&ctx, inner);
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, opad, sizeof(opad));
+    sha256_update(&ctx, inner, sizeof(inner));
+    sha256_final(&ctx, out);
+}
+
+void pbkdf2_hmac_sha256(const void *pass, size_t passlen, const void *salt, size_t saltlen,
+                        uint32_t iterations, uint8_t out[SHA256_DIGEST_LEN])
+{
+    uint8_t k[SHA256_BLOCK_LEN] = {0};
+    if (passlen > SHA256_BLOCK_LEN)
+    {
+        Sha256Ctx kc;
+        sha256_init(&kc);
+        sha256_update(&kc, pass, passlen);
+        sha256_final(&kc, k);
+    }
+    else
+    {
+        memcpy(k, pass, passlen);
+    }
+
+    // Tính sẵn trạng thái sau khi hash ipad/opad, mỗi vòng lặp chỉ còn 2 lần nén
+    uint8_t pad[SHA256_BLOCK_LEN];
+    Sha256Ctx inner0, outer0;
+    for (int i = 0; i < SHA256_BLOCK_LEN; i++)
+        pad[i] = k[i] ^ 0x36;
+    sha256_init(&inner0);
+    sha256_update(&inner0, pad, sizeof(pad));
+    for (int i = 0; i < SHA256_BLOCK_LEN; i++)
+        pad[i] = k[i] ^ 0x5c;
+    sha256_init(&outer0);
+    sha256_update(&outer0, pad, sizeof(pad));
+
+    // U1 = HMAC(P, salt || INT(1))
+    static const uint8_t block_index[4] = {0, 0, 0, 1};
+    uint8_t u[SHA256_DIGEST_LEN];
+    Sha256Ctx ctx = inner0;
+    sha256_update(&ctx, salt, saltlen);
+    sha256_update(&ctx, block_index, sizeof(block_index));
+    sha256_final(&ctx, u);
+    ctx = outer0;
+    sha256_update(&ctx, u, sizeof(u));
+    sha256_final(&ctx, u);
+    memcpy(out, u, SHA256_DIGEST_LEN);
+
+    for (uint32_t it = 1; it < iterations; it++)
+    {
+        ctx = inner0;
+        sha256_update(&ctx, u, sizeof(u));
+        sha256_final(&ctx, u);
+        ctx = outer0;
+        sha256_update(&ctx, u, sizeof(u));
+        sha256_final(&ctx, u);
+        for (int i = 0; i < SHA256_DIGEST_LEN; i++)
+            out[i] ^= u[i];
+    }
+}
+
+int crypto_equal(const void *a, const void *b, size_t len)
+{
+    const uint8_t *x = a, *y = b;
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; i++)
+        diff |= x[i] ^ y[i];
+    return diff == 0;
+}
+
+void crypto_hex_encode(const uint8_t *in, size_t n, char *out)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i * 2] = digits[in[i] >> 4];
+        out[i * 2 + 1] = digits[in[i] & 0x0f];
+    }
+    out[n * 2] = '\0';
+}
+
+static int hex_val(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+int crypto_hex_decode(const char *in, size_t inlen, uint8_t *out, size_t outsz)
+{
+    if (inlen % 2 != 0 || inlen / 2 > outsz)
+        return -1;
+    for (size_t i = 0; i < inlen / 2; i++)
+    {
+        int hi = hex_val(in[i * 2]), lo = hex_val(in[i * 2 + 1]);
+        if (hi < 0 || lo < 0)
+            return -1;
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return (int)(inlen / 2);
+}
+
+int crypto_random(void *out, size_t n)
+{
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    size_t got = 0;
+    while (got < n)
+    {
+        ssize_t r = read(fd, (uint8_t *)out + got, n - got);
+        if (r <= 0)
+        {
+            close(fd);
+            return -1;
+        }
+        got += (size_t)r;
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,40 @@
+// SHA-256 / HMAC-SHA256 tự cài đặt (không phụ thuộc OpenSSL)
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_LEN 32
+#define SHA256_BLOCK_LEN 64
+
+typedef struct
+{
+    uint32_t state[8];
+    uint64_t bitlen;
+    uint8_t buf[SHA256_BLOCK_LEN];
+    size_t buflen;
+} Sha256Ctx;
+
+void sha256_init(Sha256Ctx *ctx);
+void sha256_update(Sha256Ctx *ctx, const void *data, size_t len);
+void sha256_final(Sha256Ctx *ctx, uint8_t out[SHA256_DIGEST_LEN]);
+
+void hmac_sha256(const void *key, size_t keylen, const void *msg, size_t msglen,
+                 uint8_t out[SHA256_DIGEST_LEN]);
+
+// PBKDF2-HMAC-SHA256, chỉ sinh 1 block (32 byte) output
+void pbkdf2_hmac_sha256(const void *pass, size_t passlen, const void *salt, size_t saltlen,
+                        uint32_t iterations, uint8_t out[SHA256_DIGEST_LEN]);
+
+// So sánh thời gian hằng số (tránh timing attack khi kiểm tra MAC/hash)
+int crypto_equal(const void *a, const void *b, size_t len);
+
+// Hex helpers. out của encode cần 2n+1 byte; decode trả về số byte, -1 nếu sai format
+void crypto_hex_encode(const uint8_t *in, size_t n, char *out);
+int crypto_hex_decode(const char *in, size_t inlen, uint8_t *out, size_t outsz);
+
+// Đọc n byte ngẫu nhiên từ /dev/urandom. 0 nếu OK
+int crypto_random(void *out, size_t n);
+
+#endif
@@ -0,0 +1,151 @@
+#include "durable.h"
+#include "../metrics/metrics.h"
+#include "../slowlog/slowlog.h"
+#include "../wal/wal.h"
+
+typedef struct Held
+{
+    Client *client;
+    uint64_t conn_id; // client có thể đã ngắt kết nối và slot được dùng lại
+    uint64_t seq;     // gửi khi wal_committed_seq() >= seq
+    size_t len;
+    struct Held *next;
+    char data[];
+} Held;
+
+// Theo fd: số phần đang giữ của kết nối hiện tại trên fd đó
+typedef struct
+{
+    Client *client;
+    uint64_t conn_id;
+    int count;
+} FdHold;
+
+// FIFO theo thứ tự giữ, seq không giảm nên chỉ cần xét từ đầu
+static Held *head = NULL, *tail = NULL;
+static size_t held_bytes = 0;
+static FdHold *by_fd = NULL;
+static int by_fd_cap = 0;
+static DurableScope current = {NULL, 0};
+
+DurableScope durable_begin(Client *c, int since_start)
+{
+    DurableScope outer = current;
+    current.client = c;
+    current.since = since_start ? wal_appended_seq() : 0;
+    return outer;
+}
+
+void durable_end(DurableScope outer)
+{
+    current = outer;
+}
+
+static FdHold *fd_hold(int fd)
+{
+    if (fd < by_fd_cap)
+        return &by_fd[fd];
+    int cap = by_fd_cap ? by_fd_cap : 256;
+    while (cap <= fd)
+        cap *= 2;
+    FdHold *tmp = realloc(by_fd, (size_t)cap * sizeof(FdHold));
+    if (!tmp)
+        return NULL;
+    memset(tmp + by_fd_cap, 0, (size_t)(cap - by_fd_cap) * sizeof(FdHold));
+    by_fd = tmp;
+    by_fd_cap = cap;
+    return &by_fd[fd];
+}
+
+// Phần đang giữ trên fd còn thuộc kết nối hiện tại không (fd đóng rồi mở lại cho client khác)
+static int fd_has_held(int fd)
+{
+    if (fd < 0 || fd >= by_fd_cap || by_fd[fd].count == 0)
+        return 0;
+    FdHold *h = &by_fd[fd];
+    if (h->client->fd == fd && h->client->conn_id == h->conn_id)
+        return 1;
+    h->count = 0;
+    return 0;
+}
+
+int durable_hold(int fd, const char *data, size_t len)
+{
+    if (fd < 0)
+        return 0;
+    uint64_t seq = wal_appended_seq();
+    Client *c;
+    if (fd_has_held(fd))
+        c = by_fd[fd].client;
+    else if (current.client && current.client->fd == fd && seq > current.since && seq > wal_committed_seq())
+        c = current.client;
+    else
+        return 0;
+
+    FdHold *h = fd_hold(fd);
+    Held *item = malloc(sizeof(Held) + len);
+    if (!h || !item)
+    {
+        free(item);
+        return 0; // hết bộ nhớ: gửi luôn còn hơn mất trả lời
+    }
+    item->client = c;
+    item->conn_id = c->conn_id;
+    item->seq = seq;
+    item->len = len;
+    item->next = NULL;
+    memcpy(item->data, data, len);
+    if (tail)
+        tail->next = item;
+    else
+        head = item;
+    tail = item;
+    held_bytes += len;
+
+    h->client = c;
+    h->conn_id = c->conn_id;
+    h->count++;
+    return 1;
+}
+
+static void send_all(int fd, const char *data, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len)
+    {
+        ssize_t n = send(fd, data + sent, len - sent, 0);
+        if (n <= 0)
+            return;
+        sent += (size_t)n;
+        metrics_add(METRIC_BYTES_OUT, (uint64_t)n);
+        slowlog_count_send();
+    }
+}
+
+void durable_release()
+{
+    uint64_t committed = wal_committed_seq();
+    while (head && head->seq <= committed)
+    {
+        Held *item = head;
+        head = item->next;
+        if (!head)
+            tail = NULL;
+        held_bytes -= item->len;
+
+        Client *c = item->client;
+        if (c->fd != -1 && c->conn_id == item->conn_id)
+        {
+            send_all(c->fd, item->data, item->len);
+            FdHold *h = &by_fd[c->fd];
+            if (h->conn_id == item->conn_id && h->count > 0)
+                h->count--;
+        }
+        free(item);
+    }
+}
+
+size_t durable_held_bytes()
+{
+    return held_bytes;
+}
@@ -0,0 +1,38 @@
+// Trả lời của lệnh đã ghi WAL (REGISTER, ADDFRIEND, lưu tin offline, CREATEGROUP...) chỉ được gửi
+// sau khi lô WAL chứa record của nó đã fdatasync: client nhận OK thì thay đổi không mất dù mất điện.
+// 1 lần fdatasync của flusher trả lời cho mọi lệnh trong lô (group commit)
+#ifndef DURABLE_H
+#define DURABLE_H
+
+#include "../../common.h"
+
+/*
+    Trong lúc reactor chạy 1 lệnh của client c (durable_begin), dữ liệu gửi cho c sau khi lệnh đã
+    append record mà record đó chưa lên đĩa thì bị giữ lại, đánh dấu bằng seq của record cuối.
+    Khi c còn dữ liệu đang giữ, mọi thứ gửi cho c sau đó (trả lời các lệnh pipeline tiếp theo,
+    tin nhắn đẩy tới) xếp hàng phía sau để client nhận đúng thứ tự. Các lệnh sau của c vẫn chạy
+    ngay, không phải chờ đĩa
+*/
+
+typedef struct
+{
+    Client *client;
+    uint64_t since; // wal_appended_seq() lúc bắt đầu lệnh
+} DurableScope;
+
+// Bắt đầu phần chạy cho client c (lệnh, phần LOGIN / REGISTER xong ở worker, fan-out xong).
+// since_start = 0: giữ theo mọi record chưa lên đĩa, kể cả record append trước đó (fan-out nhiều lượt).
+// Trả về scope cũ để durable_end khôi phục (lệnh lồng nhau khi không có worker thread)
+DurableScope durable_begin(Client *c, int since_start);
+void durable_end(DurableScope outer);
+
+// Gọi trước mỗi lần gửi cho 1 client. 1 = đã giữ lại (caller không gửi), 0 = gửi ngay
+int durable_hold(int fd, const char *data, size_t len);
+
+// Gửi các phần đã giữ có record đã lên đĩa (khi wal_commit_fd readable, sau wal_sync)
+void durable_release();
+
+// Số byte đang giữ, cho STATS
+size_t durable_held_bytes();
+
+#endif
@@ -0,0 +1,110 @@
+#include "fanout.h"
+#include "../iostat/iostat.h"
+#include "../slowlog/slowlog.h"
+#include "../trace/trace.h"
+#include "../watchdog/watchdog.h"
+
+#include <stdlib.h>
+
+typedef struct FanoutTask
+{
+    uint32_t *uids;
+    int n, pos;
+    fanout_deliver_fn deliver;
+    fanout_done_fn done;
+    void *arg;
+    int traced; // submit trong 1 lệnh được lấy mẫu: các lượt sau cũng ghi span
+    int command; // I/O của các lượt sau tính vào lệnh đã submit (GROUPMSG)
+    struct FanoutTask *next;
+} FanoutTask;
+
+// FIFO: task sau chỉ bắt đầu khi task trước xong, giữ thứ tự tin nhắn trong hàng đợi offline
+static FanoutTask *head = NULL, *tail = NULL;
+static int npending = 0;
+static int chunk = FANOUT_CHUNK;
+
+void fanout_configure(int n)
+{
+    if (n > 0)
+        chunk = n;
+}
+
+int fanout_chunk()
+{
+    return chunk;
+}
+
+int fanout_submit(uint32_t *uids, int n, fanout_deliver_fn deliver, fanout_done_fn done, void *arg)
+{
+    FanoutTask *t = calloc(1, sizeof(FanoutTask));
+    if (!t)
+        return -1;
+    t->uids = uids;
+    t->n = n;
+    t->deliver = deliver;
+    t->done = done;
+    t->arg = arg;
+    t->traced = trace_thread_on;
+    t->command = iostat_command();
+
+    if (tail)
+        tail->next = t;
+    else
+        head = t;
+    tail = t;
+    npending++;
+    return 0;
+}
+
+int fanout_pending()
+{
+    return npending;
+}
+
+// 1 lượt fan-out cũng vào slow log / watchdog (tên FANOUT) để thấy group lớn chiếm reactor bao lâu
+void fanout_step()
+{
+    SlowlogCounters before = slowlog_counters;
+    watchdog_command("FANOUT", NULL);
+    uint64_t start = metrics_now_ns();
+    int budget = chunk;
+    while (head && budget > 0)
+    {
+        FanoutTask *t = head;
+        trace_set(t->traced);
+        iostat_set_command(t->command);
+        TraceSpan span = trace_begin("fanout", "fanout_step");
+        while (t->pos < t->n && budget > 0)
+        {
+            t->deliver(t->uids[t->pos++], t->arg);
+            budget--;
+        }
+        trace_end(&span, NULL);
+        if (t->pos < t->n)
+        {
+            trace_set(0);
+            iostat_set_command(-1);
+            break;
+        }
+
+        // Gỡ khỏi hàng đợi trước khi gọi done() (done có thể submit task mới)
+        head = t->next;
+        if (!head)
+            tail = NULL;
+        npending--;
+        if (t->done)
+            t->done(t->arg);
+        trace_set(0);
+        iostat_set_command(-1);
+        free(t->uids);
+        free(t);
+    }
+    slowlog_check("FANOUT", NULL, metrics_now_ns() - start, &before);
+    watchdog_command(NULL, NULL);
+}
+
+void fanout_drain()
+{
+    while (head)
+        fanout_step();
+}
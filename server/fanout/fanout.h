@@ -0,0 +1,24 @@
+// Fan-out lớn (tin nhắn group hàng chục nghìn member) chia thành nhiều lượt: mỗi vòng lặp
+// reactor chỉ giao cho tối đa FANOUT_CHUNK người nhận rồi quay lại phục vụ kết nối khác
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stdint.h>
+
+#define FANOUT_CHUNK 512
+
+// deliver() chạy cho từng người nhận, done() chạy 1 lần khi đã giao hết. Cả 2 trên reactor thread
+typedef void (*fanout_deliver_fn)(uint32_t uid, void *arg);
+typedef void (*fanout_done_fn)(void *arg);
+
+void fanout_configure(int chunk); // số người nhận mỗi lượt, <= 0 giữ mặc định
+int fanout_chunk();
+
+// Nhận luôn mảng uids (malloc). Task chạy theo thứ tự submit. 0 nếu OK, -1 nếu hết bộ nhớ
+int fanout_submit(uint32_t *uids, int n, fanout_deliver_fn deliver, fanout_done_fn done, void *arg);
+
+int fanout_pending(); // số task chưa xong, > 0 thì reactor không được ngủ trong poll
+void fanout_step();   // giao 1 lượt (tối đa FANOUT_CHUNK người nhận)
+void fanout_drain();  // giao hết mọi task (trước hot upgrade / khi thoát)
+
+#endif
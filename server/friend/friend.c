@@ -1,13 +1,37 @@
 #include "friend.h"
+#include "../auth/auth.h"
+#include "../intern/intern.h"
+#include "../trace/trace.h"
+#include "../util/idmap.h"
+#include "../wal/wal.h"
 
-#include <sys/file.h> // flock
-#include <fcntl.h>    // open
-#include <unistd.h>   // close, ftruncate
-#include <errno.h>
-
-#define ACCOUNTS_FILE "accounts.txt"
 #define FRIENDS_FILE "friends.txt"
 
+// Trạng thái cạnh nhìn từ phía chủ danh sách
+#define EDGE_FRIEND 1
+#define EDGE_OUTGOING 2 // mình đã gửi request, đang chờ
+#define EDGE_INCOMING 3 // người kia gửi request cho mình
+
+/*
+    State: mỗi user có 1 danh sách cạnh (theo thứ tự thêm vào), quan hệ giữa 2 người
+    được lưu ở cả 2 danh sách. Cạnh chỉ giữ user ID đã intern (8 byte/cạnh).
+    Mọi thay đổi ghi vào WAL trước rồi mới áp vào bộ nhớ
+*/
+
+typedef struct
+{
+    uint32_t other; // user ID
+    uint32_t state;
+} FriendEdge;
+
+typedef struct
+{
+    FriendEdge *items;
+    int n, cap;
+} FriendList;
+
+static IdMap friend_index; // user ID -> FriendList*
+
 // ---------- helpers ----------
 
 static int has_whitespace(const char *s)
@@ -23,306 +47,292 @@ static int has_whitespace(const char *s)
     return 0;
 }
 
-static void canon_pair(const char *a, const char *b, char *x, char *y)
+// Danh sách của user chưa đụng tới kể từ snapshot vẫn nằm trên mapping,
+// lần đầu truy cập thì chép ra RAM (chỉ danh sách của user đó)
+static FriendList *list_get(uint32_t user, int create)
 {
-    // x,y buffers size USERNAME_LEN
-    if (strcmp(a, b) <= 0)
+    FriendList *l = idmap_get(&friend_index, user);
+    if (l || user == INTERN_NONE)
+        return l;
+
+    SnapTable base;
+    const SnapEntry *e = NULL;
+    if (snap_table(SNAP_FRIENDS, &base) == 0)
+        e = snap_at(&base, user);
+    if ((!e || e->n == 0) && !create)
+        return NULL;
+
+    l = calloc(1, sizeof(FriendList));
+    if (!l)
+        return NULL;
+    if (e && e->n > 0)
     {
-        strncpy(x, a, USERNAME_LEN - 1);
-        x[USERNAME_LEN - 1] = '\0';
-        strncpy(y, b, USERNAME_LEN - 1);
-        y[USERNAME_LEN - 1] = '\0';
+        l->items = malloc(e->n * sizeof(FriendEdge));
+        if (!l->items)
+        {
+            free(l);
+            return NULL;
+        }
+        l->cap = (int)e->n;
+        for (uint32_t i = 0; i < e->n; i++)
+        {
+            const SnapPair *p = snap_item(&base, e->first + i);
+            if (!p)
+                break;
+            l->items[l->n].other = p->id;
+            l->items[l->n].state = p->value;
+            l->n++;
+        }
     }
-    else
+    if (idmap_put(&friend_index, user, l) != 0)
     {
-        strncpy(x, b, USERNAME_LEN - 1);
-        x[USERNAME_LEN - 1] = '\0';
-        strncpy(y, a, USERNAME_LEN - 1);
-        y[USERNAME_LEN - 1] = '\0';
+        free(l->items);
+        free(l);
+        return NULL;
     }
+    return l;
 }
 
-static int parse_friend_line(const char *line, char *a, char *b, char *st, size_t stsz)
+static FriendEdge *edge_find(uint32_t user, uint32_t other)
 {
-    // Expect: A|B|STATUS\n
-    // Copy to temp to strtok safely
-    char tmp[256];
-    strncpy(tmp, line, sizeof(tmp) - 1);
-    tmp[sizeof(tmp) - 1] = '\0';
-
-    char *p1 = strtok(tmp, "|");
-    char *p2 = strtok(NULL, "|");
-    char *p3 = strtok(NULL, "|\r\n");
-
-    if (!p1 || !p2 || !p3)
-        return 0;
-
-    strncpy(a, p1, USERNAME_LEN - 1);
-    a[USERNAME_LEN - 1] = '\0';
-    strncpy(b, p2, USERNAME_LEN - 1);
-    b[USERNAME_LEN - 1] = '\0';
-    strncpy(st, p3, stsz - 1);
-    st[stsz - 1] = '\0';
-    return 1;
+    FriendList *l = list_get(user, 0);
+    if (!l)
+        return NULL;
+    for (int i = 0; i < l->n; i++)
+    {
+        if (l->items[i].other == other)
+            return &l->items[i];
+    }
+    return NULL;
 }
 
-// ---------- accounts existence ----------
-
-int account_exists(const char *username)
+// Thêm cạnh vào cuối danh sách, không kiểm tra trùng
+static int edge_append(uint32_t user, uint32_t other, int state)
 {
-    if (has_whitespace(username))
-        return 0;
-    if ((int)strlen(username) <= 0 || (int)strlen(username) >= USERNAME_LEN)
-        return 0;
-
-    int fd = open(ACCOUNTS_FILE, O_RDONLY);
-    if (fd < 0)
-        return 0;
-
-    if (flock(fd, LOCK_SH) != 0)
+    FriendList *l = list_get(user, 1);
+    if (!l || other == INTERN_NONE)
+        return -1;
+    if (l->n >= l->cap)
     {
-        close(fd);
-        return 0;
+        int newcap = (l->cap == 0) ? 8 : l->cap * 2;
+        FriendEdge *tmp = realloc(l->items, newcap * sizeof(FriendEdge));
+        if (!tmp)
+            return -1;
+        l->items = tmp;
+        l->cap = newcap;
     }
 
-    FILE *f = fdopen(fd, "r");
-    if (!f)
+    l->items[l->n].other = other;
+    l->items[l->n].state = (uint32_t)state;
+    l->n++;
+    return 0;
+}
+
+static int edge_set(uint32_t user, uint32_t other, int state)
+{
+    FriendEdge *e = edge_find(user, other);
+    if (e)
     {
-        flock(fd, LOCK_UN);
-        close(fd);
+        e->state = (uint32_t)state;
         return 0;
     }
+    return edge_append(user, other, state);
+}
 
-    char u[USERNAME_LEN];
-    char p[128];
-
-    int found = 0;
-    while (fscanf(f, "%49s %127s", u, p) == 2)
+static void edge_remove(uint32_t user, uint32_t other)
+{
+    FriendList *l = list_get(user, 0);
+    if (!l)
+        return;
+    for (int i = 0; i < l->n; i++)
     {
-        if (strcmp(u, username) == 0)
+        if (l->items[i].other == other)
         {
-            found = 1;
-            break;
+            // Giữ thứ tự để FRIENDS/REQUESTS liệt kê theo thứ tự thêm vào
+            memmove(&l->items[i], &l->items[i + 1], (l->n - i - 1) * sizeof(FriendEdge));
+            l->n--;
+            return;
         }
     }
-
-    flock(fd, LOCK_UN);
-    fclose(f); // closes fd
-    return found;
 }
 
-// ---------- core friend ops (file-based, locked) ----------
-
-static int open_friends_locked(int flags, int lock_type, FILE **out_file, int *out_fd)
+static int edge_count(uint32_t user, const SnapTable *base)
 {
-    int fd = open(FRIENDS_FILE, flags, 0644);
-    if (fd < 0)
-        return 0;
+    FriendList *l = idmap_get(&friend_index, user);
+    if (l)
+        return l->n;
+    const SnapEntry *e = snap_at(base, user);
+    return e ? (int)e->n : 0;
+}
 
-    if (flock(fd, lock_type) != 0)
-    {
-        close(fd);
-        return 0;
-    }
+// WAL ghi tên để log tự mô tả, thao tác trên bộ nhớ dùng ID
+static int log_pair(int type, uint32_t a, uint32_t b)
+{
+    WalRecord rec;
+    wal_record_begin(&rec, type);
+    wal_record_str(&rec, intern_name(INTERN_USERS, a));
+    wal_record_str(&rec, intern_name(INTERN_USERS, b));
+    return wal_append(&rec);
+}
 
-    FILE *f = fdopen(fd, (flags & O_RDWR) ? "r+" : "r");
-    if (!f)
-    {
-        flock(fd, LOCK_UN);
-        close(fd);
-        return 0;
-    }
+// ---------- apply (dùng chung cho thao tác mới và replay WAL) ----------
 
-    *out_file = f;
-    *out_fd = fd;
-    return 1;
+static int apply_request(uint32_t from, uint32_t to)
+{
+    if (edge_set(from, to, EDGE_OUTGOING) != 0 || edge_set(to, from, EDGE_INCOMING) != 0)
+        return -1;
+    return 0;
 }
 
-static int rewrite_lines(FILE *f, int fd, char **lines, int nlines)
+static int apply_accept(uint32_t me, uint32_t from)
 {
-    // Truncate then rewrite
-    if (ftruncate(fd, 0) != 0)
-        return 0;
-    rewind(f);
-
-    for (int i = 0; i < nlines; i++)
-    {
-        if (fputs(lines[i], f) == EOF)
-            return 0;
-    }
-    if (fflush(f) != 0)
-        return 0;
-    return 1;
+    if (edge_set(me, from, EDGE_FRIEND) != 0 || edge_set(from, me, EDGE_FRIEND) != 0)
+        return -1;
+    return 0;
 }
 
-int friend_add_request(const char *from, const char *to)
+static int apply_remove(uint32_t a, uint32_t b)
 {
-    if (has_whitespace(from) || has_whitespace(to))
-        return FR_ERR;
-    if (strcmp(from, to) == 0)
-        return FR_ERR;
-    if (!account_exists(to))
-        return FR_NOT_FOUND;
+    edge_remove(a, b);
+    edge_remove(b, a);
+    return 0;
+}
 
-    FILE *f = NULL;
-    int fd = -1;
+static int replay_pair(WalReader *r, int (*apply)(uint32_t, uint32_t))
+{
+    char a[USERNAME_LEN], b[USERNAME_LEN];
+    if (wal_read_str(r, a, sizeof(a)) != 0 || wal_read_str(r, b, sizeof(b)) != 0)
+        return -1;
+    return apply(intern_id(INTERN_USERS, a), intern_id(INTERN_USERS, b));
+}
 
-    // Need read+write
-    if (!open_friends_locked(O_RDWR | O_CREAT, LOCK_EX, &f, &fd))
-        return FR_ERR;
+static int replay_request(WalReader *r) { return replay_pair(r, apply_request); }
+static int replay_accept(WalReader *r) { return replay_pair(r, apply_accept); }
+static int replay_remove(WalReader *r) { return replay_pair(r, apply_remove); }
 
-    // Read all lines
-    char **lines = NULL;
-    int cap = 0, n = 0;
+// Snapshot kiểu cũ (dãy record) chép nguyên từng danh sách (cả 2 phía) để giữ thứ tự
+static int replay_edge(WalReader *r)
+{
+    char user[USERNAME_LEN], other[USERNAME_LEN];
+    int64_t state;
+    if (wal_read_str(r, user, sizeof(user)) != 0 || wal_read_str(r, other, sizeof(other)) != 0 ||
+        wal_read_i64(r, &state) != 0)
+        return -1;
+    return edge_append(intern_id(INTERN_USERS, user), intern_id(INTERN_USERS, other), (int)state);
+}
 
-    char buf[256];
-    int already_friend = 0;
-    int already_pending = 0;
-    int incoming_pending = 0;
+static void snapshot_friends(SnapWriter *w)
+{
+    SnapTable base;
+    snap_table(SNAP_FRIENDS, &base);
 
-    char ca[USERNAME_LEN], cb[USERNAME_LEN], st[32];
-    char f1[USERNAME_LEN], f2[USERNAME_LEN];
-    canon_pair(from, to, f1, f2);
+    // Bảng theo ID chỉ cần dài tới user cuối cùng còn cạnh
+    uint32_t last = idmap_end(&friend_index) > base.count ? idmap_end(&friend_index) - 1 : base.count;
+    while (last > 0 && edge_count(last, &base) == 0)
+        last--;
 
-    rewind(f);
-    while (fgets(buf, sizeof(buf), f))
+    snap_table_begin(w, SNAP_FRIENDS, sizeof(SnapPair));
+    for (uint32_t uid = 1; uid <= last; uid++)
     {
-        // keep a copy
-        if (n >= cap)
+        snap_table_entry(w, NULL, 0);
+        FriendList *l = idmap_get(&friend_index, uid);
+        if (l)
         {
-            int newcap = (cap == 0) ? 32 : cap * 2;
-            char **tmp = (char **)realloc(lines, newcap * sizeof(char *));
-            if (!tmp)
+            for (int k = 0; k < l->n; k++)
             {
-                for (int i = 0; i < n; i++)
-                    free(lines[i]);
-                free(lines);
-                flock(fd, LOCK_UN);
-                fclose(f);
-                return FR_ERR;
+                SnapPair p = {l->items[k].other, l->items[k].state};
+                snap_table_item(w, &p);
             }
-            lines = tmp;
-            cap = newcap;
-        }
-        lines[n] = strdup(buf);
-        if (!lines[n])
-        {
-            for (int i = 0; i < n; i++)
-                free(lines[i]);
-            free(lines);
-            flock(fd, LOCK_UN);
-            fclose(f);
-            return FR_ERR;
+            continue;
         }
 
-        // analyze
-        if (parse_friend_line(buf, ca, cb, st, sizeof(st)))
+        // ID giữ nguyên giữa 2 snapshot nên item cũ chép thẳng
+        const SnapEntry *e = snap_at(&base, uid);
+        for (uint32_t k = 0; e && k < e->n; k++)
         {
-            if (strcmp(st, "FRIEND") == 0)
-            {
-                // compare canonical pair
-                char x[USERNAME_LEN], y[USERNAME_LEN];
-                canon_pair(ca, cb, x, y);
-                if (strcmp(x, f1) == 0 && strcmp(y, f2) == 0)
-                {
-                    already_friend = 1;
-                }
-            }
-            else if (strcmp(st, "PENDING") == 0)
-            {
-                // pending is directional: ca -> cb
-                if (strcmp(ca, from) == 0 && strcmp(cb, to) == 0)
-                    already_pending = 1;
-                if (strcmp(ca, to) == 0 && strcmp(cb, from) == 0)
-                    incoming_pending = 1;
-            }
+            const SnapPair *p = snap_item(&base, e->first + k);
+            if (p)
+                snap_table_item(w, p);
         }
-        n++;
     }
+    snap_table_end(w);
+}
 
-    if (already_friend)
-    {
-        for (int i = 0; i < n; i++)
-            free(lines[i]);
-        free(lines);
-        flock(fd, LOCK_UN);
-        fclose(f);
-        return FR_ALREADY_FRIEND;
-    }
-    if (already_pending)
-    {
-        for (int i = 0; i < n; i++)
-            free(lines[i]);
-        free(lines);
-        flock(fd, LOCK_UN);
-        fclose(f);
-        return FR_ALREADY_PENDING;
-    }
-    if (incoming_pending)
-    {
-        for (int i = 0; i < n; i++)
-            free(lines[i]);
-        free(lines);
-        flock(fd, LOCK_UN);
-        fclose(f);
-        return FR_INCOMING_PENDING;
-    }
+void friend_init()
+{
+    wal_register_handler(WAL_FRIEND_REQUEST, replay_request);
+    wal_register_handler(WAL_FRIEND_ACCEPT, replay_accept);
+    wal_register_handler(WAL_FRIEND_REJECT, replay_remove);
+    wal_register_handler(WAL_FRIEND_UNFRIEND, replay_remove);
+    wal_register_handler(WAL_FRIEND_EDGE, replay_edge);
+    wal_register_snapshot(snapshot_friends);
+}
 
-    // Append new pending line
-    char newline[USERNAME_LEN * 2 + 20];
-    int nn = snprintf(newline, sizeof(newline), "%s|%s|PENDING\n", from, to);
-    if (nn < 0 || (size_t)nn >= sizeof(newline))
-    {
-        for (int i = 0; i < n; i++)
-            free(lines[i]);
-        free(lines);
-        flock(fd, LOCK_UN);
-        fclose(f);
-        return FR_ERR;
-    }
+int friend_import_legacy()
+{
+    FILE *f = fopen(FRIENDS_FILE, "r");
+    if (!f)
+        return 0;
 
-    if (n >= cap)
+    // Format cũ: A|B|STATUS\n (FRIEND: cặp chuẩn hóa, PENDING: A gửi cho B)
+    char buf[256];
+    int count = 0;
+    while (fgets(buf, sizeof(buf), f))
     {
-        int newcap = (cap == 0) ? 32 : cap * 2;
-        char **tmp = (char **)realloc(lines, newcap * sizeof(char *));
-        if (!tmp)
+        char a[USERNAME_LEN], b[USERNAME_LEN], st[32];
+        if (sscanf(buf, "%49[^|]|%49[^|]|%31[^|\r\n]", a, b, st) != 3)
+            continue;
+
+        uint32_t ua = intern_id(INTERN_USERS, a), ub = intern_id(INTERN_USERS, b);
+        if (strcmp(st, "FRIEND") == 0)
         {
-            for (int i = 0; i < n; i++)
-                free(lines[i]);
-            free(lines);
-            flock(fd, LOCK_UN);
-            fclose(f);
-            return FR_ERR;
+            if (apply_accept(ua, ub) == 0 && log_pair(WAL_FRIEND_ACCEPT, ua, ub) == 0)
+                count++;
+        }
+        else if (strcmp(st, "PENDING") == 0)
+        {
+            if (apply_request(ua, ub) == 0 && log_pair(WAL_FRIEND_REQUEST, ua, ub) == 0)
+                count++;
         }
-        lines = tmp;
-        cap = newcap;
-    }
-    lines[n] = strdup(newline);
-    if (!lines[n])
-    {
-        for (int i = 0; i < n; i++)
-            free(lines[i]);
-        free(lines);
-        flock(fd, LOCK_UN);
-        fclose(f);
-        return FR_ERR;
     }
-    n++;
+    fclose(f);
 
-    int ok = rewrite_lines(f, fd, lines, n);
+    rename(FRIENDS_FILE, FRIENDS_FILE ".migrated");
+    return count;
+}
 
-    for (int i = 0; i < n; i++)
-        free(lines[i]);
-    free(lines);
+// ---------- core friend ops ----------
 
-    flock(fd, LOCK_UN);
-    fclose(f);
+int friend_add_request(const char *from, const char *to)
+{
+    TRACE_SCOPE("friend", "friend_add_request");
+    if (has_whitespace(from) || has_whitespace(to))
+        return FR_ERR;
+    if (strcmp(from, to) == 0)
+        return FR_ERR;
+    if (!account_exists(to))
+        return FR_NOT_FOUND;
+
+    uint32_t uf = intern_find(INTERN_USERS, from), ut = intern_find(INTERN_USERS, to);
+    if (uf == INTERN_NONE)
+        return FR_ERR;
 
-    return ok ? FR_OK : FR_ERR;
+    FriendEdge *e = edge_find(uf, ut);
+    if (e && e->state == EDGE_FRIEND)
+        return FR_ALREADY_FRIEND;
+    if (e && e->state == EDGE_OUTGOING)
+        return FR_ALREADY_PENDING;
+    if (e && e->state == EDGE_INCOMING)
+        return FR_INCOMING_PENDING;
+
+    if (log_pair(WAL_FRIEND_REQUEST, uf, ut) != 0)
+        return FR_ERR;
+    return apply_request(uf, ut) == 0 ? FR_OK : FR_ERR;
 }
 
 int friend_accept_request(const char *me, const char *from)
 {
+    TRACE_SCOPE("friend", "friend_accept_request");
     if (has_whitespace(me) || has_whitespace(from))
         return FR_ERR;
     if (strcmp(me, from) == 0)
@@ -330,115 +340,21 @@ int friend_accept_request(const char *me, const char *from)
     if (!account_exists(from))
         return FR_NOT_FOUND;
 
-    FILE *f = NULL;
-    int fd = -1;
-    if (!open_friends_locked(O_RDWR | O_CREAT, LOCK_EX, &f, &fd))
-        return FR_ERR;
-
-    char **lines = NULL;
-    int cap = 0, n = 0;
-
-    char buf[256];
-    int found_pending = 0;
-    int already_friend = 0;
-
-    char ca[USERNAME_LEN], cb[USERNAME_LEN], st[32];
-
-    char f1[USERNAME_LEN], f2[USERNAME_LEN];
-    canon_pair(me, from, f1, f2);
-
-    rewind(f);
-    while (fgets(buf, sizeof(buf), f))
-    {
-        if (n >= cap)
-        {
-            int newcap = (cap == 0) ? 32 : cap * 2;
-            char **tmp = (char **)realloc(lines, newcap * sizeof(char *));
-            if (!tmp)
-            {
-                for (int i = 0; i < n; i++)
-                    free(lines[i]);
-                free(lines);
-                flock(fd, LOCK_UN);
-                fclose(f);
-                return FR_ERR;
-            }
-            lines = tmp;
-            cap = newcap;
-        }
-
-        char *line_to_add = NULL;
-        // check
-        if (parse_friend_line(buf, ca, cb, st, sizeof(st)))
-        {
-            if (strcmp(st, "FRIEND") == 0)
-            {
-                char x[USERNAME_LEN], y[USERNAME_LEN];
-                canon_pair(ca, cb, x, y);
-                if (strcmp(x, f1) == 0 && strcmp(y, f2) == 0)
-                    already_friend = 1;
-                line_to_add = strdup(buf);
-            }
-            else if (strcmp(st, "PENDING") == 0)
-            {
-                if (strcmp(ca, from) == 0 && strcmp(cb, me) == 0)
-                {
-                    found_pending = 1;
-                    // Replace this line with FRIEND canonical
-                    char newl[USERNAME_LEN * 2 + 20];
-                    snprintf(newl, sizeof(newl), "%s|%s|FRIEND\n", f1, f2);
-                    line_to_add = strdup(newl);
-                }
-                else
-                {
-                    line_to_add = strdup(buf);
-                }
-            }
-            else
-            {
-                line_to_add = strdup(buf);
-            }
-        }
-        else
-        {
-            line_to_add = strdup(buf); // keep unparsed as-is
-        }
-
-        if (!line_to_add)
-        {
-            for (int i = 0; i < n; i++)
-                free(lines[i]);
-            free(lines);
-            flock(fd, LOCK_UN);
-            fclose(f);
-            return FR_ERR;
-        }
-        lines[n] = line_to_add;
-        n++;
-    }
-
-    int rc;
-    if (already_friend)
-        rc = FR_ALREADY_FRIEND;
-    else if (!found_pending)
-        rc = FR_NOT_FOUND;
-    else
-    {
-        int ok = rewrite_lines(f, fd, lines, n);
-        rc = ok ? FR_OK : FR_ERR;
-    }
-
-    for (int i = 0; i < n; i++)
-        free(lines[i]);
-    free(lines);
+    uint32_t um = intern_find(INTERN_USERS, me), uf = intern_find(INTERN_USERS, from);
+    FriendEdge *e = edge_find(um, uf);
+    if (e && e->state == EDGE_FRIEND)
+        return FR_ALREADY_FRIEND;
+    if (!e || e->state != EDGE_INCOMING)
+        return FR_NOT_FOUND;
 
-    flock(fd, LOCK_UN);
-    fclose(f);
-    return rc;
+    if (log_pair(WAL_FRIEND_ACCEPT, um, uf) != 0)
+        return FR_ERR;
+    return apply_accept(um, uf) == 0 ? FR_OK : FR_ERR;
 }
 
 int friend_reject_request(const char *me, const char *from)
 {
+    TRACE_SCOPE("friend", "friend_reject_request");
     if (has_whitespace(me) || has_whitespace(from))
         return FR_ERR;
     if (strcmp(me, from) == 0)
@@ -446,85 +362,19 @@ int friend_reject_request(const char *me, const char *from)
     if (!account_exists(from))
         return FR_NOT_FOUND;
 
-    FILE *f = NULL;
-    int fd = -1;
-    if (!open_friends_locked(O_RDWR | O_CREAT, LOCK_EX, &f, &fd))
-        return FR_ERR;
-
-    char **lines = NULL;
-    int cap = 0, n = 0;
-
-    char buf[256];
-    int removed = 0;
-
-    char ca[USERNAME_LEN], cb[USERNAME_LEN], st[32];
-
-    rewind(f);
-    while (fgets(buf, sizeof(buf), f))
-    {
-        int drop = 0;
-        if (parse_friend_line(buf, ca, cb, st, sizeof(st)))
-        {
-            if (strcmp(st, "PENDING") == 0 &&
-                strcmp(ca, from) == 0 &&
-                strcmp(cb, me) == 0)
-            {
-                drop = 1;
-                removed = 1;
-            }
-        }
-        if (drop)
-            continue;
-
-        if (n >= cap)
-        {
-            int newcap = (cap == 0) ? 32 : cap * 2;
-            char **tmp = (char **)realloc(lines, newcap * sizeof(char *));
-            if (!tmp)
-            {
-                for (int i = 0; i < n; i++)
-                    free(lines[i]);
-                free(lines);
-                flock(fd, LOCK_UN);
-                fclose(f);
-                return FR_ERR;
-            }
-            lines = tmp;
-            cap = newcap;
-        }
-        lines[n] = strdup(buf);
-        if (!lines[n])
-        {
-            for (int i = 0; i < n; i++)
-                free(lines[i]);
-            free(lines);
-            flock(fd, LOCK_UN);
-            fclose(f);
-            return FR_ERR;
-        }
-        n++;
-    }
-
-    int rc;
-    if (!removed)
-        rc = FR_NOT_FOUND;
-    else
-    {
-        int ok = rewrite_lines(f, fd, lines, n);
-        rc = ok ? FR_OK : FR_ERR;
-    }
-
-    for (int i = 0; i < n; i++)
-        free(lines[i]);
-    free(lines);
+    uint32_t um = intern_find(INTERN_USERS, me), uf = intern_find(INTERN_USERS, from);
+    FriendEdge *e = edge_find(um, uf);
+    if (!e || e->state != EDGE_INCOMING)
+        return FR_NOT_FOUND;
 
-    flock(fd, LOCK_UN);
-    fclose(f);
-    return rc;
+    if (log_pair(WAL_FRIEND_REJECT, um, uf) != 0)
+        return FR_ERR;
+    return apply_remove(um, uf) == 0 ? FR_OK : FR_ERR;
 }
 
 int friend_unfriend(const char *me, const char *other)
 {
+    TRACE_SCOPE("friend", "friend_unfriend");
     if (has_whitespace(me) || has_whitespace(other))
         return FR_ERR;
     if (strcmp(me, other) == 0)
@@ -532,151 +382,53 @@ int friend_unfriend(const char *me, const char *other)
     if (!account_exists(other))
         return FR_NOT_FOUND;
 
-    FILE *f = NULL;
-    int fd = -1;
-    if (!open_friends_locked(O_RDWR | O_CREAT, LOCK_EX, &f, &fd))
-        return FR_ERR;
-
-    char **lines = NULL;
-    int cap = 0, n = 0;
-
-    char buf[256];
-    int removed = 0;
-
-    char ca[USERNAME_LEN], cb[USERNAME_LEN], st[32];
-    char f1[USERNAME_LEN], f2[USERNAME_LEN];
-    canon_pair(me, other, f1, f2);
-
-    rewind(f);
-    while (fgets(buf, sizeof(buf), f))
-    {
-        int drop = 0;
-
-        if (parse_friend_line(buf, ca, cb, st, sizeof(st)))
-        {
-            /* 1) Xóa FRIEND giữa me và other */
-            if (strcmp(st, "FRIEND") == 0)
-            {
-                char x[USERNAME_LEN], y[USERNAME_LEN];
-                canon_pair(ca, cb, x, y);
-                if (strcmp(x, f1) == 0 && strcmp(y, f2) == 0)
-                {
-                    drop = 1;
-                    removed = 1;
-                }
-            }
-            /* 2) Xóa mọi PENDING giữa 2 người (2 chiều) */
-            else if (strcmp(st, "PENDING") == 0)
-            {
-                if ((strcmp(ca, me) == 0 && strcmp(cb, other) == 0) ||
-                    (strcmp(ca, other) == 0 && strcmp(cb, me) == 0))
-                {
-                    drop = 1;
-                    removed = 1;
-                }
-            }
-        }
-
-        if (drop)
-            continue;
+    // Xóa FRIEND hoặc mọi PENDING giữa 2 người (2 chiều)
+    uint32_t um = intern_find(INTERN_USERS, me), uo = intern_find(INTERN_USERS, other);
+    if (!edge_find(um, uo))
+        return FR_NOT_FOUND; // không có quan hệ gì để xóa
 
-        /* Giữ lại dòng */
-        if (n >= cap)
-        {
-            int newcap = (cap == 0) ? 32 : cap * 2;
-            char **tmp = realloc(lines, newcap * sizeof(char *));
-            if (!tmp)
-            {
-                for (int i = 0; i < n; i++)
-                    free(lines[i]);
-                free(lines);
-                flock(fd, LOCK_UN);
-                fclose(f);
-                return FR_ERR;
-            }
-            lines = tmp;
-            cap = newcap;
-        }
+    if (log_pair(WAL_FRIEND_UNFRIEND, um, uo) != 0)
+        return FR_ERR;
+    return apply_remove(um, uo) == 0 ? FR_OK : FR_ERR;
+}
 
-        lines[n] = strdup(buf);
-        if (!lines[n])
-        {
-            for (int i = 0; i < n; i++)
-                free(lines[i]);
-            free(lines);
-            flock(fd, LOCK_UN);
-            fclose(f);
-            return FR_ERR;
-        }
-        n++;
-    }
+// ---------- listing ----------
 
-    int rc;
-    if (!removed)
-    {
-        rc = FR_NOT_FOUND; // không có quan hệ gì để xóa
-    }
-    else
+void friend_foreach_friend(const char *me, friend_callback callback, void *userdata)
+{
+    TRACE_SCOPE("friend", "friend_foreach_friend");
+    FriendList *l = list_get(intern_find(INTERN_USERS, me), 0);
+    for (int i = 0; l && i < l->n; i++)
     {
-        int ok = rewrite_lines(f, fd, lines, n);
-        rc = ok ? FR_OK : FR_ERR;
+        if (l->items[i].state == EDGE_FRIEND)
+            callback(l->items[i].other, userdata);
     }
-
-    for (int i = 0; i < n; i++)
-        free(lines[i]);
-    free(lines);
-
-    flock(fd, LOCK_UN);
-    fclose(f);
-    return rc;
 }
 
-// ---------- listing ----------
-
 int friend_format_friends(const char *me,
                           int (*is_online)(const char *username),
                           char *out, size_t outsz)
 {
+    TRACE_SCOPE("friend", "friend_format_friends");
     if (!out || outsz == 0)
         return 0;
     out[0] = '\0';
 
-    FILE *f = NULL;
-    int fd = -1;
-    if (!open_friends_locked(O_RDONLY | O_CREAT, LOCK_SH, &f, &fd))
-        return 0;
-
     size_t used = 0;
     int count = 0;
 
     int n = snprintf(out + used, outsz - used, "=== Friends ===\n");
     if (n < 0 || (size_t)n >= outsz - used)
-    {
-        flock(fd, LOCK_UN);
-        fclose(f);
         return 0;
-    }
     used += (size_t)n;
 
-    char buf[256];
-    char a[USERNAME_LEN], b[USERNAME_LEN], st[32];
-
-    rewind(f);
-    while (fgets(buf, sizeof(buf), f))
+    FriendList *l = list_get(intern_find(INTERN_USERS, me), 0);
+    for (int i = 0; l && i < l->n; i++)
     {
-        if (!parse_friend_line(buf, a, b, st, sizeof(st)))
-            continue;
-        if (strcmp(st, "FRIEND") != 0)
-            continue;
-
-        const char *other = NULL;
-        if (strcmp(a, me) == 0)
-            other = b;
-        else if (strcmp(b, me) == 0)
-            other = a;
-        else
+        if (l->items[i].state != EDGE_FRIEND)
             continue;
 
+        const char *other = intern_name(INTERN_USERS, l->items[i].other);
         const char *status = (is_online && is_online(other)) ? "ONLINE" : "OFFLINE";
 
         n = snprintf(out + used, outsz - used, "- %s (%s)\n", other, status);
@@ -703,50 +455,32 @@ int friend_format_friends(const char *me,
         out[used] = '\0';
     }
 
-    flock(fd, LOCK_UN);
-    fclose(f);
     return count;
 }
 
 int friend_format_requests(const char *me, char *out, size_t outsz)
 {
+    TRACE_SCOPE("friend", "friend_format_requests");
     if (!out || outsz == 0)
         return 0;
     out[0] = '\0';
 
-    FILE *f = NULL;
-    int fd = -1;
-    if (!open_friends_locked(O_RDONLY | O_CREAT, LOCK_SH, &f, &fd))
-        return 0;
-
     size_t used = 0;
     int count = 0;
 
     int n = snprintf(out + used, outsz - used, "=== Friend requests ===\n");
     if (n < 0 || (size_t)n >= outsz - used)
-    {
-        flock(fd, LOCK_UN);
-        fclose(f);
         return 0;
-    }
     used += (size_t)n;
 
-    char buf[256];
-    char a[USERNAME_LEN], b[USERNAME_LEN], st[32];
-
-    rewind(f);
-    while (fgets(buf, sizeof(buf), f))
+    // Chỉ hiện các request gửi tới mình
+    FriendList *l = list_get(intern_find(INTERN_USERS, me), 0);
+    for (int i = 0; l && i < l->n; i++)
     {
-        if (!parse_friend_line(buf, a, b, st, sizeof(st)))
-            continue;
-        if (strcmp(st, "PENDING") != 0)
+        if (l->items[i].state != EDGE_INCOMING)
             continue;
 
-        // request a -> b, show only those sent to me (b==me)
-        if (strcmp(b, me) != 0)
-            continue;
-
-        n = snprintf(out + used, outsz - used, "- from %s\n", a);
+        n = snprintf(out + used, outsz - used, "- from %s\n", intern_name(INTERN_USERS, l->items[i].other));
         if (n < 0)
             break;
         if ((size_t)n >= outsz - used)
@@ -769,7 +503,5 @@ int friend_format_requests(const char *me, char *out, size_t outsz)
         out[used] = '\0';
     }
 
-    flock(fd, LOCK_UN);
-    fclose(f);
     return count;
 }
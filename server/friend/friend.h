@@ -11,7 +11,10 @@
 #define FR_ALREADY_PENDING -4
 #define FR_INCOMING_PENDING -5 // target đã gửi request cho mình
 
-int account_exists(const char *username);
+// Tạo index bạn bè in-memory và đăng ký handler replay WAL
+void friend_init();
+// Lần đầu chạy với WAL: nạp friends.txt kiểu cũ vào WAL. Trả về số quan hệ
+int friend_import_legacy();
 
 // Friend ops
 int friend_add_request(const char *from, const char *to);
@@ -27,4 +30,8 @@ int friend_format_friends(const char *me,
 int friend_format_requests(const char *me,
                            char *out, size_t outsz);
 
+// Duyệt user ID của các bạn bè (đã accept), dùng để đẩy presence
+typedef void (*friend_callback)(uint32_t uid, void *userdata);
+void friend_foreach_friend(const char *me, friend_callback callback, void *userdata);
+
 #endif
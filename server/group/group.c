@@ -1,21 +1,79 @@
 #include "group.h"
 #include "../auth/auth.h"
-
-#include <sys/file.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <time.h>
+#include "../idgen/idgen.h"
+#include "../intern/intern.h"
+#include "../trace/trace.h"
+#include "../util/idmap.h"
+#include "../wal/wal.h"
 
 #define GROUPS_FILE "groups.txt"
 #define GROUP_MEMBERS_FILE "group_members.txt"
-#define GROUP_ID_LEN 16
+#define GROUP_NAME_LEN 128
+
+#define ROLE_OWNER 1
+#define ROLE_MEMBER 2
+
+/*
+    State: group ID -> Group (danh sách member theo thứ tự tham gia)
+           user ID -> danh sách group của user (LISTGROUPS / kiểm tra membership)
+    Member / membership chỉ giữ ID đã intern (8 byte mỗi bản ghi).
+    Tạo group chỉ là 1 record WAL nên group và owner luôn được ghi cùng nhau.
+    Group / danh sách group của user chưa đụng tới kể từ snapshot vẫn nằm trên mapping,
+    lần đầu truy cập mới chép ra RAM.
+    Member đang online của mỗi group giữ riêng trong OnlineSet (chỉ trong RAM), cập nhật khi
+    login / logout / thêm / bớt member để fan-out chỉ duyệt người đang online
+*/
+
+typedef struct
+{
+    uint32_t user; // user ID
+    uint32_t role;
+} GroupMember;
+
+typedef struct
+{
+    char name[GROUP_NAME_LEN];
+    GroupMember *members;
+    int n, cap;
+} Group;
+
+typedef struct
+{
+    uint32_t gid; // group ID
+    uint32_t role;
+    int online_pos; // vị trí của user trong OnlineSet của group, -1 khi offline
+} UserGroupRef;
+
+typedef struct
+{
+    UserGroupRef *items;
+    int n, cap;
+} UserGroups;
+
+// Member đang online của 1 group, thứ tự bất kỳ (xóa = đổi chỗ với phần tử cuối)
+typedef struct
+{
+    uint32_t *users;
+    int n, cap;
+} OnlineSet;
+
+static IdMap groups;       // group ID -> Group*
+static IdMap user_groups;  // user ID -> UserGroups*
+static IdMap group_online; // group ID -> OnlineSet*, chỉ group từng có member online
+static IdMap online_users; // user ID -> (void *)1 khi đang online
 
 // ---------- helpers ----------
 
 static void generate_group_id(char *id, size_t size)
 {
-    // Simple ID: timestamp + random
-    snprintf(id, size, "G%ld%03d", (long)time(NULL), rand() % 1000);
+    snprintf(id, size, "G%llu", (unsigned long long)idgen_next());
+}
+
+// Group ID đã có (kể cả dạng cũ G<time><rand>) đưa vào idgen để ID cấp sau luôn lớn hơn
+static void observe_group_id(const char *gid)
+{
+    if (gid[0] == 'G')
+        idgen_observe(strtoull(gid + 1, NULL, 10));
 }
 
 static int has_whitespace(const char *s)
@@ -31,490 +89,651 @@ static int has_whitespace(const char *s)
     return 0;
 }
 
-static int open_file_locked(const char *filename, int flags, int lock_type, FILE **out_file, int *out_fd)
+static const char *role_name(int role)
 {
-    int fd = open(filename, flags, 0644);
-    if (fd < 0)
-        return 0;
+    return role == ROLE_OWNER ? "OWNER" : "MEMBER";
+}
+
+// Entry của group trong snapshot, NULL nếu group không có ở đó (aux = 0)
+static const SnapEntry *base_group(uint32_t gid, SnapTable *base)
+{
+    if (snap_table(SNAP_GROUPS, base) != 0)
+        return NULL;
+    const SnapEntry *e = snap_at(base, gid);
+    return e && e->aux ? e : NULL;
+}
 
-    if (flock(fd, lock_type) != 0)
+static Group *group_get(uint32_t gid)
+{
+    Group *g = idmap_get(&groups, gid);
+    if (g || gid == INTERN_NONE)
+        return g;
+
+    SnapTable base;
+    const SnapEntry *e = base_group(gid, &base);
+    if (!e)
+        return NULL;
+
+    g = calloc(1, sizeof(Group));
+    if (!g)
+        return NULL;
+    strncpy(g->name, snap_str(&base, e->aux), GROUP_NAME_LEN - 1);
+    if (e->n > 0 && !(g->members = malloc(e->n * sizeof(GroupMember))))
     {
-        close(fd);
-        return 0;
+        free(g);
+        return NULL;
     }
-
-    FILE *f = fdopen(fd, (flags & O_RDWR) ? "r+" : "r");
-    if (!f)
+    g->cap = (int)e->n;
+    for (uint32_t i = 0; i < e->n; i++)
     {
-        flock(fd, LOCK_UN);
-        close(fd);
-        return 0;
+        const SnapPair *p = snap_item(&base, e->first + i);
+        if (!p)
+            break;
+        g->members[g->n].user = p->id;
+        g->members[g->n].role = p->value;
+        g->n++;
     }
 
-    *out_file = f;
-    *out_fd = fd;
-    return 1;
+    if (idmap_put(&groups, gid, g) != 0)
+    {
+        free(g->members);
+        free(g);
+        return NULL;
+    }
+    return g;
 }
 
-// ---------- group_create ----------
-
-int group_create(const char *creator, const char *group_name, char *out_group_id, size_t id_size)
+// Chỉ cần tên thì đọc thẳng từ mapping, không chép cả danh sách member
+static const char *lookup_name(uint32_t gid)
 {
-    if (has_whitespace(creator) || !group_name || strlen(group_name) == 0)
-        return GR_ERR;
+    Group *g = idmap_get(&groups, gid);
+    if (g)
+        return g->name;
 
-    if (strlen(group_name) > 100)
-        return GR_ERR;
-
-    // Check if creator exists
-    if (!account_exists(creator))
-        return GR_NOT_FOUND;
+    SnapTable base;
+    const SnapEntry *e = base_group(gid, &base);
+    return e ? snap_str(&base, e->aux) : NULL;
+}
 
-    FILE *fg = NULL;
-    int fdg = -1;
-    if (!open_file_locked(GROUPS_FILE, O_RDWR | O_CREAT | O_APPEND, LOCK_EX, &fg, &fdg))
-        return GR_ERR;
+static int group_exists(const char *group_id)
+{
+    return lookup_name(intern_find(INTERN_GROUPS, group_id)) != NULL;
+}
 
-    FILE *fm = NULL;
-    int fdm = -1;
-    if (!open_file_locked(GROUP_MEMBERS_FILE, O_RDWR | O_CREAT | O_APPEND, LOCK_EX, &fm, &fdm))
+static UserGroups *user_groups_get(uint32_t user, int create)
+{
+    UserGroups *ug = idmap_get(&user_groups, user);
+    if (ug || user == INTERN_NONE)
+        return ug;
+
+    SnapTable base;
+    const SnapEntry *e = NULL;
+    if (snap_table(SNAP_USER_GROUPS, &base) == 0)
+        e = snap_at(&base, user);
+    if ((!e || e->n == 0) && !create)
+        return NULL;
+
+    ug = calloc(1, sizeof(UserGroups));
+    if (!ug)
+        return NULL;
+    if (e && e->n > 0)
     {
-        flock(fdg, LOCK_UN);
-        fclose(fg);
-        return GR_ERR;
+        ug->items = malloc(e->n * sizeof(UserGroupRef));
+        if (!ug->items)
+        {
+            free(ug);
+            return NULL;
+        }
+        ug->cap = (int)e->n;
+        for (uint32_t i = 0; i < e->n; i++)
+        {
+            const SnapPair *p = snap_item(&base, e->first + i);
+            if (!p)
+                break;
+            ug->items[ug->n].gid = p->id;
+            ug->items[ug->n].role = p->value;
+            ug->items[ug->n].online_pos = -1;
+            ug->n++;
+        }
     }
 
-    // Generate unique group ID
-    char gid[GROUP_ID_LEN];
-    generate_group_id(gid, sizeof(gid));
-
-    // Write to groups.txt: group_id|group_name|creator
-    if (fprintf(fg, "%s|%s|%s\n", gid, group_name, creator) < 0)
+    if (idmap_put(&user_groups, user, ug) != 0)
     {
-        flock(fdm, LOCK_UN);
-        fclose(fm);
-        flock(fdg, LOCK_UN);
-        fclose(fg);
-        return GR_ERR;
+        free(ug->items);
+        free(ug);
+        return NULL;
     }
+    return ug;
+}
 
-    if (fflush(fg) != 0)
+static GroupMember *member_find(Group *g, uint32_t user)
+{
+    for (int i = 0; g && i < g->n; i++)
     {
-        flock(fdm, LOCK_UN);
-        fclose(fm);
-        flock(fdg, LOCK_UN);
-        fclose(fg);
-        return GR_ERR;
+        if (g->members[i].user == user)
+            return &g->members[i];
     }
+    return NULL;
+}
 
-    // Add creator as OWNER in group_members.txt: group_id|username|OWNER
-    if (fprintf(fm, "%s|%s|OWNER\n", gid, creator) < 0)
+static UserGroupRef *user_ref_find(uint32_t user, uint32_t gid)
+{
+    UserGroups *ug = user_groups_get(user, 0);
+    for (int i = 0; ug && i < ug->n; i++)
     {
-        flock(fdm, LOCK_UN);
-        fclose(fm);
-        flock(fdg, LOCK_UN);
-        fclose(fg);
-        return GR_ERR;
+        if (ug->items[i].gid == gid)
+            return &ug->items[i];
     }
+    return NULL;
+}
 
-    if (fflush(fm) != 0)
-    {
-        flock(fdm, LOCK_UN);
-        fclose(fm);
-        flock(fdg, LOCK_UN);
-        fclose(fg);
-        return GR_ERR;
-    }
+// WAL ghi tên để log tự mô tả, thao tác trên bộ nhớ dùng ID
+static int log_create(const char *gid, const char *name, const char *owner)
+{
+    WalRecord rec;
+    wal_record_begin(&rec, WAL_GROUP_CREATE);
+    wal_record_str(&rec, gid);
+    wal_record_str(&rec, name);
+    wal_record_str(&rec, owner);
+    return wal_append(&rec);
+}
 
-    // Copy group ID to output
-    strncpy(out_group_id, gid, id_size - 1);
-    out_group_id[id_size - 1] = '\0';
+static int log_member(int type, uint32_t gid, uint32_t user, int role)
+{
+    WalRecord rec;
+    wal_record_begin(&rec, type);
+    wal_record_str(&rec, intern_name(INTERN_GROUPS, gid));
+    wal_record_str(&rec, intern_name(INTERN_USERS, user));
+    if (type == WAL_GROUP_ADD_MEMBER)
+        wal_record_i64(&rec, role);
+    return wal_append(&rec);
+}
 
-    flock(fdm, LOCK_UN);
-    fclose(fm);
-    flock(fdg, LOCK_UN);
-    fclose(fg);
+// ---------- apply (dùng chung cho thao tác mới và replay WAL) ----------
 
-    return GR_OK;
-}
+static int push_member(Group *g, uint32_t user, int role)
+{
+    if (g->n >= g->cap)
+    {
+        int newcap = (g->cap == 0) ? 8 : g->cap * 2;
+        GroupMember *tmp = realloc(g->members, newcap * sizeof(GroupMember));
+        if (!tmp)
+            return -1;
+        g->members = tmp;
+        g->cap = newcap;
+    }
 
-// ---------- group_add_member ----------
+    GroupMember *m = &g->members[g->n++];
+    m->user = user;
+    m->role = (uint32_t)role;
+    return 0;
+}
 
-int group_add_member(const char *group_id, const char *username, const char *added_by)
+static int push_user_ref(uint32_t user, uint32_t gid, int role)
 {
-    if (has_whitespace(group_id) || has_whitespace(username) || has_whitespace(added_by))
-        return GR_ERR;
+    UserGroups *ug = user_groups_get(user, 1);
+    if (!ug || gid == INTERN_NONE)
+        return -1;
 
-    if (!account_exists(username))
-        return GR_NOT_FOUND;
+    if (ug->n >= ug->cap)
+    {
+        int newcap = (ug->cap == 0) ? 4 : ug->cap * 2;
+        UserGroupRef *tmp = realloc(ug->items, newcap * sizeof(UserGroupRef));
+        if (!tmp)
+            return -1;
+        ug->items = tmp;
+        ug->cap = newcap;
+    }
 
-    FILE *fm = NULL;
-    int fdm = -1;
-    if (!open_file_locked(GROUP_MEMBERS_FILE, O_RDWR | O_CREAT, LOCK_EX, &fm, &fdm))
-        return GR_ERR;
+    UserGroupRef *ref = &ug->items[ug->n++];
+    ref->gid = gid;
+    ref->role = (uint32_t)role;
+    ref->online_pos = -1;
+    return 0;
+}
 
-    // Check if added_by is OWNER
-    char buf[256];
-    int is_owner = 0;
-    int already_member = 0;
+// ---------- member online ----------
+
+static void online_add(uint32_t gid, UserGroupRef *ref, uint32_t user)
+{
+    if (ref->online_pos >= 0)
+        return;
 
-    rewind(fm);
-    while (fgets(buf, sizeof(buf), fm))
+    OnlineSet *set = idmap_get(&group_online, gid);
+    if (!set)
     {
-        char gid[GROUP_ID_LEN], user[USERNAME_LEN], role[16];
-        if (sscanf(buf, "%15[^|]|%49[^|]|%15s", gid, user, role) == 3)
+        set = calloc(1, sizeof(OnlineSet));
+        if (!set || idmap_put(&group_online, gid, set) != 0)
         {
-            if (strcmp(gid, group_id) == 0)
-            {
-                if (strcmp(user, added_by) == 0 && strcmp(role, "OWNER") == 0)
-                    is_owner = 1;
-                if (strcmp(user, username) == 0)
-                    already_member = 1;
-            }
+            free(set);
+            return;
         }
     }
-
-    if (!is_owner)
+    if (set->n >= set->cap)
     {
-        flock(fdm, LOCK_UN);
-        fclose(fm);
-        return GR_NOT_OWNER;
+        int newcap = (set->cap == 0) ? 8 : set->cap * 2;
+        uint32_t *tmp = realloc(set->users, newcap * sizeof(uint32_t));
+        if (!tmp)
+            return;
+        set->users = tmp;
+        set->cap = newcap;
     }
+    ref->online_pos = set->n;
+    set->users[set->n++] = user;
+}
 
-    if (already_member)
+static void online_remove(uint32_t gid, UserGroupRef *ref)
+{
+    OnlineSet *set = idmap_get(&group_online, gid);
+    if (ref->online_pos < 0 || !set)
+        return;
+
+    // Đưa phần tử cuối vào chỗ trống rồi sửa vị trí đã lưu của user đó
+    int pos = ref->online_pos;
+    uint32_t moved = set->users[--set->n];
+    ref->online_pos = -1;
+    if (pos < set->n)
     {
-        flock(fdm, LOCK_UN);
-        fclose(fm);
-        return GR_ALREADY_MEMBER;
+        set->users[pos] = moved;
+        UserGroupRef *mref = user_ref_find(moved, gid);
+        if (mref)
+            mref->online_pos = pos;
     }
+}
+
+static int apply_add_member(uint32_t gid, uint32_t user, int role)
+{
+    Group *g = group_get(gid);
+    if (!g || user == INTERN_NONE || member_find(g, user))
+        return -1;
+    if (push_member(g, user, role) != 0 || push_user_ref(user, gid, role) != 0)
+        return -1;
+    if (idmap_get(&online_users, user))
+        online_add(gid, user_ref_find(user, gid), user);
+    return 0;
+}
 
-    // Append new member
-    fseek(fm, 0, SEEK_END);
-    if (fprintf(fm, "%s|%s|MEMBER\n", group_id, username) < 0)
+static int apply_remove_member(uint32_t gid, uint32_t user)
+{
+    Group *g = group_get(gid);
+    GroupMember *m = member_find(g, user);
+    if (!m)
+        return -1;
+    int idx = (int)(m - g->members);
+    memmove(&g->members[idx], &g->members[idx + 1], (g->n - idx - 1) * sizeof(GroupMember));
+    g->n--;
+
+    UserGroups *ug = user_groups_get(user, 0);
+    UserGroupRef *ref = user_ref_find(user, gid);
+    if (ug && ref)
     {
-        flock(fdm, LOCK_UN);
-        fclose(fm);
-        return GR_ERR;
+        online_remove(gid, ref);
+        idx = (int)(ref - ug->items);
+        memmove(&ug->items[idx], &ug->items[idx + 1], (ug->n - idx - 1) * sizeof(UserGroupRef));
+        ug->n--;
     }
+    return 0;
+}
 
-    if (fflush(fm) != 0)
+static int apply_create(const char *group_id, const char *name, const char *owner)
+{
+    uint32_t gid = intern_id(INTERN_GROUPS, group_id);
+    if (gid == INTERN_NONE || lookup_name(gid))
+        return -1;
+    observe_group_id(group_id);
+
+    Group *g = calloc(1, sizeof(Group));
+    if (!g)
+        return -1;
+    strncpy(g->name, name, GROUP_NAME_LEN - 1);
+
+    if (idmap_put(&groups, gid, g) != 0)
     {
-        flock(fdm, LOCK_UN);
-        fclose(fm);
-        return GR_ERR;
+        free(g);
+        return -1;
     }
 
-    flock(fdm, LOCK_UN);
-    fclose(fm);
-    return GR_OK;
+    if (owner[0] != '\0')
+        return apply_add_member(gid, intern_id(INTERN_USERS, owner), ROLE_OWNER);
+    return 0;
 }
 
-// ---------- group_remove_member ----------
+static int replay_create(WalReader *r)
+{
+    char gid[GROUP_ID_LEN], name[GROUP_NAME_LEN], owner[USERNAME_LEN];
+    if (wal_read_str(r, gid, sizeof(gid)) != 0 || wal_read_str(r, name, sizeof(name)) != 0 ||
+        wal_read_str(r, owner, sizeof(owner)) != 0)
+        return -1;
+    return apply_create(gid, name, owner);
+}
 
-int group_remove_member(const char *group_id, const char *username, const char *removed_by)
+static int replay_add_member(WalReader *r)
 {
-    if (has_whitespace(group_id) || has_whitespace(username) || has_whitespace(removed_by))
-        return GR_ERR;
+    char gid[GROUP_ID_LEN], user[USERNAME_LEN];
+    int64_t role;
+    if (wal_read_str(r, gid, sizeof(gid)) != 0 || wal_read_str(r, user, sizeof(user)) != 0 ||
+        wal_read_i64(r, &role) != 0)
+        return -1;
+    return apply_add_member(intern_find(INTERN_GROUPS, gid), intern_id(INTERN_USERS, user), (int)role);
+}
 
-    // Cannot remove owner
-    if (strcmp(username, removed_by) == 0)
-        return GR_ERR; // Use LEAVE instead
+static int replay_remove_member(WalReader *r)
+{
+    char gid[GROUP_ID_LEN], user[USERNAME_LEN];
+    if (wal_read_str(r, gid, sizeof(gid)) != 0 || wal_read_str(r, user, sizeof(user)) != 0)
+        return -1;
+    return apply_remove_member(intern_find(INTERN_GROUPS, gid), intern_find(INTERN_USERS, user));
+}
 
-    FILE *fm = NULL;
-    int fdm = -1;
-    if (!open_file_locked(GROUP_MEMBERS_FILE, O_RDWR | O_CREAT, LOCK_EX, &fm, &fdm))
-        return GR_ERR;
+// Snapshot kiểu cũ (dãy record) chép nguyên danh sách member của group và danh sách group
+// của user để giữ thứ tự
+static int replay_snapshot_ref(WalReader *r, int by_group)
+{
+    char a[USERNAME_LEN], b[USERNAME_LEN];
+    int64_t role;
+    if (wal_read_str(r, a, sizeof(a)) != 0 || wal_read_str(r, b, sizeof(b)) != 0 ||
+        wal_read_i64(r, &role) != 0)
+        return -1;
+    if (!by_group)
+        return push_user_ref(intern_id(INTERN_USERS, a), intern_id(INTERN_GROUPS, b), (int)role);
+
+    Group *g = group_get(intern_find(INTERN_GROUPS, a));
+    uint32_t user = intern_id(INTERN_USERS, b);
+    return g && user != INTERN_NONE ? push_member(g, user, (int)role) : -1;
+}
 
-    char **lines = NULL;
-    int cap = 0, n = 0;
-    char buf[256];
-    int is_owner = 0;
-    int found_member = 0;
+static int replay_group_member(WalReader *r) { return replay_snapshot_ref(r, 1); }
+static int replay_user_group(WalReader *r) { return replay_snapshot_ref(r, 0); }
 
-    rewind(fm);
-    while (fgets(buf, sizeof(buf), fm))
+// Phần chưa chép ra RAM thì chép nguyên item từ snapshot cũ (ID giữ nguyên giữa 2 snapshot)
+static void copy_base_pairs(SnapWriter *w, const SnapTable *base, const SnapEntry *e)
+{
+    for (uint32_t k = 0; e && k < e->n; k++)
     {
-        char gid[GROUP_ID_LEN], user[USERNAME_LEN], role[16];
-        int drop = 0;
+        const SnapPair *p = snap_item(base, e->first + k);
+        if (p)
+            snap_table_item(w, p);
+    }
+}
 
-        if (sscanf(buf, "%15[^|]|%49[^|]|%15s", gid, user, role) == 3)
-        {
-            if (strcmp(gid, group_id) == 0)
-            {
-                if (strcmp(user, removed_by) == 0 && strcmp(role, "OWNER") == 0)
-                    is_owner = 1;
-
-                // Don't remove owner
-                if (strcmp(user, username) == 0 && strcmp(role, "OWNER") != 0)
-                {
-                    drop = 1;
-                    found_member = 1;
-                }
-            }
-        }
+static uint32_t last_id(const IdMap *heap, const SnapTable *base)
+{
+    return idmap_end(heap) > base->count ? idmap_end(heap) - 1 : base->count;
+}
 
-        if (drop)
-            continue;
+static int ref_count(uint32_t user, const SnapTable *base)
+{
+    UserGroups *ug = idmap_get(&user_groups, user);
+    if (ug)
+        return ug->n;
+    const SnapEntry *e = snap_at(base, user);
+    return e ? (int)e->n : 0;
+}
 
-        if (n >= cap)
+static void snapshot_groups(SnapWriter *w)
+{
+    SnapTable base;
+
+    snap_table(SNAP_GROUPS, &base);
+    uint32_t last = last_id(&groups, &base);
+    while (last > 0 && !lookup_name(last))
+        last--;
+    snap_table_begin(w, SNAP_GROUPS, sizeof(SnapPair));
+    for (uint32_t gid = 1; gid <= last; gid++)
+    {
+        Group *g = idmap_get(&groups, gid);
+        if (!g)
         {
-            int newcap = (cap == 0) ? 32 : cap * 2;
-            char **tmp = realloc(lines, newcap * sizeof(char *));
-            if (!tmp)
-            {
-                for (int i = 0; i < n; i++)
-                    free(lines[i]);
-                free(lines);
-                flock(fdm, LOCK_UN);
-                fclose(fm);
-                return GR_ERR;
-            }
-            lines = tmp;
-            cap = newcap;
+            const SnapEntry *e = base_group(gid, &base);
+            snap_table_entry(w, NULL, e ? snap_string(w, snap_str(&base, e->aux)) : 0);
+            copy_base_pairs(w, &base, e);
+            continue;
         }
 
-        lines[n] = strdup(buf);
-        if (!lines[n])
+        snap_table_entry(w, NULL, snap_string(w, g->name));
+        for (int k = 0; k < g->n; k++)
+        {
+            SnapPair p = {g->members[k].user, g->members[k].role};
+            snap_table_item(w, &p);
+        }
+    }
+    snap_table_end(w);
+
+    snap_table(SNAP_USER_GROUPS, &base);
+    last = last_id(&user_groups, &base);
+    while (last > 0 && ref_count(last, &base) == 0)
+        last--;
+    snap_table_begin(w, SNAP_USER_GROUPS, sizeof(SnapPair));
+    for (uint32_t uid = 1; uid <= last; uid++)
+    {
+        snap_table_entry(w, NULL, 0);
+        UserGroups *ug = idmap_get(&user_groups, uid);
+        if (!ug)
+        {
+            copy_base_pairs(w, &base, snap_at(&base, uid));
+            continue;
+        }
+        for (int k = 0; k < ug->n; k++)
         {
-            for (int i = 0; i < n; i++)
-                free(lines[i]);
-            free(lines);
-            flock(fdm, LOCK_UN);
-            fclose(fm);
-            return GR_ERR;
+            SnapPair p = {ug->items[k].gid, ug->items[k].role};
+            snap_table_item(w, &p);
         }
-        n++;
     }
+    snap_table_end(w);
+}
 
-    int rc;
-    if (!is_owner)
-        rc = GR_NOT_OWNER;
-    else if (!found_member)
-        rc = GR_NOT_MEMBER;
-    else
+void group_init()
+{
+    wal_register_handler(WAL_GROUP_CREATE, replay_create);
+    wal_register_handler(WAL_GROUP_ADD_MEMBER, replay_add_member);
+    wal_register_handler(WAL_GROUP_REMOVE_MEMBER, replay_remove_member);
+    wal_register_handler(WAL_GROUP_MEMBER, replay_group_member);
+    wal_register_handler(WAL_USER_GROUP, replay_user_group);
+    wal_register_snapshot(snapshot_groups);
+}
+
+int group_import_legacy()
+{
+    int count = 0;
+    char buf[256];
+
+    // groups.txt: group_id|group_name|creator (owner nằm ở group_members.txt)
+    FILE *fg = fopen(GROUPS_FILE, "r");
+    if (fg)
     {
-        // Rewrite file
-        if (ftruncate(fdm, 0) != 0)
+        while (fgets(buf, sizeof(buf), fg))
         {
-            for (int i = 0; i < n; i++)
-                free(lines[i]);
-            free(lines);
-            flock(fdm, LOCK_UN);
-            fclose(fm);
-            return GR_ERR;
+            char gid[GROUP_ID_LEN], name[GROUP_NAME_LEN];
+            if (sscanf(buf, "%15[^|]|%127[^|]|", gid, name) != 2)
+                continue;
+            if (apply_create(gid, name, "") == 0 && log_create(gid, name, "") == 0)
+                count++;
         }
-        rewind(fm);
-        for (int i = 0; i < n; i++)
+        fclose(fg);
+        rename(GROUPS_FILE, GROUPS_FILE ".migrated");
+    }
+
+    // group_members.txt: group_id|username|ROLE
+    FILE *fm = fopen(GROUP_MEMBERS_FILE, "r");
+    if (fm)
+    {
+        while (fgets(buf, sizeof(buf), fm))
         {
-            if (fputs(lines[i], fm) == EOF)
-            {
-                for (int j = 0; j < n; j++)
-                    free(lines[j]);
-                free(lines);
-                flock(fdm, LOCK_UN);
-                fclose(fm);
-                return GR_ERR;
-            }
+            char gid[GROUP_ID_LEN], user[USERNAME_LEN], role[16];
+            if (sscanf(buf, "%15[^|]|%49[^|]|%15s", gid, user, role) != 3)
+                continue;
+
+            // Member của group không có trong groups.txt (tạo group cũ bị ghi dở)
+            if (!group_exists(gid) && apply_create(gid, "Unknown", "") == 0)
+                log_create(gid, "Unknown", "");
+
+            int r = strcmp(role, "OWNER") == 0 ? ROLE_OWNER : ROLE_MEMBER;
+            uint32_t g = intern_find(INTERN_GROUPS, gid), u = intern_id(INTERN_USERS, user);
+            if (apply_add_member(g, u, r) == 0)
+                log_member(WAL_GROUP_ADD_MEMBER, g, u, r);
         }
-        fflush(fm);
-        rc = GR_OK;
+        fclose(fm);
+        rename(GROUP_MEMBERS_FILE, GROUP_MEMBERS_FILE ".migrated");
     }
+    return count;
+}
+
+// ---------- group_create ----------
+
+int group_create(const char *creator, const char *group_name, char *out_group_id, size_t id_size)
+{
+    TRACE_SCOPE("group", "group_create");
+    if (has_whitespace(creator) || !group_name || strlen(group_name) == 0)
+        return GR_ERR;
+
+    if (strlen(group_name) > 100)
+        return GR_ERR;
+
+    // Check if creator exists
+    if (!account_exists(creator))
+        return GR_NOT_FOUND;
+
+    // ID Snowflake không trùng trong cùng process, kiểm tra thêm phòng node ID cấu hình trùng
+    char gid[GROUP_ID_LEN];
+    generate_group_id(gid, sizeof(gid));
+    if (group_exists(gid))
+        return GR_ERR;
 
-    for (int i = 0; i < n; i++)
-        free(lines[i]);
-    free(lines);
+    // 1 record duy nhất cho cả group + owner
+    if (log_create(gid, group_name, creator) != 0)
+        return GR_ERR;
+    if (apply_create(gid, group_name, creator) != 0)
+        return GR_ERR;
 
-    flock(fdm, LOCK_UN);
-    fclose(fm);
-    return rc;
+    // Copy group ID to output
+    strncpy(out_group_id, gid, id_size - 1);
+    out_group_id[id_size - 1] = '\0';
+
+    return GR_OK;
 }
 
-// ---------- group_leave ----------
+// ---------- group_add_member ----------
 
-int group_leave(const char *group_id, const char *username)
+int group_add_member(const char *group_id, const char *username, const char *added_by)
 {
-    if (has_whitespace(group_id) || has_whitespace(username))
+    TRACE_SCOPE("group", "group_add_member");
+    if (has_whitespace(group_id) || has_whitespace(username) || has_whitespace(added_by))
         return GR_ERR;
 
-    FILE *fm = NULL;
-    int fdm = -1;
-    if (!open_file_locked(GROUP_MEMBERS_FILE, O_RDWR | O_CREAT, LOCK_EX, &fm, &fdm))
+    if (!account_exists(username))
+        return GR_NOT_FOUND;
+
+    // Check if added_by is OWNER
+    uint32_t gid = intern_find(INTERN_GROUPS, group_id), user = intern_find(INTERN_USERS, username);
+    Group *g = group_get(gid);
+    GroupMember *owner = member_find(g, intern_find(INTERN_USERS, added_by));
+    if (!owner || owner->role != ROLE_OWNER)
+        return GR_NOT_OWNER;
+
+    if (member_find(g, user))
+        return GR_ALREADY_MEMBER;
+
+    if (log_member(WAL_GROUP_ADD_MEMBER, gid, user, ROLE_MEMBER) != 0)
         return GR_ERR;
+    return apply_add_member(gid, user, ROLE_MEMBER) == 0 ? GR_OK : GR_ERR;
+}
 
-    char **lines = NULL;
-    int cap = 0, n = 0;
-    char buf[256];
-    int found = 0;
+// ---------- group_remove_member ----------
 
-    rewind(fm);
-    while (fgets(buf, sizeof(buf), fm))
-    {
-        char gid[GROUP_ID_LEN], user[USERNAME_LEN], role[16];
-        int drop = 0;
+int group_remove_member(const char *group_id, const char *username, const char *removed_by)
+{
+    TRACE_SCOPE("group", "group_remove_member");
+    if (has_whitespace(group_id) || has_whitespace(username) || has_whitespace(removed_by))
+        return GR_ERR;
 
-        if (sscanf(buf, "%15[^|]|%49[^|]|%15s", gid, user, role) == 3)
-        {
-            if (strcmp(gid, group_id) == 0 && strcmp(user, username) == 0)
-            {
-                drop = 1;
-                found = 1;
-            }
-        }
+    // Cannot remove owner
+    if (strcmp(username, removed_by) == 0)
+        return GR_ERR; // Use LEAVE instead
 
-        if (drop)
-            continue;
+    uint32_t gid = intern_find(INTERN_GROUPS, group_id), user = intern_find(INTERN_USERS, username);
+    Group *g = group_get(gid);
+    GroupMember *owner = member_find(g, intern_find(INTERN_USERS, removed_by));
+    if (!owner || owner->role != ROLE_OWNER)
+        return GR_NOT_OWNER;
 
-        if (n >= cap)
-        {
-            int newcap = (cap == 0) ? 32 : cap * 2;
-            char **tmp = realloc(lines, newcap * sizeof(char *));
-            if (!tmp)
-            {
-                for (int i = 0; i < n; i++)
-                    free(lines[i]);
-                free(lines);
-                flock(fdm, LOCK_UN);
-                fclose(fm);
-                return GR_ERR;
-            }
-            lines = tmp;
-            cap = newcap;
-        }
+    // Don't remove owner
+    GroupMember *m = member_find(g, user);
+    if (!m || m->role == ROLE_OWNER)
+        return GR_NOT_MEMBER;
 
-        lines[n] = strdup(buf);
-        if (!lines[n])
-        {
-            for (int i = 0; i < n; i++)
-                free(lines[i]);
-            free(lines);
-            flock(fdm, LOCK_UN);
-            fclose(fm);
-            return GR_ERR;
-        }
-        n++;
-    }
+    if (log_member(WAL_GROUP_REMOVE_MEMBER, gid, user, 0) != 0)
+        return GR_ERR;
+    return apply_remove_member(gid, user) == 0 ? GR_OK : GR_ERR;
+}
 
-    int rc;
-    if (!found)
-        rc = GR_NOT_MEMBER;
-    else
-    {
-        if (ftruncate(fdm, 0) != 0)
-        {
-            for (int i = 0; i < n; i++)
-                free(lines[i]);
-            free(lines);
-            flock(fdm, LOCK_UN);
-            fclose(fm);
-            return GR_ERR;
-        }
-        rewind(fm);
-        for (int i = 0; i < n; i++)
-        {
-            fputs(lines[i], fm);
-        }
-        fflush(fm);
-        rc = GR_OK;
-    }
+// ---------- group_leave ----------
+
+int group_leave(const char *group_id, const char *username)
+{
+    TRACE_SCOPE("group", "group_leave");
+    if (has_whitespace(group_id) || has_whitespace(username))
+        return GR_ERR;
 
-    for (int i = 0; i < n; i++)
-        free(lines[i]);
-    free(lines);
+    uint32_t gid = intern_find(INTERN_GROUPS, group_id), user = intern_find(INTERN_USERS, username);
+    if (!user_ref_find(user, gid))
+        return GR_NOT_MEMBER;
 
-    flock(fdm, LOCK_UN);
-    fclose(fm);
-    return rc;
+    if (log_member(WAL_GROUP_REMOVE_MEMBER, gid, user, 0) != 0)
+        return GR_ERR;
+    return apply_remove_member(gid, user) == 0 ? GR_OK : GR_ERR;
 }
 
 // ---------- group_check_member ----------
 
 int group_check_member(const char *group_id, const char *username)
 {
+    TRACE_SCOPE("group", "group_check_member");
     if (has_whitespace(group_id) || has_whitespace(username))
         return 0;
 
-    FILE *fm = NULL;
-    int fdm = -1;
-    if (!open_file_locked(GROUP_MEMBERS_FILE, O_RDONLY, LOCK_SH, &fm, &fdm))
-        return 0;
-
-    char buf[256];
-    int is_member = 0;
-
-    rewind(fm);
-    while (fgets(buf, sizeof(buf), fm))
-    {
-        char gid[GROUP_ID_LEN], user[USERNAME_LEN];
-        if (sscanf(buf, "%15[^|]|%49[^|]|", gid, user) == 2)
-        {
-            if (strcmp(gid, group_id) == 0 && strcmp(user, username) == 0)
-            {
-                is_member = 1;
-                break;
-            }
-        }
-    }
-
-    flock(fdm, LOCK_UN);
-    fclose(fm);
-    return is_member;
+    // Duyệt danh sách group của user (thường ngắn hơn nhiều so với danh sách member)
+    uint32_t gid = intern_find(INTERN_GROUPS, group_id);
+    return gid != INTERN_NONE && user_ref_find(intern_find(INTERN_USERS, username), gid) != NULL;
 }
 
 // ---------- group_list_members ----------
 
 int group_list_members(const char *group_id, char *out, size_t outsz)
 {
+    TRACE_SCOPE("group", "group_list_members");
     if (!out || outsz == 0)
         return 0;
     out[0] = '\0';
 
-    FILE *fm = NULL;
-    int fdm = -1;
-    if (!open_file_locked(GROUP_MEMBERS_FILE, O_RDONLY, LOCK_SH, &fm, &fdm))
-        return 0;
-
     size_t used = 0;
     int count = 0;
 
     int n = snprintf(out + used, outsz - used, "=== Group Members ===\n");
     if (n < 0 || (size_t)n >= outsz - used)
-    {
-        flock(fdm, LOCK_UN);
-        fclose(fm);
         return 0;
-    }
     used += (size_t)n;
 
-    char buf[256];
-    rewind(fm);
-    while (fgets(buf, sizeof(buf), fm))
+    Group *g = group_get(intern_find(INTERN_GROUPS, group_id));
+    for (int i = 0; g && i < g->n; i++)
     {
-        char gid[GROUP_ID_LEN], user[USERNAME_LEN], role[16];
-        if (sscanf(buf, "%15[^|]|%49[^|]|%15s", gid, user, role) == 3)
+        n = snprintf(out + used, outsz - used, "- %s (%s)\n",
+                     intern_name(INTERN_USERS, g->members[i].user), role_name(g->members[i].role));
+        if (n < 0)
+            break;
+        if ((size_t)n >= outsz - used)
         {
-            if (strcmp(gid, group_id) == 0)
-            {
-                n = snprintf(out + used, outsz - used, "- %s (%s)\n", user, role);
-                if (n < 0)
-                    break;
-                if ((size_t)n >= outsz - used)
-                {
-                    if (outsz - used > 5)
-                        snprintf(out + used, outsz - used, "...\n");
-                    break;
-                }
-                used += (size_t)n;
-                count++;
-            }
+            if (outsz - used > 5)
+                snprintf(out + used, outsz - used, "...\n");
+            break;
         }
+        used += (size_t)n;
+        count++;
     }
 
     n = snprintf(out + used, outsz - used, "Total: %d\n", count);
     if (n > 0 && (size_t)n < outsz - used)
         used += (size_t)n;
 
-    flock(fdm, LOCK_UN);
-    fclose(fm);
     return count;
 }
 
@@ -522,87 +741,44 @@ int group_list_members(const char *group_id, char *out, size_t outsz)
 
 int group_list_user_groups(const char *username, char *out, size_t outsz)
 {
+    TRACE_SCOPE("group", "group_list_user_groups");
     if (!out || outsz == 0)
         return 0;
     out[0] = '\0';
 
-    FILE *fm = NULL;
-    int fdm = -1;
-    if (!open_file_locked(GROUP_MEMBERS_FILE, O_RDONLY, LOCK_SH, &fm, &fdm))
-        return 0;
-
-    FILE *fg = NULL;
-    int fdg = -1;
-    if (!open_file_locked(GROUPS_FILE, O_RDONLY, LOCK_SH, &fg, &fdg))
-    {
-        flock(fdm, LOCK_UN);
-        fclose(fm);
-        return 0;
-    }
-
     size_t used = 0;
     int count = 0;
 
     int n = snprintf(out + used, outsz - used, "=== Your Groups ===\n");
     if (n < 0 || (size_t)n >= outsz - used)
-    {
-        flock(fdg, LOCK_UN);
-        fclose(fg);
-        flock(fdm, LOCK_UN);
-        fclose(fm);
         return 0;
-    }
     used += (size_t)n;
 
-    char buf[256];
-    rewind(fm);
-    while (fgets(buf, sizeof(buf), fm))
+    UserGroups *ug = user_groups_get(intern_find(INTERN_USERS, username), 0);
+    for (int i = 0; ug && i < ug->n; i++)
     {
-        char gid[GROUP_ID_LEN], user[USERNAME_LEN], role[16];
-        if (sscanf(buf, "%15[^|]|%49[^|]|%15s", gid, user, role) == 3)
+        const char *gname = lookup_name(ug->items[i].gid);
+        if (!gname)
+            gname = "Unknown";
+
+        n = snprintf(out + used, outsz - used, "- %s: %s (%s)\n",
+                     intern_name(INTERN_GROUPS, ug->items[i].gid), gname, role_name(ug->items[i].role));
+        if (n < 0)
+            break;
+        if ((size_t)n >= outsz - used)
         {
-            if (strcmp(user, username) == 0)
-            {
-                // Find group name
-                char gname[128] = "Unknown";
-                rewind(fg);
-                char gbuf[256];
-                while (fgets(gbuf, sizeof(gbuf), fg))
-                {
-                    char g[GROUP_ID_LEN], gn[128];
-                    if (sscanf(gbuf, "%15[^|]|%127[^|]|", g, gn) == 2)
-                    {
-                        if (strcmp(g, gid) == 0)
-                        {
-                            strncpy(gname, gn, sizeof(gname) - 1);
-                            break;
-                        }
-                    }
-                }
-
-                n = snprintf(out + used, outsz - used, "- %s: %s (%s)\n", gid, gname, role);
-                if (n < 0)
-                    break;
-                if ((size_t)n >= outsz - used)
-                {
-                    if (outsz - used > 5)
-                        snprintf(out + used, outsz - used, "...\n");
-                    break;
-                }
-                used += (size_t)n;
-                count++;
-            }
+            if (outsz - used > 5)
+                snprintf(out + used, outsz - used, "...\n");
+            break;
         }
+        used += (size_t)n;
+        count++;
     }
 
     n = snprintf(out + used, outsz - used, "Total: %d\n", count);
     if (n > 0 && (size_t)n < outsz - used)
         used += (size_t)n;
 
-    flock(fdg, LOCK_UN);
-    fclose(fg);
-    flock(fdm, LOCK_UN);
-    fclose(fm);
     return count;
 }
 
@@ -610,27 +786,54 @@ int group_list_user_groups(const char *username, char *out, size_t outsz)
 
 void group_foreach_member(const char *group_id, group_member_callback callback, void *userdata)
 {
+    TRACE_SCOPE("group", "group_foreach_member");
     if (!group_id || !callback)
         return;
 
-    FILE *fm = NULL;
-    int fdm = -1;
-    if (!open_file_locked(GROUP_MEMBERS_FILE, O_RDONLY, LOCK_SH, &fm, &fdm))
+    Group *g = group_get(intern_find(INTERN_GROUPS, group_id));
+    for (int i = 0; g && i < g->n; i++)
+        callback(intern_name(INTERN_USERS, g->members[i].user), userdata);
+}
+
+// ---------- member online ----------
+
+void group_user_online(uint32_t user)
+{
+    if (user == INTERN_NONE || idmap_get(&online_users, user))
+        return;
+    idmap_put(&online_users, user, (void *)1);
+
+    UserGroups *ug = user_groups_get(user, 0);
+    for (int i = 0; ug && i < ug->n; i++)
+        online_add(ug->items[i].gid, &ug->items[i], user);
+}
+
+void group_user_offline(uint32_t user)
+{
+    if (!idmap_get(&online_users, user))
         return;
+    idmap_put(&online_users, user, NULL);
 
-    char buf[256];
-    while (fgets(buf, sizeof(buf), fm))
+    UserGroups *ug = user_groups_get(user, 0);
+    for (int i = 0; ug && i < ug->n; i++)
+        online_remove(ug->items[i].gid, &ug->items[i]);
+}
+
+void group_foreach_online_member(const char *group_id, group_member_id_callback callback, void *userdata)
+{
+    TRACE_SCOPE("group", "group_foreach_online_member");
+    OnlineSet *set = idmap_get(&group_online, intern_find(INTERN_GROUPS, group_id));
+    for (int i = 0; set && i < set->n; i++)
+        callback(set->users[i], userdata);
+}
+
+void group_foreach_offline_member(const char *group_id, group_member_id_callback callback, void *userdata)
+{
+    TRACE_SCOPE("group", "group_foreach_offline_member");
+    Group *g = group_get(intern_find(INTERN_GROUPS, group_id));
+    for (int i = 0; g && i < g->n; i++)
     {
-        char gid[GROUP_ID_LEN], user[USERNAME_LEN], role[16];
-        if (sscanf(buf, "%15[^|]|%49[^|]|%15s", gid, user, role) == 3)
-        {
-            if (strcmp(gid, group_id) == 0)
-            {
-                callback(user, userdata);
-            }
-        }
+        if (!idmap_get(&online_users, g->members[i].user))
+            callback(g->members[i].user, userdata);
     }
-
-    flock(fdm, LOCK_UN);
-    fclose(fm);
-}
\ No newline at end of file
+}
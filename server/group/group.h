@@ -3,6 +3,8 @@
 
 #include "../../common.h"
 
+#define GROUP_ID_LEN 24 // "G" + ID 64 bit dạng thập phân
+
 // Return codes
 #define GR_OK 0
 #define GR_ERR -1
@@ -12,6 +14,11 @@
 #define GR_ALREADY_MEMBER -5
 #define GR_NOT_OWNER -6
 
+// Tạo bảng group in-memory và đăng ký handler replay WAL
+void group_init();
+// Lần đầu chạy với WAL: nạp groups.txt + group_members.txt kiểu cũ vào WAL. Trả về số group
+int group_import_legacy();
+
 // Group operations
 int group_create(const char *creator, const char *group_name, char *out_group_id, size_t id_size);
 int group_add_member(const char *group_id, const char *username, const char *added_by);
@@ -25,4 +32,13 @@ int group_list_user_groups(const char *username, char *out, size_t outsz);
 typedef void (*group_member_callback)(const char *username, void *userdata);
 void group_foreach_member(const char *group_id, group_member_callback callback, void *userdata);
 
+// Client login / logout: cập nhật danh sách member online của các group của user
+void group_user_online(uint32_t uid);
+void group_user_offline(uint32_t uid);
+
+// Fan-out theo user ID: member online chỉ duyệt danh sách online (O(số người online))
+typedef void (*group_member_id_callback)(uint32_t uid, void *userdata);
+void group_foreach_online_member(const char *group_id, group_member_id_callback callback, void *userdata);
+void group_foreach_offline_member(const char *group_id, group_member_id_callback callback, void *userdata);
+
 #endif
\ No newline at end of file
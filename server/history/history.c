@@ -0,0 +1,444 @@
+#include "history.h"
+#include "../iostat/iostat.h"
+#include "../slowlog/slowlog.h"
+#include "../trace/trace.h"
+#include "../util/crc32.h"
+#include "../util/strmap.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define REC_HEADER 8                  // len + crc
+#define REC_FIXED 10                  // msg_id + from_len
+#define REC_MAX_BODY (64 * 1024)      // lớn hơn thì coi như file hỏng
+#define SCAN_CHUNK (1024 * 1024)
+#define HISTORY_PATH_LEN (256 + HISTORY_KEY_LEN * 2 + 8)
+
+typedef struct
+{
+    uint64_t offset;
+    uint64_t msg_id;
+} IdxEntry;
+
+typedef struct Conv
+{
+    char key[HISTORY_KEY_LEN];
+    int fd, idx_fd;
+    uint64_t size;  // số byte hợp lệ của .log
+    uint64_t count; // số tin nhắn
+    IdxEntry *idx;  // idx[i] = tin nhắn seq i * HISTORY_INDEX_EVERY + 1
+    uint32_t nidx, cap;
+    struct Conv *prev, *next; // LRU, đầu danh sách = vừa dùng
+} Conv;
+
+static char base_dir[256] = HISTORY_DIR;
+static StrMap *convs = NULL; // key -> Conv* đang mở
+static Conv *lru_head = NULL, *lru_tail = NULL;
+static int nopen = 0;
+
+// ---------- helpers ----------
+
+static void build_path(const char *key, const char *ext, char *out, size_t outsz)
+{
+    static const char hexdigits[] = "0123456789abcdef";
+    int n = snprintf(out, outsz, "%s/", base_dir);
+    for (const unsigned char *p = (const unsigned char *)key; *p && (size_t)n + 3 < outsz; p++)
+    {
+        out[n++] = hexdigits[*p >> 4];
+        out[n++] = hexdigits[*p & 15];
+    }
+    snprintf(out + n, outsz - (size_t)n, "%s", ext);
+}
+
+static int pread_all(int fd, void *buf, size_t n, uint64_t off)
+{
+    uint8_t *p = buf;
+    while (n > 0)
+    {
+        ssize_t r = pread(fd, p, n, (off_t)off);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        n -= (size_t)r;
+        off += (uint64_t)r;
+        slowlog_count_read((size_t)r);
+        iostat_add(IO_HISTORY, IO_BYTES_READ, (uint64_t)r);
+    }
+    return 0;
+}
+
+static int pwrite_all(int fd, const void *buf, size_t n, uint64_t off)
+{
+    const uint8_t *p = buf;
+    while (n > 0)
+    {
+        ssize_t w = pwrite(fd, p, n, (off_t)off);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return -1;
+        p += w;
+        n -= (size_t)w;
+        off += (uint64_t)w;
+        iostat_add(IO_HISTORY, IO_BYTES_WRITTEN, (uint64_t)w);
+    }
+    return 0;
+}
+
+static int idx_push(Conv *c, uint64_t offset, uint64_t msg_id)
+{
+    if (c->nidx >= c->cap)
+    {
+        uint32_t newcap = c->cap == 0 ? 64 : c->cap * 2;
+        IdxEntry *tmp = realloc(c->idx, newcap * sizeof(IdxEntry));
+        if (!tmp)
+            return -1;
+        c->idx = tmp;
+        c->cap = newcap;
+    }
+    c->idx[c->nidx++] = (IdxEntry){offset, msg_id};
+    return 0;
+}
+
+// Đọc 1 record đã nằm trọn trong buf. Trả về độ dài record, 0 nếu chưa đủ dữ liệu, -1 nếu hỏng
+static long parse_record(const uint8_t *buf, size_t avail, uint64_t *msg_id,
+                         const char **from, size_t *from_len, const char **text, size_t *text_len)
+{
+    if (avail < REC_HEADER)
+        return 0;
+    uint32_t len, crc;
+    memcpy(&len, buf, 4);
+    memcpy(&crc, buf + 4, 4);
+    if (len < REC_FIXED || len > REC_MAX_BODY)
+        return -1;
+    if (avail < REC_HEADER + (size_t)len)
+        return 0;
+
+    const uint8_t *body = buf + REC_HEADER;
+    if (crc32(body, len) != crc)
+        return -1;
+    uint16_t flen;
+    memcpy(msg_id, body, 8);
+    memcpy(&flen, body + 8, 2);
+    if ((size_t)REC_FIXED + flen > len)
+        return -1;
+    *from = (const char *)body + REC_FIXED;
+    *from_len = flen;
+    *text = *from + flen;
+    *text_len = len - REC_FIXED - flen;
+    return REC_HEADER + (long)len;
+}
+
+// Quét từ offset (là đầu record seq) tới hết file, bổ sung entry index còn thiếu.
+// Trả về offset cuối cùng hợp lệ, *seq = seq của record kế tiếp
+static uint64_t scan_tail(Conv *c, uint64_t offset, uint64_t *seq, uint64_t file_size)
+{
+    uint8_t *buf = malloc(SCAN_CHUNK);
+    if (!buf)
+        return offset;
+
+    while (offset < file_size)
+    {
+        size_t want = file_size - offset < SCAN_CHUNK ? (size_t)(file_size - offset) : SCAN_CHUNK;
+        if (pread_all(c->fd, buf, want, offset) != 0)
+            break;
+
+        size_t pos = 0;
+        long n = 0;
+        while (pos < want)
+        {
+            uint64_t msg_id;
+            const char *from, *text;
+            size_t flen, tlen;
+            n = parse_record(buf + pos, want - pos, &msg_id, &from, &flen, &text, &tlen);
+            if (n <= 0)
+                break;
+            uint64_t block = (*seq - 1) / HISTORY_INDEX_EVERY;
+            if ((*seq - 1) % HISTORY_INDEX_EVERY == 0 && block >= c->nidx)
+                idx_push(c, offset + pos, msg_id);
+            pos += (size_t)n;
+            (*seq)++;
+        }
+        offset += pos;
+        if (n < 0 || pos == 0)
+            break; // record hỏng hoặc bị cắt dở ở cuối file
+    }
+    free(buf);
+    return offset;
+}
+
+// ---------- LRU ----------
+
+static void lru_unlink(Conv *c)
+{
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        lru_head = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    else
+        lru_tail = c->prev;
+    c->prev = c->next = NULL;
+}
+
+static void lru_push_front(Conv *c)
+{
+    c->next = lru_head;
+    c->prev = NULL;
+    if (lru_head)
+        lru_head->prev = c;
+    lru_head = c;
+    if (!lru_tail)
+        lru_tail = c;
+}
+
+static void conv_close(Conv *c)
+{
+    lru_unlink(c);
+    strmap_remove(convs, c->key);
+    close(c->fd);
+    close(c->idx_fd);
+    free(c->idx);
+    free(c);
+    nopen--;
+}
+
+// ---------- mở hội thoại ----------
+
+static Conv *conv_open(const char *key, int create)
+{
+    Conv *c = strmap_get(convs, key);
+    if (c)
+    {
+        lru_unlink(c);
+        lru_push_front(c);
+        return c;
+    }
+    if (strlen(key) >= HISTORY_KEY_LEN)
+        return NULL;
+
+    char path[HISTORY_PATH_LEN];
+    build_path(key, ".log", path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+    if (fd < 0)
+        return NULL;
+    build_path(key, ".idx", path, sizeof(path));
+    int idx_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    c = calloc(1, sizeof(Conv));
+    struct stat st, ist;
+    if (idx_fd < 0 || !c || fstat(fd, &st) != 0 || fstat(idx_fd, &ist) != 0)
+    {
+        close(fd);
+        if (idx_fd >= 0)
+            close(idx_fd);
+        free(c);
+        return NULL;
+    }
+    strcpy(c->key, key);
+    c->fd = fd;
+    c->idx_fd = idx_fd;
+
+    // Index thưa trên đĩa, bỏ các entry trỏ quá phần .log còn lại (crash giữa 2 lần ghi)
+    uint32_t n = (uint32_t)(ist.st_size / sizeof(IdxEntry));
+    if (n > 0 && (c->idx = malloc(n * sizeof(IdxEntry))) && pread_all(idx_fd, c->idx, n * sizeof(IdxEntry), 0) == 0)
+    {
+        c->cap = n;
+        while (c->nidx < n && c->idx[c->nidx].offset < (uint64_t)st.st_size &&
+               (c->nidx == 0 || c->idx[c->nidx].offset > c->idx[c->nidx - 1].offset))
+            c->nidx++;
+    }
+    uint32_t idx_valid = c->nidx;
+
+    // Chỉ quét phần sau entry index cuối cùng (tối đa vài chục record nếu index đầy đủ)
+    uint64_t seq = c->nidx ? (uint64_t)(c->nidx - 1) * HISTORY_INDEX_EVERY + 1 : 1;
+    uint64_t from = c->nidx ? c->idx[c->nidx - 1].offset : 0;
+    c->size = scan_tail(c, from, &seq, (uint64_t)st.st_size);
+    c->count = seq - 1;
+    if (c->size < (uint64_t)st.st_size && ftruncate(fd, (off_t)c->size) != 0)
+        perror("history truncate failed");
+
+    // Entry trỏ vào record hỏng vừa bị cắt thì bỏ, lần ghi sau tạo lại đúng vị trí
+    while (c->nidx > 0 && (uint64_t)(c->nidx - 1) * HISTORY_INDEX_EVERY + 1 > c->count)
+        c->nidx--;
+    if (idx_valid > c->nidx)
+        idx_valid = c->nidx;
+
+    // Ghi lại phần index vừa dựng thêm / cắt bỏ
+    if (c->nidx != n || idx_valid != n)
+    {
+        if (pwrite_all(idx_fd, c->idx + idx_valid, (c->nidx - idx_valid) * sizeof(IdxEntry),
+                       (uint64_t)idx_valid * sizeof(IdxEntry)) != 0 ||
+            ftruncate(idx_fd, (off_t)c->nidx * sizeof(IdxEntry)) != 0)
+            perror("history index rebuild failed");
+    }
+
+    if (strmap_put(convs, c->key, c) != 0)
+    {
+        close(fd);
+        close(idx_fd);
+        free(c->idx);
+        free(c);
+        return NULL;
+    }
+    lru_push_front(c);
+    if (++nopen > HISTORY_MAX_OPEN)
+        conv_close(lru_tail);
+    return c;
+}
+
+// ---------- API ----------
+
+int history_init(const char *dir)
+{
+    if (dir)
+        snprintf(base_dir, sizeof(base_dir), "%s", dir);
+    if (!convs)
+        convs = strmap_new();
+    if (!convs || (mkdir(base_dir, 0755) != 0 && errno != EEXIST))
+        return -1;
+    return 0;
+}
+
+// Username / group_id không chứa khoảng trắng nên dùng ' ' làm dấu phân cách
+void history_pm_key(const char *a, const char *b, char *out, size_t outsz)
+{
+    if (strcmp(a, b) > 0)
+    {
+        const char *t = a;
+        a = b;
+        b = t;
+    }
+    snprintf(out, outsz, "P %s %s", a, b);
+}
+
+void history_group_key(const char *group_id, char *out, size_t outsz)
+{
+    snprintf(out, outsz, "G %s", group_id);
+}
+
+uint64_t history_append(const char *key, uint64_t msg_id, const char *from, const char *text)
+{
+    TRACE_SCOPE("history", "history_append");
+    SLOWLOG_STORAGE_SCOPE();
+    static uint8_t rec[REC_HEADER + REC_MAX_BODY];
+
+    size_t flen = strlen(from), tlen = strlen(text);
+    if (flen > UINT16_MAX || REC_FIXED + flen + tlen > REC_MAX_BODY)
+        return 0;
+    Conv *c = conv_open(key, 1);
+    if (!c)
+        return 0;
+
+    uint32_t len = (uint32_t)(REC_FIXED + flen + tlen);
+    uint16_t flen16 = (uint16_t)flen;
+    uint8_t *body = rec + REC_HEADER;
+    memcpy(body, &msg_id, 8);
+    memcpy(body + 8, &flen16, 2);
+    memcpy(body + REC_FIXED, from, flen);
+    memcpy(body + REC_FIXED + flen, text, tlen);
+    uint32_t crc = crc32(body, len);
+    memcpy(rec, &len, 4);
+    memcpy(rec + 4, &crc, 4);
+
+    if (pwrite_all(c->fd, rec, REC_HEADER + len, c->size) != 0)
+    {
+        if (ftruncate(c->fd, (off_t)c->size) != 0)
+            perror("history truncate failed");
+        return 0;
+    }
+
+    uint64_t seq = c->count + 1;
+    if ((seq - 1) % HISTORY_INDEX_EVERY == 0 && idx_push(c, c->size, msg_id) == 0)
+    {
+        // Index ghi hỏng thì lần mở sau quét lại từ entry cuối cùng còn đúng
+        pwrite_all(c->idx_fd, &c->idx[c->nidx - 1], sizeof(IdxEntry), (uint64_t)(c->nidx - 1) * sizeof(IdxEntry));
+    }
+    c->size += REC_HEADER + len;
+    c->count = seq;
+    return seq;
+}
+
+int history_page(const char *key, uint64_t before_seq, int n, uint64_t *total, history_cb cb, void *userdata)
+{
+    TRACE_SCOPE("history", "history_page");
+    SLOWLOG_STORAGE_SCOPE();
+    *total = 0;
+    if (n <= 0)
+        return 0;
+    if (n > HISTORY_MAX_PAGE)
+        n = HISTORY_MAX_PAGE;
+
+    Conv *c = conv_open(key, 0);
+    if (!c)
+        return 0; // chưa có tin nhắn nào
+    *total = c->count;
+
+    uint64_t hi = (before_seq == 0 || before_seq > c->count) ? c->count : before_seq - 1;
+    if (hi == 0)
+        return 0;
+    uint64_t lo = hi > (uint64_t)n ? hi - (uint64_t)n + 1 : 1;
+
+    // Các block index chứa [lo, hi] nằm liền nhau -> đúng 1 lần pread
+    uint64_t bi = (lo - 1) / HISTORY_INDEX_EVERY, bj = (hi - 1) / HISTORY_INDEX_EVERY;
+    if (bj >= c->nidx)
+        return -1;
+    uint64_t start = c->idx[bi].offset;
+    uint64_t end = bj + 1 < c->nidx ? c->idx[bj + 1].offset : c->size;
+
+    uint8_t *buf = malloc(end - start);
+    if (!buf || pread_all(c->fd, buf, end - start, start) != 0)
+    {
+        free(buf);
+        return -1;
+    }
+
+    char from[256];
+    int emitted = 0;
+    size_t pos = 0;
+    for (uint64_t seq = bi * HISTORY_INDEX_EVERY + 1; seq <= hi; seq++)
+    {
+        uint64_t msg_id;
+        const char *f, *text;
+        size_t flen, tlen;
+        long r = parse_record(buf + pos, (size_t)(end - start) - pos, &msg_id, &f, &flen, &text, &tlen);
+        if (r <= 0)
+        {
+            emitted = emitted ? emitted : -1;
+            break;
+        }
+        pos += (size_t)r;
+        if (seq < lo)
+            continue;
+
+        // Record không có '\0' -> chép ra buffer trước khi trả cho caller
+        snprintf(from, sizeof(from), "%.*s", (int)flen, f);
+        char *t = malloc(tlen + 1);
+        if (!t)
+            break;
+        memcpy(t, text, tlen);
+        t[tlen] = '\0';
+        cb(seq, msg_id, from, t, userdata);
+        free(t);
+        emitted++;
+    }
+    free(buf);
+    return emitted;
+}
+
+void history_sync()
+{
+    for (Conv *c = lru_head; c; c = c->next)
+    {
+        fdatasync(c->fd);
+        fdatasync(c->idx_fd);
+        iostat_add(IO_HISTORY, IO_FSYNCS, 2);
+    }
+}
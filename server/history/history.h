@@ -0,0 +1,41 @@
+// Lịch sử tin nhắn theo cuộc hội thoại (PM giữa 2 người hoặc 1 group), chỉ ghi nối đuôi
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTORY_DIR "history"
+#define HISTORY_INDEX_EVERY 64 // 1 entry index thưa cho mỗi 64 tin nhắn
+#define HISTORY_DEFAULT_PAGE 20
+#define HISTORY_MAX_PAGE 100
+#define HISTORY_MAX_OPEN 64    // số hội thoại giữ fd + index trong RAM (LRU)
+#define HISTORY_KEY_LEN 128
+
+/*
+    Mỗi hội thoại là 1 cặp file trong HISTORY_DIR, tên = hex của key:
+      <hex>.log: [u32 len][u32 crc][u64 msg_id][u16 from_len][from][text] nối đuôi nhau
+      <hex>.idx: [u64 offset][u64 msg_id] cho tin nhắn seq 1, 65, 129, ...
+    seq là số thứ tự trong hội thoại (1, 2, 3, ...), msg_id là ID Snowflake (chứa thời gian).
+    Đọc 1 trang = tra index rồi 1 lần pread, không phụ thuộc độ dài lịch sử
+*/
+
+// Tạo thư mục lịch sử. 0 nếu OK
+int history_init(const char *dir);
+
+// Key hội thoại: PM không phân biệt chiều, group theo group_id
+void history_pm_key(const char *a, const char *b, char *out, size_t outsz);
+void history_group_key(const char *group_id, char *out, size_t outsz);
+
+// Ghi 1 tin nhắn, trả về seq của nó hoặc 0 nếu lỗi
+uint64_t history_append(const char *key, uint64_t msg_id, const char *from, const char *text);
+
+// Duyệt tối đa n tin nhắn ngay trước before_seq (0 = mới nhất), từ cũ đến mới.
+// Trả về số tin nhắn, -1 nếu lỗi. *total = số tin nhắn của hội thoại
+typedef void (*history_cb)(uint64_t seq, uint64_t msg_id, const char *from, const char *text, void *userdata);
+int history_page(const char *key, uint64_t before_seq, int n, uint64_t *total, history_cb cb, void *userdata);
+
+// fdatasync các hội thoại đang mở (trước khi thoát / chuyển giao)
+void history_sync();
+
+#endif
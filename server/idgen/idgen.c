@@ -0,0 +1,124 @@
+#include "idgen.h"
+#include "../wal/wal.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#define NODE_SHIFT IDGEN_SEQ_BITS
+#define TIME_SHIFT (IDGEN_SEQ_BITS + IDGEN_NODE_BITS)
+#define NODE_MASK ((uint64_t)IDGEN_MAX_NODE << NODE_SHIFT)
+
+static uint64_t node_bits = 0;
+static uint64_t last_id = 0; // ID lớn nhất đã cấp hoặc đã thấy, chỉ truy cập bằng __atomic
+static uint64_t lease_end = 0; // mốc đã ghi WAL, ID < mốc thì cấp luôn; chỉ truy cập bằng __atomic
+static pthread_mutex_t lease_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t ms = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - IDGEN_EPOCH_MS;
+    return ms > 0 ? (uint64_t)ms : 0;
+}
+
+int idgen_init(int node)
+{
+    if (node < 0 || node > IDGEN_MAX_NODE)
+        return -1;
+    node_bits = (uint64_t)node << NODE_SHIFT;
+    return 0;
+}
+
+// ID nhỏ nhất của node này mà > after
+static uint64_t next_after(uint64_t after)
+{
+    uint64_t ms = after >> TIME_SHIFT;
+    uint64_t node = after & NODE_MASK;
+    if (node < node_bits)
+        return (ms << TIME_SHIFT) | node_bits;
+    if (node == node_bits && (after & ((1u << IDGEN_SEQ_BITS) - 1)) != (1u << IDGEN_SEQ_BITS) - 1)
+        return after + 1;
+    return ((ms + 1) << TIME_SHIFT) | node_bits; // hết sequence trong ms này -> mượn ms sau
+}
+
+// id vượt mốc: ghi mốc mới vào WAL trước khi trả id cho caller. Thread khác cũng vượt mốc thì
+// đợi ở lock, không trả ID nào trước khi mốc che nó đã nằm trong WAL
+static void extend_lease(uint64_t id)
+{
+    pthread_mutex_lock(&lease_lock);
+    if (id >= __atomic_load_n(&lease_end, __ATOMIC_ACQUIRE))
+    {
+        uint64_t end = ((id >> TIME_SHIFT) + IDGEN_LEASE_MS) << TIME_SHIFT;
+        WalRecord rec;
+        wal_record_begin(&rec, WAL_IDGEN_LEASE);
+        wal_record_i64(&rec, (int64_t)end);
+        (void)wal_append(&rec); // WAL chưa mở (bench) thì vẫn cấp ID như trước
+        __atomic_store_n(&lease_end, end, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&lease_lock);
+}
+
+uint64_t idgen_next()
+{
+    uint64_t last = __atomic_load_n(&last_id, __ATOMIC_RELAXED);
+    uint64_t id;
+    do
+    {
+        id = (now_ms() << TIME_SHIFT) | node_bits;
+        if (id <= last)
+            id = next_after(last);
+    } while (!__atomic_compare_exchange_n(&last_id, &last, id, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    if (id >= __atomic_load_n(&lease_end, __ATOMIC_ACQUIRE))
+        extend_lease(id);
+    return id;
+}
+
+void idgen_observe(uint64_t id)
+{
+    uint64_t last = __atomic_load_n(&last_id, __ATOMIC_RELAXED);
+    while (id > last && !__atomic_compare_exchange_n(&last_id, &last, id, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+// ---------- lưu mốc ----------
+
+static int replay_lease(WalReader *r)
+{
+    int64_t end;
+    if (wal_read_i64(r, &end) != 0)
+        return -1;
+    idgen_observe((uint64_t)end);
+    return 0;
+}
+
+// Chạy trong process con chụp snapshot: mốc hiện tại che cả ID trong các segment bị xóa
+static void snapshot_lease(SnapWriter *w)
+{
+    uint64_t mark = __atomic_load_n(&lease_end, __ATOMIC_ACQUIRE);
+    uint64_t last = __atomic_load_n(&last_id, __ATOMIC_RELAXED);
+    if (last > mark)
+        mark = last;
+    snap_table_begin(w, SNAP_IDGEN, sizeof(mark));
+    snap_table_entry(w, NULL, 0);
+    snap_table_item(w, &mark);
+    snap_table_end(w);
+}
+
+void idgen_wal_init()
+{
+    wal_register_handler(WAL_IDGEN_LEASE, replay_lease);
+    wal_register_snapshot(snapshot_lease);
+}
+
+void idgen_load_snapshot()
+{
+    SnapTable t;
+    uint64_t mark;
+    if (snap_table(SNAP_IDGEN, &t) == 0 && t.nitems > 0 && snap_item_copy(&t, 0, &mark, sizeof(mark)) == 0)
+        idgen_observe(mark);
+}
+
+int64_t idgen_time_ms(uint64_t id)
+{
+    return (int64_t)(id >> TIME_SHIFT) + IDGEN_EPOCH_MS;
+}
@@ -0,0 +1,41 @@
+// ID 64 bit kiểu Snowflake cho group và tin nhắn: tăng theo thời gian, không cần phối hợp giữa các node
+#ifndef IDGEN_H
+#define IDGEN_H
+
+#include <stdint.h>
+
+/*
+    [1 bit 0][41 bit ms kể từ IDGEN_EPOCH_MS][10 bit node][12 bit sequence]
+    Sắp xếp theo số = sắp xếp theo thời gian tạo. Mỗi node tự cấp tối đa 4096 ID/ms,
+    vượt quá thì mượn ms kế tiếp thay vì chờ đồng hồ
+*/
+#define IDGEN_EPOCH_MS 1704067200000LL // 2024-01-01 00:00:00 UTC
+#define IDGEN_NODE_BITS 10
+#define IDGEN_SEQ_BITS 12
+#define IDGEN_MAX_NODE ((1 << IDGEN_NODE_BITS) - 1)
+
+/*
+    Chống cấp lại ID khi restart với đồng hồ bị lùi: trước khi cấp ID đầu tiên vượt mốc đã ghi,
+    ghi record WAL_IDGEN_LEASE với mốc mới = thời điểm của ID + IDGEN_LEASE_MS, nên chỉ tốn
+    1 record mỗi IDGEN_LEASE_MS. Replay (và snapshot, section SNAP_IDGEN) trả lại mốc này cho
+    idgen_observe: ID cấp sau restart luôn lớn hơn mọi ID đã cấp, kể cả ID chỉ nằm trong history
+*/
+#define IDGEN_LEASE_MS 10000
+
+// Node của process này (mặc định 0). -1 nếu ngoài khoảng 0..IDGEN_MAX_NODE
+int idgen_init(int node);
+
+// Đăng ký handler replay WAL_IDGEN_LEASE và phần snapshot, gọi trước wal_open
+void idgen_wal_init();
+// Sau wal_open: đọc mốc trong snapshot đã map
+void idgen_load_snapshot();
+
+// Thread-safe, chỉ khóa khi phải ghi mốc mới (1 lần mỗi IDGEN_LEASE_MS)
+uint64_t idgen_next();
+
+// ID đã cấp trước đó (mốc lease, ID trong record replay): không bao giờ cấp lại ID <= id
+void idgen_observe(uint64_t id);
+
+int64_t idgen_time_ms(uint64_t id); // Unix ms lúc cấp ID
+
+#endif
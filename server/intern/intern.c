@@ -0,0 +1,126 @@
+#include "intern.h"
+#include "../snapshot/snapshot.h"
+#include "../util/strmap.h"
+#include "../wal/wal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    ID 1 .. base là tên có trong snapshot (entry i của bảng tên = ID i + 1, tra tên -> ID bằng
+    hash index ngay trên mapping). ID > base là tên thêm sau snapshot, giữ trong RAM.
+    ID không bao giờ bị thu hồi và snapshot ghi cả bảng theo thứ tự ID nên ID giữ nguyên qua
+    restart. WAL vẫn ghi tên, replay tự intern lại những tên chưa có trong snapshot
+*/
+
+typedef struct
+{
+    int section;
+    StrMap *ids;  // tên -> ID, chỉ phần thêm sau snapshot
+    char **names; // names[i] = tên của ID base + 1 + i
+    uint32_t n, cap;
+} InternTable;
+
+static InternTable tables[2] = {{SNAP_USER_NAMES, NULL, NULL, 0, 0}, {SNAP_GROUP_NAMES, NULL, NULL, 0, 0}};
+
+static InternTable *table_of(int kind)
+{
+    return kind == INTERN_GROUPS ? &tables[1] : &tables[0];
+}
+
+// Số tên nằm trong snapshot đang map (0 nếu không có)
+static uint32_t base_get(const InternTable *t, SnapTable *base)
+{
+    snap_table(t->section, base);
+    return base->count;
+}
+
+uint32_t intern_find(int kind, const char *name)
+{
+    InternTable *t = table_of(kind);
+    if (!name || !t->ids)
+        return INTERN_NONE;
+
+    void *v = strmap_get(t->ids, name);
+    if (v)
+        return (uint32_t)(uintptr_t)v;
+
+    SnapTable base;
+    if (base_get(t, &base) == 0)
+        return INTERN_NONE;
+    const SnapEntry *e = snap_find(&base, name);
+    return e ? (uint32_t)(e - base.entries) + 1 : INTERN_NONE;
+}
+
+uint32_t intern_id(int kind, const char *name)
+{
+    uint32_t id = intern_find(kind, name);
+    if (id != INTERN_NONE || !name || !name[0])
+        return id;
+
+    InternTable *t = table_of(kind);
+    SnapTable base;
+    uint32_t nbase = base_get(t, &base);
+    if (nbase + t->n >= UINT32_MAX - 1)
+        return INTERN_NONE;
+
+    if (t->n >= t->cap)
+    {
+        uint32_t newcap = t->cap == 0 ? 1024 : t->cap * 2;
+        char **tmp = realloc(t->names, (size_t)newcap * sizeof(char *));
+        if (!tmp)
+            return INTERN_NONE;
+        t->names = tmp;
+        t->cap = newcap;
+    }
+
+    char *copy = strdup(name);
+    id = nbase + t->n + 1;
+    if (!copy || strmap_put(t->ids, name, (void *)(uintptr_t)id) != 0)
+    {
+        free(copy);
+        return INTERN_NONE;
+    }
+    t->names[t->n++] = copy;
+    return id;
+}
+
+const char *intern_name(int kind, uint32_t id)
+{
+    InternTable *t = table_of(kind);
+    SnapTable base;
+    uint32_t nbase = base_get(t, &base);
+
+    if (id >= 1 && id <= nbase)
+        return snap_str(&base, base.entries[id - 1].key);
+    if (id > nbase && id - nbase <= t->n)
+        return t->names[id - nbase - 1];
+    return "";
+}
+
+uint32_t intern_count(int kind)
+{
+    InternTable *t = table_of(kind);
+    SnapTable base;
+    return base_get(t, &base) + t->n;
+}
+
+// Ghi lại toàn bộ bảng theo thứ tự ID để ID không đổi sau khi nạp snapshot mới
+static void snapshot_names(SnapWriter *w)
+{
+    for (int kind = INTERN_USERS; kind <= INTERN_GROUPS; kind++)
+    {
+        uint32_t count = intern_count(kind);
+        snap_table_begin(w, table_of(kind)->section, 0);
+        for (uint32_t id = 1; id <= count; id++)
+            snap_table_entry(w, intern_name(kind, id), 0);
+        snap_table_end(w);
+    }
+}
+
+void intern_init()
+{
+    tables[0].ids = strmap_new();
+    tables[1].ids = strmap_new();
+    wal_register_snapshot(snapshot_names);
+}
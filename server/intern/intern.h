@@ -0,0 +1,21 @@
+// Intern username / group_id thành ID 32 bit dày (1, 2, 3, ...) ngay tại biên protocol.
+// Index, danh sách fan-out và snapshot bên trong đều dùng ID, chỉ đổi lại thành chuỗi khi format output
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+
+#define INTERN_USERS 0
+#define INTERN_GROUPS 1
+
+#define INTERN_NONE 0 // ID 0 = không có
+
+// Đăng ký ghi bảng tên vào snapshot. Gọi trước wal_open
+void intern_init();
+
+uint32_t intern_find(int kind, const char *name); // INTERN_NONE nếu chưa từng intern
+uint32_t intern_id(int kind, const char *name);   // Cấp ID mới nếu chưa có, INTERN_NONE nếu hết bộ nhớ
+const char *intern_name(int kind, uint32_t id);   // "" nếu ID không hợp lệ. Chuỗi sống tới hết process
+uint32_t intern_count(int kind);                  // ID lớn nhất đã cấp
+
+#endif
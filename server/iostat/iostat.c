@@ -0,0 +1,142 @@
+#include "iostat.h"
+#include "../metrics/metrics.h"
+#include "../util/outbuf.h"
+
+#include <stdio.h>
+
+static const char *const subsystem_names[IO_SUBSYSTEMS] = {
+    "auth", "friend", "group", "offline", "history", "log", "wal"};
+
+// Tên metric Prometheus (minachat_io_<name>) và tiêu đề cột của STATS
+static const char *const counter_names[IO_COUNTERS] = {
+    "bytes_read_total", "bytes_written_total", "fsyncs_total", "lock_waits_total", "lock_wait_seconds_total"};
+static const char *const counter_help[IO_COUNTERS] = {
+    "Bytes read from storage files", "Bytes written to storage (WAL records for the in-memory stores)",
+    "fsync / fdatasync calls", "Lock acquisitions that had to wait", "Time spent waiting for storage locks"};
+
+static uint64_t totals[IO_SUBSYSTEMS][IO_COUNTERS];
+static uint64_t by_command[METRICS_MAX_COMMANDS][IO_SUBSYSTEMS][IO_COUNTERS];
+static __thread int current_command = -1;
+
+void iostat_add(IoSubsystem s, IoCounter c, uint64_t n)
+{
+    __atomic_fetch_add(&totals[s][c], n, __ATOMIC_RELAXED);
+    if (current_command >= 0)
+        __atomic_fetch_add(&by_command[current_command][s][c], n, __ATOMIC_RELAXED);
+}
+
+int iostat_command()
+{
+    return current_command;
+}
+
+void iostat_set_command(int index)
+{
+    current_command = index < METRICS_MAX_COMMANDS ? index : -1;
+}
+
+// ---------- xuất ----------
+
+static void snapshot(uint64_t *src, uint64_t dst[IO_COUNTERS])
+{
+    for (int c = 0; c < IO_COUNTERS; c++)
+        dst[c] = __atomic_load_n(&src[c], __ATOMIC_RELAXED);
+}
+
+static int all_zero(const uint64_t v[IO_COUNTERS])
+{
+    for (int c = 0; c < IO_COUNTERS; c++)
+        if (v[c])
+            return 0;
+    return 1;
+}
+
+static void put_row(OutBuf *o, const char *name, const uint64_t v[IO_COUNTERS])
+{
+    outbuf_put(o, "%-26s %12llu %12llu %8llu %10llu %12.1f\n", name, (unsigned long long)v[IO_BYTES_READ],
+        (unsigned long long)v[IO_BYTES_WRITTEN], (unsigned long long)v[IO_FSYNCS],
+        (unsigned long long)v[IO_LOCK_WAITS], v[IO_LOCK_WAIT_NS] / 1e3);
+}
+
+static void render_text(OutBuf *o)
+{
+    uint64_t v[IO_COUNTERS];
+    outbuf_put(o, "%-26s %12s %12s %8s %10s %12s\n", "IO", "read(B)", "written(B)", "fsyncs", "lock_waits", "lock_wait(us)");
+    for (int s = 0; s < IO_SUBSYSTEMS; s++)
+    {
+        snapshot(totals[s], v);
+        put_row(o, subsystem_names[s], v);
+    }
+
+    // Theo lệnh: chỉ các cặp lệnh / subsystem đã có I/O
+    int ncommands = metrics_command_count();
+    for (int i = 0; i < ncommands && i < METRICS_MAX_COMMANDS; i++)
+        for (int s = 0; s < IO_SUBSYSTEMS; s++)
+        {
+            snapshot(by_command[i][s], v);
+            if (all_zero(v))
+                continue;
+            char name[64];
+            snprintf(name, sizeof(name), "%s/%s", metrics_command_name(i), subsystem_names[s]);
+            put_row(o, name, v);
+        }
+}
+
+static void put_value(OutBuf *o, IoCounter c, uint64_t v)
+{
+    if (c == IO_LOCK_WAIT_NS)
+        outbuf_put(o, "%.9f\n", v / 1e9);
+    else
+        outbuf_put(o, "%llu\n", (unsigned long long)v);
+}
+
+static void render_prometheus(OutBuf *o)
+{
+    uint64_t v[IO_COUNTERS];
+    for (int c = 0; c < IO_COUNTERS; c++)
+    {
+        outbuf_put(o, "# HELP minachat_io_%s %s\n# TYPE minachat_io_%s counter\n", counter_names[c], counter_help[c],
+            counter_names[c]);
+        for (int s = 0; s < IO_SUBSYSTEMS; s++)
+        {
+            snapshot(totals[s], v);
+            outbuf_put(o, "minachat_io_%s{subsystem=\"%s\"} ", counter_names[c], subsystem_names[s]);
+            put_value(o, c, v[c]);
+        }
+    }
+
+    int ncommands = metrics_command_count();
+    for (int c = 0; c < IO_COUNTERS; c++)
+    {
+        outbuf_put(o, "# HELP minachat_io_command_%s %s, by protocol command\n# TYPE minachat_io_command_%s counter\n",
+            counter_names[c], counter_help[c], counter_names[c]);
+        for (int i = 0; i < ncommands && i < METRICS_MAX_COMMANDS; i++)
+            for (int s = 0; s < IO_SUBSYSTEMS; s++)
+            {
+                uint64_t n = __atomic_load_n(&by_command[i][s][c], __ATOMIC_RELAXED);
+                if (!n)
+                    continue;
+                outbuf_put(o, "minachat_io_command_%s{command=\"%s\",subsystem=\"%s\"} ", counter_names[c],
+                    metrics_command_name(i), subsystem_names[s]);
+                put_value(o, c, n);
+            }
+    }
+}
+
+static size_t render(char *out, size_t outsz, int prometheus)
+{
+    OutBuf o = {out, outsz, 0};
+    if (outsz == 0)
+        return 0;
+    out[0] = '\0';
+    if (prometheus)
+        render_prometheus(&o);
+    else
+        render_text(&o);
+    return o.len;
+}
+
+void iostat_init()
+{
+    metrics_section(render);
+}
@@ -0,0 +1,54 @@
+// Đếm I/O theo từng subsystem lưu trữ và theo lệnh: byte đọc / ghi, số lần fsync, số lần phải chờ
+// lock và tổng thời gian chờ. Xuất cùng số liệu khác (STATS, socket Prometheus) để đo khuếch đại
+// đọc / ghi trước và sau khi đổi tầng lưu trữ
+#ifndef IOSTAT_H
+#define IOSTAT_H
+
+#include <stdint.h>
+
+/*
+    auth / friend / group / offline không tự đọc ghi file mà ghi record vào WAL: byte ghi của
+    chúng là byte record đưa vào WAL (ghi logic), lock là mutex WAL + chờ khi buffer WAL đầy.
+    wal là phần ghi thật xuống đĩa của flusher thread (byte, fdatasync) và phần đọc lúc replay,
+    chia cho tổng byte logic ra được khuếch đại ghi. history / log là file riêng của chúng
+*/
+typedef enum
+{
+    IO_AUTH,
+    IO_FRIEND,
+    IO_GROUP,
+    IO_OFFLINE,
+    IO_HISTORY,
+    IO_LOG,
+    IO_WAL,
+    IO_SUBSYSTEMS
+} IoSubsystem;
+
+typedef enum
+{
+    IO_BYTES_READ,
+    IO_BYTES_WRITTEN,
+    IO_FSYNCS,
+    IO_LOCK_WAITS,
+    IO_LOCK_WAIT_NS,
+    IO_COUNTERS
+} IoCounter;
+
+// Đăng ký phần xuất số liệu với metrics (gọi lúc khởi động)
+void iostat_init();
+
+// Gọi được từ mọi thread. Thread đang xử lý 1 lệnh (iostat_set_command) cộng thêm vào dòng của lệnh đó
+void iostat_add(IoSubsystem s, IoCounter c, uint64_t n);
+
+static inline void iostat_lock_wait(IoSubsystem s, uint64_t ns)
+{
+    iostat_add(s, IO_LOCK_WAITS, 1);
+    iostat_add(s, IO_LOCK_WAIT_NS, ns);
+}
+
+// Lệnh thread hiện tại đang xử lý: chỉ số trong metrics (metrics_command_index), -1 = không có.
+// Phần chạy sau của lệnh (fan-out, LOGIN xong ở worker) lưu iostat_command() lúc submit rồi đặt lại
+int iostat_command();
+void iostat_set_command(int index);
+
+#endif
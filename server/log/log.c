@@ -1,4 +1,8 @@
 #include "log.h"
+#include "../iostat/iostat.h"
+#include "../metrics/metrics.h"
+#include "../slowlog/slowlog.h"
+#include "../trace/trace.h"
 #include <stdio.h>
 #include <time.h>
 #include <sys/file.h>
@@ -12,24 +16,35 @@
 static void get_timestamp(char *buf, size_t size)
 {
     time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    strftime(buf, size, "%Y-%m-%d %H:%M:%S", tm_info);
+    struct tm tm_info;
+    localtime_r(&now, &tm_info); // watchdog thread cũng ghi log
+    strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm_info);
 }
 
 // Helper: ghi log vào file với file locking
 static void write_log(const char *log_entry)
 {
+    TRACE_SCOPE("log", "write_log");
+    SLOWLOG_STORAGE_SCOPE();
     int fd = open(LOG_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
     if (fd < 0)
         return;
 
-    if (flock(fd, LOCK_EX) != 0)
+    // Thử không chờ trước để chỉ đo thời gian khi thật sự phải đợi process / thread khác
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0)
     {
-        close(fd);
-        return;
+        uint64_t start = metrics_now_ns();
+        if (flock(fd, LOCK_EX) != 0)
+        {
+            close(fd);
+            return;
+        }
+        iostat_lock_wait(IO_LOG, metrics_now_ns() - start);
     }
 
-    write(fd, log_entry, strlen(log_entry));
+    ssize_t n = write(fd, log_entry, strlen(log_entry));
+    if (n > 0)
+        iostat_add(IO_LOG, IO_BYTES_WRITTEN, (uint64_t)n);
 
     flock(fd, LOCK_UN);
     close(fd);
@@ -61,6 +76,19 @@ void log_login(const char *username, int success)
     write_log(log_entry);
 }
 
+// Log khôi phục session bằng token (RESUME)
+void log_resume(const char *username)
+{
+    char timestamp[64];
+    get_timestamp(timestamp, sizeof(timestamp));
+
+    char log_entry[256];
+    snprintf(log_entry, sizeof(log_entry), "[%s] [%s] RESUME\n",
+             timestamp, username ? username : "unknown");
+
+    write_log(log_entry);
+}
+
 // Log đăng xuất
 void log_logout(const char *username)
 {
@@ -103,15 +131,30 @@ void log_group_action(const char *username, const char *action, const char *deta
 }
 
 // Log tin nhắn
-void log_message(const char *from, const char *to, const char *type)
+void log_message(const char *from, const char *to, const char *type, uint64_t msg_id)
 {
     char timestamp[64];
     get_timestamp(timestamp, sizeof(timestamp));
 
     char log_entry[256];
-    snprintf(log_entry, sizeof(log_entry), "[%s] [%s] MESSAGE_%s to=%s\n",
+    snprintf(log_entry, sizeof(log_entry), "[%s] [%s] MESSAGE_%s to=%s id=%llu\n",
              timestamp, from ? from : "unknown",
-             type ? type : "UNKNOWN", to ? to : "unknown");
+             type ? type : "UNKNOWN", to ? to : "unknown", (unsigned long long)msg_id);
+
+    write_log(log_entry);
+}
+
+// Log reactor bị kẹt (gọi từ watchdog thread): 1 dòng tóm tắt, mỗi frame backtrace 1 dòng thụt lề
+void log_stall(const char *username, const char *command, long ms, char **frames, int nframes)
+{
+    char timestamp[64];
+    get_timestamp(timestamp, sizeof(timestamp));
+
+    char log_entry[4096];
+    int len = snprintf(log_entry, sizeof(log_entry), "[%s] [%s] STALL reactor busy %ld ms in %s\n",
+                       timestamp, username ? username : "-", ms, command ? command : "-");
+    for (int i = 0; i < nframes && len < (int)sizeof(log_entry); i++)
+        len += snprintf(log_entry + len, sizeof(log_entry) - len, "    #%d %s\n", i, frames[i]);
 
     write_log(log_entry);
 }
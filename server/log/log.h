@@ -1,6 +1,8 @@
 #ifndef LOG_H
 #define LOG_H
 
+#include <stdint.h>
+
 // Ghi log hoạt động của server vào file
 // Format: [timestamp] [username] [action] [details]
 
@@ -10,6 +12,9 @@ void log_register(const char *username, int success);
 // Log đăng nhập
 void log_login(const char *username, int success);
 
+// Log khôi phục session bằng token (RESUME)
+void log_resume(const char *username);
+
 // Log đăng xuất
 void log_logout(const char *username);
 
@@ -20,6 +25,9 @@ void log_friend_action(const char *username, const char *action, const char *tar
 void log_group_action(const char *username, const char *action, const char *details);
 
 // Log tin nhắn
-void log_message(const char *from, const char *to, const char *type);
+void log_message(const char *from, const char *to, const char *type, uint64_t msg_id);
+
+// Log reactor bị kẹt quá ngưỡng watchdog, kèm lệnh đang chạy và backtrace (có thể 0 frame)
+void log_stall(const char *username, const char *command, long ms, char **frames, int nframes);
 
 #endif
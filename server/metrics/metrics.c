@@ -0,0 +1,349 @@
+#include "metrics.h"
+#include "../util/strmap.h"
+#include "../util/outbuf.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SUB (1u << METRICS_SUB_BITS)
+#define COMMAND_NAME_LEN 24
+
+struct MetricsHist
+{
+    char name[COMMAND_NAME_LEN];
+    uint64_t sum_ns; // số lần = tổng các bucket, không cần counter riêng
+    uint64_t max_ns;
+    uint64_t buckets[METRICS_BUCKETS];
+};
+
+typedef struct
+{
+    char name[64];
+    const char *help;
+    metrics_gauge_fn fn;
+} Gauge;
+
+static uint64_t counters[METRIC_COUNTERS];
+static const char *const counter_names[METRIC_COUNTERS] = {
+    "bytes_received_total", "bytes_sent_total", "connections_accepted_total", "reactor_stalls_total"};
+static const char *const counter_help[METRIC_COUNTERS] = {
+    "Bytes read from client sockets", "Bytes written to client sockets",
+    "Client connections accepted or taken over", "Reactor iterations the watchdog caught over its threshold"};
+
+// commands[0] là METRICS_OTHER, các lệnh đăng ký nối tiếp
+static MetricsHist commands[METRICS_MAX_COMMANDS];
+static int ncommands = 0;
+static StrMap *by_name = NULL;
+
+static Gauge gauges[METRICS_MAX_GAUGES];
+static int ngauges = 0;
+
+static MetricsHist histograms[METRICS_MAX_HISTOGRAMS];
+static const char *histogram_help[METRICS_MAX_HISTOGRAMS];
+static int nhistograms = 0;
+
+static metrics_section_fn sections[METRICS_MAX_SECTIONS];
+static int nsections = 0;
+
+// ---------- ghi ----------
+
+void metrics_add(MetricCounter m, uint64_t n)
+{
+    __atomic_fetch_add(&counters[m], n, __ATOMIC_RELAXED);
+}
+
+uint64_t metrics_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int bucket_of(uint64_t v)
+{
+    if (v < SUB)
+        return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    if (msb > METRICS_MAX_SHIFT)
+        return METRICS_BUCKETS - 1;
+    int shift = msb - METRICS_SUB_BITS;
+    return ((shift + 1) << METRICS_SUB_BITS) + (int)((v >> shift) & (SUB - 1));
+}
+
+// Giá trị lớn nhất rơi vào bucket b (báo cáo theo cận trên cho an toàn)
+static uint64_t bucket_upper(int b)
+{
+    if (b < (int)SUB)
+        return (uint64_t)b;
+    int shift = (b >> METRICS_SUB_BITS) - 1;
+    uint64_t base = (uint64_t)(SUB + (b & (SUB - 1))) << shift;
+    return base + ((1ull << shift) - 1);
+}
+
+void metrics_observe(MetricsHist *h, uint64_t ns)
+{
+    __atomic_fetch_add(&h->buckets[bucket_of(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, ns, __ATOMIC_RELAXED);
+    // Không CAS: 2 thread cùng ghi max có thể mất 1 giá trị, chấp nhận được cho số liệu
+    if (ns > __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED))
+        __atomic_store_n(&h->max_ns, ns, __ATOMIC_RELAXED);
+}
+
+// ---------- đăng ký ----------
+
+static MetricsHist *other()
+{
+    if (ncommands == 0)
+    {
+        snprintf(commands[0].name, COMMAND_NAME_LEN, "%s", METRICS_OTHER);
+        ncommands = 1;
+    }
+    return &commands[0];
+}
+
+MetricsHist *metrics_command(const char *name)
+{
+    MetricsHist *h = metrics_command_find(name);
+    if (h != other() || ncommands >= METRICS_MAX_COMMANDS)
+        return h;
+    if (!by_name && !(by_name = strmap_new()))
+        return h;
+
+    h = &commands[ncommands];
+    snprintf(h->name, COMMAND_NAME_LEN, "%s", name);
+    if (strmap_put(by_name, h->name, h) != 0)
+        return other();
+    ncommands++;
+    return h;
+}
+
+MetricsHist *metrics_command_find(const char *name)
+{
+    MetricsHist *h = by_name ? strmap_get(by_name, name) : NULL;
+    return h ? h : other();
+}
+
+int metrics_command_index(const MetricsHist *h)
+{
+    return h >= commands && h < commands + ncommands ? (int)(h - commands) : -1;
+}
+
+int metrics_command_count()
+{
+    return ncommands;
+}
+
+const char *metrics_command_name(int index)
+{
+    return index >= 0 && index < ncommands ? commands[index].name : METRICS_OTHER;
+}
+
+void metrics_section(metrics_section_fn fn)
+{
+    if (nsections < METRICS_MAX_SECTIONS)
+        sections[nsections++] = fn;
+}
+
+MetricsHist *metrics_histogram(const char *name, const char *help)
+{
+    if (nhistograms >= METRICS_MAX_HISTOGRAMS)
+        return NULL;
+    MetricsHist *h = &histograms[nhistograms];
+    snprintf(h->name, COMMAND_NAME_LEN, "%s", name);
+    histogram_help[nhistograms++] = help;
+    return h;
+}
+
+void metrics_gauge(const char *name, const char *help, metrics_gauge_fn fn)
+{
+    if (ngauges >= METRICS_MAX_GAUGES)
+        return;
+    Gauge *g = &gauges[ngauges++];
+    snprintf(g->name, sizeof(g->name), "%s", name);
+    g->help = help;
+    g->fn = fn;
+}
+
+// ---------- xuất ----------
+
+// Bản chụp 1 histogram: bucket đọc từng cái nên count lấy từ tổng bucket cho khớp
+typedef struct
+{
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t count, sum_ns, max_ns;
+} HistSnap;
+
+static void snapshot(const MetricsHist *h, HistSnap *s)
+{
+    s->count = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++)
+    {
+        s->buckets[b] = __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+        s->count += s->buckets[b];
+    }
+    s->sum_ns = __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED);
+    s->max_ns = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+}
+
+static uint64_t quantile(const HistSnap *s, double q)
+{
+    if (s->count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(q * (double)s->count + 0.999999);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++)
+    {
+        seen += s->buckets[b];
+        if (seen >= rank)
+        {
+            uint64_t v = bucket_upper(b);
+            return v < s->max_ns ? v : s->max_ns;
+        }
+    }
+    return s->max_ns;
+}
+
+static void render_sections(OutBuf *o, int prometheus)
+{
+    for (int i = 0; i < nsections && o->len + 1 < o->cap; i++)
+        o->len += sections[i](o->out + o->len, o->cap - o->len, prometheus);
+}
+
+static uint64_t counter(int m)
+{
+    return __atomic_load_n(&counters[m], __ATOMIC_RELAXED);
+}
+
+size_t metrics_render_text(char *out, size_t outsz)
+{
+    OutBuf o = {out, outsz, 0};
+    if (outsz == 0)
+        return 0;
+    out[0] = '\0';
+
+    outbuf_put(&o, "=== Server stats ===\n");
+    for (int i = 0; i < ngauges; i++)
+        outbuf_put(&o, "%-28s %ld\n", gauges[i].name, gauges[i].fn());
+    for (int m = 0; m < METRIC_COUNTERS; m++)
+        outbuf_put(&o, "%-28s %llu\n", counter_names[m], (unsigned long long)counter(m));
+
+    outbuf_put(&o, "%-18s %10s %9s %9s %9s %9s %9s\n", "COMMAND", "count", "avg(us)", "p50(us)", "p99(us)",
+        "p999(us)", "max(us)");
+    HistSnap s;
+    for (int i = 0; i < ncommands; i++)
+    {
+        snapshot(&commands[i], &s);
+        if (s.count == 0)
+            continue;
+        outbuf_put(&o, "%-18s %10llu %9.1f %9.1f %9.1f %9.1f %9.1f\n", commands[i].name, (unsigned long long)s.count,
+            s.sum_ns / 1e3 / s.count, quantile(&s, 0.5) / 1e3, quantile(&s, 0.99) / 1e3,
+            quantile(&s, 0.999) / 1e3, s.max_ns / 1e3);
+    }
+    for (int i = 0; i < nhistograms; i++)
+    {
+        snapshot(&histograms[i], &s);
+        if (s.count == 0)
+            continue;
+        outbuf_put(&o, "%-18s %10llu %9.1f %9.1f %9.1f %9.1f %9.1f\n", histograms[i].name, (unsigned long long)s.count,
+            s.sum_ns / 1e3 / s.count, quantile(&s, 0.5) / 1e3, quantile(&s, 0.99) / 1e3,
+            quantile(&s, 0.999) / 1e3, s.max_ns / 1e3);
+    }
+    render_sections(&o, 0);
+    return o.len;
+}
+
+size_t metrics_render_prometheus(char *out, size_t outsz)
+{
+    static const double qs[] = {0.5, 0.9, 0.99, 0.999};
+    OutBuf o = {out, outsz, 0};
+    if (outsz == 0)
+        return 0;
+    out[0] = '\0';
+
+    for (int i = 0; i < ngauges; i++)
+    {
+        outbuf_put(&o, "# HELP minachat_%s %s\n# TYPE minachat_%s gauge\n", gauges[i].name, gauges[i].help, gauges[i].name);
+        outbuf_put(&o, "minachat_%s %ld\n", gauges[i].name, gauges[i].fn());
+    }
+    for (int m = 0; m < METRIC_COUNTERS; m++)
+    {
+        outbuf_put(&o, "# HELP minachat_%s %s\n# TYPE minachat_%s counter\n", counter_names[m], counter_help[m],
+            counter_names[m]);
+        outbuf_put(&o, "minachat_%s %llu\n", counter_names[m], (unsigned long long)counter(m));
+    }
+
+    outbuf_put(&o, "# HELP minachat_command_duration_seconds Time spent handling one protocol command\n"
+            "# TYPE minachat_command_duration_seconds summary\n");
+    HistSnap s;
+    for (int i = 0; i < ncommands; i++)
+    {
+        snapshot(&commands[i], &s);
+        const char *name = commands[i].name;
+        for (size_t q = 0; q < sizeof(qs) / sizeof(qs[0]); q++)
+            outbuf_put(&o, "minachat_command_duration_seconds{command=\"%s\",quantile=\"%g\"} %.9f\n", name, qs[q],
+                quantile(&s, qs[q]) / 1e9);
+        outbuf_put(&o, "minachat_command_duration_seconds_sum{command=\"%s\"} %.9f\n", name, s.sum_ns / 1e9);
+        outbuf_put(&o, "minachat_command_duration_seconds_count{command=\"%s\"} %llu\n", name,
+            (unsigned long long)s.count);
+    }
+    for (int i = 0; i < nhistograms; i++)
+    {
+        snapshot(&histograms[i], &s);
+        const char *name = histograms[i].name;
+        outbuf_put(&o, "# HELP minachat_%s_seconds %s\n# TYPE minachat_%s_seconds summary\n", name, histogram_help[i], name);
+        for (size_t q = 0; q < sizeof(qs) / sizeof(qs[0]); q++)
+            outbuf_put(&o, "minachat_%s_seconds{quantile=\"%g\"} %.9f\n", name, qs[q], quantile(&s, qs[q]) / 1e9);
+        outbuf_put(&o, "minachat_%s_seconds_sum %.9f\n", name, s.sum_ns / 1e9);
+        outbuf_put(&o, "minachat_%s_seconds_count %llu\n", name, (unsigned long long)s.count);
+    }
+    render_sections(&o, 1);
+    return o.len;
+}
+
+// ---------- endpoint ----------
+
+int metrics_listen()
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, METRICS_SOCK_PATH, sizeof(addr.sun_path) - 1);
+    unlink(METRICS_SOCK_PATH); // socket của process trước (đã thoát hoặc đang chuyển giao)
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void metrics_serve(int listen_fd)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+        return;
+
+    // Chạy trên reactor: không chờ người đọc chậm, phần không vừa buffer socket thì bỏ
+    static char buf[128 * 1024];
+    size_t len = metrics_render_prometheus(buf, sizeof(buf));
+    size_t sent = 0;
+    while (sent < len)
+    {
+        ssize_t n = send(fd, buf + sent, len - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        sent += (size_t)n;
+    }
+    close(fd);
+}
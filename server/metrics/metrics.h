@@ -0,0 +1,72 @@
+// Số liệu vận hành: counter, histogram độ trễ theo lệnh, gauge. Xem bằng lệnh STATS (admin)
+// hoặc đọc Unix socket METRICS_SOCK_PATH (định dạng text của Prometheus)
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define METRICS_SOCK_PATH "server_metrics.sock"
+#define METRICS_MAX_COMMANDS 48
+#define METRICS_MAX_GAUGES 16
+#define METRICS_MAX_HISTOGRAMS 8
+#define METRICS_MAX_SECTIONS 4
+#define METRICS_OTHER "OTHER" // dòng không khớp lệnh nào đã đăng ký
+
+/*
+    Histogram kiểu HDR: 8 bucket tuyến tính cho mỗi lũy thừa của 2 (sai số <= 12.5%),
+    giá trị tính bằng nano giây, tối đa ~2^40 ns (~18 phút). Ghi = vài phép dịch bit + 2 lệnh
+    atomic add, không lock, gọi được từ mọi thread
+*/
+#define METRICS_SUB_BITS 3
+#define METRICS_MAX_SHIFT 40
+#define METRICS_BUCKETS ((METRICS_MAX_SHIFT - METRICS_SUB_BITS + 2) << METRICS_SUB_BITS)
+
+typedef enum
+{
+    METRIC_BYTES_IN,
+    METRIC_BYTES_OUT,
+    METRIC_CONNECTIONS, // số kết nối đã accept (kể cả nhận lại khi hot upgrade)
+    METRIC_REACTOR_STALLS, // số lần watchdog thấy reactor kẹt quá ngưỡng
+    METRIC_COUNTERS
+} MetricCounter;
+
+typedef struct MetricsHist MetricsHist;
+
+void metrics_add(MetricCounter m, uint64_t n);
+
+// Đăng ký 1 lệnh (gọi lúc khởi động). Trả về histogram của lệnh
+MetricsHist *metrics_command(const char *name);
+// Tra histogram theo tên lệnh, lệnh chưa đăng ký gộp vào METRICS_OTHER
+MetricsHist *metrics_command_find(const char *name);
+void metrics_observe(MetricsHist *h, uint64_t ns);
+
+// Chỉ số của lệnh (0 = METRICS_OTHER, < metrics_command_count()) để module khác đếm theo lệnh
+int metrics_command_index(const MetricsHist *h); // -1 nếu h không phải histogram của lệnh
+int metrics_command_count();
+const char *metrics_command_name(int index);
+
+// Histogram độ trễ không gắn với lệnh (vd. thời gian 1 lượt vòng lặp reactor). Gọi lúc khởi động,
+// xuất ra Prometheus tên minachat_<name>_seconds. NULL nếu hết chỗ
+MetricsHist *metrics_histogram(const char *name, const char *help);
+
+uint64_t metrics_now_ns(); // CLOCK_MONOTONIC
+
+// Gauge đọc giá trị lúc xuất số liệu (số client, độ dài hàng đợi, ...)
+typedef long (*metrics_gauge_fn)();
+void metrics_gauge(const char *name, const char *help, metrics_gauge_fn fn);
+
+// Module có bảng số liệu riêng (vd. iostat) tự xuất phần của mình, nối vào cuối STATS / Prometheus.
+// Trả về số byte đã ghi (không tính '\0')
+typedef size_t (*metrics_section_fn)(char *out, size_t outsz, int prometheus);
+void metrics_section(metrics_section_fn fn);
+
+// Xuất số liệu. Trả về số byte đã ghi (không tính '\0'), cắt bớt nếu thiếu chỗ
+size_t metrics_render_text(char *out, size_t outsz);       // bảng cho lệnh STATS
+size_t metrics_render_prometheus(char *out, size_t outsz); // text exposition format
+
+// Endpoint: mỗi kết nối vào socket nhận 1 bản số liệu Prometheus rồi bị đóng
+int metrics_listen(); // Trả về fd cần poll hoặc -1
+void metrics_serve(int listen_fd);
+
+#endif
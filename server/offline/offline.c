@@ -1,298 +1,421 @@
 #include "offline.h"
 #include "../auth/auth.h"
+#include "../idgen/idgen.h"
+#include "../intern/intern.h"
+#include "../probe/probe.h"
+#include "../trace/trace.h"
+#include "../util/idmap.h"
+#include "../wal/wal.h"
 
-#include <sys/file.h>
-#include <fcntl.h>
-#include <unistd.h>
 #include <time.h>
 
 #define OFFLINE_MESSAGES_FILE "offline_messages.txt"
 #define MAX_LINE_LEN 2048
+#define OFFLINE_FROM_LEN (USERNAME_LEN + 50) // Đủ chứa GROUP:xxx:yyy
 
-// Helper: mở file với lock
-static int open_offline_locked(int flags, int lock_type, FILE **out_file, int *out_fd)
-{
-    int fd = open(OFFLINE_MESSAGES_FILE, flags, 0644);
-    if (fd < 0)
-        return 0;
-
-    if (flock(fd, lock_type) != 0)
-    {
-        close(fd);
-        return 0;
-    }
-
-    // Chọn mode phù hợp dựa trên flags
-    const char *mode;
-    if ((flags & O_RDWR) == O_RDWR)
-        mode = "r+";
-    else if (flags & O_WRONLY)
-        mode = "a"; // append mode cho write-only
-    else
-        mode = "r";
+/*
+    State: user ID -> hàng đợi tin nhắn offline (theo thứ tự gửi)
+    Lưu = 1 record WAL_OFFLINE_SAVE, giao xong = 1 record WAL_OFFLINE_CLEAR.
+    WAL ghi người gửi dạng chuỗi ("user" hoặc "GROUP:group_id:user"), trong bộ nhớ chỉ giữ ID.
+    Hàng đợi chưa đụng tới kể từ snapshot được đọc thẳng trên mapping; xóa hàng đợi đó
+    thì để lại 1 hàng đợi rỗng trong RAM để che bản trong snapshot
+*/
 
-    FILE *f = fdopen(fd, mode);
-    if (!f)
-    {
-        flock(fd, LOCK_UN);
-        close(fd);
-        return 0;
-    }
+typedef struct
+{
+    uint32_t from;  // user ID
+    uint32_t group; // group ID, INTERN_NONE = tin nhắn riêng
+    long timestamp;
+    uint64_t msg_id; // 0 = tin nhắn từ trước khi có ID
+    char *text;
+} OfflineMsg;
+
+typedef struct
+{
+    OfflineMsg *items;
+    int n, cap;
+} OfflineQueue;
 
-    *out_file = f;
-    *out_fd = fd;
-    return 1;
-}
+static IdMap queues; // user ID -> OfflineQueue*
 
-// Helper: escape pipe character trong message
-static void escape_message(const char *src, char *dst, size_t dst_size)
+// Helper: unescape pipe character (chỉ dùng khi import file cũ)
+static void unescape_message(const char *src, char *dst, size_t dst_size)
 {
     size_t i = 0, j = 0;
     while (src[i] && j < dst_size - 1)
     {
-        if (src[i] == '|')
-        {
-            if (j < dst_size - 2)
-            {
-                dst[j++] = '\\';
-                dst[j++] = '|';
-            }
-            else
-                break;
-        }
-        else if (src[i] == '\n' || src[i] == '\r')
+        if (src[i] == '\\' && src[i + 1] == '|')
         {
-            // Skip newlines
-            i++;
-            continue;
+            dst[j++] = '|';
+            i += 2;
         }
         else
         {
-            dst[j++] = src[i];
+            dst[j++] = src[i++];
         }
-        i++;
     }
     dst[j] = '\0';
 }
 
-// Helper: unescape pipe character
-static void unescape_message(const char *src, char *dst, size_t dst_size)
+// Helper: bỏ ký tự xuống dòng như bản lưu file cũ
+static void strip_newlines(const char *src, char *dst, size_t dst_size)
 {
-    size_t i = 0, j = 0;
-    while (src[i] && j < dst_size - 1)
+    size_t j = 0;
+    for (size_t i = 0; src[i] && j < dst_size - 1; i++)
     {
-        if (src[i] == '\\' && src[i + 1] == '|')
-        {
-            dst[j++] = '|';
-            i += 2;
-        }
-        else
-        {
-            dst[j++] = src[i++];
-        }
+        if (src[i] != '\n' && src[i] != '\r')
+            dst[j++] = src[i];
     }
     dst[j] = '\0';
 }
 
-// Lưu tin nhắn offline vào file
-// Format: to_user|from_user|timestamp|message
-int offline_save_message(const char *to_user, const char *from_user, const char *message)
+// "user" hoặc "GROUP:group_id:user" (định dạng trong WAL và file cũ) -> ID
+static void parse_from(const char *from, uint32_t *user, uint32_t *group)
 {
-    if (!to_user || !from_user || !message)
-        return -1;
+    char gid[USERNAME_LEN], actual[USERNAME_LEN];
+    if (strncmp(from, "GROUP:", 6) == 0 && sscanf(from, "GROUP:%49[^:]:%49s", gid, actual) == 2)
+    {
+        *group = intern_id(INTERN_GROUPS, gid);
+        *user = intern_id(INTERN_USERS, actual);
+        return;
+    }
+    *group = INTERN_NONE;
+    *user = intern_id(INTERN_USERS, from);
+}
 
-    FILE *f = NULL;
-    int fd = -1;
-    if (!open_offline_locked(O_WRONLY | O_CREAT | O_APPEND, LOCK_EX, &f, &fd))
-        return -1;
+// ---------- apply (dùng chung cho thao tác mới và replay WAL) ----------
 
-    // Escape message để tránh conflict với delimiter
-    char escaped_msg[INBUF_SIZE];
-    escape_message(message, escaped_msg, sizeof(escaped_msg));
+static const SnapEntry *base_find(uint32_t to, SnapTable *base)
+{
+    if (snap_table(SNAP_OFFLINE, base) != 0)
+        return NULL;
+    const SnapEntry *e = snap_at(base, to);
+    return e && e->n > 0 ? e : NULL;
+}
 
-    // Lấy timestamp
-    time_t now = time(NULL);
+static int queue_push(OfflineQueue *q, const OfflineMsg *m);
 
-    // Ghi vào file
-    int rc = fprintf(f, "%s|%s|%ld|%s\n", to_user, from_user, (long)now, escaped_msg);
+static OfflineQueue *queue_get(uint32_t to)
+{
+    OfflineQueue *q = idmap_get(&queues, to);
+    if (q || to == INTERN_NONE)
+        return q;
+
+    q = calloc(1, sizeof(OfflineQueue));
+    if (!q)
+        return NULL;
+
+    // Chép phần đang nằm trong snapshot ra trước khi thêm tin mới
+    SnapTable base;
+    const SnapEntry *e = base_find(to, &base);
+    for (uint32_t i = 0; e && i < e->n; i++)
+    {
+        SnapOfflineItem it;
+        if (snap_item_copy(&base, e->first + i, &it, sizeof(it)) != 0)
+            continue;
+        OfflineMsg m = {it.from, it.group, (long)it.timestamp, it.msg_id, (char *)snap_str(&base, it.text)};
+        queue_push(q, &m);
+    }
 
-    if (rc < 0 || fflush(f) != 0)
+    if (idmap_put(&queues, to, q) != 0)
     {
-        flock(fd, LOCK_UN);
-        fclose(f);
+        free(q);
+        return NULL;
+    }
+    return q;
+}
+
+static int apply_save(uint32_t to, const OfflineMsg *m)
+{
+    OfflineQueue *q = queue_get(to);
+    if (!q)
         return -1;
+    return queue_push(q, m);
+}
+
+// Chép m vào cuối hàng đợi (text được strdup)
+static int queue_push(OfflineQueue *q, const OfflineMsg *m)
+{
+    if (q->n >= q->cap)
+    {
+        int newcap = (q->cap == 0) ? 8 : q->cap * 2;
+        OfflineMsg *tmp = realloc(q->items, newcap * sizeof(OfflineMsg));
+        if (!tmp)
+            return -1;
+        q->items = tmp;
+        q->cap = newcap;
     }
 
-    flock(fd, LOCK_UN);
-    fclose(f);
+    OfflineMsg *dst = &q->items[q->n];
+    *dst = *m;
+    dst->text = strdup(m->text);
+    if (!dst->text)
+        return -1;
+    q->n++;
     return 0;
 }
 
-// Lưu tin nhắn group offline
-// Format: to_user|GROUP:group_id:from_user|timestamp|message
-int offline_save_group_message(const char *to_user, const char *group_id, const char *from_user, const char *message)
+static void apply_clear(uint32_t to)
 {
-    if (!to_user || !group_id || !from_user || !message)
-        return -1;
+    SnapTable base;
+    int in_base = base_find(to, &base) != NULL;
+
+    OfflineQueue *q = in_base ? queue_get(to) : idmap_get(&queues, to);
+    if (!q)
+        return;
+    for (int i = 0; i < q->n; i++)
+        free(q->items[i].text);
+    free(q->items);
+    q->items = NULL;
+    q->n = q->cap = 0;
+    if (!in_base)
+    {
+        idmap_put(&queues, to, NULL);
+        free(q);
+    }
+}
 
-    FILE *f = NULL;
-    int fd = -1;
-    if (!open_offline_locked(O_WRONLY | O_CREAT | O_APPEND, LOCK_EX, &f, &fd))
+static int replay_save(WalReader *r)
+{
+    char to[USERNAME_LEN], from[OFFLINE_FROM_LEN], text[INBUF_SIZE];
+    int64_t ts;
+    if (wal_read_str(r, to, sizeof(to)) != 0 || wal_read_str(r, from, sizeof(from)) != 0 ||
+        wal_read_i64(r, &ts) != 0 || wal_read_str(r, text, sizeof(text)) != 0)
         return -1;
 
-    // Escape message
-    char escaped_msg[INBUF_SIZE];
-    escape_message(message, escaped_msg, sizeof(escaped_msg));
+    // Record cũ không có msg_id
+    int64_t msg_id = 0;
+    if (wal_read_i64(r, &msg_id) == 0)
+        idgen_observe((uint64_t)msg_id);
 
-    // Lấy timestamp
-    time_t now = time(NULL);
+    OfflineMsg m = {0, 0, (long)ts, (uint64_t)msg_id, text};
+    parse_from(from, &m.from, &m.group);
+    return apply_save(intern_id(INTERN_USERS, to), &m);
+}
+
+static int replay_clear(WalReader *r)
+{
+    char to[USERNAME_LEN];
+    if (wal_read_str(r, to, sizeof(to)) != 0)
+        return -1;
+    apply_clear(intern_find(INTERN_USERS, to));
+    return 0;
+}
+
+static int queue_count(uint32_t to, SnapTable *base)
+{
+    OfflineQueue *q = idmap_get(&queues, to);
+    if (q)
+        return q->n;
+    const SnapEntry *e = base_find(to, base);
+    return e ? (int)e->n : 0;
+}
 
-    // Format from_user với prefix GROUP để phân biệt
-    char group_from[USERNAME_LEN + 50];
-    snprintf(group_from, sizeof(group_from), "GROUP:%s:%s", group_id, from_user);
+static void snapshot_offline(SnapWriter *w)
+{
+    SnapTable base;
+    snap_table(SNAP_OFFLINE, &base);
 
-    // Ghi vào file
-    int rc = fprintf(f, "%s|%s|%ld|%s\n", to_user, group_from, (long)now, escaped_msg);
+    // Bảng theo ID chỉ cần dài tới user cuối cùng còn tin nhắn chờ
+    uint32_t last = idmap_end(&queues) > base.count ? idmap_end(&queues) - 1 : base.count;
+    while (last > 0 && queue_count(last, &base) == 0)
+        last--;
 
-    if (rc < 0 || fflush(f) != 0)
+    snap_table_begin(w, SNAP_OFFLINE, sizeof(SnapOfflineItem));
+    for (uint32_t uid = 1; uid <= last; uid++)
     {
-        flock(fd, LOCK_UN);
-        fclose(f);
-        return -1;
+        snap_table_entry(w, NULL, 0);
+        OfflineQueue *q = idmap_get(&queues, uid);
+        const SnapEntry *e = q ? NULL : base_find(uid, &base);
+        int count = q ? q->n : e ? (int)e->n : 0;
+        for (int k = 0; k < count; k++)
+        {
+            SnapOfflineItem it = {0};
+            if (q)
+            {
+                it.from = q->items[k].from;
+                it.group = q->items[k].group;
+                it.text = snap_string(w, q->items[k].text);
+                it.timestamp = q->items[k].timestamp;
+                it.msg_id = q->items[k].msg_id;
+            }
+            else
+            {
+                if (snap_item_copy(&base, e->first + k, &it, sizeof(it)) != 0)
+                    break;
+                it.text = snap_string(w, snap_str(&base, it.text));
+            }
+            snap_table_item(w, &it);
+        }
     }
+    snap_table_end(w);
+}
 
-    flock(fd, LOCK_UN);
-    fclose(f);
-    return 0;
+void offline_init()
+{
+    wal_register_handler(WAL_OFFLINE_SAVE, replay_save);
+    wal_register_handler(WAL_OFFLINE_CLEAR, replay_clear);
+    wal_register_snapshot(snapshot_offline);
 }
 
-// Gửi tất cả tin nhắn offline cho user
-int offline_deliver_messages(const char *username, int fd)
+static int save(uint32_t to, const OfflineMsg *m)
 {
-    if (!username)
-        return 0;
+    if (to == INTERN_NONE || m->from == INTERN_NONE)
+        return -1;
 
-    FILE *f = NULL;
-    int ffd = -1;
-    if (!open_offline_locked(O_RDWR | O_CREAT, LOCK_EX, &f, &ffd))
-        return 0;
+    char from_str[OFFLINE_FROM_LEN];
+    if (m->group != INTERN_NONE)
+        snprintf(from_str, sizeof(from_str), "GROUP:%s:%s",
+                 intern_name(INTERN_GROUPS, m->group), intern_name(INTERN_USERS, m->from));
+    else
+        snprintf(from_str, sizeof(from_str), "%s", intern_name(INTERN_USERS, m->from));
+
+    WalRecord rec;
+    wal_record_begin(&rec, WAL_OFFLINE_SAVE);
+    wal_record_str(&rec, intern_name(INTERN_USERS, to));
+    wal_record_str(&rec, from_str);
+    wal_record_i64(&rec, m->timestamp);
+    wal_record_str(&rec, m->text);
+    wal_record_i64(&rec, (int64_t)m->msg_id);
+    if (wal_append(&rec) != 0)
+        return -1;
+    PROBE3(offline__save, to, m->from, m->msg_id);
+    return apply_save(to, m);
+}
 
-    char **remaining_lines = NULL;
-    int remaining_cap = 0, remaining_count = 0;
-    int delivered_count = 0;
+int offline_import_legacy()
+{
+    FILE *f = fopen(OFFLINE_MESSAGES_FILE, "r");
+    if (!f)
+        return 0;
 
+    int count = 0;
     char buf[MAX_LINE_LEN];
-    rewind(f);
-
     while (fgets(buf, sizeof(buf), f))
     {
         char to_user[USERNAME_LEN];
-        char from_user[USERNAME_LEN + 50]; // Tăng size để chứa GROUP:xxx:yyy
+        char from_user[OFFLINE_FROM_LEN];
         long timestamp;
         char escaped_msg[INBUF_SIZE];
 
-        // Parse line: to_user|from_user|timestamp|message
-        int parsed = sscanf(buf, "%49[^|]|%99[^|]|%ld|%[^\n]", to_user, from_user, &timestamp, escaped_msg);
+        // Format cũ: to_user|from_user|timestamp|message
+        if (sscanf(buf, "%49[^|]|%99[^|]|%ld|%[^\n]", to_user, from_user, &timestamp, escaped_msg) != 4)
+            continue;
 
-        if (parsed == 4 && strcmp(to_user, username) == 0)
-        {
-            // Tin nhắn này dành cho user đang login
-            char unescaped_msg[INBUF_SIZE];
-            unescape_message(escaped_msg, unescaped_msg, sizeof(unescaped_msg));
+        char msg[INBUF_SIZE];
+        unescape_message(escaped_msg, msg, sizeof(msg));
+        OfflineMsg m = {0, 0, timestamp, 0, msg};
+        parse_from(from_user, &m.from, &m.group);
+        if (save(intern_id(INTERN_USERS, to_user), &m) == 0)
+            count++;
+    }
+    fclose(f);
+    rename(OFFLINE_MESSAGES_FILE, OFFLINE_MESSAGES_FILE ".migrated");
+    return count;
+}
 
-            // Kiểm tra xem có phải group message không
-            char formatted[INBUF_SIZE + 100];
-            int n = 0;
+// Lưu tin nhắn offline
+int offline_save_message(const char *to_user, const char *from_user, uint64_t msg_id, const char *message)
+{
+    TRACE_SCOPE("offline", "offline_save_message");
+    if (!to_user || !from_user || !message)
+        return -1;
 
-            if (strncmp(from_user, "GROUP:", 6) == 0)
-            {
-                // Format: GROUP:group_id:actual_from_user
-                char group_id[USERNAME_LEN];
-                char actual_from[USERNAME_LEN];
-
-                if (sscanf(from_user, "GROUP:%49[^:]:%49s", group_id, actual_from) == 2)
-                {
-                    n = snprintf(formatted, sizeof(formatted),
-                                 "[Offline Group %s - %s] %s\n", group_id, actual_from, unescaped_msg);
-                }
-                else
-                {
-                    // Fallback nếu parse lỗi
-                    n = snprintf(formatted, sizeof(formatted),
-                                 "[Offline Group] %s\n", unescaped_msg);
-                }
-            }
-            else
-            {
-                // Private message thông thường
-                n = snprintf(formatted, sizeof(formatted),
-                             "[Offline PM from %s] %s\n", from_user, unescaped_msg);
-            }
+    char msg[INBUF_SIZE];
+    strip_newlines(message, msg, sizeof(msg));
+    OfflineMsg m = {intern_find(INTERN_USERS, from_user), INTERN_NONE, (long)time(NULL), msg_id, msg};
+    return save(intern_find(INTERN_USERS, to_user), &m);
+}
 
-            if (n > 0 && (size_t)n < sizeof(formatted))
-            {
-                send(fd, formatted, strlen(formatted), 0);
-                delivered_count++;
-            }
+// Lưu tin nhắn group offline, giữ group ID để khi giao hiển thị đúng group
+int offline_save_group_message(const char *to_user, const char *group_id, const char *from_user,
+                               uint64_t msg_id, const char *message)
+{
+    TRACE_SCOPE("offline", "offline_save_group_message");
+    if (!to_user || !group_id || !from_user || !message)
+        return -1;
 
-            // Không lưu lại dòng này (đã gửi)
-            continue;
-        }
+    uint32_t group = intern_find(INTERN_GROUPS, group_id);
+    if (group == INTERN_NONE)
+        return -1;
 
-        // Lưu lại các dòng khác (không phải của user này)
-        if (remaining_count >= remaining_cap)
-        {
-            int new_cap = (remaining_cap == 0) ? 32 : remaining_cap * 2;
-            char **tmp = realloc(remaining_lines, new_cap * sizeof(char *));
-            if (!tmp)
-            {
-                // Lỗi malloc, giữ nguyên file
-                for (int i = 0; i < remaining_count; i++)
-                    free(remaining_lines[i]);
-                free(remaining_lines);
-                flock(ffd, LOCK_UN);
-                fclose(f);
-                return delivered_count;
-            }
-            remaining_lines = tmp;
-            remaining_cap = new_cap;
-        }
+    char msg[INBUF_SIZE];
+    strip_newlines(message, msg, sizeof(msg));
+    OfflineMsg m = {intern_find(INTERN_USERS, from_user), group, (long)time(NULL), msg_id, msg};
+    return save(intern_find(INTERN_USERS, to_user), &m);
+}
 
-        remaining_lines[remaining_count] = strdup(buf);
-        if (!remaining_lines[remaining_count])
-        {
-            for (int i = 0; i < remaining_count; i++)
-                free(remaining_lines[i]);
-            free(remaining_lines);
-            flock(ffd, LOCK_UN);
-            fclose(f);
-            return delivered_count;
-        }
-        remaining_count++;
-    }
+// Format 1 tin nhắn offline để gửi cho client, trả về độ dài (0 nếu lỗi)
+static int format_offline(uint32_t from, uint32_t group, const char *msg, char *out, size_t outsz)
+{
+    int n = 0;
 
-    // Rewrite file với các dòng còn lại
-    if (ftruncate(ffd, 0) != 0)
+    if (group != INTERN_NONE)
+    {
+        n = snprintf(out, outsz, "[Offline Group %s - %s] %s\n",
+                     intern_name(INTERN_GROUPS, group), intern_name(INTERN_USERS, from), msg);
+    }
+    else
     {
-        for (int i = 0; i < remaining_count; i++)
-            free(remaining_lines[i]);
-        free(remaining_lines);
-        flock(ffd, LOCK_UN);
-        fclose(f);
-        return delivered_count;
+        // Private message thông thường
+        n = snprintf(out, outsz, "[Offline PM from %s] %s\n", intern_name(INTERN_USERS, from), msg);
     }
 
-    rewind(f);
-    for (int i = 0; i < remaining_count; i++)
+    return (n > 0 && (size_t)n < outsz) ? n : 0;
+}
+
+// Gửi tất cả tin nhắn offline cho user
+int offline_deliver_messages(const char *username, offline_deliver_cb deliver, void *userdata)
+{
+    TRACE_SCOPE("offline", "offline_deliver_messages");
+    if (!username || !deliver)
+        return 0;
+
+    // Hàng đợi sẽ bị xóa ngay sau đó nên đọc thẳng trên mapping, không chép ra RAM
+    uint32_t to = intern_find(INTERN_USERS, username);
+    SnapTable base;
+    OfflineQueue *q = idmap_get(&queues, to);
+    const SnapEntry *e = q ? NULL : base_find(to, &base);
+    if (q ? q->n == 0 : !e)
+        return 0;
+
+    int delivered_count = 0;
+    int count = q ? q->n : (int)e->n;
+    for (int i = 0; i < count; i++)
     {
-        fputs(remaining_lines[i], f);
-        free(remaining_lines[i]);
+        uint32_t from, group;
+        const char *msg;
+        if (q)
+        {
+            from = q->items[i].from;
+            group = q->items[i].group;
+            msg = q->items[i].text;
+        }
+        else
+        {
+            SnapOfflineItem it;
+            if (snap_item_copy(&base, e->first + i, &it, sizeof(it)) != 0)
+                break;
+            from = it.from;
+            group = it.group;
+            msg = snap_str(&base, it.text);
+        }
+
+        char formatted[INBUF_SIZE + 100];
+        if (format_offline(from, group, msg, formatted, sizeof(formatted)) > 0)
+        {
+            deliver(formatted, userdata);
+            delivered_count++;
+        }
     }
-    free(remaining_lines);
 
-    fflush(f);
-    flock(ffd, LOCK_UN);
-    fclose(f);
+    // Đã giao hết -> xóa hàng đợi
+    WalRecord rec;
+    wal_record_begin(&rec, WAL_OFFLINE_CLEAR);
+    wal_record_str(&rec, username);
+    wal_append(&rec);
+    apply_clear(to);
 
+    PROBE2(offline__deliver, to, delivered_count);
     return delivered_count;
 }
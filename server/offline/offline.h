@@ -3,14 +3,23 @@
 
 #include "../../common.h"
 
-// Lưu tin nhắn offline khi người nhận không online
-int offline_save_message(const char *to_user, const char *from_user, const char *message);
+// Tạo hàng đợi offline in-memory và đăng ký handler replay WAL
+void offline_init();
+// Lần đầu chạy với WAL: nạp offline_messages.txt kiểu cũ vào WAL. Trả về số tin nhắn
+int offline_import_legacy();
 
-// Lưu tin nhắn group cho một member offline
-int offline_save_group_message(const char *to_user, const char *group_id, const char *from_user, const char *message);
+// Lưu tin nhắn offline khi người nhận không online (msg_id lấy từ idgen_next)
+int offline_save_message(const char *to_user, const char *from_user, uint64_t msg_id, const char *message);
+
+// Lưu tin nhắn group cho một member offline, cùng msg_id cho mọi member
+int offline_save_group_message(const char *to_user, const char *group_id, const char *from_user,
+                               uint64_t msg_id, const char *message);
+
+// Callback nhận từng tin nhắn offline đã format sẵn (kết thúc bằng '\n')
+typedef void (*offline_deliver_cb)(const char *text, void *userdata);
 
 // Gửi tất cả tin nhắn offline cho user khi họ login
 // Trả về số tin nhắn đã gửi
-int offline_deliver_messages(const char *username, int fd);
+int offline_deliver_messages(const char *username, offline_deliver_cb deliver, void *userdata);
 
 #endif
@@ -0,0 +1,41 @@
+// Điểm probe tĩnh USDT (SystemTap SDT), provider "minachat", để bpftrace / perf / stap gắn vào
+// server đang chạy mà không cần restart. Mỗi probe chỉ là 1 lệnh nop + ghi chú trong section
+// .note.stapsdt, không tốn gì khi không có ai gắn. Cần <sys/sdt.h> (gói systemtap-sdt-dev /
+// systemtap-sdt-devel); không có thì các macro dưới đây thành rỗng. Build với -DMINACHAT_NO_USDT để tắt
+#ifndef PROBE_H
+#define PROBE_H
+
+/*
+    Probe                     Tham số
+    conn__accept              conn_id, fd
+    user__login               conn_id, uid                (LOGIN, REGISTER xong, RESUME)
+    user__logout              conn_id, uid                (LOGOUT hoặc mất kết nối khi đang login)
+    command__start            conn_id, uid, code, cmd     code = chỉ số lệnh trong metrics (0 = OTHER), cmd là chuỗi
+    command__end              conn_id, uid, code, elapsed_ns
+    message__enqueue          msg_id, from_uid, target, is_group   target = chuỗi username / group ID
+    message__deliver          conn_id, to_uid, msg_id     giao tới 1 client đang online
+    offline__save             to_uid, from_uid, msg_id
+    offline__deliver          uid, count                  giao hàng đợi offline lúc login
+    uid = 0 khi chưa login. Ví dụ:
+      bpftrace -e 'usdt:./server_app:minachat:command__end { @us[arg2] = hist(arg3 / 1000); }'
+*/
+
+#if !defined(MINACHAT_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MINACHAT_USDT 1
+#endif
+#endif
+
+#ifdef MINACHAT_USDT
+#define PROBE2(name, a, b) DTRACE_PROBE2(minachat, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(minachat, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(minachat, name, a, b, c, d)
+#else
+// Tham số không bị tính (if (0)) nhưng vẫn được "dùng" để không sinh cảnh báo biến thừa
+#define PROBE2(name, a, b) do { if (0) { (void)(a); (void)(b); } } while (0)
+#define PROBE3(name, a, b, c) do { if (0) { (void)(a); (void)(b); (void)(c); } } while (0)
+#define PROBE4(name, a, b, c, d) do { if (0) { (void)(a); (void)(b); (void)(c); (void)(d); } } while (0)
+#endif
+
+#endif
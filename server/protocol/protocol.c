@@ -1,27 +1,52 @@
 #include "protocol.h"
 #include "../auth/auth.h"
+#include "../capture/capture.h"
+#include "../durable/durable.h"
 #include "../friend/friend.h"
 #include "../group/group.h"
+#include "../history/history.h"
+#include "../fanout/fanout.h"
+#include "../idgen/idgen.h"
+#include "../intern/intern.h"
+#include "../iostat/iostat.h"
 #include "../offline/offline.h"
+#include "../probe/probe.h"
+#include "../pubsub/pubsub.h"
+#include "../recent/recent.h"
 #include "../log/log.h"
+#include "../metrics/metrics.h"
+#include "../session/session.h"
+#include "../slowlog/slowlog.h"
+#include "../trace/trace.h"
+#include "../watchdog/watchdog.h"
+#include "../worker/worker.h"
+
+#include <time.h>
 
 // --- Helper Struct & Callback cho GROUPMSG ---
 
 // 1. Định nghĩa struct để chứa dữ liệu truyền vào callback
+// Tự giữ bản sao chuỗi vì fan-out lớn còn chạy tiếp sau khi protocol_handle đã trả về
 typedef struct
 {
-    const char *group_id;
-    const char *from_user;
-    const char *message;
-    const char *formatted_msg;
+    char group_id[GROUP_ID_LEN];
+    char from_user[USERNAME_LEN];
+    char message[INBUF_SIZE];
+    char formatted_msg[INBUF_SIZE];
+    uint64_t msg_id;
     Client *sender;
+    uint64_t sender_conn; // sender có thể đã ngắt kết nối khi fan-out xong
     int sent_count;
     int offline_count;
+    uint32_t *offline; // member offline lúc gửi, giao dần qua fanout
+    int n_offline, cap_offline;
 } GroupMsgData;
 
 static void send_text(int fd, const char *msg)
 {
     int len = strlen(msg);
+    if (durable_hold(fd, msg, (size_t)len))
+        return;
     int sent = 0;
     while (sent < len)
     {
@@ -29,6 +54,8 @@ static void send_text(int fd, const char *msg)
         if (n <= 0)
             return; // Lỗi hoặc connection closed
         sent += n;
+        metrics_add(METRIC_BYTES_OUT, n);
+        slowlog_count_send();
     }
 }
 
@@ -37,51 +64,401 @@ static int is_online_cb(const char *username)
     return client_by_username(username) != NULL;
 }
 
-// Wrapper cho group_check_member để phù hợp với client_filter_cb signature
-static int group_member_filter(const char *username, void *userdata)
+// Giao 1 tin nhắn PM / group tới client đang online
+static void deliver_message(Client *dst, const char *text, uint64_t msg_id)
 {
-    const char *group_id = (const char *)userdata;
-    return group_check_member(group_id, username);
+    session_deliver(dst->username, dst->fd, text);
+    PROBE3(message__deliver, dst->conn_id, dst->uid, msg_id);
 }
 
-// 2. Đưa hàm callback ra ngoài (File scope)
-static void send_or_save_group_msg(const char *member, void *userdata)
+// Giao tin nhắn offline qua session để được gán seq (RESUME có thể replay)
+static void deliver_to_client(const char *text, void *userdata)
 {
-    GroupMsgData *data = (GroupMsgData *)userdata;
+    Client *c = (Client *)userdata;
+    session_deliver(c->username, c->fd, text);
+}
 
-    // Không gửi lại cho chính người gửi
-    if (strcmp(member, data->from_user) == 0)
+// Member online nhận ngay, người gửi đã online nên không nằm trong danh sách offline
+static void send_group_msg_online(uint32_t uid, void *userdata)
+{
+    GroupMsgData *data = (GroupMsgData *)userdata;
+    Client *dst = client_by_uid(uid);
+    if (!dst || dst == data->sender)
         return;
 
-    Client *dst = client_by_username(member);
+    deliver_message(dst, data->formatted_msg, data->msg_id);
+    data->sent_count++;
+}
+
+static void collect_offline_cb(uint32_t uid, void *userdata)
+{
+    GroupMsgData *data = (GroupMsgData *)userdata;
+    if (data->n_offline >= data->cap_offline)
+    {
+        int newcap = data->cap_offline == 0 ? 64 : data->cap_offline * 2;
+        uint32_t *tmp = realloc(data->offline, newcap * sizeof(uint32_t));
+        if (!tmp)
+            return;
+        data->offline = tmp;
+        data->cap_offline = newcap;
+    }
+    data->offline[data->n_offline++] = uid;
+}
+
+// Member offline lúc gửi: lưu vào hàng đợi offline, trừ khi họ đã login trong lúc fan-out chạy
+static void deliver_group_msg_offline(uint32_t uid, void *userdata)
+{
+    GroupMsgData *data = (GroupMsgData *)userdata;
+    Client *dst = client_by_uid(uid);
     if (dst)
     {
-        // Member đang online, gửi ngay
-        send(dst->fd, data->formatted_msg, strlen(data->formatted_msg), 0);
+        deliver_message(dst, data->formatted_msg, data->msg_id);
         data->sent_count++;
+        return;
     }
-    else
+
+    const char *member = intern_name(INTERN_USERS, uid);
+    if (offline_save_group_message(member, data->group_id, data->from_user, data->msg_id, data->message) == 0)
     {
-        // Member offline, lưu tin nhắn
-        if (offline_save_group_message(member, data->group_id, data->from_user, data->message) == 0)
+        session_note_offline(member);
+        data->offline_count++;
+    }
+}
+
+// Fan-out xong: xác nhận cho người gửi nếu vẫn còn kết nối
+static void group_msg_done(void *userdata)
+{
+    GroupMsgData *data = (GroupMsgData *)userdata;
+    Client *c = data->sender;
+    if (c->fd != -1 && c->conn_id == data->sender_conn)
+    {
+        char confirm[256];
+        if (data->offline_count > 0)
+        {
+            snprintf(confirm, sizeof(confirm),
+                     "[Group %s] Sent to %d online, saved for %d offline member(s)\n",
+                     data->group_id, data->sent_count, data->offline_count);
+        }
+        else
         {
-            data->offline_count++;
+            snprintf(confirm, sizeof(confirm),
+                     "[Group %s] Message sent to %d online member(s)\n",
+                     data->group_id, data->sent_count);
         }
+        // Các lượt trước đã lưu tin offline vào WAL: xác nhận sau khi chúng lên đĩa
+        DurableScope outer = durable_begin(c, 0);
+        send_text(c->fd, confirm);
+        durable_end(outer);
     }
+    free(data->offline);
+    free(data);
 }
 
-// --- Main Protocol Handler ---
+// Thông báo của server cho các member đang online của group (trừ exclude)
+typedef struct
+{
+    const char *text;
+    Client *exclude;
+} GroupNotify;
 
-void protocol_handle(Client *c, const char *line)
+static void group_notify_cb(uint32_t uid, void *userdata)
 {
-    char buf[INBUF_SIZE];
-    strncpy(buf, line, sizeof(buf) - 1);
-    buf[sizeof(buf) - 1] = '\0';
+    GroupNotify *n = (GroupNotify *)userdata;
+    Client *dst = client_by_uid(uid);
+    if (dst && dst != n->exclude)
+        send_text(dst->fd, n->text);
+}
 
-    char *cmd = strtok(buf, " ");
-    if (!cmd)
+static void notify_group(const char *group_id, const char *text, Client *exclude)
+{
+    GroupNotify n = {text, exclude};
+    group_foreach_online_member(group_id, group_notify_cb, &n);
+}
+
+// --- Lịch sử hội thoại ---
+
+// Lỗi ghi lịch sử không chặn việc gửi tin, chỉ báo ra stderr
+static void save_pm_history(const char *from, const char *to, uint64_t msg_id, const char *msg)
+{
+    char key[HISTORY_KEY_LEN];
+    history_pm_key(from, to, key, sizeof(key));
+    if (history_append(key, msg_id, from, msg) == 0)
+        fprintf(stderr, "history append failed (%s -> %s)\n", from, to);
+}
+
+static void save_group_history(const char *group_id, const char *from, uint64_t msg_id, const char *msg)
+{
+    char key[HISTORY_KEY_LEN];
+    history_group_key(group_id, key, sizeof(key));
+    if (history_append(key, msg_id, from, msg) == 0)
+        fprintf(stderr, "history append failed (group %s)\n", group_id);
+}
+
+// Mỗi tin nhắn trong trang HISTORY: "#<seq> [<thời gian>] <from>: <text>"
+static void send_history_line(uint64_t seq, uint64_t msg_id, const char *from, const char *text, void *userdata)
+{
+    Client *c = (Client *)userdata;
+    time_t t = (time_t)(idgen_time_ms(msg_id) / 1000);
+    struct tm tm;
+    char ts[32];
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+
+    char line[INBUF_SIZE + 128];
+    snprintf(line, sizeof(line), "#%llu [%s] %s: %s\n", (unsigned long long)seq, ts, from, text);
+    send_text(c->fd, line);
+}
+
+// Gửi các tin nhắn group gần nhất đang giữ trong RAM (không đọc đĩa)
+static void send_recent_line(const char *formatted, void *userdata)
+{
+    send_text(*(int *)userdata, formatted);
+}
+
+static int send_recent(int fd, const char *group_id)
+{
+    return recent_foreach(group_id, send_recent_line, &fd);
+}
+
+// --- Presence: đẩy thay đổi online / offline cho bạn bè thay vì để client poll FRIENDS ---
+
+#define PRESENCE_LINE_MAX 1024
+
+typedef struct
+{
+    int fd;
+    char line[PRESENCE_LINE_MAX];
+    size_t used;
+} PresenceList;
+
+static void push_presence_cb(uint32_t uid, void *userdata)
+{
+    Client *dst = client_by_uid(uid);
+    if (dst)
+        send_text(dst->fd, (const char *)userdata);
+}
+
+// Gom tên bạn bè đang online thành các dòng "[Presence] online: a b c"
+static void collect_online_cb(uint32_t uid, void *userdata)
+{
+    PresenceList *pl = (PresenceList *)userdata;
+    Client *f = client_by_uid(uid);
+    if (!f)
         return;
 
+    if (pl->used > 0 && pl->used + strlen(f->username) + 2 >= sizeof(pl->line))
+    {
+        memcpy(pl->line + pl->used, "\n", 2);
+        send_text(pl->fd, pl->line);
+        pl->used = 0;
+    }
+    if (pl->used == 0)
+        pl->used = (size_t)snprintf(pl->line, sizeof(pl->line), "[Presence] online:");
+    pl->used += (size_t)snprintf(pl->line + pl->used, sizeof(pl->line) - pl->used, " %s", f->username);
+}
+
+// Báo cho các bạn bè đang online biết user vừa online / offline
+static void push_presence(Client *c, int online)
+{
+    char line[USERNAME_LEN + 32];
+    snprintf(line, sizeof(line), "[Presence] %s %s\n", c->username, online ? "online" : "offline");
+    friend_foreach_friend(c->username, push_presence_cb, line);
+}
+
+// Trạng thái ban đầu cho user vừa vào, sau đó chỉ nhận các dòng thay đổi
+static void send_online_friends(Client *c)
+{
+    PresenceList pl;
+    pl.fd = c->fd;
+    pl.used = 0;
+    friend_foreach_friend(c->username, collect_online_cb, &pl);
+    if (pl.used > 0)
+    {
+        memcpy(pl.line + pl.used, "\n", 2);
+        send_text(pl.fd, pl.line);
+    }
+}
+
+// --- LOGIN / REGISTER bất đồng bộ qua worker pool ---
+
+#define AUTH_OP_LOGIN 1
+#define AUTH_OP_REGISTER 2
+
+typedef struct
+{
+    int op;
+    Client *client;
+    uint64_t conn_id; // client có thể đã ngắt kết nối và slot được dùng lại khi job xong
+    char username[USERNAME_LEN];
+    char password[128];
+    char hash[PASSWORD_FIELD_LEN]; // LOGIN: hash đang lưu (vào), hash mới nếu cần rehash (ra)
+    int rehash;
+    int ok;
+    int no_account; // LOGIN user không tồn tại: verify với hash giả cho đủ thời gian rồi FAIL
+    int traced; // lệnh LOGIN / REGISTER được lấy mẫu: trace tiếp phần chạy trên worker và done()
+    int command; // I/O lúc xong (rehash ghi WAL) tính vào đúng lệnh
+} AuthJob;
+
+// Chạy trên worker thread: chỉ làm phần tốn CPU, không đụng Client hay bảng account
+static void auth_job_run(void *arg)
+{
+    AuthJob *job = (AuthJob *)arg;
+    int was_traced = trace_thread_on; // không có worker thread thì job chạy ngay trong lệnh
+    trace_set(job->traced);
+    if (job->op == AUTH_OP_LOGIN)
+    {
+        int legacy = 0;
+        job->ok = auth_verify_password(job->password, job->hash, &legacy) && !job->no_account;
+        // Mật khẩu plaintext kiểu cũ: hash lại luôn khi đã biết mật khẩu đúng
+        if (job->ok && legacy)
+            job->rehash = auth_hash_password(job->password, job->hash, sizeof(job->hash));
+    }
+    else
+    {
+        job->ok = auth_hash_password(job->password, job->hash, sizeof(job->hash));
+    }
+    trace_set(was_traced);
+}
+
+static void login_finish(Client *c, const char *u, int ok)
+{
+    // Trong lúc chờ worker có thể đã có kết nối khác login cùng user
+    if (ok && client_by_username(u))
+    {
+        send_text(c->fd, "Login FAIL: user already logged in\n");
+        return;
+    }
+
+    if (!ok)
+    {
+        send_text(c->fd, "Login FAIL\n");
+        log_login(u, 0);
+        return;
+    }
+
+    client_login(c, u);
+
+    // Trả kèm session token để lần reconnect sau dùng RESUME thay vì LOGIN
+    char token[SESSION_TOKEN_MAX];
+    char resp[SESSION_TOKEN_MAX + 32];
+    if (session_open(u, token, sizeof(token)) == SESSION_OK)
+        snprintf(resp, sizeof(resp), "Login OK %s\n", token);
+    else
+        snprintf(resp, sizeof(resp), "Login OK\n");
+    send_text(c->fd, resp);
+
+    // Log login success
+    log_login(u, 1);
+    push_presence(c, 1);
+    send_online_friends(c);
+
+    // Gửi tất cả tin nhắn offline cho user
+    int offline_count = offline_deliver_messages(u, deliver_to_client, c);
+    if (offline_count > 0)
+    {
+        char info[128];
+        snprintf(info, sizeof(info), "[Server] You have %d offline message(s)\n", offline_count);
+        send_text(c->fd, info);
+    }
+}
+
+// Trả về 0 nếu client đã ngắt kết nối trong lúc chờ worker
+static int auth_job_finish(AuthJob *job)
+{
+    Client *c = job->client;
+    if (c->fd == -1 || c->conn_id != job->conn_id)
+        return 0;
+
+    c->auth_pending = 0;
+    if (job->op == AUTH_OP_LOGIN)
+    {
+        if (job->ok && job->rehash)
+            auth_set_password(job->username, job->hash);
+        login_finish(c, job->username, job->ok);
+    }
+    else if (job->ok && auth_add_account(job->username, job->hash))
+    {
+        send_text(c->fd, "Register OK\n");
+        log_register(job->username, 1);
+    }
+    else
+    {
+        send_text(c->fd, "Register FAIL\n");
+        log_register(job->username, 0);
+    }
+    return 1;
+}
+
+// Chạy trên reactor khi worker đã xong
+static void auth_job_done(void *arg)
+{
+    AuthJob *job = (AuthJob *)arg;
+    Client *c = job->client;
+    memset(job->password, 0, sizeof(job->password));
+
+    int was_traced = trace_thread_on, outer_command = iostat_command();
+    trace_set(job->traced);
+    iostat_set_command(job->command);
+    TraceSpan span = trace_begin("protocol", job->op == AUTH_OP_LOGIN ? "LOGIN done" : "REGISTER done");
+    DurableScope outer = durable_begin(c, 1);
+    int connected = auth_job_finish(job);
+    durable_end(outer);
+    trace_end(&span, job->username);
+    trace_set(was_traced);
+    iostat_set_command(outer_command);
+    free(job);
+
+    // Xử lý tiếp các dòng client gửi trong lúc chờ
+    if (connected)
+        protocol_process_input(c);
+}
+
+static int submit_auth_job(Client *c, int op, const char *u, const char *p, const char *stored,
+                           int no_account)
+{
+    AuthJob *job = calloc(1, sizeof(AuthJob));
+    if (!job)
+        return -1;
+
+    job->op = op;
+    job->client = c;
+    job->conn_id = c->conn_id;
+    job->traced = trace_thread_on;
+    job->command = iostat_command();
+    strncpy(job->username, u, USERNAME_LEN - 1);
+    strncpy(job->password, p, sizeof(job->password) - 1);
+    if (stored)
+        strncpy(job->hash, stored, sizeof(job->hash) - 1);
+    job->no_account = no_account;
+
+    // Đánh dấu trước khi submit: pool có thể chạy done() ngay nếu không có worker thread
+    c->auth_pending = 1;
+    if (workers_submit(auth_job_run, auth_job_done, job) != 0)
+    {
+        c->auth_pending = 0;
+        free(job);
+        return -1;
+    }
+    return 0;
+}
+
+// --- Main Protocol Handler ---
+
+// Mỗi lệnh có 1 histogram độ trễ riêng, dòng không khớp lệnh nào tính vào OTHER
+static const char *const command_names[] = {
+    "LOGIN", "RESUME", "REGISTER", "LIST", "ONLINECOUNT", "ADDFRIEND", "ACCEPT", "REJECT",
+    "UNFRIEND", "REQUESTS", "FRIENDS", "MSGTO", "CREATEGROUP", "ADDMEMBER", "REMOVEMEMBER",
+    "LEAVEGROUP", "GROUPMSG", "LISTGROUPS", "GROUPINFO", "RECENT", "HISTORY", "SUBSCRIBE",
+    "UNSUBSCRIBE", "PUBLISH", "STATS", "TRACE", "SLOWLOG", "LOGOUT"};
+
+void protocol_init()
+{
+    for (size_t i = 0; i < sizeof(command_names) / sizeof(command_names[0]); i++)
+        metrics_command(command_names[i]);
+}
+
+// cmd là token đầu của dòng, các tham số còn lại lấy tiếp bằng strtok(NULL, ...)
+static void handle_command(Client *c, const char *cmd)
+{
     if (!strcmp(cmd, "LOGIN"))
     {
         if (c->logged_in)
@@ -112,18 +489,90 @@ void protocol_handle(Client *c, const char *line)
             return;
         }
 
-        if (check_login(u, p))
+        // Sai định dạng thì không thể là account nào nên trả luôn
+        if (!auth_valid_credential(u, p))
         {
-            c->logged_in = 1;
-            strncpy(c->username, u, USERNAME_LEN - 1);
-            c->username[USERNAME_LEN - 1] = '\0';
-            send_text(c->fd, "Login OK\n");
+            login_finish(c, u, 0);
+            return;
+        }
+
+        // Tra bảng account ngay trên reactor. User không tồn tại vẫn chạy 1 job với hash giả,
+        // trả lời nhanh hơn sẽ cho biết username nào có thật
+        char stored[PASSWORD_FIELD_LEN];
+        int no_account = !auth_get_hash(u, stored, sizeof(stored));
+        if (no_account)
+            snprintf(stored, sizeof(stored), "%s", auth_dummy_hash());
 
-            // Log login success
-            log_login(u, 1);
+        // Hash mật khẩu chạy trên worker, kết quả xử lý tiếp trong auth_job_done
+        if (submit_auth_job(c, AUTH_OP_LOGIN, u, p, stored, no_account) != 0)
+            send_text(c->fd, "Login FAIL: server busy\n");
+        return;
+    }
 
-            // Gửi tất cả tin nhắn offline cho user
-            int offline_count = offline_deliver_messages(u, c->fd);
+    // Command: RESUME <token> <last_seq>
+    if (!strcmp(cmd, "RESUME"))
+    {
+        if (c->logged_in)
+        {
+            send_text(c->fd, "Already logged in\n");
+            return;
+        }
+
+        char *tok = strtok(NULL, " ");
+        char *seq = strtok(NULL, " ");
+        char *end = NULL;
+        unsigned long long last_seq = seq ? strtoull(seq, &end, 10) : 0;
+
+        if (!tok || !seq || *end != '\0')
+        {
+            send_text(c->fd, "Usage: RESUME <token> <last_seq>\n");
+            return;
+        }
+
+        char username[USERNAME_LEN];
+        char token[SESSION_TOKEN_MAX];
+        int rc = session_resume(tok, last_seq, username, token, sizeof(token));
+        if (rc == SESSION_REPLACED)
+        {
+            send_text(c->fd, "Resume FAIL: session replaced by a newer login\n");
+            return;
+        }
+        if (rc != SESSION_OK)
+        {
+            send_text(c->fd, "Resume FAIL\n");
+            return;
+        }
+
+        // Kết nối cũ có thể chưa bị phát hiện là đã chết (mạng chập chờn) -> gỡ login khỏi nó
+        Client *old = client_by_username(username);
+        if (old)
+        {
+            send_text(old->fd, "[Server] Session resumed from another connection\n");
+            client_logout(old);
+        }
+
+        client_login(c, username);
+        if (old)
+            pubsub_move(old, c);
+
+        char resp[SESSION_TOKEN_MAX + 32];
+        snprintf(resp, sizeof(resp), "Resume OK %s\n", token);
+        send_text(c->fd, resp);
+        log_resume(username);
+        // Kết nối cũ còn sống thì với bạn bè user vẫn online suốt, không cần báo lại
+        if (!old)
+            push_presence(c, 1);
+        send_online_friends(c);
+
+        // Chỉ gửi lại phần client chưa nhận, không quét lại accounts.txt
+        int lost = 0;
+        session_replay(username, last_seq, c->fd, &lost);
+        if (lost)
+            send_text(c->fd, "[Server] Some messages were too old to replay\n");
+
+        if (session_take_offline_pending(username))
+        {
+            int offline_count = offline_deliver_messages(username, deliver_to_client, c);
             if (offline_count > 0)
             {
                 char info[128];
@@ -131,11 +580,6 @@ void protocol_handle(Client *c, const char *line)
                 send_text(c->fd, info);
             }
         }
-        else
-        {
-            send_text(c->fd, "Login FAIL\n");
-            log_login(u, 0);
-        }
         return;
     }
 
@@ -156,16 +600,16 @@ void protocol_handle(Client *c, const char *line)
             return;
         }
 
-        if (register_user(u, p))
-        {
-            send_text(c->fd, "Register OK\n");
-            log_register(u, 1);
-        }
-        else
+        if (!auth_valid_credential(u, p) || account_exists(u))
         {
             send_text(c->fd, "Register FAIL\n");
             log_register(u, 0);
+            return;
         }
+
+        // Account chỉ được thêm trong auth_job_done (reactor), trùng tên lúc đó vẫn bị chặn
+        if (submit_auth_job(c, AUTH_OP_REGISTER, u, p, NULL, 0) != 0)
+            send_text(c->fd, "Register FAIL: server busy\n");
         return;
     }
 
@@ -177,9 +621,43 @@ void protocol_handle(Client *c, const char *line)
             return;
         }
 
-        char out[INBUF_SIZE];
-        clients_format_online(out, sizeof(out), c);
+        // LIST [cursor] [limit]: trang đầu khi không có cursor
+        char *cur = strtok(NULL, " ");
+        char *lim = strtok(NULL, " ");
+        uint64_t cursor = cur ? strtoull(cur, NULL, 10) : 0;
+        int limit = lim ? atoi(lim) : LIST_DEFAULT_PAGE;
+        if (limit <= 0)
+            limit = LIST_DEFAULT_PAGE;
+        if (limit > LIST_MAX_PAGE)
+            limit = LIST_MAX_PAGE;
+
+        char out[LIST_MAX_PAGE * (USERNAME_LEN + 3) + 1];
+        uint64_t next;
+        int count = clients_format_online(cursor, limit, out, sizeof(out), c, &next);
+
+        char line[128];
+        snprintf(line, sizeof(line), "=== Online users (%d) ===\n", clients_online_count());
+        send_text(c->fd, line);
         send_text(c->fd, out);
+        if (next)
+            snprintf(line, sizeof(line), "Shown: %d, more: LIST %llu %d\n", count, (unsigned long long)next, limit);
+        else
+            snprintf(line, sizeof(line), "Shown: %d, end of list\n", count);
+        send_text(c->fd, line);
+        return;
+    }
+
+    if (!strcmp(cmd, "ONLINECOUNT"))
+    {
+        if (!c->logged_in)
+        {
+            send_text(c->fd, "Login first\n");
+            return;
+        }
+
+        char line[64];
+        snprintf(line, sizeof(line), "Online: %d\n", clients_online_count());
+        send_text(c->fd, line);
         return;
     }
 
@@ -277,6 +755,12 @@ void protocol_handle(Client *c, const char *line)
                 {
                     send_text(dst->fd, note);
                 }
+
+                // Bạn mới đang online: cả 2 bên nhận trạng thái của nhau luôn
+                snprintf(note, sizeof(note), "[Presence] %s online\n", c->username);
+                send_text(dst->fd, note);
+                snprintf(note, sizeof(note), "[Presence] %s online\n", dst->username);
+                send_text(c->fd, note);
             }
         }
         else if (rc == FR_ALREADY_FRIEND)
@@ -414,6 +898,8 @@ void protocol_handle(Client *c, const char *line)
             return;
         }
 
+        // Mỗi PM có 1 ID Snowflake, dù giao ngay hay lưu offline
+        uint64_t msg_id = idgen_next();
         Client *dst = client_by_username(target);
         if (!dst)
         {
@@ -423,10 +909,13 @@ void protocol_handle(Client *c, const char *line)
                 return;
             }
 
-            if (offline_save_message(target, c->username, msg) == 0)
+            PROBE4(message__enqueue, msg_id, c->uid, target, 0);
+            if (offline_save_message(target, c->username, msg_id, msg) == 0)
             {
+                save_pm_history(c->username, target, msg_id, msg);
+                session_note_offline(target);
                 send_text(c->fd, "Message saved (user offline)\n");
-                log_message(c->username, target, "PM_OFFLINE");
+                log_message(c->username, target, "PM_OFFLINE", msg_id);
             }
             else
             {
@@ -451,8 +940,10 @@ void protocol_handle(Client *c, const char *line)
             return;
         }
 
-        send_text(dst->fd, to_dst);
-        log_message(c->username, target, "PM");
+        PROBE4(message__enqueue, msg_id, c->uid, target, 0);
+        deliver_message(dst, to_dst, msg_id);
+        save_pm_history(c->username, target, msg_id, msg);
+        log_message(c->username, target, "PM", msg_id);
 
         char to_sender[INBUF_SIZE];
         snprintf(to_sender, sizeof(to_sender), "[PM to %s] %s\n", target, msg);
@@ -493,7 +984,7 @@ void protocol_handle(Client *c, const char *line)
             return;
         }
 
-        char group_id[20];
+        char group_id[GROUP_ID_LEN];
         int rc = group_create(c->username, gname, group_id, sizeof(group_id));
 
         if (rc == GR_OK)
@@ -546,11 +1037,12 @@ void protocol_handle(Client *c, const char *line)
                 char note[256];
                 snprintf(note, sizeof(note), "[Server] You were added to group %s by %s\n", gid, c->username);
                 send_text(dst->fd, note);
+                send_recent(dst->fd, gid);
             }
 
             char notify[256];
             snprintf(notify, sizeof(notify), "[Server] %s was added to group %s\n", target, gid);
-            clients_broadcast_to_group(notify, dst, group_member_filter, (void *)gid);
+            notify_group(gid, notify, dst);
         }
         else if (rc == GR_NOT_OWNER)
             send_text(c->fd, "Only group owner can add members\n");
@@ -601,7 +1093,7 @@ void protocol_handle(Client *c, const char *line)
 
             char notify[256];
             snprintf(notify, sizeof(notify), "[Server] %s was removed from group %s\n", target, gid);
-            clients_broadcast_to_group(notify, NULL, group_member_filter, (void *)gid);
+            notify_group(gid, notify, NULL);
         }
         else if (rc == GR_NOT_OWNER)
             send_text(c->fd, "Only group owner can remove members\n");
@@ -636,7 +1128,7 @@ void protocol_handle(Client *c, const char *line)
 
             char notify[256];
             snprintf(notify, sizeof(notify), "[Server] %s left group %s\n", c->username, gid);
-            clients_broadcast_to_group(notify, c, group_member_filter, (void *)gid);
+            notify_group(gid, notify, c);
         }
         else if (rc == GR_NOT_MEMBER)
             send_text(c->fd, "You are not a member of this group\n");
@@ -671,47 +1163,51 @@ void protocol_handle(Client *c, const char *line)
             return;
         }
 
+        GroupMsgData *gdata = calloc(1, sizeof(GroupMsgData));
+        if (!gdata)
+        {
+            send_text(c->fd, "Server busy, try again\n");
+            return;
+        }
+
         // Format tin nhắn nhóm
-        char group_msg[INBUF_SIZE];
-        int n = snprintf(group_msg, sizeof(group_msg), "[Group %s - %s] %s\n", gid, c->username, msg);
-        if (n < 0 || (size_t)n >= sizeof(group_msg))
+        int n = snprintf(gdata->formatted_msg, sizeof(gdata->formatted_msg), "[Group %s - %s] %s\n",
+                         gid, c->username, msg);
+        if (n < 0 || (size_t)n >= sizeof(gdata->formatted_msg))
         {
+            free(gdata);
             send_text(c->fd, "Message too long\n");
             return;
         }
 
-        // 3. Sử dụng struct tường minh thay vì khai báo nested struct/function
-        GroupMsgData gdata;
-        gdata.group_id = gid;
-        gdata.from_user = c->username;
-        gdata.message = msg;
-        gdata.formatted_msg = group_msg;
-        gdata.sender = c;
-        gdata.sent_count = 0;
-        gdata.offline_count = 0;
+        snprintf(gdata->group_id, sizeof(gdata->group_id), "%s", gid);
+        snprintf(gdata->from_user, sizeof(gdata->from_user), "%s", c->username);
+        snprintf(gdata->message, sizeof(gdata->message), "%s", msg);
+        gdata->msg_id = idgen_next();
+        gdata->sender = c;
+        gdata->sender_conn = c->conn_id;
+        PROBE4(message__enqueue, gdata->msg_id, c->uid, gdata->group_id, 1);
 
-        // Gọi hàm callback static đã định nghĩa ở trên
-        group_foreach_member(gid, send_or_save_group_msg, &gdata);
+        // Online: giao ngay, chỉ duyệt danh sách member đang online của group (tối đa MAX_CLIENTS)
+        group_foreach_online_member(gid, send_group_msg_online, gdata);
+        group_foreach_offline_member(gid, collect_offline_cb, gdata);
+        save_group_history(gid, c->username, gdata->msg_id, msg);
+        recent_push(gid, gdata->formatted_msg);
 
         // Log group message
-        log_message(c->username, gid, "GROUP");
+        log_message(c->username, gid, "GROUP", gdata->msg_id);
 
-        // Xác nhận cho người gửi
-        char confirm[256];
-        if (gdata.offline_count > 0)
+        // Lưu offline: group nhỏ làm luôn, group lớn chia lượt để không chặn reactor.
+        // Người gửi nhận xác nhận khi đã lưu xong cho mọi member
+        if (gdata->n_offline > fanout_chunk() &&
+            fanout_submit(gdata->offline, gdata->n_offline, deliver_group_msg_offline, group_msg_done, gdata) == 0)
         {
-            snprintf(confirm, sizeof(confirm),
-                     "[Group %s] Sent to %d online, saved for %d offline member(s)\n",
-                     gid, gdata.sent_count, gdata.offline_count);
-        }
-        else
-        {
-            snprintf(confirm, sizeof(confirm),
-                     "[Group %s] Message sent to %d online member(s)\n",
-                     gid, gdata.sent_count);
+            gdata->offline = NULL;
+            return;
         }
-        send_text(c->fd, confirm);
-
+        for (int i = 0; i < gdata->n_offline; i++)
+            deliver_group_msg_offline(gdata->offline[i], gdata);
+        group_msg_done(gdata);
         return;
     }
 
@@ -766,14 +1262,301 @@ void protocol_handle(Client *c, const char *line)
         return;
     }
 
+    // Command: RECENT <group_id>
+    if (!strcmp(cmd, "RECENT"))
+    {
+        if (!c->logged_in)
+        {
+            send_text(c->fd, "Login first\n");
+            return;
+        }
+
+        char *gid = strtok(NULL, " ");
+        if (!gid)
+        {
+            send_text(c->fd, "Usage: RECENT <group_id>\n");
+            return;
+        }
+
+        if (!group_check_member(gid, c->username))
+        {
+            send_text(c->fd, "You are not a member of this group\n");
+            return;
+        }
+
+        char line[256];
+        snprintf(line, sizeof(line), "=== Recent %s ===\n", gid);
+        send_text(c->fd, line);
+        int count = send_recent(c->fd, gid);
+        snprintf(line, sizeof(line), "=== %d message(s), older: HISTORY %s ===\n", count, gid);
+        send_text(c->fd, line);
+        return;
+    }
+
+    // Command: HISTORY <user|group_id> [before_seq] [n]
+    if (!strcmp(cmd, "HISTORY"))
+    {
+        if (!c->logged_in)
+        {
+            send_text(c->fd, "Login first\n");
+            return;
+        }
+
+        char *target = strtok(NULL, " ");
+        char *before = strtok(NULL, " ");
+        char *count = strtok(NULL, " ");
+        if (!target)
+        {
+            send_text(c->fd, "Usage: HISTORY <user|group_id> [before_seq] [n]\n");
+            return;
+        }
+
+        uint64_t before_seq = before ? strtoull(before, NULL, 10) : 0;
+        int n = count ? atoi(count) : HISTORY_DEFAULT_PAGE;
+        if (n <= 0)
+            n = HISTORY_DEFAULT_PAGE;
+        if (n > HISTORY_MAX_PAGE)
+            n = HISTORY_MAX_PAGE;
+
+        // Group chỉ thành viên mới đọc được, PM thì là hội thoại giữa mình và target
+        char key[HISTORY_KEY_LEN];
+        if (group_check_member(target, c->username))
+            history_group_key(target, key, sizeof(key));
+        else if (strcmp(target, c->username) != 0 && account_exists(target))
+            history_pm_key(c->username, target, key, sizeof(key));
+        else
+        {
+            send_text(c->fd, "No such user or group (or you are not a member)\n");
+            return;
+        }
+
+        char header[256];
+        snprintf(header, sizeof(header), "=== History %s ===\n", target);
+        send_text(c->fd, header);
+
+        uint64_t total = 0;
+        int got = history_page(key, before_seq, n, &total, send_history_line, c);
+        if (got < 0)
+        {
+            send_text(c->fd, "Failed to read history\n");
+            return;
+        }
+
+        char footer[256];
+        if (got == 0)
+            snprintf(footer, sizeof(footer), "(no messages, total %llu)\n", (unsigned long long)total);
+        else
+        {
+            uint64_t last = (before_seq == 0 || before_seq > total) ? total : before_seq - 1;
+            uint64_t first = last - (uint64_t)got + 1;
+            if (first > 1)
+                snprintf(footer, sizeof(footer), "=== %llu-%llu of %llu, more: HISTORY %s %llu %d ===\n",
+                         (unsigned long long)first, (unsigned long long)last, (unsigned long long)total,
+                         target, (unsigned long long)first, n);
+            else
+                snprintf(footer, sizeof(footer), "=== %llu-%llu of %llu, beginning of history ===\n",
+                         (unsigned long long)first, (unsigned long long)last, (unsigned long long)total);
+        }
+        send_text(c->fd, footer);
+        return;
+    }
+
+    // ========== PUB/SUB ==========
+
+    if (!strcmp(cmd, "SUBSCRIBE") || !strcmp(cmd, "UNSUBSCRIBE"))
+    {
+        if (!c->logged_in)
+        {
+            send_text(c->fd, "Login first\n");
+            return;
+        }
+
+        int sub = !strcmp(cmd, "SUBSCRIBE");
+        char *topic = strtok(NULL, " ");
+        if (!topic)
+        {
+            send_text(c->fd, sub ? "Usage: SUBSCRIBE <topic>\n" : "Usage: UNSUBSCRIBE <topic>\n");
+            return;
+        }
+
+        int rc = sub ? pubsub_subscribe(c, topic) : pubsub_unsubscribe(c, topic);
+        char resp[PUBSUB_TOPIC_LEN + 64];
+        if (rc == PS_OK)
+            snprintf(resp, sizeof(resp), sub ? "Subscribed to %s\n" : "Unsubscribed from %s\n", topic);
+        else if (rc == PS_ALREADY)
+            snprintf(resp, sizeof(resp), "Already subscribed\n");
+        else if (rc == PS_NOT_SUBSCRIBED)
+            snprintf(resp, sizeof(resp), "Not subscribed\n");
+        else if (rc == PS_INVALID)
+            snprintf(resp, sizeof(resp), "Invalid topic name (max %d chars, no spaces)\n", PUBSUB_TOPIC_LEN - 1);
+        else if (rc == PS_LIMIT)
+            snprintf(resp, sizeof(resp), "Too many subscriptions (max %d)\n", PUBSUB_MAX_PER_CLIENT);
+        else
+            snprintf(resp, sizeof(resp), "Subscribe failed\n");
+        send_text(c->fd, resp);
+        return;
+    }
+
+    // Command: PUBLISH <topic> <message>. Topic "*" = toàn server, chỉ admin
+    if (!strcmp(cmd, "PUBLISH"))
+    {
+        if (!c->logged_in)
+        {
+            send_text(c->fd, "Login first\n");
+            return;
+        }
+
+        char *topic = strtok(NULL, " ");
+        char *msg = strtok(NULL, "");
+        if (!topic || !msg || msg[0] == '\0')
+        {
+            send_text(c->fd, "Usage: PUBLISH <topic> <message>\n");
+            return;
+        }
+
+        int all = !strcmp(topic, PUBSUB_ALL);
+        if (all && strcmp(c->username, PUBSUB_ADMIN) != 0)
+        {
+            send_text(c->fd, "Only " PUBSUB_ADMIN " can publish to all users\n");
+            return;
+        }
+
+        // Format 1 lần, mọi người nhận dùng chung buffer này
+        char text[INBUF_SIZE];
+        int n = all ? snprintf(text, sizeof(text), "[Announcement from %s] %s\n", c->username, msg)
+                    : snprintf(text, sizeof(text), "[Topic %s - %s] %s\n", topic, c->username, msg);
+        if (n < 0 || (size_t)n >= sizeof(text))
+        {
+            send_text(c->fd, "Message too long\n");
+            return;
+        }
+
+        int count = all ? clients_broadcast(text, c) : pubsub_publish(topic, text, c);
+        char resp[PUBSUB_TOPIC_LEN + 64];
+        snprintf(resp, sizeof(resp), "[Topic %s] Published to %d subscriber(s)\n", topic, count);
+        send_text(c->fd, resp);
+        return;
+    }
+
+    // Command: STATS (admin) - counter, gauge, độ trễ từng lệnh
+    if (!strcmp(cmd, "STATS"))
+    {
+        if (!c->logged_in)
+        {
+            send_text(c->fd, "Login first\n");
+            return;
+        }
+        if (strcmp(c->username, ADMIN_USERNAME) != 0)
+        {
+            send_text(c->fd, "Only " ADMIN_USERNAME " can view stats\n");
+            return;
+        }
+
+        char *out = malloc(64 * 1024);
+        if (!out)
+        {
+            send_text(c->fd, "Server busy, try again\n");
+            return;
+        }
+        metrics_render_text(out, 64 * 1024);
+        send_text(c->fd, out);
+        free(out);
+        return;
+    }
+
+    // Command: TRACE (admin) - TRACE <N> lấy mẫu 1/N lệnh (0 = tắt), TRACE DUMP ghi span ra file
+    if (!strcmp(cmd, "TRACE"))
+    {
+        if (!c->logged_in)
+        {
+            send_text(c->fd, "Login first\n");
+            return;
+        }
+        if (strcmp(c->username, ADMIN_USERNAME) != 0)
+        {
+            send_text(c->fd, "Only " ADMIN_USERNAME " can control tracing\n");
+            return;
+        }
+
+        char *arg = strtok(NULL, " ");
+        char resp[128];
+        if (arg && !strcmp(arg, "DUMP"))
+        {
+            long n = trace_dump(TRACE_DUMP_FILE);
+            if (n < 0)
+                snprintf(resp, sizeof(resp), "Trace dump failed\n");
+            else
+                snprintf(resp, sizeof(resp), "Wrote %ld span(s) to " TRACE_DUMP_FILE "\n", n);
+            send_text(c->fd, resp);
+            return;
+        }
+        if (arg)
+            trace_configure(atoi(arg));
+
+        if (trace_sample_every())
+            snprintf(resp, sizeof(resp), "Tracing 1 in %d command(s)\n", trace_sample_every());
+        else
+            snprintf(resp, sizeof(resp), "Tracing off\n");
+        send_text(c->fd, resp);
+        return;
+    }
+
+    // Command: SLOWLOG (admin) - SLOWLOG GET [n] | LEN | RESET
+    if (!strcmp(cmd, "SLOWLOG"))
+    {
+        if (!c->logged_in)
+        {
+            send_text(c->fd, "Login first\n");
+            return;
+        }
+        if (strcmp(c->username, ADMIN_USERNAME) != 0)
+        {
+            send_text(c->fd, "Only " ADMIN_USERNAME " can view the slow log\n");
+            return;
+        }
+
+        char *sub = strtok(NULL, " ");
+        char *n = strtok(NULL, " ");
+        char resp[64];
+        if (sub && !strcmp(sub, "RESET"))
+        {
+            slowlog_reset();
+            send_text(c->fd, "Slow log cleared\n");
+        }
+        else if (sub && !strcmp(sub, "LEN"))
+        {
+            snprintf(resp, sizeof(resp), "%d\n", slowlog_len());
+            send_text(c->fd, resp);
+        }
+        else if (!sub || !strcmp(sub, "GET"))
+        {
+            char *out = malloc(32 * 1024);
+            if (!out)
+            {
+                send_text(c->fd, "Server busy, try again\n");
+                return;
+            }
+            slowlog_render(out, 32 * 1024, n ? atoi(n) : 10);
+            send_text(c->fd, out);
+            free(out);
+        }
+        else
+        {
+            send_text(c->fd, "Usage: SLOWLOG GET [n] | LEN | RESET\n");
+        }
+        return;
+    }
+
     if (!strcmp(cmd, "LOGOUT"))
     {
         if (c->logged_in)
         {
             log_logout(c->username);
+            session_close(c->username);
+            push_presence(c, 0);
+            pubsub_unsubscribe_all(c);
 
-            c->logged_in = 0;
-            c->username[0] = '\0';
+            client_logout(c);
             send_text(c->fd, "Logged out\n");
         }
         else
@@ -784,4 +1567,61 @@ void protocol_handle(Client *c, const char *line)
     }
 
     send_text(c->fd, "Unknown command\n");
-}
\ No newline at end of file
+}
+
+void protocol_handle(Client *c, const char *line)
+{
+    char buf[INBUF_SIZE];
+    strncpy(buf, line, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *cmd = strtok(buf, " ");
+    if (!cmd)
+        return;
+
+    trace_sample();
+    TraceSpan span = trace_begin("protocol", cmd);
+    SlowlogCounters before = slowlog_counters;
+    watchdog_command(cmd, c->logged_in ? c->username : NULL);
+    MetricsHist *hist = metrics_command_find(cmd);
+    int code = metrics_command_index(hist);
+    int outer_command = iostat_command(); // LOGIN đồng bộ (không có worker) gọi lồng lệnh kế tiếp
+    iostat_set_command(code);
+    PROBE4(command__start, c->conn_id, c->uid, code, cmd);
+    uint64_t start = metrics_now_ns();
+    DurableScope outer_scope = durable_begin(c, 1);
+    handle_command(c, cmd);
+    durable_end(outer_scope);
+    uint64_t elapsed = metrics_now_ns() - start;
+    PROBE4(command__end, c->conn_id, c->uid, code, elapsed);
+    metrics_observe(hist, elapsed);
+    iostat_set_command(outer_command);
+    slowlog_check(cmd, c->logged_in ? c->username : NULL, elapsed, &before);
+    watchdog_command(NULL, NULL);
+    trace_end(&span, c->logged_in ? c->username : NULL);
+    trace_set(0);
+}
+
+void protocol_disconnect(Client *c)
+{
+    // Mất kết nối mà chưa LOGOUT: giữ session để client RESUME lại
+    if (c->logged_in)
+    {
+        session_detach(c->username);
+        push_presence(c, 0);
+    }
+    pubsub_unsubscribe_all(c);
+
+    client_remove(c);
+}
+
+void protocol_process_input(Client *c)
+{
+    // Đang chờ worker xác thực thì giữ các dòng sau trong buffer để xử lý đúng thứ tự
+    while (c->fd != -1 && !c->auth_pending && client_has_line(c))
+    {
+        char *line = client_pop_line(c);
+        capture_line(c->conn_id, line, strlen(line));
+        protocol_handle(c, line);
+    }
+}
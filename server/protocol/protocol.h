@@ -3,6 +3,9 @@
 
 #include "../client/client_mgr.h"
 
+void protocol_init(); // Đăng ký các lệnh với metrics
 void protocol_handle(Client *c, const char *line);
+void protocol_process_input(Client *c); // Xử lý các dòng hoàn chỉnh đang có trong buffer
+void protocol_disconnect(Client *c); // Dọn trạng thái của client rồi đóng kết nối
 
 #endif
@@ -0,0 +1,236 @@
+#include "pubsub.h"
+#include "../durable/durable.h"
+#include "../metrics/metrics.h"
+#include "../slowlog/slowlog.h"
+#include "../util/strmap.h"
+
+/*
+    Mỗi topic giữ mảng Subscription* (xóa = đổi chỗ với phần tử cuối, O(1)), mỗi client giữ
+    danh sách liên kết các Subscription của nó để dọn khi ngắt kết nối.
+    Topic không còn ai subscribe thì bị xóa
+*/
+
+typedef struct Topic
+{
+    char name[PUBSUB_TOPIC_LEN];
+    struct Subscription **subs;
+    int n, cap;
+} Topic;
+
+typedef struct Subscription
+{
+    Topic *topic;
+    Client *client;
+    int pos; // vị trí trong topic->subs
+    struct Subscription *next;
+} Subscription;
+
+static StrMap *topics = NULL; // tên -> Topic*
+
+// ---------- helpers ----------
+
+static int valid_topic(const char *topic)
+{
+    size_t len = strlen(topic);
+    if (len == 0 || len >= PUBSUB_TOPIC_LEN || !strcmp(topic, PUBSUB_ALL))
+        return 0;
+    for (const unsigned char *p = (const unsigned char *)topic; *p; p++)
+    {
+        if (*p <= ' ')
+            return 0;
+    }
+    return 1;
+}
+
+static Subscription *find_sub(Client *c, const char *topic, Subscription ***link)
+{
+    Subscription **pp = &c->subs;
+    for (; *pp; pp = &(*pp)->next)
+    {
+        if (!strcmp((*pp)->topic->name, topic))
+        {
+            if (link)
+                *link = pp;
+            return *pp;
+        }
+    }
+    return NULL;
+}
+
+static void topic_remove(Subscription *s)
+{
+    Topic *t = s->topic;
+    Subscription *moved = t->subs[--t->n];
+    if (s->pos < t->n)
+    {
+        t->subs[s->pos] = moved;
+        moved->pos = s->pos;
+    }
+
+    if (t->n == 0)
+    {
+        strmap_remove(topics, t->name);
+        free(t->subs);
+        free(t);
+    }
+}
+
+// ---------- API ----------
+
+int pubsub_subscribe(Client *c, const char *topic)
+{
+    if (!valid_topic(topic))
+        return PS_INVALID;
+    if (find_sub(c, topic, NULL))
+        return PS_ALREADY;
+
+    int count = 0;
+    for (Subscription *s = c->subs; s; s = s->next)
+        count++;
+    if (count >= PUBSUB_MAX_PER_CLIENT)
+        return PS_LIMIT;
+
+    if (!topics && !(topics = strmap_new()))
+        return PS_ERR;
+    Topic *t = strmap_get(topics, topic);
+    if (!t)
+    {
+        t = calloc(1, sizeof(Topic));
+        if (!t)
+            return PS_ERR;
+        strcpy(t->name, topic);
+        if (strmap_put(topics, topic, t) != 0)
+        {
+            free(t);
+            return PS_ERR;
+        }
+    }
+
+    Subscription *s = calloc(1, sizeof(Subscription));
+    if (s && t->n >= t->cap)
+    {
+        int newcap = t->cap == 0 ? 8 : t->cap * 2;
+        Subscription **tmp = realloc(t->subs, newcap * sizeof(Subscription *));
+        if (tmp)
+        {
+            t->subs = tmp;
+            t->cap = newcap;
+        }
+    }
+    if (!s || t->n >= t->cap)
+    {
+        free(s);
+        if (t->n == 0)
+        {
+            strmap_remove(topics, t->name);
+            free(t->subs);
+            free(t);
+        }
+        return PS_ERR;
+    }
+
+    s->topic = t;
+    s->client = c;
+    s->pos = t->n;
+    t->subs[t->n++] = s;
+    s->next = c->subs;
+    c->subs = s;
+    return PS_OK;
+}
+
+int pubsub_unsubscribe(Client *c, const char *topic)
+{
+    Subscription **link;
+    Subscription *s = find_sub(c, topic, &link);
+    if (!s)
+        return PS_NOT_SUBSCRIBED;
+    *link = s->next;
+    topic_remove(s);
+    free(s);
+    return PS_OK;
+}
+
+void pubsub_unsubscribe_all(Client *c)
+{
+    while (c->subs)
+    {
+        Subscription *s = c->subs;
+        c->subs = s->next;
+        topic_remove(s);
+        free(s);
+    }
+}
+
+void pubsub_move(Client *from, Client *to)
+{
+    pubsub_unsubscribe_all(to);
+    for (Subscription *s = from->subs; s; s = s->next)
+        s->client = to;
+    to->subs = from->subs;
+    from->subs = NULL;
+}
+
+// Gửi đủ len byte (send có thể chỉ nhận 1 phần khi buffer socket gần đầy). 1 nếu đã gửi hết
+static int send_all(int fd, const char *data, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len)
+    {
+        ssize_t n = send(fd, data + sent, len - sent, 0);
+        if (n <= 0)
+            return 0;
+        sent += (size_t)n;
+        metrics_add(METRIC_BYTES_OUT, (uint64_t)n);
+        slowlog_count_send();
+    }
+    return 1;
+}
+
+int pubsub_publish(const char *topic, const char *text, Client *exclude)
+{
+    Topic *t = topics ? strmap_get(topics, topic) : NULL;
+    if (!t)
+        return 0;
+
+    // Cùng 1 buffer đã format cho mọi subscriber, không chép / format lại theo từng người
+    size_t len = strlen(text);
+    int count = 0;
+    for (int i = 0; i < t->n; i++)
+    {
+        Client *dst = t->subs[i]->client;
+        if (dst == exclude || dst->fd == -1)
+            continue;
+        // Phần giữ lại chờ WAL sẽ được gửi đủ khi lô lên đĩa nên cũng tính là đã giao
+        if (durable_hold(dst->fd, text, len) || send_all(dst->fd, text, len))
+            count++;
+    }
+    return count;
+}
+
+size_t pubsub_export(Client *c, char *out, size_t outsz)
+{
+    size_t used = 0;
+    for (Subscription *s = c->subs; s; s = s->next)
+    {
+        size_t len = strlen(s->topic->name) + 1;
+        if (used + len > outsz)
+            break;
+        memcpy(out + used, s->topic->name, len);
+        used += len;
+    }
+    return used;
+}
+
+void pubsub_import(Client *c, const char *blob, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len)
+    {
+        const char *name = blob + pos;
+        size_t n = strnlen(name, len - pos);
+        if (n == len - pos)
+            break; // thiếu '\0' cuối
+        pubsub_subscribe(c, name);
+        pos += n + 1;
+    }
+}
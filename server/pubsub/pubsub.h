@@ -0,0 +1,33 @@
+// Kênh pub/sub theo topic (status feed, thông báo, bot stream). Chỉ nằm trong RAM, gắn với
+// kết nối: mất kết nối / LOGOUT là hết subscription, RESUME và hot upgrade thì giữ nguyên
+#ifndef PUBSUB_H
+#define PUBSUB_H
+
+#include "../../common.h"
+
+#define PUBSUB_TOPIC_LEN 64
+#define PUBSUB_MAX_PER_CLIENT 32
+#define PUBSUB_ALL "*"         // kênh toàn server: mọi client đang login
+#define PUBSUB_ADMIN ADMIN_USERNAME // user duy nhất được PUBLISH lên kênh toàn server
+
+// Return codes
+#define PS_OK 0
+#define PS_ERR -1
+#define PS_INVALID -2
+#define PS_ALREADY -3
+#define PS_NOT_SUBSCRIBED -4
+#define PS_LIMIT -5
+
+int pubsub_subscribe(Client *c, const char *topic);
+int pubsub_unsubscribe(Client *c, const char *topic);
+void pubsub_unsubscribe_all(Client *c);
+void pubsub_move(Client *from, Client *to); // RESUME: chuyển subscription sang kết nối mới
+
+// Gửi cùng 1 buffer cho mọi subscriber trừ exclude. Trả về số người nhận được trọn dòng
+int pubsub_publish(const char *topic, const char *text, Client *exclude);
+
+// Hot upgrade: các topic của client nối nhau bằng '\0'. Trả về số byte đã ghi
+size_t pubsub_export(Client *c, char *out, size_t outsz);
+void pubsub_import(Client *c, const char *blob, size_t len);
+
+#endif
@@ -0,0 +1,141 @@
+#include "recent.h"
+#include "../intern/intern.h"
+#include "../util/idmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Ring
+{
+    uint32_t gid;
+    uint32_t first, count; // msgs[first] là tin cũ nhất, vòng quanh per_group
+    size_t bytes;          // cả phần header + mảng con trỏ
+    struct Ring *prev, *next; // LRU, đầu danh sách = vừa dùng
+    char *msgs[];
+} Ring;
+
+static int per_group = RECENT_PER_GROUP;
+static size_t max_bytes = RECENT_MAX_BYTES;
+static size_t total_bytes = 0;
+
+static IdMap rings; // group ID -> Ring*
+static Ring *lru_head = NULL, *lru_tail = NULL;
+
+// ---------- LRU ----------
+
+static void lru_unlink(Ring *r)
+{
+    if (r->prev)
+        r->prev->next = r->next;
+    else
+        lru_head = r->next;
+    if (r->next)
+        r->next->prev = r->prev;
+    else
+        lru_tail = r->prev;
+    r->prev = r->next = NULL;
+}
+
+static void lru_push_front(Ring *r)
+{
+    r->next = lru_head;
+    r->prev = NULL;
+    if (lru_head)
+        lru_head->prev = r;
+    lru_head = r;
+    if (!lru_tail)
+        lru_tail = r;
+}
+
+static void drop_oldest(Ring *r)
+{
+    char *m = r->msgs[r->first];
+    size_t sz = strlen(m) + 1;
+    r->bytes -= sz;
+    total_bytes -= sz;
+    free(m);
+    r->msgs[r->first] = NULL;
+    r->first = (r->first + 1) % (uint32_t)per_group;
+    r->count--;
+}
+
+static void ring_free(Ring *r)
+{
+    while (r->count > 0)
+        drop_oldest(r);
+    lru_unlink(r);
+    idmap_put(&rings, r->gid, NULL);
+    total_bytes -= r->bytes;
+    free(r);
+}
+
+// ---------- API ----------
+
+void recent_configure(int n, size_t bytes)
+{
+    while (lru_tail)
+        ring_free(lru_tail);
+    per_group = n > 0 ? n : 0;
+    max_bytes = bytes;
+}
+
+void recent_push(const char *group_id, const char *formatted)
+{
+    uint32_t gid = intern_find(INTERN_GROUPS, group_id);
+    if (per_group == 0 || gid == INTERN_NONE)
+        return;
+
+    Ring *r = idmap_get(&rings, gid);
+    if (!r)
+    {
+        size_t sz = sizeof(Ring) + (size_t)per_group * sizeof(char *);
+        r = calloc(1, sz);
+        if (!r)
+            return;
+        if (idmap_put(&rings, gid, r) != 0)
+        {
+            free(r);
+            return;
+        }
+        r->gid = gid;
+        r->bytes = sz;
+        total_bytes += sz;
+    }
+    else
+        lru_unlink(r);
+    lru_push_front(r);
+
+    char *copy = strdup(formatted);
+    if (!copy)
+        return;
+    if (r->count == (uint32_t)per_group)
+        drop_oldest(r);
+    r->msgs[(r->first + r->count) % (uint32_t)per_group] = copy;
+    r->count++;
+    r->bytes += strlen(copy) + 1;
+    total_bytes += strlen(copy) + 1;
+
+    // Quá giới hạn: bỏ group nguội nhất trước, chỉ còn group này thì bớt tin cũ của nó
+    while (total_bytes > max_bytes && lru_tail != r)
+        ring_free(lru_tail);
+    while (total_bytes > max_bytes && r->count > 1)
+        drop_oldest(r);
+}
+
+int recent_foreach(const char *group_id, recent_cb cb, void *userdata)
+{
+    Ring *r = idmap_get(&rings, intern_find(INTERN_GROUPS, group_id));
+    if (!r)
+        return 0;
+    lru_unlink(r);
+    lru_push_front(r);
+
+    for (uint32_t i = 0; i < r->count; i++)
+        cb(r->msgs[(r->first + i) % (uint32_t)per_group], userdata);
+    return (int)r->count;
+}
+
+size_t recent_memory()
+{
+    return total_bytes;
+}
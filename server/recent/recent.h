@@ -0,0 +1,23 @@
+// Vòng đệm N tin nhắn group gần nhất (đã format) trong RAM, để xem lại ngay khi vào group
+// mà không đọc đĩa. Tổng bộ nhớ có giới hạn, group lâu không hoạt động bị bỏ trước (LRU)
+#ifndef RECENT_H
+#define RECENT_H
+
+#include <stddef.h>
+
+#define RECENT_PER_GROUP 50                 // số tin nhắn giữ cho mỗi group
+#define RECENT_MAX_BYTES (16 * 1024 * 1024) // tổng bộ nhớ cho mọi group
+
+// Đổi cấu hình, gọi trước tin nhắn đầu tiên. per_group = 0 tắt tính năng
+void recent_configure(int per_group, size_t max_bytes);
+
+// Thêm 1 tin nhắn đã format (kết thúc bằng '\n') vào vòng đệm của group
+void recent_push(const char *group_id, const char *formatted);
+
+// Duyệt các tin nhắn đang giữ từ cũ đến mới, trả về số tin nhắn
+typedef void (*recent_cb)(const char *formatted, void *userdata);
+int recent_foreach(const char *group_id, recent_cb cb, void *userdata);
+
+size_t recent_memory(); // số byte đang dùng
+
+#endif
@@ -1,17 +1,193 @@
+#define _GNU_SOURCE // ppoll
 #include "../common.h"
+#include "auth/auth.h"
+#include "capture/capture.h"
 #include "client/client_mgr.h"
+#include "durable/durable.h"
+#include "fanout/fanout.h"
+#include "friend/friend.h"
+#include "group/group.h"
+#include "history/history.h"
+#include "idgen/idgen.h"
+#include "intern/intern.h"
+#include "iostat/iostat.h"
+#include "metrics/metrics.h"
+#include "offline/offline.h"
 #include "protocol/protocol.h"
+#include "recent/recent.h"
+#include "session/session.h"
+#include "slowlog/slowlog.h"
+#include "trace/trace.h"
+#include "upgrade/upgrade.h"
+#include "wal/wal.h"
+#include "watchdog/watchdog.h"
+#include "worker/worker.h"
 
 #include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 
-int main()
+// Các slot cố định ở đầu mảng pfds, client bắt đầu từ FIRST_CLIENT_SLOT
+#define SLOT_LISTEN 0
+#define SLOT_UPGRADE 1
+#define SLOT_WORKERS 2
+#define SLOT_METRICS 3
+#define SLOT_WAL 4
+#define FIRST_CLIENT_SLOT 5
+
+// Trong lúc process con ghi snapshot, poll thức dậy định kỳ để thu dọn nó
+#define SNAPSHOT_REAP_MS 200
+
+static volatile sig_atomic_t stop_requested = 0;
+static pthread_t reactor_thread;
+
+static void on_stop_signal(int sig)
 {
-    // Bỏ qua SIGPIPE để tránh crash khi client ngắt kết nối đột ngột
-    signal(SIGPIPE, SIG_IGN);
+    stop_requested = 1;
+    // Kernel giao signal cho thread nào không chặn nó; rơi vào flusher / worker / watchdog thì
+    // chuyển tiếp để reactor (đang chặn ngoài ppoll) vẫn thức dậy ở lần ppoll kế tiếp
+    if (!pthread_equal(pthread_self(), reactor_thread))
+        pthread_kill(reactor_thread, sig);
+}
 
-    clients_init();
+// Sync WAL / history rồi thoát. Gọi được cả lúc khởi động: các bước chưa mở thì không làm gì
+static void stop_server()
+{
+    workers_drain();
+    fanout_drain();
+    wal_sync();
+    durable_release();
+    history_sync();
+    wal_snapshot_reap(1);
+    capture_flush();
+    printf("Server stopped\n");
+    exit(EXIT_SUCCESS);
+}
+
+// Nạp state từ WAL; lần đầu chạy (WAL rỗng) thì chuyển dữ liệu từ các file text cũ sang
+static void open_stores()
+{
+    intern_init();
+    auth_init();
+    friend_init();
+    group_init();
+    offline_init();
+    idgen_wal_init();
+
+    // Cửa sổ gom fdatasync, đặt MINACHAT_WAL_SYNC_MS=0 để sync ngay từng lô nhỏ
+    int window = WAL_SYNC_WINDOW_MS;
+    const char *env = getenv("MINACHAT_WAL_SYNC_MS");
+    if (env && *env)
+        window = atoi(env);
+
+    // Node ID cho group / message ID, mỗi server trong cùng hệ thống phải khác nhau
+    env = getenv("MINACHAT_NODE_ID");
+    if (env && *env && idgen_init(atoi(env)) != 0)
+    {
+        fprintf(stderr, "MINACHAT_NODE_ID must be 0-%d\n", IDGEN_MAX_NODE);
+        exit(EXIT_FAILURE);
+    }
+
+    // Vòng đệm tin nhắn group gần nhất: số tin mỗi group và tổng số byte
+    env = getenv("MINACHAT_RECENT_MESSAGES");
+    const char *bytes = getenv("MINACHAT_RECENT_BYTES");
+    if ((env && *env) || (bytes && *bytes))
+        recent_configure(env && *env ? atoi(env) : RECENT_PER_GROUP,
+                         bytes && *bytes ? strtoul(bytes, NULL, 10) : RECENT_MAX_BYTES);
+
+    // Số người nhận mỗi lượt fan-out của tin nhắn group lớn
+    env = getenv("MINACHAT_FANOUT_CHUNK");
+    if (env && *env)
+        fanout_configure(atoi(env));
+
+    // Lấy mẫu span cho 1/N lệnh, xuất bằng lệnh admin TRACE DUMP
+    env = getenv("MINACHAT_TRACE_SAMPLE");
+    if (env && *env)
+        trace_configure(atoi(env));
+
+    // Ngưỡng slow log (micro giây), 0 = ghi mọi lệnh, -1 = tắt
+    env = getenv("MINACHAT_SLOWLOG_US");
+    if (env && *env)
+        slowlog_configure(atol(env));
+
+    // Số record giữa 2 lần snapshot, 0 = tắt snapshot tự động
+    env = getenv("MINACHAT_SNAPSHOT_RECORDS");
+    if (env && *env)
+        wal_snapshot_every(atol(env));
+
+    if (history_init(HISTORY_DIR) != 0)
+        perror("history init failed (HISTORY will be empty)");
+
+    long replayed = wal_open(WAL_FILE, window);
+    if (replayed < 0 && stop_requested)
+        stop_server(); // flock đang chờ process khác bị signal dừng cắt ngang (EINTR)
+    if (replayed < 0)
+    {
+        perror("wal open failed");
+        exit(EXIT_FAILURE);
+    }
+    idgen_load_snapshot();
+
+    if (wal_is_empty())
+    {
+        int accounts = auth_import_legacy();
+        int friends = friend_import_legacy();
+        int groups = group_import_legacy();
+        int offline = offline_import_legacy();
+        wal_sync();
+        printf("Imported legacy data: %d account(s), %d friend edge(s), %d group(s), %d offline message(s)\n",
+               accounts, friends, groups, offline);
+    }
+    else
+    {
+        printf("Loaded %ld record(s) from snapshot + WAL\n", replayed);
+    }
+}
+
+// ---------- gauge cho metrics ----------
+
+static long gauge_connected()
+{
+    return clients_connected_count();
+}
+
+static long gauge_logged_in()
+{
+    return clients_online_count();
+}
+
+static long gauge_worker_queue()
+{
+    return workers_pending();
+}
+
+static long gauge_fanout_queue()
+{
+    return fanout_pending();
+}
+
+static long gauge_recent_bytes()
+{
+    return (long)recent_memory();
+}
+
+static long gauge_durable_bytes()
+{
+    return (long)durable_held_bytes();
+}
+
+static void register_gauges()
+{
+    metrics_gauge("clients_connected", "Open client connections", gauge_connected);
+    metrics_gauge("clients_logged_in", "Logged-in client connections", gauge_logged_in);
+    metrics_gauge("worker_queue_depth", "LOGIN/REGISTER jobs waiting for or running on workers", gauge_worker_queue);
+    metrics_gauge("fanout_queue_depth", "Group messages still being fanned out", gauge_fanout_queue);
+    metrics_gauge("recent_buffer_bytes", "Memory used by the recent group message rings", gauge_recent_bytes);
+    metrics_gauge("durable_held_bytes", "Replies waiting for their WAL batch to be fdatasync'd", gauge_durable_bytes);
+}
 
+static int create_listener()
+{
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0)
     {
@@ -41,22 +217,134 @@ int main()
         exit(EXIT_FAILURE);
     }
 
-    printf("Server listening on port %d...\n", PORT);
+    return server_fd;
+}
+
+int main(int argc, char **argv)
+{
+    // Bỏ qua SIGPIPE để tránh crash khi client ngắt kết nối đột ngột
+    signal(SIGPIPE, SIG_IGN);
+
+    // SIGINT/SIGTERM: sync WAL rồi mới thoát (không SA_RESTART để flock chờ WAL / ppoll trả về EINTR)
+    reactor_thread = pthread_self();
+    struct sigaction sa = {0};
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    clients_init();
+
+    if (session_init() != 0)
+        fprintf(stderr, "Session key unavailable, RESUME tokens will not survive hot upgrade\n");
+
+    struct pollfd pfds[MAX_CLIENTS + FIRST_CLIENT_SLOT];
+    int nfds = FIRST_CLIENT_SLOT;
+    int server_fd;
+
+    // Ghi lại lưu lượng vào để replay (bench/replay). Bật trước khi nhận client để trace có đủ OPEN
+    const char *capture = getenv("MINACHAT_CAPTURE");
+    if (capture && *capture)
+    {
+        if (capture_start(capture) == 0)
+            printf("Capturing inbound traffic to %s\n", capture);
+        else
+            perror("capture file open failed");
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--takeover") == 0)
+    {
+        // Hot upgrade: nhận listener + client đang kết nối từ process cũ thay vì bind lại
+        int fds[MAX_CLIENTS];
+        int n = upgrade_takeover(&server_fd, fds, MAX_CLIENTS);
+        if (n < 0)
+        {
+            fprintf(stderr, "Takeover failed, old server keeps running\n");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < n; i++)
+            pfds[nfds++] = (struct pollfd){fds[i], POLLIN, 0};
+        metrics_add(METRIC_CONNECTIONS, (uint64_t)n);
+
+        printf("Took over listener and %d client(s) on port %d\n", n, PORT);
+    }
+    else
+    {
+        server_fd = create_listener();
+        printf("Server listening on port %d...\n", PORT);
+    }
 
-    struct pollfd pfds[MAX_CLIENTS + 1];
-    pfds[0] = (struct pollfd){server_fd, POLLIN, 0};
-    int nfds = 1;
+    // Khi takeover, flock trên WAL sẽ chờ process cũ thoát hẳn rồi mới replay. Signal dừng tới
+    // trong lúc khởi động được kiểm tra ở các mốc dưới đây
+    if (stop_requested)
+        stop_server();
+    open_stores();
+    if (stop_requested)
+        stop_server();
+    clients_index_restored();
+    protocol_init();
+    register_gauges();
+    iostat_init();
+
+    // Control socket cho lần upgrade tiếp theo (fd âm thì poll bỏ qua)
+    int ctl_fd = upgrade_listen();
+    if (ctl_fd < 0)
+        perror("upgrade socket failed");
+
+    // Số liệu dạng Prometheus cho công cụ giám sát trên cùng máy
+    int metrics_fd = metrics_listen();
+    if (metrics_fd < 0)
+        perror("metrics socket failed");
+
+    // Worker pool cho LOGIN/REGISTER (hash mật khẩu), lỗi thì chạy đồng bộ trên reactor
+    int wake_fd = workers_init(WORKER_THREADS, WORKER_QUEUE_CAP);
+    if (wake_fd < 0)
+        fprintf(stderr, "Worker pool unavailable, authenticating on the main thread\n");
+
+    // Watchdog: reactor không quay lại poll sau MINACHAT_WATCHDOG_MS thì ghi lệnh + backtrace vào log
+    long watchdog_ms = WATCHDOG_DEFAULT_MS;
+    const char *env = getenv("MINACHAT_WATCHDOG_MS");
+    if (env && *env)
+        watchdog_ms = atol(env);
+    if (watchdog_start(watchdog_ms) != 0)
+        perror("watchdog start failed");
+
+    pfds[SLOT_LISTEN] = (struct pollfd){server_fd, POLLIN, 0};
+    pfds[SLOT_UPGRADE] = (struct pollfd){ctl_fd, POLLIN, 0};
+    pfds[SLOT_WORKERS] = (struct pollfd){wake_fd, POLLIN, 0};
+    pfds[SLOT_METRICS] = (struct pollfd){metrics_fd, POLLIN, 0};
+    pfds[SLOT_WAL] = (struct pollfd){wal_commit_fd(), POLLIN, 0};
+
+    // Từ đây reactor chỉ nhận SIGINT/SIGTERM trong ppoll: signal tới lúc reactor đang bận nằm chờ
+    // tới lần ppoll kế tiếp thay vì bị xử lý ngay trước poll rồi kẹt lại tới khi có sự kiện
+    sigset_t stop_signals, poll_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &poll_mask);
+    sigdelset(&poll_mask, SIGINT);
+    sigdelset(&poll_mask, SIGTERM);
+    if (stop_requested)
+        stop_server();
 
     while (1)
     {
-        int ret = poll(pfds, nfds, -1);
+        // Còn fan-out dở thì chỉ kiểm tra sự kiện rồi quay lại giao tiếp lượt sau
+        int timeout = fanout_pending() ? 0 : wal_snapshot_running() ? SNAPSHOT_REAP_MS : -1;
+        struct timespec ts = {timeout / 1000, (timeout % 1000) * 1000000L};
+        watchdog_idle();
+        int ret = ppoll(pfds, nfds, timeout < 0 ? NULL : &ts, &poll_mask);
+        watchdog_busy();
+        if (stop_requested)
+            stop_server();
         if (ret < 0)
         {
             perror("poll failed");
             continue;
         }
 
-        if (pfds[0].revents & POLLIN)
+        if (pfds[SLOT_LISTEN].revents & POLLIN)
         {
             int cfd = accept(server_fd, NULL, NULL);
             if (cfd < 0)
@@ -73,6 +361,7 @@ int main()
                 pfds[nfds].events = POLLIN;
                 pfds[nfds].revents = 0;
                 nfds++;
+                metrics_add(METRIC_CONNECTIONS, 1);
             }
             else
             {
@@ -80,7 +369,7 @@ int main()
             }
         }
 
-        for (int i = 1; i < nfds; i++)
+        for (int i = FIRST_CLIENT_SLOT; i < nfds; i++)
         {
             short re = pfds[i].revents;
             if (re & (POLLHUP | POLLERR | POLLNVAL))
@@ -88,7 +377,7 @@ int main()
                 int fd = pfds[i].fd;
                 Client *c = client_by_fd(fd);
                 if (c)
-                    client_remove(c);
+                    protocol_disconnect(c);
                 else
                     close(fd);
                 pfds[i] = pfds[--nfds];
@@ -117,7 +406,7 @@ int main()
                     // Buffer đầy, ngắt kết nối
                     fprintf(stderr, "Buffer overflow for client %s, disconnecting\n",
                             c->logged_in ? c->username : "(not logged in)");
-                    client_remove(c);
+                    protocol_disconnect(c);
                     pfds[i] = pfds[--nfds];
                     i--;
                     continue;
@@ -130,7 +419,7 @@ int main()
                 if (n <= 0)
                 {
                     // 1. Xóa thông tin client khỏi mảng quản lý
-                    client_remove(c); // Hàm tự gọi close(fd)
+                    protocol_disconnect(c); // Hàm tự gọi close(fd)
 
                     // 2. Xóa khỏi mảng poll bằng cách swap phần tử cuối lên
                     pfds[i] = pfds[--nfds];
@@ -139,25 +428,67 @@ int main()
                 }
                 else
                 {
+                    metrics_add(METRIC_BYTES_IN, (uint64_t)n);
+
                     // Kiểm tra xem append có thành công không
                     if (client_append_data(c, buf, n) < 0)
                     {
                         // Buffer đầy, ngắt kết nối
                         fprintf(stderr, "Buffer full for client %s, disconnecting\n",
                                 c->logged_in ? c->username : "(not logged in)");
-                        client_remove(c);
+                        protocol_disconnect(c);
                         pfds[i] = pfds[--nfds];
                         i--;
                         continue;
                     }
 
-                    while (client_has_line(c))
-                    {
-                        char *line = client_pop_line(c);
-                        protocol_handle(c, line);
-                    }
+                    protocol_process_input(c);
                 }
             }
         }
+
+        // Kết quả LOGIN/REGISTER từ worker
+        if (pfds[SLOT_WORKERS].revents & POLLIN)
+            workers_complete();
+
+        if (pfds[SLOT_METRICS].revents & POLLIN)
+            metrics_serve(metrics_fd);
+
+        // Lô WAL vừa fdatasync xong: gửi các trả lời đang chờ lô đó
+        if (pfds[SLOT_WAL].revents & POLLIN)
+        {
+            wal_commit_ack();
+            durable_release();
+        }
+
+        // 1 lượt fan-out (tối đa FANOUT_CHUNK người nhận) xen giữa các lần phục vụ client
+        if (fanout_pending())
+            fanout_step();
+
+        // Process mới kết nối vào control socket -> chuyển giao socket rồi thoát
+        if (pfds[SLOT_UPGRADE].revents & POLLIN)
+        {
+            // Hoàn tất các LOGIN/REGISTER đang dở trước khi chuyển client đi
+            workers_drain();
+            // Tin nhắn group đang fan-out dở phải lưu xong vào WAL trước khi chuyển giao
+            fanout_drain();
+            // Process mới replay WAL nên mọi record phải nằm trên đĩa trước khi chuyển giao
+            wal_sync();
+            durable_release(); // trả lời đang chờ sync phải gửi trước khi client thuộc về process mới
+            history_sync();
+            wal_snapshot_reap(1); // process mới sẽ tự chụp snapshot, không để 2 process con ghi cùng lúc
+            capture_flush();      // process mới nối segment vào cùng file trace
+            if (upgrade_handoff(ctl_fd, server_fd) == 0)
+            {
+                close(ctl_fd);
+                exit(EXIT_SUCCESS);
+            }
+            fprintf(stderr, "Upgrade handoff failed, continuing\n");
+        }
+
+        // Snapshot nền: WAL đủ dài thì fork process con ghi snapshot rồi cắt bớt WAL
+        wal_snapshot_reap(0);
+        if (wal_snapshot_due())
+            wal_snapshot_start();
     }
 }
\ No newline at end of file
@@ -0,0 +1,382 @@
+#include "session.h"
+#include "../crypto/sha256.h"
+#include "../durable/durable.h"
+#include "../metrics/metrics.h"
+#include "../slowlog/slowlog.h"
+#include "../trace/trace.h"
+#include "../util/strmap.h"
+
+#include <fcntl.h>
+#include <time.h>
+#include <inttypes.h>
+
+#define SESSION_KEY_LEN 32
+#define SESSION_MAC_LEN 16 // số byte HMAC giữ lại trong token
+#define SWEEP_STEP 8       // số slot kiểm tra hết hạn mỗi lần mở session
+
+/*
+    Token = hex(payload) "." hex(HMAC-SHA256(key, payload)[0..16])
+    payload = <username>:<sid hex>:<expiry>
+    Kiểm tra token chỉ cần tính 1 HMAC + 1 lần tra hash map, không đọc accounts.txt
+*/
+
+typedef struct
+{
+    uint64_t sid;
+    uint64_t next_seq;
+    time_t detached_at; // 0 nếu đang online
+    int closed;         // đã LOGOUT: giữ lại để từ chối token cũ cho đến khi hết hạn
+    int offline_pending;
+    uint64_t ring_seq[SESSION_RING_SIZE];
+    char *ring_text[SESSION_RING_SIZE];
+} Session;
+
+static uint8_t session_key[SESSION_KEY_LEN];
+static StrMap *sessions = NULL;
+static long sweep_pos = 0;
+
+// ---------- helpers ----------
+
+static void send_all(int fd, const char *data, size_t len)
+{
+    if (durable_hold(fd, data, len))
+        return;
+    size_t sent = 0;
+    while (sent < len)
+    {
+        ssize_t n = send(fd, data + sent, len - sent, 0);
+        if (n <= 0)
+            return;
+        sent += (size_t)n;
+        metrics_add(METRIC_BYTES_OUT, (uint64_t)n);
+        slowlog_count_send();
+    }
+}
+
+static void session_free(Session *s)
+{
+    for (int i = 0; i < SESSION_RING_SIZE; i++)
+        free(s->ring_text[i]);
+    free(s);
+}
+
+static Session *session_new(uint64_t sid, uint64_t next_seq)
+{
+    Session *s = calloc(1, sizeof(Session));
+    if (!s)
+        return NULL;
+    s->sid = sid;
+    s->next_seq = next_seq;
+    return s;
+}
+
+static int make_token(const char *username, uint64_t sid, char *out, size_t outsz)
+{
+    char payload[USERNAME_LEN + 48];
+    int plen = snprintf(payload, sizeof(payload), "%s:%016" PRIx64 ":%ld",
+                        username, sid, (long)(time(NULL) + SESSION_TTL_SEC));
+    if (plen < 0 || (size_t)plen >= sizeof(payload))
+        return -1;
+    if ((size_t)plen * 2 + 1 + SESSION_MAC_LEN * 2 + 1 > outsz)
+        return -1;
+
+    uint8_t mac[SHA256_DIGEST_LEN];
+    hmac_sha256(session_key, sizeof(session_key), payload, (size_t)plen, mac);
+
+    crypto_hex_encode((const uint8_t *)payload, (size_t)plen, out);
+    out[plen * 2] = '.';
+    crypto_hex_encode(mac, SESSION_MAC_LEN, out + plen * 2 + 1);
+    return 0;
+}
+
+static int verify_token(const char *token, char *username_out, uint64_t *sid_out)
+{
+    const char *dot = strchr(token, '.');
+    if (!dot)
+        return 0;
+
+    char payload[USERNAME_LEN + 48];
+    int plen = crypto_hex_decode(token, (size_t)(dot - token), (uint8_t *)payload, sizeof(payload) - 1);
+    if (plen <= 0)
+        return 0;
+    payload[plen] = '\0';
+
+    uint8_t mac[SESSION_MAC_LEN];
+    if (strlen(dot + 1) != SESSION_MAC_LEN * 2 ||
+        crypto_hex_decode(dot + 1, SESSION_MAC_LEN * 2, mac, sizeof(mac)) != SESSION_MAC_LEN)
+        return 0;
+
+    uint8_t expect[SHA256_DIGEST_LEN];
+    hmac_sha256(session_key, sizeof(session_key), payload, (size_t)plen, expect);
+    if (!crypto_equal(mac, expect, SESSION_MAC_LEN))
+        return 0;
+
+    // Parse từ phải sang vì username có thể chứa ':'
+    char *p_exp = strrchr(payload, ':');
+    if (!p_exp)
+        return 0;
+    *p_exp++ = '\0';
+    char *p_sid = strrchr(payload, ':');
+    if (!p_sid)
+        return 0;
+    *p_sid++ = '\0';
+
+    if (atol(p_exp) < (long)time(NULL))
+        return 0; // hết hạn
+
+    if (strlen(payload) == 0 || strlen(payload) >= USERNAME_LEN)
+        return 0;
+
+    strcpy(username_out, payload);
+    *sid_out = strtoull(p_sid, NULL, 16);
+    return 1;
+}
+
+// Dọn dần các session đã mất kết nối quá TTL, mỗi lần chỉ xét vài slot
+static void sweep_expired()
+{
+    time_t now = time(NULL);
+    for (int step = 0; step < SWEEP_STEP; step++)
+    {
+        const char *key;
+        void *val;
+        long i = strmap_next(sessions, sweep_pos, &key, &val);
+        if (i < 0)
+        {
+            sweep_pos = 0;
+            return;
+        }
+        sweep_pos = i + 1;
+
+        Session *s = val;
+        if (s->detached_at && now - s->detached_at > SESSION_TTL_SEC)
+        {
+            char name[USERNAME_LEN];
+            strncpy(name, key, USERNAME_LEN - 1);
+            name[USERNAME_LEN - 1] = '\0';
+            strmap_remove(sessions, name);
+            session_free(s);
+            return; // bảng vừa thay đổi, lần sau xét tiếp
+        }
+    }
+}
+
+// ---------- API ----------
+
+int session_init()
+{
+    sessions = strmap_new();
+    if (!sessions)
+        return -1;
+
+    // Khóa lưu ra file để token còn hiệu lực ở process mới sau hot upgrade
+    int fd = open(SESSION_KEY_FILE, O_RDONLY);
+    if (fd >= 0)
+    {
+        ssize_t n = read(fd, session_key, sizeof(session_key));
+        close(fd);
+        if (n == (ssize_t)sizeof(session_key))
+            return 0;
+    }
+
+    if (crypto_random(session_key, sizeof(session_key)) != 0)
+        return -1;
+
+    fd = open(SESSION_KEY_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        return -1;
+    ssize_t n = write(fd, session_key, sizeof(session_key));
+    close(fd);
+    return n == (ssize_t)sizeof(session_key) ? 0 : -1;
+}
+
+int session_open(const char *username, char *token_out, size_t outsz)
+{
+    sweep_expired();
+
+    uint64_t sid;
+    if (crypto_random(&sid, sizeof(sid)) != 0)
+        return SESSION_ERR;
+
+    Session *s = session_new(sid, 1);
+    if (!s)
+        return SESSION_ERR;
+
+    if (make_token(username, sid, token_out, outsz) != 0)
+    {
+        session_free(s);
+        return SESSION_ERR;
+    }
+
+    Session *old = strmap_get(sessions, username);
+    if (strmap_put(sessions, username, s) != 0)
+    {
+        session_free(s);
+        return SESSION_ERR;
+    }
+    if (old)
+        session_free(old);
+    return SESSION_OK;
+}
+
+int session_resume(const char *token, uint64_t last_seq,
+                   char *username_out, char *token_out, size_t outsz)
+{
+    uint64_t sid;
+    if (!verify_token(token, username_out, &sid))
+        return SESSION_BAD_TOKEN;
+
+    // Session chỉ nằm trong RAM (hot upgrade thì được chuyển sang process mới). Không có session
+    // nghĩa là server đã restart: không biết token đã bị LOGOUT / LOGIN mới thay chưa nên từ chối,
+    // client LOGIN lại
+    Session *s = strmap_get(sessions, username_out);
+    if (!s || (s->closed && s->sid == sid))
+        return SESSION_BAD_TOKEN;
+    if (s->sid != sid)
+        return SESSION_REPLACED;
+
+    if (s->next_seq <= last_seq)
+        s->next_seq = last_seq + 1;
+    s->detached_at = 0;
+
+    if (make_token(username_out, sid, token_out, outsz) != 0)
+        return SESSION_ERR;
+    return SESSION_OK;
+}
+
+int session_replay(const char *username, uint64_t last_seq, int fd, int *lost)
+{
+    *lost = 0;
+    Session *s = strmap_get(sessions, username);
+    if (!s)
+        return 0;
+
+    uint64_t first = last_seq + 1;
+    if (s->next_seq > SESSION_RING_SIZE && first < s->next_seq - SESSION_RING_SIZE)
+    {
+        first = s->next_seq - SESSION_RING_SIZE;
+        *lost = 1;
+    }
+
+    int count = 0;
+    for (uint64_t seq = first; seq < s->next_seq; seq++)
+    {
+        int slot = (int)(seq % SESSION_RING_SIZE);
+        if (s->ring_seq[slot] != seq || !s->ring_text[slot])
+        {
+            *lost = 1;
+            continue;
+        }
+
+        char tag[32];
+        int n = snprintf(tag, sizeof(tag), "#%" PRIu64 " ", seq);
+        send_all(fd, tag, (size_t)n);
+        send_all(fd, s->ring_text[slot], strlen(s->ring_text[slot]));
+        count++;
+    }
+    return count;
+}
+
+int session_take_offline_pending(const char *username)
+{
+    Session *s = strmap_get(sessions, username);
+    if (!s)
+        return 1; // không biết trạng thái, giao lại cho chắc
+    int pending = s->offline_pending;
+    s->offline_pending = 0;
+    return pending;
+}
+
+void session_deliver(const char *username, int fd, const char *text)
+{
+    TRACE_SCOPE("session", "session_deliver");
+    Session *s = strmap_get(sessions, username);
+    if (!s || s->closed)
+    {
+        send_all(fd, text, strlen(text));
+        return;
+    }
+
+    uint64_t seq = s->next_seq++;
+    int slot = (int)(seq % SESSION_RING_SIZE);
+    free(s->ring_text[slot]);
+    s->ring_text[slot] = strdup(text);
+    s->ring_seq[slot] = seq;
+
+    char tag[32];
+    int n = snprintf(tag, sizeof(tag), "#%" PRIu64 " ", seq);
+    send_all(fd, tag, (size_t)n);
+    send_all(fd, text, strlen(text));
+}
+
+void session_note_offline(const char *username)
+{
+    Session *s = strmap_get(sessions, username);
+    if (s)
+        s->offline_pending = 1;
+}
+
+void session_detach(const char *username)
+{
+    Session *s = strmap_get(sessions, username);
+    if (s)
+        s->detached_at = time(NULL);
+}
+
+void session_close(const char *username)
+{
+    Session *s = strmap_get(sessions, username);
+    if (!s)
+        return;
+
+    for (int i = 0; i < SESSION_RING_SIZE; i++)
+    {
+        free(s->ring_text[i]);
+        s->ring_text[i] = NULL;
+    }
+    s->closed = 1;
+    s->detached_at = time(NULL);
+}
+
+int session_export(const char *username, uint64_t *sid, uint64_t *next_seq)
+{
+    Session *s = strmap_get(sessions, username);
+    if (!s || s->closed)
+        return -1;
+    *sid = s->sid;
+    *next_seq = s->next_seq;
+    return 0;
+}
+
+long session_next_detached(long pos, const char **username, uint64_t *sid, uint64_t *next_seq,
+                           int64_t *detached_at)
+{
+    void *val;
+    for (long i = strmap_next(sessions, pos, username, &val); i >= 0; i = strmap_next(sessions, i + 1, username, &val))
+    {
+        Session *s = val;
+        if (s->closed || !s->detached_at)
+            continue;
+        *sid = s->sid;
+        *next_seq = s->next_seq;
+        *detached_at = (int64_t)s->detached_at;
+        return i;
+    }
+    return -1;
+}
+
+void session_import(const char *username, uint64_t sid, uint64_t next_seq, int64_t detached_at)
+{
+    Session *s = session_new(sid, next_seq);
+    if (!s)
+        return;
+    s->detached_at = (time_t)detached_at;
+    Session *old = strmap_get(sessions, username);
+    if (strmap_put(sessions, username, s) != 0)
+    {
+        session_free(s);
+        return;
+    }
+    if (old)
+        session_free(old);
+}
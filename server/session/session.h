@@ -0,0 +1,51 @@
+// Session token để client reconnect bằng RESUME thay vì LOGIN lại
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "../../common.h"
+#include <stdint.h>
+
+#define SESSION_KEY_FILE "session.key"
+#define SESSION_TOKEN_MAX 256
+#define SESSION_RING_SIZE 64        // Số message gần nhất giữ lại để replay khi RESUME
+#define SESSION_TTL_SEC (24 * 3600) // Hạn của token / session đã mất kết nối
+
+// Return codes
+#define SESSION_OK 0
+#define SESSION_ERR -1
+#define SESSION_BAD_TOKEN -2 // sai chữ ký, sai format hoặc hết hạn
+#define SESSION_REPLACED -3  // user đã LOGIN lại, token cũ không còn dùng được
+
+// Load (hoặc tạo mới) khóa ký token. 0 nếu OK
+int session_init();
+
+// LOGIN thành công: tạo session mới (token cũ mất hiệu lực) và ghi token ra token_out
+int session_open(const char *username, char *token_out, size_t outsz);
+
+// RESUME: kiểm tra token, gắn lại session, cấp token mới. username_out cỡ USERNAME_LEN
+int session_resume(const char *token, uint64_t last_seq,
+                   char *username_out, char *token_out, size_t outsz);
+
+// Gửi lại các message có seq > last_seq còn trong ring. Trả về số message đã gửi,
+// *lost = 1 nếu có message đã bị đẩy ra khỏi ring (không replay được)
+int session_replay(const char *username, uint64_t last_seq, int fd, int *lost);
+
+// Trả về 1 (và xóa cờ) nếu có tin nhắn offline được lưu trong lúc user mất kết nối
+int session_take_offline_pending(const char *username);
+
+// Gửi message chat cho user đang online: gán seq, lưu vào ring, gửi dạng "#<seq> <text>"
+void session_deliver(const char *username, int fd, const char *text);
+
+void session_note_offline(const char *username); // Có tin nhắn offline mới cho user
+void session_detach(const char *username);       // Mất kết nối (chưa LOGOUT), giữ session để RESUME
+void session_close(const char *username);        // LOGOUT: hủy session
+
+// Hot upgrade: chuyển trạng thái session sang process mới (ring tin nhắn không được chuyển).
+// Session không qua được restart thường: RESUME sau restart bị từ chối, client LOGIN lại
+int session_export(const char *username, uint64_t *sid, uint64_t *next_seq); // client đang online
+// Duyệt session đã mất kết nối (chưa LOGOUT) như strmap_next: vị trí session tìm được, -1 nếu hết
+long session_next_detached(long pos, const char **username, uint64_t *sid, uint64_t *next_seq,
+                           int64_t *detached_at);
+void session_import(const char *username, uint64_t sid, uint64_t next_seq, int64_t detached_at); // 0 = online
+
+#endif
@@ -0,0 +1,90 @@
+#include "../../common.h"
+#include "slowlog.h"
+#include "../util/outbuf.h"
+
+#include <time.h>
+
+typedef struct
+{
+    uint64_t id; // tăng dần từ 1 như Redis, giữ nguyên qua RESET
+    time_t when;
+    char cmd[SLOWLOG_CMD_LEN];
+    char user[USERNAME_LEN];
+    uint64_t total_ns;
+    SlowlogCounters used;
+} SlowEntry;
+
+__thread SlowlogCounters slowlog_counters = {0, 0, 0};
+__thread int slowlog_storage_depth = 0;
+
+// Chỉ reactor ghi / đọc vòng đệm nên không cần lock
+static SlowEntry ring[SLOWLOG_MAX_ENTRIES];
+static int count = 0, head = 0; // head = slot sẽ ghi tiếp
+static uint64_t next_id = 1;
+static uint64_t threshold_ns = SLOWLOG_DEFAULT_US * 1000ULL;
+static int enabled = 1;
+
+void slowlog_configure(long threshold_us)
+{
+    enabled = threshold_us >= 0;
+    threshold_ns = enabled ? (uint64_t)threshold_us * 1000 : 0;
+}
+
+long slowlog_threshold_us()
+{
+    return enabled ? (long)(threshold_ns / 1000) : -1;
+}
+
+void slowlog_check(const char *cmd, const char *user, uint64_t total_ns, const SlowlogCounters *before)
+{
+    if (!enabled || total_ns < threshold_ns)
+        return;
+
+    SlowEntry *e = &ring[head];
+    e->id = next_id++;
+    e->when = time(NULL);
+    snprintf(e->cmd, sizeof(e->cmd), "%s", cmd);
+    snprintf(e->user, sizeof(e->user), "%s", user ? user : "-");
+    e->total_ns = total_ns;
+    e->used.storage_ns = slowlog_counters.storage_ns - before->storage_ns;
+    e->used.read_bytes = slowlog_counters.read_bytes - before->read_bytes;
+    e->used.sends = slowlog_counters.sends - before->sends;
+
+    head = (head + 1) % SLOWLOG_MAX_ENTRIES;
+    if (count < SLOWLOG_MAX_ENTRIES)
+        count++;
+}
+
+// ---------- xuất ----------
+
+size_t slowlog_render(char *out, size_t outsz, int max)
+{
+    OutBuf o = {out, outsz, 0};
+    if (outsz == 0)
+        return 0;
+    out[0] = '\0';
+
+    int n = max > 0 && max < count ? max : count;
+    outbuf_put(&o, "=== Slow log (%d of %d, threshold %ld us) ===\n", n, count, slowlog_threshold_us());
+    for (int i = 0; i < n; i++)
+    {
+        const SlowEntry *e = &ring[(head - 1 - i + SLOWLOG_MAX_ENTRIES) % SLOWLOG_MAX_ENTRIES];
+        char when[32];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&e->when));
+        outbuf_put(&o, "#%llu %s %s user=%s total=%.1fus storage=%.1fus read=%lluB sends=%llu\n",
+            (unsigned long long)e->id, when, e->cmd, e->user, e->total_ns / 1e3, e->used.storage_ns / 1e3,
+            (unsigned long long)e->used.read_bytes, (unsigned long long)e->used.sends);
+    }
+    return o.len;
+}
+
+int slowlog_len()
+{
+    return count;
+}
+
+void slowlog_reset()
+{
+    count = 0;
+    head = 0;
+}
@@ -0,0 +1,65 @@
+// Slow log kiểu Redis SLOWLOG: lệnh nào xử lý lâu hơn ngưỡng thì lưu lại (lệnh, user, tổng thời
+// gian, thời gian trong tầng lưu trữ, số byte đọc từ file, số lần send) vào vòng đệm trong RAM.
+// Xem bằng lệnh admin SLOWLOG GET / RESET, ngưỡng đặt bằng MINACHAT_SLOWLOG_US
+#ifndef SLOWLOG_H
+#define SLOWLOG_H
+
+#include "../metrics/metrics.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLOWLOG_MAX_ENTRIES 128   // đầy thì đè entry cũ nhất
+#define SLOWLOG_DEFAULT_US 10000 // 10 ms
+#define SLOWLOG_CMD_LEN 16
+
+// Số liệu cộng dồn của thread hiện tại, không bao giờ reset: lệnh chụp lại lúc bắt đầu rồi lấy
+// hiệu lúc kết thúc nên lệnh lồng nhau (LOGIN chạy đồng bộ khi không có worker) vẫn đúng
+typedef struct
+{
+    uint64_t storage_ns; // thời gian trong WAL / history / log
+    uint64_t read_bytes; // byte đọc từ file
+    uint64_t sends;      // số lần gọi send() tới client
+} SlowlogCounters;
+
+extern __thread SlowlogCounters slowlog_counters;
+extern __thread int slowlog_storage_depth;
+
+// Ngưỡng tính bằng micro giây, 0 = ghi mọi lệnh, < 0 = tắt
+void slowlog_configure(long threshold_us);
+long slowlog_threshold_us();
+
+// Gọi sau mỗi lệnh: before là slowlog_counters chụp lúc bắt đầu. user có thể NULL
+void slowlog_check(const char *cmd, const char *user, uint64_t total_ns, const SlowlogCounters *before);
+
+static inline void slowlog_count_read(size_t n)
+{
+    slowlog_counters.read_bytes += n;
+}
+
+static inline void slowlog_count_send()
+{
+    slowlog_counters.sends++;
+}
+
+// Thời gian tầng lưu trữ: chỉ scope ngoài cùng được cộng (history_append gọi tiếp wal, ...)
+static inline uint64_t slowlog_storage_enter()
+{
+    return slowlog_storage_depth++ ? 0 : metrics_now_ns();
+}
+
+static inline void slowlog_storage_exit(uint64_t *start)
+{
+    if (--slowlog_storage_depth == 0)
+        slowlog_counters.storage_ns += metrics_now_ns() - *start;
+}
+
+#define SLOWLOG_STORAGE_SCOPE() \
+    uint64_t slowlog_storage_ __attribute__((cleanup(slowlog_storage_exit))) = slowlog_storage_enter()
+
+// Các entry mới nhất trước, tối đa max entry (<= 0: tất cả). Trả về số byte đã ghi
+size_t slowlog_render(char *out, size_t outsz, int max);
+int slowlog_len();
+void slowlog_reset();
+
+#endif
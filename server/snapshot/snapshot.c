@@ -0,0 +1,418 @@
+#include "snapshot.h"
+#include "../util/crc32.h"
+#include "../util/strmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAP_WRITE_BUF (256 * 1024)
+#define SNAP_ALIGN 8
+
+// ---------- đọc ----------
+
+static const uint8_t *map_base = NULL;
+static const SnapHeader *header = NULL;
+
+int snap_is_binary(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    char magic[8];
+    int ok = read(fd, magic, sizeof(magic)) == (ssize_t)sizeof(magic) &&
+             memcmp(magic, SNAP_MAGIC, sizeof(magic)) == 0;
+    close(fd);
+    return ok;
+}
+
+int snap_load(const char *path, int64_t *generation)
+{
+    if (!snap_is_binary(path))
+        return 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapHeader))
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // mapping vẫn giữ file kể cả khi snapshot mới rename đè lên
+    if (p == MAP_FAILED)
+        return -1;
+
+    const SnapHeader *h = p;
+    uint32_t crc = crc32(h, offsetof(SnapHeader, header_crc));
+    int bad = h->version != SNAP_VERSION || h->header_crc != crc ||
+              h->file_size != (uint64_t)st.st_size || h->nsections > SNAP_MAX_SECTIONS;
+
+    // Kiểm tra biên của từng section một lần, sau đó tra cứu không cần kiểm tra lại
+    for (uint32_t i = 0; !bad && i < h->nsections; i++)
+    {
+        const SnapSection *s = &h->sections[i];
+        if (s->offset > h->file_size || s->length > h->file_size - s->offset)
+            bad = 1;
+        else if (s->id == SNAP_STRINGS)
+            bad = s->length == 0 || ((const char *)p)[s->offset + s->length - 1] != '\0';
+        else
+        {
+            uint64_t need = (uint64_t)s->count * sizeof(SnapEntry) + (uint64_t)s->nbuckets * sizeof(uint32_t) +
+                            (uint64_t)s->nitems * s->item_size;
+            bad = need > s->length || (s->nbuckets & (s->nbuckets - 1)) != 0;
+        }
+    }
+
+    if (bad)
+    {
+        munmap(p, (size_t)st.st_size);
+        return -1;
+    }
+
+    map_base = p;
+    header = h;
+    *generation = h->generation;
+    return 1;
+}
+
+static const SnapSection *section_get(int id)
+{
+    for (uint32_t i = 0; header && i < header->nsections; i++)
+    {
+        if ((int)header->sections[i].id == id)
+            return &header->sections[i];
+    }
+    return NULL;
+}
+
+int snap_table(int section, SnapTable *t)
+{
+    memset(t, 0, sizeof(*t));
+    const SnapSection *strs = section_get(SNAP_STRINGS);
+    const SnapSection *s = section_get(section);
+    if (!strs || !s)
+        return -1;
+
+    const uint8_t *base = map_base + s->offset;
+    t->strings = (const char *)map_base + strs->offset;
+    t->strings_len = strs->length;
+    t->entries = (const SnapEntry *)base;
+    t->count = s->count;
+    t->buckets = (const uint32_t *)(base + (size_t)s->count * sizeof(SnapEntry));
+    t->nbuckets = s->nbuckets;
+    t->items = (const uint8_t *)(t->buckets + s->nbuckets);
+    t->item_size = s->item_size;
+    t->nitems = s->nitems;
+    return 0;
+}
+
+const char *snap_str(const SnapTable *t, uint32_t off)
+{
+    return off < t->strings_len ? t->strings + off : "";
+}
+
+const SnapEntry *snap_find(const SnapTable *t, const char *key)
+{
+    if (t->nbuckets == 0)
+        return NULL;
+
+    uint32_t mask = t->nbuckets - 1;
+    for (uint32_t i = (uint32_t)strmap_hash(key) & mask, probes = 0; probes < t->nbuckets; i = (i + 1) & mask, probes++)
+    {
+        uint32_t slot = t->buckets[i];
+        if (slot == 0 || slot > t->count)
+            return NULL;
+        const SnapEntry *e = &t->entries[slot - 1];
+        if (strcmp(snap_str(t, e->key), key) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+const SnapEntry *snap_at(const SnapTable *t, uint32_t id)
+{
+    if (id == 0 || id > t->count)
+        return NULL;
+    return &t->entries[id - 1];
+}
+
+const void *snap_item(const SnapTable *t, uint32_t idx)
+{
+    if (idx >= t->nitems)
+        return NULL;
+    return t->items + (size_t)idx * t->item_size;
+}
+
+int snap_item_copy(const SnapTable *t, uint32_t idx, void *out, size_t size)
+{
+    const void *p = snap_item(t, idx);
+    if (!p)
+        return -1;
+    size_t n = t->item_size < size ? t->item_size : size;
+    memcpy(out, p, n);
+    memset((uint8_t *)out + n, 0, size - n);
+    return 0;
+}
+
+// ---------- ghi ----------
+
+typedef struct
+{
+    int id;
+    uint32_t item_size;
+    SnapEntry *entries;
+    uint32_t *hashes;
+    size_t count, cap;
+    int keyed; // 0 = bảng theo ID, không cần hash index
+    uint8_t *items;
+    size_t nitems, items_cap;
+} PendingTable;
+
+struct SnapWriter
+{
+    int fd;
+    int error;
+    SnapHeader hdr;
+    uint64_t pos;          // offset ghi tiếp theo trong file
+    uint64_t strings_len;  // string table ghi thẳng xuống file ngay khi thêm
+    PendingTable tables[SNAP_MAX_SECTIONS];
+    int ntables;
+    PendingTable *cur;
+    size_t buf_len;
+    uint8_t buf[SNAP_WRITE_BUF];
+};
+
+static int write_all(int fd, const void *data, size_t n)
+{
+    const uint8_t *p = data;
+    while (n > 0)
+    {
+        ssize_t w = write(fd, p, n);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static void buf_flush(SnapWriter *w)
+{
+    if (w->buf_len > 0 && !w->error && write_all(w->fd, w->buf, w->buf_len) != 0)
+        w->error = 1;
+    w->buf_len = 0;
+}
+
+static void buf_put(SnapWriter *w, const void *data, size_t n)
+{
+    const uint8_t *p = data;
+    while (n > 0)
+    {
+        if (w->buf_len == sizeof(w->buf))
+            buf_flush(w);
+        size_t k = sizeof(w->buf) - w->buf_len;
+        if (k > n)
+            k = n;
+        memcpy(w->buf + w->buf_len, p, k);
+        w->buf_len += k;
+        p += k;
+        n -= k;
+    }
+    w->pos += (uint64_t)(p - (const uint8_t *)data);
+}
+
+static void buf_align(SnapWriter *w)
+{
+    static const uint8_t zero[SNAP_ALIGN];
+    if (w->pos % SNAP_ALIGN)
+        buf_put(w, zero, SNAP_ALIGN - w->pos % SNAP_ALIGN);
+}
+
+SnapWriter *snap_writer_open(const char *path, int64_t generation)
+{
+    SnapWriter *w = calloc(1, sizeof(SnapWriter));
+    if (!w)
+        return NULL;
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0)
+    {
+        free(w);
+        return NULL;
+    }
+
+    memcpy(w->hdr.magic, SNAP_MAGIC, sizeof(w->hdr.magic));
+    w->hdr.version = SNAP_VERSION;
+    w->hdr.generation = generation;
+
+    // Chỗ cho header (ghi đè ở cuối), string table nối ngay sau
+    buf_put(w, &w->hdr, sizeof(w->hdr));
+    buf_put(w, "", 1); // offset 0 = chuỗi rỗng
+    w->strings_len = 1;
+    return w;
+}
+
+uint32_t snap_string(SnapWriter *w, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    if (w->strings_len + n > UINT32_MAX)
+    {
+        w->error = 1;
+        return 0;
+    }
+    uint32_t off = (uint32_t)w->strings_len;
+    buf_put(w, s, n);
+    w->strings_len += n;
+    return off;
+}
+
+void snap_table_begin(SnapWriter *w, int section, uint32_t item_size)
+{
+    if (w->ntables >= SNAP_MAX_SECTIONS - 1) // chừa 1 section cho string table
+    {
+        w->error = 1;
+        w->cur = NULL;
+        return;
+    }
+    w->cur = &w->tables[w->ntables++];
+    w->cur->id = section;
+    w->cur->item_size = item_size;
+}
+
+void snap_table_entry(SnapWriter *w, const char *key, uint32_t aux)
+{
+    PendingTable *t = w->cur;
+    if (!t)
+        return;
+
+    if (t->count >= t->cap)
+    {
+        size_t newcap = t->cap == 0 ? 1024 : t->cap * 2;
+        SnapEntry *e = realloc(t->entries, newcap * sizeof(SnapEntry));
+        uint32_t *h = e ? realloc(t->hashes, newcap * sizeof(uint32_t)) : NULL;
+        if (e)
+            t->entries = e;
+        if (!e || !h)
+        {
+            w->error = 1;
+            return;
+        }
+        t->hashes = h;
+        t->cap = newcap;
+    }
+
+    SnapEntry *e = &t->entries[t->count];
+    e->key = key ? snap_string(w, key) : 0;
+    e->aux = aux;
+    e->first = (uint32_t)t->nitems;
+    e->n = 0;
+    t->hashes[t->count] = key ? (uint32_t)strmap_hash(key) : 0;
+    if (key)
+        t->keyed = 1;
+    t->count++;
+}
+
+void snap_table_item(SnapWriter *w, const void *item)
+{
+    PendingTable *t = w->cur;
+    if (!t || t->count == 0)
+        return;
+
+    if ((t->nitems + 1) * t->item_size > t->items_cap)
+    {
+        size_t newcap = t->items_cap == 0 ? 16 * 1024 : t->items_cap * 2;
+        uint8_t *p = realloc(t->items, newcap);
+        if (!p)
+        {
+            w->error = 1;
+            return;
+        }
+        t->items = p;
+        t->items_cap = newcap;
+    }
+    memcpy(t->items + t->nitems * t->item_size, item, t->item_size);
+    t->nitems++;
+    t->entries[t->count - 1].n++;
+}
+
+void snap_table_end(SnapWriter *w)
+{
+    w->cur = NULL;
+}
+
+static void write_table(SnapWriter *w, PendingTable *t)
+{
+    // Hash index: gấp đôi số entry, dò tuyến tính. Bảng theo ID tra bằng vị trí nên bỏ qua
+    uint32_t nbuckets = 0;
+    while (t->keyed && nbuckets < t->count * 2)
+        nbuckets = nbuckets ? nbuckets << 1 : 1;
+    uint32_t *buckets = calloc(nbuckets ? nbuckets : 1, sizeof(uint32_t));
+    if (!buckets)
+    {
+        w->error = 1;
+        return;
+    }
+    for (size_t i = 0; nbuckets && i < t->count; i++)
+    {
+        uint32_t j = t->hashes[i] & (nbuckets - 1);
+        while (buckets[j])
+            j = (j + 1) & (nbuckets - 1);
+        buckets[j] = (uint32_t)i + 1;
+    }
+
+    buf_align(w);
+    SnapSection *s = &w->hdr.sections[w->hdr.nsections++];
+    s->id = (uint32_t)t->id;
+    s->item_size = t->item_size;
+    s->offset = w->pos;
+    s->count = (uint32_t)t->count;
+    s->nitems = (uint32_t)t->nitems;
+    s->nbuckets = nbuckets;
+
+    buf_put(w, t->entries, t->count * sizeof(SnapEntry));
+    buf_put(w, buckets, (size_t)nbuckets * sizeof(uint32_t));
+    buf_put(w, t->items, t->nitems * t->item_size);
+    s->length = w->pos - s->offset;
+    free(buckets);
+}
+
+int snap_writer_close(SnapWriter *w)
+{
+    SnapSection *strs = &w->hdr.sections[w->hdr.nsections++];
+    strs->id = SNAP_STRINGS;
+    strs->offset = sizeof(SnapHeader);
+    strs->length = w->strings_len;
+
+    for (int i = 0; i < w->ntables; i++)
+    {
+        write_table(w, &w->tables[i]);
+        free(w->tables[i].entries);
+        free(w->tables[i].hashes);
+        free(w->tables[i].items);
+    }
+    buf_flush(w);
+
+    w->hdr.file_size = w->pos;
+    w->hdr.header_crc = crc32(&w->hdr, offsetof(SnapHeader, header_crc));
+
+    int rc = -1;
+    if (!w->error && pwrite(w->fd, &w->hdr, sizeof(w->hdr), 0) == (ssize_t)sizeof(w->hdr) && fsync(w->fd) == 0)
+        rc = 0;
+    close(w->fd);
+    free(w);
+    return rc;
+}
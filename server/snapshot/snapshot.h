@@ -0,0 +1,121 @@
+// Định dạng snapshot nhị phân, server mmap read-only và tra cứu thẳng trên file
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNAP_MAGIC "MCSNAP\0\0"
+#define SNAP_VERSION 3 // version 1 = dãy record WAL (vẫn đọc được qua replay)
+#define SNAP_MAX_SECTIONS 16
+
+/*
+    File: [SnapHeader][string table][bảng 1][bảng 2]...
+    String table là các chuỗi kết thúc bằng '\0', mọi tham chiếu chuỗi là offset u32 vào đây.
+    Mỗi bảng: entries[count] + buckets[nbuckets] (hash FNV-1a của key, chứa index entry + 1,
+    0 = trống) + items[nitems] kích thước cố định. Entry i sở hữu items[first .. first + n).
+    Bảng theo ID (không có key, nbuckets = 0): entry i là của ID i + 1 (xem intern.h).
+    Item chỉ được thêm field vào cuối; file cũ có item_size nhỏ hơn thì field thiếu coi như 0
+*/
+
+// Section
+#define SNAP_STRINGS 1
+#define SNAP_ACCOUNTS 2     // theo user ID, aux = password hash (0 = không có account), không có item
+#define SNAP_FRIENDS 3      // theo user ID, item = SnapPair{user ID, state}
+#define SNAP_GROUPS 4       // theo group ID, aux = tên group (0 = không có group), item = SnapPair{user ID, role}
+#define SNAP_USER_GROUPS 5  // theo user ID, item = SnapPair{group ID, role}
+#define SNAP_OFFLINE 6      // theo user ID, item = SnapOfflineItem
+#define SNAP_USER_NAMES 7   // key = username, entry i = user ID i + 1
+#define SNAP_GROUP_NAMES 8  // key = group_id dạng chuỗi, entry i = group ID i + 1
+#define SNAP_IDGEN 9        // 1 entry, item = u64 mốc idgen (mọi ID đã cấp đều < mốc)
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t item_size;
+    uint64_t offset;
+    uint64_t length;
+    uint32_t count;    // số entry
+    uint32_t nitems;
+    uint32_t nbuckets; // luỹ thừa của 2
+    uint32_t reserved;
+} SnapSection;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nsections;
+    int64_t generation;
+    uint64_t file_size;
+    SnapSection sections[SNAP_MAX_SECTIONS];
+    uint32_t header_crc; // CRC32 của mọi byte phía trước
+    uint32_t reserved;
+} SnapHeader;
+
+typedef struct
+{
+    uint32_t key;
+    uint32_t aux;
+    uint32_t first;
+    uint32_t n;
+} SnapEntry;
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t value;
+} SnapPair;
+
+typedef struct
+{
+    uint32_t from;  // user ID người gửi
+    uint32_t group; // group ID, 0 = tin nhắn riêng
+    uint32_t text;
+    uint32_t reserved;
+    int64_t timestamp;
+    uint64_t msg_id; // 0 = tin nhắn từ trước khi có ID
+} SnapOfflineItem;
+
+// ---------- đọc (process server) ----------
+
+typedef struct
+{
+    const char *strings;
+    uint64_t strings_len;
+    const SnapEntry *entries;
+    uint32_t count;
+    const uint32_t *buckets;
+    uint32_t nbuckets;
+    const uint8_t *items;
+    uint32_t item_size;
+    uint32_t nitems;
+} SnapTable;
+
+// 1 = đã map snapshot nhị phân, 0 = không phải định dạng này (hoặc không có file), -1 = file hỏng
+int snap_load(const char *path, int64_t *generation);
+int snap_is_binary(const char *path);
+
+// 0 nếu snapshot có section này. Không có snapshot thì t là bảng rỗng
+int snap_table(int section, SnapTable *t);
+const SnapEntry *snap_find(const SnapTable *t, const char *key);
+const SnapEntry *snap_at(const SnapTable *t, uint32_t id); // Bảng theo ID, NULL nếu ngoài bảng
+const char *snap_str(const SnapTable *t, uint32_t off);
+const void *snap_item(const SnapTable *t, uint32_t idx);
+// Chép item ra out (size byte), phần file cũ không có thì điền 0. 0 nếu OK
+int snap_item_copy(const SnapTable *t, uint32_t idx, void *out, size_t size);
+
+// ---------- ghi (process con chụp snapshot) ----------
+
+typedef struct SnapWriter SnapWriter;
+
+SnapWriter *snap_writer_open(const char *path, int64_t generation);
+int snap_writer_close(SnapWriter *w); // Ghi bảng + header rồi fsync. 0 nếu OK, luôn giải phóng w
+
+uint32_t snap_string(SnapWriter *w, const char *s);
+void snap_table_begin(SnapWriter *w, int section, uint32_t item_size);
+void snap_table_entry(SnapWriter *w, const char *key, uint32_t aux); // key NULL = bảng theo ID
+void snap_table_item(SnapWriter *w, const void *item); // Thuộc entry vừa thêm
+void snap_table_end(SnapWriter *w);
+
+#endif
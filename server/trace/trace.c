@@ -0,0 +1,132 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+typedef struct
+{
+    uint64_t seq; // thứ tự ghi (từ 1), 0 = slot đang được ghi
+    uint64_t start_ns, dur_ns;
+    const char *cat;
+    int tid;
+    char name[TRACE_NAME_LEN];
+    char arg[TRACE_ARG_LEN];
+} TraceEvent;
+
+__thread int trace_thread_on = 0;
+static __thread int thread_tid = 0;
+
+static TraceEvent ring[TRACE_RING_EVENTS];
+static uint64_t written = 0; // tổng số span đã ghi, slot = (seq - 1) % TRACE_RING_EVENTS
+static int sample_every = 0;
+static unsigned long commands_seen = 0;
+
+void trace_configure(int n)
+{
+    sample_every = n > 0 ? n : 0;
+}
+
+int trace_sample_every()
+{
+    return sample_every;
+}
+
+int trace_sample()
+{
+    trace_thread_on = sample_every > 0 && ++commands_seen % (unsigned long)sample_every == 0;
+    return trace_thread_on;
+}
+
+void trace_set(int on)
+{
+    trace_thread_on = on;
+}
+
+// Reactor và worker cùng ghi: giành slot bằng atomic add, seq ghi sau cùng để trace_dump bỏ
+// qua slot đang ghi dở hoặc vừa bị đè
+void trace_record(const TraceSpan *s, const char *arg)
+{
+    uint64_t end = metrics_now_ns();
+    if (!thread_tid)
+        thread_tid = (int)syscall(SYS_gettid);
+
+    uint64_t seq = __atomic_add_fetch(&written, 1, __ATOMIC_RELAXED);
+    TraceEvent *e = &ring[(seq - 1) & (TRACE_RING_EVENTS - 1)];
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    e->start_ns = s->start_ns;
+    e->dur_ns = end - s->start_ns;
+    e->cat = s->cat;
+    e->tid = thread_tid;
+    snprintf(e->name, sizeof(e->name), "%s", s->name);
+    snprintf(e->arg, sizeof(e->arg), "%s", arg ? arg : "");
+    __atomic_store_n(&e->seq, seq, __ATOMIC_RELEASE);
+}
+
+// ---------- xuất JSON ----------
+
+static void put_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++)
+    {
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\')
+            fprintf(f, "\\%c", ch);
+        else if (ch < 0x20)
+            fprintf(f, "\\u%04x", ch);
+        else
+            fputc(ch, f);
+    }
+    fputc('"', f);
+}
+
+long trace_dump(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return -1;
+
+    int pid = (int)getpid();
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    // Thread chính của process là reactor, các tid khác là worker
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"reactor\"}}", pid, pid);
+
+    uint64_t last = __atomic_load_n(&written, __ATOMIC_ACQUIRE);
+    uint64_t first = last > TRACE_RING_EVENTS ? last - TRACE_RING_EVENTS + 1 : 1;
+    long count = 0;
+    for (uint64_t seq = first; seq <= last; seq++)
+    {
+        const TraceEvent *slot = &ring[(seq - 1) & (TRACE_RING_EVENTS - 1)];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq)
+            continue;
+        TraceEvent e = *slot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+            continue; // bị đè trong lúc chép
+
+        // ts / dur tính bằng micro giây, giữ phần lẻ nano giây
+        fprintf(f, ",\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"cat\":", pid, e.tid,
+                (unsigned long long)(e.start_ns / 1000), (unsigned)(e.start_ns % 1000),
+                (unsigned long long)(e.dur_ns / 1000), (unsigned)(e.dur_ns % 1000));
+        put_json_string(f, e.cat);
+        fprintf(f, ",\"name\":");
+        put_json_string(f, e.name);
+        if (e.arg[0])
+        {
+            fprintf(f, ",\"args\":{\"arg\":");
+            put_json_string(f, e.arg);
+            fputc('}', f);
+        }
+        fputc('}', f);
+        count++;
+    }
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f) != 0)
+        return -1;
+    return count;
+}
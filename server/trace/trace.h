@@ -0,0 +1,66 @@
+// Span theo từng lệnh (protocol, group, friend, offline, auth, log, ...) lấy mẫu 1/N lệnh, lưu vào
+// vòng đệm trong RAM, xuất ra file JSON định dạng Chrome trace (mở bằng ui.perfetto.dev hoặc
+// chrome://tracing). Bật bằng MINACHAT_TRACE_SAMPLE=N hoặc lệnh admin TRACE N
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "../metrics/metrics.h"
+
+#include <stdint.h>
+
+#define TRACE_RING_EVENTS 65536 // lũy thừa 2, đầy thì đè span cũ nhất
+#define TRACE_NAME_LEN 32
+#define TRACE_ARG_LEN 48
+#define TRACE_DUMP_FILE "server_trace.json"
+
+// Cờ của thread hiện tại: đang chạy 1 lệnh được lấy mẫu thì span mới được ghi
+extern __thread int trace_thread_on;
+
+typedef struct
+{
+    const char *cat;
+    const char *name; // chép vào vòng đệm lúc trace_end nên chuỗi chỉ cần sống tới đó
+    uint64_t start_ns; // 0 = không ghi
+} TraceSpan;
+
+// Lấy mẫu 1 lệnh trên N, 0 = tắt
+void trace_configure(int sample_every);
+int trace_sample_every();
+
+// Reactor gọi đầu mỗi lệnh: quyết định lệnh này có được trace không và bật cờ của thread
+int trace_sample();
+// Bật / tắt cờ của thread hiện tại, dùng để nối tiếp lệnh đã lấy mẫu sang job của worker /
+// các lượt fan-out sau (lưu trace_thread_on lúc submit rồi trace_set lại khi chạy)
+void trace_set(int on);
+
+void trace_record(const TraceSpan *s, const char *arg);
+
+// Khi không trace chỉ tốn 1 lần đọc biến thread-local
+static inline TraceSpan trace_begin(const char *cat, const char *name)
+{
+    TraceSpan s = {cat, name, 0};
+    if (trace_thread_on)
+        s.start_ns = metrics_now_ns();
+    return s;
+}
+
+// arg: chuỗi tùy chọn hiện trong phần args của span (user, group ID, ...), có thể NULL
+static inline void trace_end(const TraceSpan *s, const char *arg)
+{
+    if (s->start_ns)
+        trace_record(s, arg);
+}
+
+static inline void trace_scope_end(TraceSpan *s)
+{
+    trace_end(s, NULL);
+}
+
+// Span cho cả phần còn lại của block, tự kết thúc ở mọi return (cleanup attribute của GCC / clang)
+#define TRACE_SCOPE(cat, name) \
+    TraceSpan trace_scope_ __attribute__((cleanup(trace_scope_end))) = trace_begin(cat, name)
+
+// Ghi các span đang có trong vòng đệm ra file. Trả về số span đã ghi, -1 nếu lỗi
+long trace_dump(const char *path);
+
+#endif
@@ -0,0 +1,304 @@
+#define _GNU_SOURCE // struct ucred
+#include "upgrade.h"
+#include "../client/client_mgr.h"
+#include "../pubsub/pubsub.h"
+#include "../session/session.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+#define UPGRADE_MAGIC 0x4d434855 // "UHCM"
+#define UPGRADE_VERSION 3
+#define UPGRADE_TIMEOUT_SEC 5
+
+/*
+    Giao thức trên control socket (SOCK_SEQPACKET, mỗi message giữ nguyên biên):
+      1. UpgradeHeader + fd listener
+      2. nclients x UpgradeClientRec (chỉ gửi inlen byte của inbuf, sau đó là các topic
+         pubsub nối bằng '\0' nếu có) + fd client
+      3. nsessions x UpgradeSessionRec: session đã mất kết nối, chưa LOGOUT (không kèm fd)
+      4. process mới trả về 1 byte 'K' khi đã nhận đủ
+    Version 2 không có bước 3 và header không có nsessions
+*/
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nclients;
+    uint32_t nsessions;
+} UpgradeHeader;
+
+typedef struct
+{
+    uint64_t session_sid; // session của client đang login, giữ nguyên seq sau upgrade
+    uint64_t session_next_seq;
+    int32_t logged_in;
+    int32_t inlen;
+    char username[USERNAME_LEN];
+    char inbuf[INBUF_SIZE + PUBSUB_MAX_PER_CLIENT * PUBSUB_TOPIC_LEN]; // inbuf + topic
+} UpgradeClientRec;
+
+typedef struct
+{
+    uint64_t sid;
+    uint64_t next_seq;
+    int64_t detached_at;
+    char username[USERNAME_LEN];
+} UpgradeSessionRec;
+
+// ---------- helpers ----------
+
+static int send_with_fd(int sock, const void *data, size_t len, int fd)
+{
+    struct iovec iov = {(void *)data, len};
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    memset(cbuf, 0, sizeof(cbuf));
+
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+
+    return sendmsg(sock, &msg, 0) == (ssize_t)len ? 0 : -1;
+}
+
+// Trả về số byte nhận được, *out_fd = -1 nếu message không kèm fd
+static int recv_with_fd(int sock, void *data, size_t cap, int *out_fd)
+{
+    struct iovec iov = {data, cap};
+    char cbuf[CMSG_SPACE(sizeof(int))];
+
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    *out_fd = -1;
+    ssize_t n = recvmsg(sock, &msg, 0);
+    if (n <= 0)
+        return -1;
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (cm && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+        memcpy(out_fd, CMSG_DATA(cm), sizeof(int));
+
+    return (int)n;
+}
+
+static void set_timeouts(int sock)
+{
+    struct timeval tv = {UPGRADE_TIMEOUT_SEC, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static void fill_addr(struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strncpy(addr->sun_path, UPGRADE_SOCK_PATH, sizeof(addr->sun_path) - 1);
+}
+
+// ---------- process cũ ----------
+
+int upgrade_listen()
+{
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_un addr;
+    fill_addr(&addr);
+    unlink(UPGRADE_SOCK_PATH); // socket cũ còn sót lại (process trước đã thoát)
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int upgrade_handoff(int ctl_fd, int listen_fd)
+{
+    int s = accept(ctl_fd, NULL, NULL);
+    if (s < 0)
+        return -1;
+
+    // Chỉ cho process cùng user lấy socket
+    struct ucred cred;
+    socklen_t clen = sizeof(cred);
+    if (getsockopt(s, SOL_SOCKET, SO_PEERCRED, &cred, &clen) != 0 || cred.uid != getuid())
+    {
+        close(s);
+        return -1;
+    }
+    set_timeouts(s);
+
+    UpgradeHeader hdr = {UPGRADE_MAGIC, UPGRADE_VERSION, 0, 0};
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (client_at(i))
+            hdr.nclients++;
+    }
+
+    UpgradeSessionRec srec;
+    const char *name;
+    for (long i = session_next_detached(0, &name, &srec.sid, &srec.next_seq, &srec.detached_at); i >= 0;
+         i = session_next_detached(i + 1, &name, &srec.sid, &srec.next_seq, &srec.detached_at))
+        hdr.nsessions++;
+
+    if (send_with_fd(s, &hdr, sizeof(hdr), listen_fd) < 0)
+    {
+        close(s);
+        return -1;
+    }
+
+    static UpgradeClientRec rec;
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        Client *c = client_at(i);
+        if (!c)
+            continue;
+
+        memset(&rec, 0, offsetof(UpgradeClientRec, inbuf));
+        rec.logged_in = c->logged_in;
+        rec.inlen = c->inlen;
+        snprintf(rec.username, sizeof(rec.username), "%s", c->username);
+        memcpy(rec.inbuf, c->inbuf, c->inlen);
+        if (c->logged_in)
+            session_export(c->username, &rec.session_sid, &rec.session_next_seq);
+        size_t topics = pubsub_export(c, rec.inbuf + c->inlen, sizeof(rec.inbuf) - c->inlen);
+
+        if (send_with_fd(s, &rec, offsetof(UpgradeClientRec, inbuf) + rec.inlen + topics, c->fd) < 0)
+        {
+            close(s);
+            return -1;
+        }
+    }
+
+    // Client đang chờ RESUME vẫn resume được ở process mới
+    for (long i = session_next_detached(0, &name, &srec.sid, &srec.next_seq, &srec.detached_at); i >= 0;
+         i = session_next_detached(i + 1, &name, &srec.sid, &srec.next_seq, &srec.detached_at))
+    {
+        memset(srec.username, 0, sizeof(srec.username));
+        snprintf(srec.username, sizeof(srec.username), "%s", name);
+        if (send(s, &srec, sizeof(srec), 0) != (ssize_t)sizeof(srec))
+        {
+            close(s);
+            return -1;
+        }
+    }
+
+    // Đợi process mới xác nhận trước khi thoát, nếu không nhận được thì tiếp tục phục vụ
+    char ack = 0;
+    int ok = recv(s, &ack, 1, 0) == 1 && ack == 'K';
+    close(s);
+
+    if (ok)
+        printf("Handed off listener, %u client(s) and %u detached session(s) to new process\n", hdr.nclients,
+               hdr.nsessions);
+    return ok ? 0 : -1;
+}
+
+// ---------- process mới ----------
+
+int upgrade_takeover(int *out_listen_fd, int *client_fds, int max_fds)
+{
+    int s = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (s < 0)
+        return -1;
+
+    struct sockaddr_un addr;
+    fill_addr(&addr);
+    if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror("connect to running server failed");
+        close(s);
+        return -1;
+    }
+    set_timeouts(s);
+
+    UpgradeHeader hdr = {0};
+    int lfd = -1;
+    int n = recv_with_fd(s, &hdr, sizeof(hdr), &lfd);
+    int v2 = hdr.version == 2 && n == (int)offsetof(UpgradeHeader, nsessions); // process cũ chưa chuyển session
+    if ((n != (int)sizeof(hdr) && !v2) || hdr.magic != UPGRADE_MAGIC ||
+        (hdr.version != UPGRADE_VERSION && !v2) || lfd < 0)
+    {
+        fprintf(stderr, "Invalid upgrade header\n");
+        if (lfd >= 0)
+            close(lfd);
+        close(s);
+        return -1;
+    }
+
+    static UpgradeClientRec rec;
+    int count = 0;
+    for (uint32_t i = 0; i < hdr.nclients; i++)
+    {
+        int cfd = -1;
+        n = recv_with_fd(s, &rec, sizeof(rec), &cfd);
+        // Process cũ chưa có pubsub gửi đúng inlen byte, không có phần topic
+        if (n < (int)offsetof(UpgradeClientRec, inbuf) || cfd < 0 || rec.inlen < 0 ||
+            rec.inlen >= INBUF_SIZE || n < (int)offsetof(UpgradeClientRec, inbuf) + rec.inlen)
+        {
+            fprintf(stderr, "Invalid client record during takeover\n");
+            if (cfd >= 0)
+                close(cfd);
+            close(lfd);
+            close(s);
+            return -1;
+        }
+
+        rec.username[USERNAME_LEN - 1] = '\0';
+        int idx = count >= max_fds ? -1 : client_restore(cfd, rec.logged_in, rec.username, rec.inbuf, rec.inlen);
+        if (idx < 0)
+        {
+            close(cfd);
+            continue;
+        }
+        size_t topics = (size_t)n - offsetof(UpgradeClientRec, inbuf) - (size_t)rec.inlen;
+        pubsub_import(client_at(idx), rec.inbuf + rec.inlen, topics);
+        if (rec.logged_in && rec.session_next_seq > 0)
+            session_import(rec.username, rec.session_sid, rec.session_next_seq, 0);
+        client_fds[count++] = cfd;
+    }
+
+    for (uint32_t i = 0; i < hdr.nsessions; i++)
+    {
+        UpgradeSessionRec srec;
+        if (recv(s, &srec, sizeof(srec), 0) != (ssize_t)sizeof(srec))
+        {
+            fprintf(stderr, "Invalid session record during takeover\n");
+            close(lfd);
+            close(s);
+            return -1;
+        }
+        srec.username[USERNAME_LEN - 1] = '\0';
+        session_import(srec.username, srec.sid, srec.next_seq, srec.detached_at);
+    }
+
+    char ack = 'K';
+    if (send(s, &ack, 1, 0) != 1)
+    {
+        close(lfd);
+        close(s);
+        return -1;
+    }
+    close(s);
+
+    *out_listen_fd = lfd;
+    return count;
+}
@@ -0,0 +1,21 @@
+// Hot upgrade: chuyển listener + client socket sang process mới qua Unix socket (SCM_RIGHTS)
+#ifndef UPGRADE_H
+#define UPGRADE_H
+
+#include "../../common.h"
+
+#define UPGRADE_SOCK_PATH "server_upgrade.sock"
+
+// Process cũ: tạo control socket để process mới kết nối vào. Trả về fd hoặc -1
+int upgrade_listen();
+
+// Process cũ: accept kết nối trên control socket và gửi listener + toàn bộ client.
+// Trả về 0 nếu process mới đã nhận đủ (process cũ nên thoát), -1 nếu lỗi (tiếp tục chạy)
+int upgrade_handoff(int ctl_fd, int listen_fd);
+
+// Process mới (--takeover): nhận listener + client từ process cũ.
+// Client được khôi phục vào client_mgr, fd của chúng ghi vào client_fds.
+// Trả về số client nhận được, -1 nếu lỗi
+int upgrade_takeover(int *out_listen_fd, int *client_fds, int max_fds);
+
+#endif
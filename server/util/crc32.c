@@ -0,0 +1,28 @@
+#include "crc32.h"
+
+#include <pthread.h>
+
+static uint32_t crc_table[256];
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+static void crc_init()
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+uint32_t crc32(const void *data, size_t n)
+{
+    pthread_once(&table_once, crc_init);
+
+    const uint8_t *p = data;
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < n; i++)
+        c = crc_table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
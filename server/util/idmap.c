@@ -0,0 +1,41 @@
+#include "idmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define IDMAP_INIT_CAP 64
+
+void *idmap_get(const IdMap *m, uint32_t id)
+{
+    return id < m->cap ? m->slots[id] : NULL;
+}
+
+int idmap_put(IdMap *m, uint32_t id, void *val)
+{
+    if (id == 0 || id == UINT32_MAX)
+        return -1;
+
+    if (id >= m->cap)
+    {
+        if (!val)
+            return 0; // chưa có slot thì coi như đã là NULL
+
+        uint32_t newcap = m->cap ? m->cap : IDMAP_INIT_CAP;
+        while (newcap <= id)
+            newcap = newcap > UINT32_MAX / 2 ? UINT32_MAX : newcap * 2;
+
+        void **p = realloc(m->slots, (size_t)newcap * sizeof(void *));
+        if (!p)
+            return -1;
+        memset(p + m->cap, 0, (size_t)(newcap - m->cap) * sizeof(void *));
+        m->slots = p;
+        m->cap = newcap;
+    }
+    m->slots[id] = val;
+    return 0;
+}
+
+uint32_t idmap_end(const IdMap *m)
+{
+    return m->cap;
+}
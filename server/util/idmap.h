@@ -0,0 +1,17 @@
+// Mảng con trỏ đánh chỉ số theo ID đã intern (ID dày, bắt đầu từ 1), tra cứu O(1) không cần hash
+#ifndef IDMAP_H
+#define IDMAP_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    void **slots;
+    uint32_t cap; // ID hợp lệ: 1 .. cap - 1
+} IdMap;
+
+void *idmap_get(const IdMap *m, uint32_t id);
+int idmap_put(IdMap *m, uint32_t id, void *val); // 0 OK, -1 hết bộ nhớ. Tự nới mảng
+uint32_t idmap_end(const IdMap *m);              // Duyệt: for (id = 1; id < idmap_end(m); id++)
+
+#endif
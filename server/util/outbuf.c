@@ -0,0 +1,16 @@
+#include "outbuf.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+void outbuf_put(OutBuf *o, const char *fmt, ...)
+{
+    if (o->len + 1 >= o->cap)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->out + o->len, o->cap - o->len, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        o->len = o->len + n < o->cap ? o->len + n : o->cap - 1;
+}
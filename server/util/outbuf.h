@@ -0,0 +1,16 @@
+// Ghi nối chuỗi có format vào buffer cố định của caller (xuất STATS / SLOWLOG / IOSTAT)
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stddef.h>
+
+typedef struct
+{
+    char *out;
+    size_t cap, len;
+} OutBuf;
+
+// Hết chỗ thì cắt bớt, len không vượt cap - 1 và out luôn kết thúc bằng '\0'
+void outbuf_put(OutBuf *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
@@ -0,0 +1,179 @@
+#include "strmap.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STRMAP_INIT_CAP 64
+
+typedef struct
+{
+    char *key; // NULL = slot trống
+    void *val;
+    uint64_t hash;
+} StrMapSlot;
+
+struct StrMap
+{
+    StrMapSlot *slots;
+    size_t cap; // luôn là lũy thừa của 2
+    size_t count;
+};
+
+// FNV-1a 64 bit
+uint64_t strmap_hash(const char *s)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)s; *p; ++p)
+    {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static long find_slot(const StrMap *m, const char *key, uint64_t h)
+{
+    size_t mask = m->cap - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask)
+    {
+        if (!m->slots[i].key)
+            return -(long)i - 1; // chưa có, trả về slot trống (mã hóa âm)
+        if (m->slots[i].hash == h && strcmp(m->slots[i].key, key) == 0)
+            return (long)i;
+    }
+}
+
+static int grow(StrMap *m)
+{
+    size_t newcap = m->cap * 2;
+    StrMapSlot *ns = calloc(newcap, sizeof(StrMapSlot));
+    if (!ns)
+        return -1;
+
+    for (size_t i = 0; i < m->cap; i++)
+    {
+        if (!m->slots[i].key)
+            continue;
+        size_t j = m->slots[i].hash & (newcap - 1);
+        while (ns[j].key)
+            j = (j + 1) & (newcap - 1);
+        ns[j] = m->slots[i];
+    }
+
+    free(m->slots);
+    m->slots = ns;
+    m->cap = newcap;
+    return 0;
+}
+
+StrMap *strmap_new()
+{
+    StrMap *m = malloc(sizeof(StrMap));
+    if (!m)
+        return NULL;
+    m->slots = calloc(STRMAP_INIT_CAP, sizeof(StrMapSlot));
+    if (!m->slots)
+    {
+        free(m);
+        return NULL;
+    }
+    m->cap = STRMAP_INIT_CAP;
+    m->count = 0;
+    return m;
+}
+
+void strmap_free(StrMap *m)
+{
+    if (!m)
+        return;
+    for (size_t i = 0; i < m->cap; i++)
+        free(m->slots[i].key);
+    free(m->slots);
+    free(m);
+}
+
+void *strmap_get(const StrMap *m, const char *key)
+{
+    long i = find_slot(m, key, strmap_hash(key));
+    return i >= 0 ? m->slots[i].val : NULL;
+}
+
+int strmap_put(StrMap *m, const char *key, void *val)
+{
+    uint64_t h = strmap_hash(key);
+    long i = find_slot(m, key, h);
+    if (i >= 0)
+    {
+        m->slots[i].val = val;
+        return 0;
+    }
+
+    // Giữ load factor <= 0.7
+    if ((m->count + 1) * 10 > m->cap * 7)
+    {
+        if (grow(m) != 0)
+            return -1;
+        i = find_slot(m, key, h);
+    }
+
+    char *k = strdup(key);
+    if (!k)
+        return -1;
+
+    size_t slot = (size_t)(-i - 1);
+    m->slots[slot].key = k;
+    m->slots[slot].val = val;
+    m->slots[slot].hash = h;
+    m->count++;
+    return 0;
+}
+
+void *strmap_remove(StrMap *m, const char *key)
+{
+    long i = find_slot(m, key, strmap_hash(key));
+    if (i < 0)
+        return NULL;
+
+    void *old = m->slots[i].val;
+    free(m->slots[i].key);
+    m->slots[i].key = NULL;
+    m->count--;
+
+    // Backward shift: dời các phần tử phía sau lên để không cần tombstone
+    size_t mask = m->cap - 1;
+    size_t hole = (size_t)i;
+    for (size_t j = (hole + 1) & mask; m->slots[j].key; j = (j + 1) & mask)
+    {
+        size_t home = m->slots[j].hash & mask;
+        // Chỉ dời nếu home của phần tử không nằm trong (hole, j]
+        if (((j - home) & mask) >= ((j - hole) & mask))
+        {
+            m->slots[hole] = m->slots[j];
+            m->slots[j].key = NULL;
+            hole = j;
+        }
+    }
+    return old;
+}
+
+size_t strmap_count(const StrMap *m)
+{
+    return m->count;
+}
+
+long strmap_next(const StrMap *m, long pos, const char **key, void **val)
+{
+    for (size_t i = pos < 0 ? 0 : (size_t)pos; i < m->cap; i++)
+    {
+        if (m->slots[i].key)
+        {
+            if (key)
+                *key = m->slots[i].key;
+            if (val)
+                *val = m->slots[i].val;
+            return (long)i;
+        }
+    }
+    return -1;
+}
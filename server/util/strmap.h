@@ -0,0 +1,24 @@
+// Hash map string -> con trỏ (open addressing), dùng cho các bảng tra cứu in-memory
+#ifndef STRMAP_H
+#define STRMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct StrMap StrMap;
+
+StrMap *strmap_new();
+void strmap_free(StrMap *m); // Không free value, caller tự dọn trước
+
+void *strmap_get(const StrMap *m, const char *key);
+int strmap_put(StrMap *m, const char *key, void *val); // 0 OK, -1 hết bộ nhớ. Ghi đè nếu key đã có
+void *strmap_remove(StrMap *m, const char *key);       // Trả về value cũ hoặc NULL
+size_t strmap_count(const StrMap *m);
+uint64_t strmap_hash(const char *s); // FNV-1a, dùng lại cho các bảng hash trên đĩa
+
+// Duyệt map: trả về slot có dữ liệu đầu tiên >= pos, -1 nếu hết.
+// Dùng: for (long i = strmap_next(m, 0, &k, &v); i >= 0; i = strmap_next(m, i + 1, &k, &v))
+// Không được put/remove trong lúc duyệt
+long strmap_next(const StrMap *m, long pos, const char **key, void **val);
+
+#endif
@@ -0,0 +1,746 @@
+#include "wal.h"
+#include "../iostat/iostat.h"
+#include "../metrics/metrics.h"
+#include "../slowlog/slowlog.h"
+#include "../trace/trace.h"
+#include "../util/crc32.h"
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <errno.h>
+
+#define WAL_HEADER_LEN 8
+#define WAL_MAX_SNAPSHOT_FNS 16
+
+static wal_handler handlers[WAL_MAX_TYPE];
+static wal_snapshot_fn snapshot_fns[WAL_MAX_SNAPSHOT_FNS];
+static int snapshot_fn_count = 0;
+
+static char wal_path[256];
+static int wal_fd = -1;
+static int lock_fd = -1;
+static off_t wal_size = 0;
+static int sync_window_ms = WAL_SYNC_WINDOW_MS;
+static long data_records = 0; // record dữ liệu đã nạp + đã append (không tính header)
+static int snapshot_loaded = 0;
+
+// Segment / snapshot (chỉ reactor thread đụng tới)
+static int64_t cur_gen = 1;      // generation của server.wal
+static int64_t oldest_frozen = 0; // segment đã đóng cũ nhất còn trên đĩa, 0 = không có
+static long since_snapshot = 0;
+static long snapshot_every = WAL_SNAPSHOT_RECORDS;
+static pid_t snapshot_pid = -1;
+static int64_t snapshot_gen = 0;
+static struct timespec snapshot_started;
+
+// Buffer record chưa ghi xuống đĩa, flusher tráo với spare khi ghi để append không phải đợi
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t has_data;
+static pthread_cond_t flushed;
+static uint8_t *pend = NULL, *spare = NULL;
+static size_t pend_len = 0, pend_cap = 0, spare_cap = 0;
+static struct timespec first_pending; // thời điểm record đầu tiên của lô hiện tại
+static int flushing = 0;
+static int sync_requested = 0;
+
+// Số thứ tự record: append_seq = record cuối đã đưa vào buffer, committed_seq = record cuối đã
+// fdatasync. Mỗi lô xong flusher ghi 1 byte vào commit_pipe để reactor gửi các trả lời đang giữ
+static uint64_t append_seq = 0, committed_seq = 0;
+static int commit_pipe[2] = {-1, -1};
+static int commit_signaled = 0;
+
+// ---------- record builder / reader ----------
+
+void wal_record_begin(WalRecord *r, int type)
+{
+    r->len = WAL_HEADER_LEN;
+    r->overflow = 0;
+    r->data[r->len++] = (uint8_t)type;
+}
+
+static void record_put(WalRecord *r, const void *p, size_t n)
+{
+    if (r->overflow || r->len + n > sizeof(r->data))
+    {
+        r->overflow = 1;
+        return;
+    }
+    memcpy(r->data + r->len, p, n);
+    r->len += n;
+}
+
+void wal_record_str(WalRecord *r, const char *s)
+{
+    size_t n = strlen(s);
+    if (n > UINT16_MAX)
+    {
+        r->overflow = 1;
+        return;
+    }
+    uint16_t len = (uint16_t)n;
+    record_put(r, &len, sizeof(len));
+    record_put(r, s, n);
+}
+
+void wal_record_i64(WalRecord *r, int64_t v)
+{
+    record_put(r, &v, sizeof(v));
+}
+
+int wal_read_str(WalReader *r, char *out, size_t outsz)
+{
+    uint16_t len;
+    if (r->left < sizeof(len))
+        return -1;
+    memcpy(&len, r->p, sizeof(len));
+    r->p += sizeof(len);
+    r->left -= sizeof(len);
+
+    if (r->left < len || (size_t)len >= outsz)
+        return -1;
+    memcpy(out, r->p, len);
+    out[len] = '\0';
+    r->p += len;
+    r->left -= len;
+    return 0;
+}
+
+int wal_read_i64(WalReader *r, int64_t *v)
+{
+    if (r->left < sizeof(*v))
+        return -1;
+    memcpy(v, r->p, sizeof(*v));
+    r->p += sizeof(*v);
+    r->left -= sizeof(*v);
+    return 0;
+}
+
+void wal_register_handler(int type, wal_handler fn)
+{
+    if (type > 0 && type < WAL_MAX_TYPE)
+        handlers[type] = fn;
+}
+
+void wal_register_snapshot(wal_snapshot_fn fn)
+{
+    if (snapshot_fn_count < WAL_MAX_SNAPSHOT_FNS)
+        snapshot_fns[snapshot_fn_count++] = fn;
+}
+
+// Điền len + crc vào header của record
+static void record_seal(WalRecord *r)
+{
+    uint32_t len = (uint32_t)(r->len - WAL_HEADER_LEN);
+    uint32_t crc = crc32(r->data + WAL_HEADER_LEN, len);
+    memcpy(r->data, &len, sizeof(len));
+    memcpy(r->data + 4, &crc, sizeof(crc));
+}
+
+static int write_all(int fd, const uint8_t *p, size_t n)
+{
+    while (n > 0)
+    {
+        ssize_t w = write(fd, p, n);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+// ---------- append + group commit ----------
+
+// Store sở hữu loại record, để iostat chia byte WAL theo subsystem
+static IoSubsystem subsystem_of(int type)
+{
+    if (type == WAL_ACCOUNT_ADD || type == WAL_ACCOUNT_PASSWORD)
+        return IO_AUTH;
+    if (type >= WAL_FRIEND_REQUEST && type <= WAL_FRIEND_UNFRIEND)
+        return IO_FRIEND;
+    if (type >= WAL_GROUP_CREATE && type <= WAL_GROUP_REMOVE_MEMBER)
+        return IO_GROUP;
+    if (type == WAL_OFFLINE_SAVE || type == WAL_OFFLINE_CLEAR)
+        return IO_OFFLINE;
+    return IO_WAL;
+}
+
+int wal_append(WalRecord *r)
+{
+    TRACE_SCOPE("wal", "wal_append");
+    SLOWLOG_STORAGE_SCOPE();
+    if (r->overflow || wal_fd < 0)
+        return -1;
+
+    record_seal(r);
+    IoSubsystem owner = subsystem_of(r->data[WAL_HEADER_LEN]);
+
+    // Chờ = mutex đang bị flusher giữ hoặc buffer đầy (đĩa không theo kịp), tính cho store gọi
+    uint64_t wait_start = 0;
+    if (pthread_mutex_trylock(&lock) != 0)
+    {
+        wait_start = metrics_now_ns();
+        pthread_mutex_lock(&lock);
+    }
+
+    // Đĩa không theo kịp: chặn lại thay vì để buffer phình vô hạn
+    while (pend_len > WAL_MAX_PENDING)
+    {
+        if (!wait_start)
+            wait_start = metrics_now_ns();
+        pthread_cond_wait(&flushed, &lock);
+    }
+    if (wait_start)
+        iostat_lock_wait(owner, metrics_now_ns() - wait_start);
+
+    if (pend_len + r->len > pend_cap)
+    {
+        size_t newcap = pend_cap == 0 ? 64 * 1024 : pend_cap * 2;
+        while (newcap < pend_len + r->len)
+            newcap *= 2;
+        uint8_t *tmp = realloc(pend, newcap);
+        if (!tmp)
+        {
+            pthread_mutex_unlock(&lock);
+            return -1;
+        }
+        pend = tmp;
+        pend_cap = newcap;
+    }
+
+    if (pend_len == 0)
+        clock_gettime(CLOCK_MONOTONIC, &first_pending);
+    memcpy(pend + pend_len, r->data, r->len);
+    pend_len += r->len;
+    __atomic_store_n(&append_seq, append_seq + 1, __ATOMIC_RELAXED);
+    data_records++;
+    since_snapshot++;
+
+    pthread_cond_signal(&has_data);
+    pthread_mutex_unlock(&lock);
+    iostat_add(owner, IO_BYTES_WRITTEN, r->len);
+    return 0;
+}
+
+static void *flusher_main(void *unused)
+{
+    (void)unused;
+    pthread_mutex_lock(&lock);
+    while (1)
+    {
+        while (pend_len == 0)
+            pthread_cond_wait(&has_data, &lock);
+
+        // Group commit: đợi thêm record tới hết cửa sổ trễ (tính từ record đầu tiên của lô)
+        struct timespec deadline = first_pending;
+        deadline.tv_nsec += (long)sync_window_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (pend_len < WAL_FLUSH_BYTES && !sync_requested)
+        {
+            if (pthread_cond_timedwait(&has_data, &lock, &deadline) == ETIMEDOUT)
+                break;
+        }
+
+        // Tráo buffer để reactor tiếp tục append trong lúc ghi
+        uint8_t *batch = pend;
+        size_t batch_len = pend_len, batch_cap = pend_cap;
+        uint64_t batch_seq = append_seq;
+        pend = spare;
+        pend_cap = spare_cap;
+        pend_len = 0;
+        spare = NULL;
+        spare_cap = 0;
+        flushing = 1;
+        pthread_mutex_unlock(&lock);
+
+        if (write_all(wal_fd, batch, batch_len) != 0)
+            perror("WAL write failed");
+        if (fdatasync(wal_fd) != 0)
+            perror("WAL fdatasync failed");
+        iostat_add(IO_WAL, IO_BYTES_WRITTEN, batch_len);
+        iostat_add(IO_WAL, IO_FSYNCS, 1);
+
+        pthread_mutex_lock(&lock);
+        wal_size += (off_t)batch_len;
+        spare = batch;
+        spare_cap = batch_cap;
+        flushing = 0;
+        __atomic_store_n(&committed_seq, batch_seq, __ATOMIC_RELEASE);
+        int need_wake = !commit_signaled;
+        commit_signaled = 1;
+        pthread_cond_broadcast(&flushed);
+
+        // 1 byte cho mọi lô xong trước khi reactor kịp đọc, như wake pipe của worker pool
+        if (need_wake)
+        {
+            char b = 1;
+            (void)!write(commit_pipe[1], &b, 1);
+        }
+    }
+    return NULL;
+}
+
+uint64_t wal_appended_seq()
+{
+    return __atomic_load_n(&append_seq, __ATOMIC_RELAXED);
+}
+
+uint64_t wal_committed_seq()
+{
+    return __atomic_load_n(&committed_seq, __ATOMIC_ACQUIRE);
+}
+
+int wal_commit_fd()
+{
+    return commit_pipe[0];
+}
+
+void wal_commit_ack()
+{
+    // Đọc hết rồi mới xóa cờ: lô xong sau đó ghi byte mới, lô xong trước đó đã nằm trong committed_seq
+    char buf[64];
+    while (read(commit_pipe[0], buf, sizeof(buf)) > 0)
+        ;
+    pthread_mutex_lock(&lock);
+    commit_signaled = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+void wal_sync()
+{
+    if (wal_fd < 0)
+        return;
+    pthread_mutex_lock(&lock);
+    sync_requested = 1;
+    pthread_cond_signal(&has_data);
+    while (pend_len > 0 || flushing)
+        pthread_cond_wait(&flushed, &lock);
+    sync_requested = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+// ---------- open + replay ----------
+
+// Đọc lần lượt từng record, dừng ở record hỏng đầu tiên.
+// *header_gen nhận generation nếu gặp record header. Trả về số record dữ liệu, *good = offset hợp lệ cuối
+static long replay(int fd, int64_t *header_gen, off_t *good)
+{
+    FILE *f = fdopen(dup(fd), "rb");
+    if (!f)
+        return -1;
+
+    static uint8_t body[WAL_MAX_RECORD];
+    long count = 0;
+    *good = 0;
+
+    while (1)
+    {
+        uint32_t hdr[2];
+        if (fread(hdr, sizeof(uint32_t), 2, f) != 2)
+            break;
+        uint32_t len = hdr[0], crc = hdr[1];
+        if (len == 0 || len > sizeof(body) - WAL_HEADER_LEN || fread(body, 1, len, f) != len)
+            break;
+        if (crc32(body, len) != crc)
+            break;
+
+        int type = body[0];
+        WalReader r = {body + 1, len - 1};
+        if (type == WAL_SNAPSHOT_HEADER || type == WAL_SEGMENT_HEADER)
+        {
+            int64_t gen = 0;
+            if (wal_read_i64(&r, &gen) == 0 && header_gen)
+                *header_gen = gen;
+        }
+        else
+        {
+            if (type <= 0 || type >= WAL_MAX_TYPE || !handlers[type] || handlers[type](&r) != 0)
+                fprintf(stderr, "WAL: skipped record type %d at offset %ld\n", type, (long)*good);
+            count++;
+        }
+        *good += WAL_HEADER_LEN + (off_t)len;
+    }
+    iostat_add(IO_WAL, IO_BYTES_READ, (uint64_t)*good);
+    fclose(f);
+    return count;
+}
+
+static long replay_file(const char *path, int64_t *header_gen)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    off_t good;
+    long count = replay(fd, header_gen, &good);
+    close(fd);
+    return count;
+}
+
+static void segment_name(char *out, size_t outsz, int64_t gen)
+{
+    snprintf(out, outsz, "%s.%lld", wal_path, (long long)gen);
+}
+
+static void sync_dir()
+{
+    char tmp[sizeof(wal_path)];
+    strcpy(tmp, wal_path);
+    int dfd = open(dirname(tmp), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd >= 0)
+    {
+        fsync(dfd);
+        iostat_add(IO_WAL, IO_FSYNCS, 1);
+        close(dfd);
+    }
+}
+
+static int write_header(int fd, int type, int64_t gen)
+{
+    WalRecord rec;
+    wal_record_begin(&rec, type);
+    wal_record_i64(&rec, gen);
+    record_seal(&rec);
+    if (write_all(fd, rec.data, rec.len) != 0)
+        return -1;
+    iostat_add(IO_WAL, IO_BYTES_WRITTEN, rec.len);
+    return (int)rec.len;
+}
+
+static int cmp_gen(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Liệt kê generation của các segment đã đóng (server.wal.<gen>), tăng dần
+static int list_frozen(int64_t *gens, int max)
+{
+    char dir_buf[sizeof(wal_path)], base_buf[sizeof(wal_path)];
+    strcpy(dir_buf, wal_path);
+    strcpy(base_buf, wal_path);
+    const char *base = basename(base_buf);
+    size_t blen = strlen(base);
+
+    DIR *d = opendir(dirname(dir_buf));
+    if (!d)
+        return 0;
+
+    int n = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) && n < max)
+    {
+        if (strncmp(e->d_name, base, blen) != 0 || e->d_name[blen] != '.')
+            continue;
+        const char *num = e->d_name + blen + 1;
+        char *end = NULL;
+        long long gen = strtoll(num, &end, 10);
+        if (*num != '\0' && *end == '\0' && gen > 0)
+            gens[n++] = gen;
+    }
+    closedir(d);
+    qsort(gens, n, sizeof(int64_t), cmp_gen);
+    return n;
+}
+
+long wal_open(const char *path, int window_ms)
+{
+    sync_window_ms = window_ms < 0 ? 0 : window_ms;
+    snprintf(wal_path, sizeof(wal_path), "%s", path);
+
+    // Chỉ 1 process được ghi WAL. Khi hot upgrade, process mới đợi ở đây tới khi process cũ thoát.
+    // Lock nằm trên file riêng vì server.wal bị đổi tên mỗi lần đóng segment
+    char lock_path[sizeof(wal_path) + 8];
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+    lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0)
+    {
+        perror("Could not lock WAL");
+        return -1;
+    }
+
+    // 1. Snapshot: bản nhị phân chỉ mmap, store tự tra trên mapping. Bản cũ (dãy record) thì replay
+    int64_t snap_gen = 0;
+    long count = 0;
+    int snap = snap_load(WAL_SNAPSHOT_FILE, &snap_gen);
+    if (snap < 0)
+    {
+        fprintf(stderr, "Snapshot %s is corrupt or has an unsupported format version\n", WAL_SNAPSHOT_FILE);
+        return -1;
+    }
+    if (snap == 0)
+        count = replay_file(WAL_SNAPSHOT_FILE, &snap_gen);
+    snapshot_loaded = snap_gen > 0;
+
+    // 2. Segment đã đóng nhưng snapshot chưa kịp bao gồm (process con chết giữa chừng)
+    int64_t gens[256];
+    int nfrozen = list_frozen(gens, 256);
+    int64_t next_gen = snap_gen > 0 ? snap_gen : 1;
+    long tail = 0;
+    for (int i = 0; i < nfrozen; i++)
+    {
+        char name[sizeof(wal_path) + 24];
+        segment_name(name, sizeof(name), gens[i]);
+        if (gens[i] < snap_gen)
+        {
+            unlink(name); // đã nằm trong snapshot
+            continue;
+        }
+        tail += replay_file(name, NULL);
+        if (oldest_frozen == 0)
+            oldest_frozen = gens[i];
+        if (gens[i] + 1 > next_gen)
+            next_gen = gens[i] + 1;
+    }
+
+    // 3. Segment đang ghi
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        perror("Could not open WAL");
+        return -1;
+    }
+
+    int64_t seg_gen = 0;
+    off_t good;
+    long cur = replay(fd, &seg_gen, &good);
+    if (cur < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    tail += cur;
+
+    // Bỏ phần đuôi ghi dở (crash giữa chừng) để record mới nối tiếp từ chỗ hợp lệ
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > good)
+    {
+        fprintf(stderr, "WAL: truncating %ld byte(s) of torn tail\n", (long)(st.st_size - good));
+        if (ftruncate(fd, good) != 0)
+            perror("WAL truncate failed");
+    }
+    wal_size = good;
+
+    cur_gen = seg_gen > 0 ? seg_gen : next_gen;
+    if (wal_size == 0)
+    {
+        int n = write_header(fd, WAL_SEGMENT_HEADER, cur_gen);
+        if (n < 0 || fdatasync(fd) != 0)
+        {
+            perror("WAL header write failed");
+            close(fd);
+            return -1;
+        }
+        iostat_add(IO_WAL, IO_FSYNCS, 1);
+        wal_size = n;
+    }
+    wal_fd = fd;
+
+    count += tail;
+    data_records = count;
+    since_snapshot = tail; // phần phải replay sau snapshot, đủ dài thì sớm chụp snapshot mới
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&has_data, &attr);
+    pthread_cond_init(&flushed, NULL);
+    pthread_condattr_destroy(&attr);
+
+    if (pipe(commit_pipe) != 0)
+    {
+        close(fd);
+        wal_fd = -1;
+        return -1;
+    }
+    fcntl(commit_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(commit_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(commit_pipe[1], F_SETFD, FD_CLOEXEC);
+
+    pthread_t t;
+    if (pthread_create(&t, NULL, flusher_main, NULL) != 0)
+    {
+        close(fd);
+        wal_fd = -1;
+        return -1;
+    }
+    pthread_detach(t);
+    return count;
+}
+
+int wal_is_empty()
+{
+    pthread_mutex_lock(&lock);
+    int empty = data_records == 0 && !snapshot_loaded;
+    pthread_mutex_unlock(&lock);
+    return empty;
+}
+
+// ---------- snapshot ----------
+
+// Đóng segment hiện tại (đổi tên thành server.wal.<gen>) và mở segment mới
+static int rotate()
+{
+    pthread_mutex_lock(&lock);
+    sync_requested = 1;
+    pthread_cond_signal(&has_data);
+    while (pend_len > 0 || flushing)
+        pthread_cond_wait(&flushed, &lock);
+    sync_requested = 0;
+
+    // Flusher đang đứng chờ dữ liệu và reactor là nơi duy nhất append -> đổi fd an toàn
+    char frozen[sizeof(wal_path) + 24];
+    segment_name(frozen, sizeof(frozen), cur_gen);
+    if (rename(wal_path, frozen) != 0)
+    {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    int fd = open(wal_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    int n = fd >= 0 ? write_header(fd, WAL_SEGMENT_HEADER, cur_gen + 1) : -1;
+    if (n < 0 || fdatasync(fd) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        rename(frozen, wal_path);
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+    iostat_add(IO_WAL, IO_FSYNCS, 1);
+    sync_dir();
+
+    close(wal_fd);
+    wal_fd = fd;
+    wal_size = n;
+    if (oldest_frozen == 0)
+        oldest_frozen = cur_gen;
+    cur_gen++;
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+// Chạy trong process con: chỉ đọc state đã được copy-on-write tại thời điểm fork
+static int write_snapshot(int64_t gen)
+{
+    const char *tmp = WAL_SNAPSHOT_FILE ".tmp";
+
+    SnapWriter *w = snap_writer_open(tmp, gen);
+    if (!w)
+        return -1;
+    for (int i = 0; i < snapshot_fn_count; i++)
+        snapshot_fns[i](w);
+    if (snap_writer_close(w) != 0)
+    {
+        unlink(tmp);
+        return -1;
+    }
+
+    if (rename(tmp, WAL_SNAPSHOT_FILE) != 0)
+        return -1;
+    sync_dir();
+
+    // Các segment cũ đã nằm trong snapshot
+    for (int64_t g = oldest_frozen; g > 0 && g < gen; g++)
+    {
+        char name[sizeof(wal_path) + 24];
+        segment_name(name, sizeof(name), g);
+        unlink(name);
+    }
+    return 0;
+}
+
+void wal_snapshot_every(long records)
+{
+    snapshot_every = records < 0 ? 0 : records;
+}
+
+int wal_snapshot_due()
+{
+    return snapshot_every > 0 && snapshot_pid < 0 && since_snapshot >= snapshot_every;
+}
+
+int wal_snapshot_running()
+{
+    return snapshot_pid > 0;
+}
+
+int wal_snapshot_start()
+{
+    if (wal_fd < 0 || snapshot_pid > 0)
+        return -1;
+
+    if (rotate() != 0)
+    {
+        perror("WAL rotate failed");
+        since_snapshot = 0; // thử lại sau thêm snapshot_every record
+        return -1;
+    }
+    since_snapshot = 0;
+
+    // Snapshot chứa state tới hết segment vừa đóng -> bao gồm mọi segment < cur_gen
+    int64_t gen = cur_gen;
+    clock_gettime(CLOCK_MONOTONIC, &snapshot_started);
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("snapshot fork failed"); // segment đã đóng vẫn được replay khi khởi động
+        return -1;
+    }
+    if (pid == 0)
+    {
+        // Không giữ socket của client: FIN phải tới ngay khi reactor đóng kết nối
+        long maxfd = sysconf(_SC_OPEN_MAX);
+        if (maxfd < 0 || maxfd > 65536)
+            maxfd = 65536;
+        for (int fd = 3; fd < maxfd; fd++)
+            close(fd);
+        _exit(write_snapshot(gen) == 0 ? 0 : 1);
+    }
+
+    snapshot_pid = pid;
+    snapshot_gen = gen;
+    return 0;
+}
+
+void wal_snapshot_reap(int block)
+{
+    if (snapshot_pid < 0)
+        return;
+
+    int status = 0;
+    pid_t r;
+    do
+    {
+        r = waitpid(snapshot_pid, &status, block ? 0 : WNOHANG);
+    } while (r < 0 && errno == EINTR);
+    if (r == 0)
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double ms = (now.tv_sec - snapshot_started.tv_sec) * 1000.0 +
+                (now.tv_nsec - snapshot_started.tv_nsec) / 1e6;
+
+    if (r == snapshot_pid && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        oldest_frozen = 0;
+        printf("Snapshot generation %lld written in %.1f ms\n", (long long)snapshot_gen, ms);
+    }
+    else
+    {
+        fprintf(stderr, "Snapshot generation %lld failed, keeping WAL segments\n", (long long)snapshot_gen);
+    }
+    snapshot_pid = -1;
+}
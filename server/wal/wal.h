@@ -0,0 +1,108 @@
+// Write-ahead log dùng chung cho mọi store (account, friend, group, offline)
+#ifndef WAL_H
+#define WAL_H
+
+#include "../../common.h"
+#include "../snapshot/snapshot.h"
+#include <stdint.h>
+
+#define WAL_FILE "server.wal"
+#define WAL_SYNC_WINDOW_MS 5              // Gom record trong tối đa 5ms rồi mới fdatasync 1 lần
+#define WAL_FLUSH_BYTES (256 * 1024)      // Đủ lô lớn thì flush luôn, không đợi hết cửa sổ
+#define WAL_MAX_PENDING (8 * 1024 * 1024) // Buffer chưa ghi vượt mức này thì append phải đợi
+#define WAL_MAX_RECORD (INBUF_SIZE * 2)
+#define WAL_SNAPSHOT_FILE "server.snap"
+#define WAL_SNAPSHOT_RECORDS 1000000 // Sau ngần này record kể từ snapshot trước thì chụp snapshot mới
+
+/*
+    Mỗi record trên đĩa: [u32 len][u32 crc32][u8 type][payload]
+    len = 1 + độ dài payload, crc32 tính trên type + payload.
+    Payload là dãy field: string = [u16 len][bytes], số = [i64]
+
+    WAL chia thành segment theo generation: server.wal là segment đang ghi, server.wal.<gen>
+    là segment đã đóng. Snapshot (server.snap, định dạng trong snapshot.h) do process con
+    (fork, copy-on-write) ghi ra nên reactor không phải dừng. Snapshot generation G chứa
+    toàn bộ state của các segment < G, khởi động = mmap snapshot + replay các segment >= G
+*/
+
+// Loại record
+#define WAL_ACCOUNT_ADD 1          // username, password hash
+#define WAL_ACCOUNT_PASSWORD 2     // username, password hash mới
+#define WAL_FRIEND_REQUEST 3       // from, to
+#define WAL_FRIEND_ACCEPT 4        // me, from
+#define WAL_FRIEND_REJECT 5        // me, from
+#define WAL_FRIEND_UNFRIEND 6      // me, other
+#define WAL_GROUP_CREATE 7         // group_id, name, owner (rỗng = không tự thêm owner)
+#define WAL_GROUP_ADD_MEMBER 8     // group_id, username, role
+#define WAL_GROUP_REMOVE_MEMBER 9  // group_id, username
+#define WAL_OFFLINE_SAVE 10        // to_user, from, timestamp, message
+#define WAL_OFFLINE_CLEAR 11       // to_user
+// Chỉ có trong snapshot version 1 (dãy record): chép lại nguyên danh sách, giữ đúng thứ tự
+#define WAL_FRIEND_EDGE 12         // username, other, state
+#define WAL_GROUP_MEMBER 13        // group_id, username, role (chỉ thêm vào danh sách member)
+#define WAL_USER_GROUP 14          // username, group_id, role (chỉ thêm vào danh sách group của user)
+#define WAL_IDGEN_LEASE 15         // id: mọi group / message ID đã cấp đều < id
+// Record nội bộ của WAL
+#define WAL_SNAPSHOT_HEADER 30     // generation
+#define WAL_SEGMENT_HEADER 31      // generation
+#define WAL_MAX_TYPE 32
+
+typedef struct
+{
+    uint8_t data[WAL_MAX_RECORD];
+    size_t len;
+    int overflow;
+} WalRecord;
+
+void wal_record_begin(WalRecord *r, int type);
+void wal_record_str(WalRecord *r, const char *s);
+void wal_record_i64(WalRecord *r, int64_t v);
+
+// Đưa record vào buffer, flusher thread sẽ ghi + fdatasync theo lô. 0 nếu OK
+int wal_append(WalRecord *r);
+
+// Record được đánh số theo thứ tự append (bắt đầu từ 1 mỗi lần chạy). Record seq đã nằm trên đĩa
+// khi wal_committed_seq() >= seq: trả lời của lệnh đã ghi WAL được giữ tới lúc đó (xem durable.h)
+uint64_t wal_appended_seq();  // record cuối cùng đã append, 0 = chưa có
+uint64_t wal_committed_seq(); // record cuối cùng đã fdatasync
+// fd cần poll: readable khi có lô mới fdatasync xong, -1 nếu WAL chưa mở. Reactor gọi
+// wal_commit_ack() để đọc hết rồi mới xem wal_committed_seq()
+int wal_commit_fd();
+void wal_commit_ack();
+
+typedef struct
+{
+    const uint8_t *p;
+    size_t left;
+} WalReader;
+
+int wal_read_str(WalReader *r, char *out, size_t outsz); // 0 nếu OK, -1 nếu record hỏng
+int wal_read_i64(WalReader *r, int64_t *v);
+
+// Handler áp record vào state in-memory khi replay, trả về 0 nếu OK
+typedef int (*wal_handler)(WalReader *r);
+void wal_register_handler(int type, wal_handler fn);
+
+// Mỗi store đăng ký 1 hàm ghi toàn bộ state của nó (phần trong RAM gộp với phần còn nằm
+// trong snapshot cũ) thành các bảng snapshot. Hàm này chạy trong process con sau fork:
+// chỉ đọc state, không gọi wal_append
+typedef void (*wal_snapshot_fn)(SnapWriter *w);
+void wal_register_snapshot(wal_snapshot_fn fn);
+
+// Map snapshot + replay các segment qua handler rồi chạy flusher thread.
+// Trả về số record đã nạp, -1 nếu lỗi
+long wal_open(const char *path, int sync_window_ms);
+
+int wal_is_empty(); // Chưa có snapshot lẫn record nào (lần đầu chạy -> import file text cũ)
+
+// Snapshot nền: đóng segment hiện tại rồi fork process con ghi snapshot
+void wal_snapshot_every(long records); // 0 = tắt snapshot tự động
+int wal_snapshot_due();
+int wal_snapshot_start();          // 0 nếu đã fork xong
+int wal_snapshot_running();
+void wal_snapshot_reap(int block); // Thu dọn process con, block = 1 thì đợi tới khi xong
+
+// Ghi + fdatasync mọi record đang chờ, chặn đến khi xong (dùng khi tắt server / hot upgrade)
+void wal_sync();
+
+#endif
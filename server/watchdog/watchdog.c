@@ -0,0 +1,135 @@
+#include "../../common.h"
+#include "watchdog.h"
+#include "../log/log.h"
+#include "../metrics/metrics.h"
+
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#define WATCHDOG_COMMAND_LEN 24
+#define WATCHDOG_BACKTRACE_WAIT_MS 100
+
+static MetricsHist *iteration_hist = NULL;
+static uint64_t busy_since = 0; // 0 = reactor đang chờ trong poll. Reactor ghi, watchdog đọc
+static uint64_t threshold_ns = 0;
+static pthread_t reactor_thread;
+
+// Reactor ghi, watchdog chỉ đọc khi reactor đang kẹt nên gần như không có ghi đồng thời; nếu
+// reactor vừa chạy tiếp thì tên lệnh có thể lệch, chấp nhận được cho 1 dòng log
+static char current_cmd[WATCHDOG_COMMAND_LEN];
+static char current_user[USERNAME_LEN];
+
+// Backtrace lấy trong signal handler trên chính reactor thread
+static void *frames[WATCHDOG_MAX_FRAMES];
+static volatile sig_atomic_t nframes = -1; // -1 = chưa lấy xong
+
+static void on_backtrace_signal(int sig)
+{
+    (void)sig;
+    nframes = backtrace(frames, WATCHDOG_MAX_FRAMES);
+}
+
+static void sleep_ms(long ms)
+{
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+static void report(uint64_t since, uint64_t now)
+{
+    char cmd[WATCHDOG_COMMAND_LEN], user[USERNAME_LEN];
+    snprintf(cmd, sizeof(cmd), "%s", current_cmd[0] ? current_cmd : "-");
+    snprintf(user, sizeof(user), "%s", current_user);
+
+    nframes = -1;
+    int n = 0;
+    if (pthread_kill(reactor_thread, WATCHDOG_SIGNAL) == 0)
+    {
+        for (int waited = 0; nframes < 0 && waited < WATCHDOG_BACKTRACE_WAIT_MS; waited++)
+            sleep_ms(1);
+        n = nframes > 0 ? nframes : 0;
+    }
+    char **symbols = n ? backtrace_symbols(frames, n) : NULL;
+    if (!symbols)
+        n = 0;
+
+    long ms = (long)((now - since) / 1000000);
+    fprintf(stderr, "Reactor stalled for %ld ms in %s (backtrace in server.log)\n", ms, cmd);
+    log_stall(user[0] ? user : NULL, cmd, ms, symbols, n);
+    free(symbols);
+}
+
+static void *watchdog_main(void *arg)
+{
+    (void)arg;
+    long period_ms = (long)(threshold_ns / 1000000 / 4);
+    if (period_ms < 1)
+        period_ms = 1;
+
+    uint64_t reported = 0; // busy_since của lượt đã báo: mỗi lần kẹt chỉ ghi log 1 lần
+    while (1)
+    {
+        sleep_ms(period_ms);
+        uint64_t since = __atomic_load_n(&busy_since, __ATOMIC_ACQUIRE);
+        if (!since || since == reported)
+            continue;
+        uint64_t now = metrics_now_ns();
+        if (now - since < threshold_ns)
+            continue;
+
+        reported = since;
+        metrics_add(METRIC_REACTOR_STALLS, 1);
+        report(since, now);
+    }
+    return NULL;
+}
+
+int watchdog_start(long threshold_ms)
+{
+    iteration_hist = metrics_histogram("reactor_iteration", "Time from poll() returning to the next poll() call");
+    if (threshold_ms <= 0)
+        return 0;
+
+    threshold_ns = (uint64_t)threshold_ms * 1000000;
+    reactor_thread = pthread_self();
+
+    // Lần gọi đầu tiên nạp libgcc (malloc, dlopen) nên không được để tới lúc trong signal handler
+    void *warmup[1];
+    backtrace(warmup, 1);
+
+    struct sigaction sa = {0};
+    sa.sa_handler = on_backtrace_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART; // send / flock đang chặn trên reactor chạy tiếp sau handler
+    if (sigaction(WATCHDOG_SIGNAL, &sa, NULL) != 0)
+        return -1;
+
+    pthread_t t;
+    if (pthread_create(&t, NULL, watchdog_main, NULL) != 0)
+        return -1;
+    pthread_detach(t);
+    return 0;
+}
+
+void watchdog_busy()
+{
+    __atomic_store_n(&busy_since, metrics_now_ns(), __ATOMIC_RELEASE);
+}
+
+void watchdog_idle()
+{
+    uint64_t since = busy_since;
+    if (!since)
+        return;
+    if (iteration_hist)
+        metrics_observe(iteration_hist, metrics_now_ns() - since);
+    __atomic_store_n(&busy_since, 0, __ATOMIC_RELEASE);
+}
+
+void watchdog_command(const char *cmd, const char *user)
+{
+    snprintf(current_cmd, sizeof(current_cmd), "%s", cmd ? cmd : "");
+    snprintf(current_user, sizeof(current_user), "%s", user ? user : "");
+}
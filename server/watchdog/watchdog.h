@@ -0,0 +1,22 @@
+// Đo thời gian mỗi lượt vòng lặp reactor (từ lúc poll trả về tới lần poll kế tiếp) vào histogram
+// reactor_iteration, và 1 thread watchdog phát hiện reactor không quay lại poll quá ngưỡng: ghi
+// lệnh đang chạy + backtrace của reactor vào server.log. Ngưỡng đặt bằng MINACHAT_WATCHDOG_MS
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#define WATCHDOG_DEFAULT_MS 1000
+#define WATCHDOG_MAX_FRAMES 32
+#define WATCHDOG_SIGNAL SIGUSR2 // watchdog gửi cho reactor thread để lấy backtrace
+
+// Gọi từ reactor thread lúc khởi động. threshold_ms <= 0: chỉ đo histogram, không chạy thread.
+// Trả về 0 nếu OK, -1 nếu không tạo được thread (histogram vẫn đo)
+int watchdog_start(long threshold_ms);
+
+// Reactor gọi ngay sau khi poll trả về / ngay trước khi vào poll
+void watchdog_busy();
+void watchdog_idle();
+
+// Lệnh reactor đang xử lý để ghi kèm khi kẹt, cmd NULL = không xử lý lệnh nào. user có thể NULL
+void watchdog_command(const char *cmd, const char *user);
+
+#endif
@@ -0,0 +1,172 @@
+#include "worker.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+typedef struct
+{
+    worker_fn run;
+    worker_fn done;
+    void *arg;
+} Job;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_finished = PTHREAD_COND_INITIALIZER;
+
+// Hàng đợi job (ring) và danh sách job đã xong chờ reactor xử lý (ring cùng kích thước)
+static Job *queue = NULL, *finished = NULL;
+static int cap = 0;
+static int q_head = 0, q_len = 0;
+static int f_head = 0, f_len = 0;
+static int pending = 0; // submit nhưng chưa chạy done()
+
+static int wake_pipe[2] = {-1, -1};
+static int wake_signaled = 0;
+
+static void *worker_main(void *unused)
+{
+    (void)unused;
+    // Hạ ưu tiên riêng thread này (nice trên Linux tính theo thread): khi CPU không đủ, hash mật
+    // khẩu nhường reactor thay vì chia đều, các lệnh khác không bị chậm theo lượng LOGIN
+    (void)setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), WORKER_NICE);
+    while (1)
+    {
+        pthread_mutex_lock(&lock);
+        while (q_len == 0)
+            pthread_cond_wait(&job_ready, &lock);
+        Job job = queue[q_head];
+        q_head = (q_head + 1) % cap;
+        q_len--;
+        pthread_mutex_unlock(&lock);
+
+        job.run(job.arg);
+
+        pthread_mutex_lock(&lock);
+        finished[(f_head + f_len) % cap] = job;
+        f_len++;
+        int need_wake = !wake_signaled;
+        wake_signaled = 1;
+        pthread_cond_broadcast(&job_finished);
+        pthread_mutex_unlock(&lock);
+
+        // Chỉ ghi 1 byte cho cả lô, reactor đọc hết rồi xử lý toàn bộ danh sách
+        if (need_wake)
+        {
+            char b = 1;
+            (void)!write(wake_pipe[1], &b, 1);
+        }
+    }
+    return NULL;
+}
+
+int workers_init(int nthreads, int queue_cap)
+{
+    queue = calloc(queue_cap, sizeof(Job));
+    finished = calloc(queue_cap, sizeof(Job));
+    if (!queue || !finished || pipe(wake_pipe) != 0)
+        return -1;
+
+    fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(wake_pipe[1], F_SETFD, FD_CLOEXEC);
+
+    cap = queue_cap;
+    int started = 0;
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_t t;
+        if (pthread_create(&t, NULL, worker_main, NULL) != 0)
+            break;
+        pthread_detach(t);
+        started++;
+    }
+
+    if (started == 0)
+    {
+        cap = 0;
+        return -1;
+    }
+    return wake_pipe[0];
+}
+
+int workers_submit(worker_fn run, worker_fn done, void *arg)
+{
+    // Pool chưa khởi tạo được: chạy đồng bộ luôn
+    if (cap == 0)
+    {
+        run(arg);
+        done(arg);
+        return 0;
+    }
+
+    pthread_mutex_lock(&lock);
+    // pending bao gồm cả job đã xong chưa được reactor lấy, nên finished không bao giờ tràn
+    if (pending >= cap)
+    {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+    queue[(q_head + q_len) % cap] = (Job){run, done, arg};
+    q_len++;
+    pending++;
+    pthread_cond_signal(&job_ready);
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+int workers_complete()
+{
+    if (cap == 0)
+        return 0;
+
+    char drain[64];
+    while (read(wake_pipe[0], drain, sizeof(drain)) > 0)
+        ;
+
+    int count = 0;
+    while (1)
+    {
+        pthread_mutex_lock(&lock);
+        if (f_len == 0)
+        {
+            wake_signaled = 0;
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        Job job = finished[f_head];
+        f_head = (f_head + 1) % cap;
+        f_len--;
+        pending--;
+        pthread_mutex_unlock(&lock);
+
+        // done() có thể submit job mới, nên gọi ngoài lock
+        job.done(job.arg);
+        count++;
+    }
+    return count;
+}
+
+int workers_pending()
+{
+    pthread_mutex_lock(&lock);
+    int n = pending;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+void workers_drain()
+{
+    while (workers_pending() > 0)
+    {
+        pthread_mutex_lock(&lock);
+        while (f_len == 0 && pending > 0)
+            pthread_cond_wait(&job_finished, &lock);
+        pthread_mutex_unlock(&lock);
+        workers_complete();
+    }
+}
@@ -0,0 +1,27 @@
+// Thread pool có giới hạn cho việc nặng CPU (hash mật khẩu), kết quả trả về reactor qua pipe
+#ifndef WORKER_H
+#define WORKER_H
+
+#define WORKER_THREADS 4
+#define WORKER_QUEUE_CAP 1024
+#define WORKER_NICE 10 // worker chạy ở nice này, reactor giữ nice của process
+
+// run() chạy trên worker thread, done() chạy trên reactor thread (trong workers_complete)
+typedef void (*worker_fn)(void *arg);
+
+// Khởi tạo pool. Trả về fd cần poll (POLLIN khi có job hoàn tất), -1 nếu lỗi
+int workers_init(int nthreads, int queue_cap);
+
+// Đưa job vào hàng đợi. 0 nếu OK, -1 nếu hàng đợi đầy (caller báo server busy)
+int workers_submit(worker_fn run, worker_fn done, void *arg);
+
+// Gọi từ reactor khi wake fd readable: chạy done() của các job đã xong. Trả về số job
+int workers_complete();
+
+// Số job đã submit nhưng done() chưa chạy
+int workers_pending();
+
+// Chặn đến khi mọi job đã submit chạy xong rồi gọi done() của chúng (dùng trước hot upgrade)
+void workers_drain();
+
+#endif